@@ -0,0 +1,135 @@
+/*
+This file implements all the functions defined in alarm.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN ALARM.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <errno.h>
+#include <sys/timerfd.h>
+#include "rtutil.h"
+#include "alarm.h"
+
+
+static void wait_until(const Alarm *alarm, int64_t deadline_ns) {
+    if (alarm->timer_fd >= 0) {
+        struct itimerspec spec;
+        uint64_t expirations = 0U;
+
+        (void) memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = (time_t) (deadline_ns / NS_PER_SEC);
+        spec.it_value.tv_nsec = (long) (deadline_ns % NS_PER_SEC);
+
+        // A deadline that already passed makes the timer expire right away, so the read never blocks forever.
+        if (timerfd_settime(alarm->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {
+            while (read(alarm->timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+            }
+        }
+        else {
+            rt_sleep_until_ns(deadline_ns);
+        }
+    }
+    else {
+        rt_sleep_until_ns(deadline_ns);
+    }
+}
+
+
+int32_t alarm_init(Alarm *alarm, int32_t wait_method) {
+    int32_t result = 1;
+
+    (void) memset(alarm, 0, sizeof(*alarm));
+    alarm->wait_method = wait_method;
+    alarm->timer_fd = -1;
+    clear_pwm_handle(&alarm->buzzer);
+    alarm->stats.min_onset_ns = INT64_MAX;
+
+    if (wait_method == ALARM_WAIT_TIMERFD) {
+        alarm->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (alarm->timer_fd < 0) {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+
+int32_t alarm_attach_buzzer(Alarm *alarm, Buffer pin_identifier, int32_t frequency) {
+    // Disabled rather than left alone, in case an earlier run left the channel on.
+    return open_pwm_channel(pin_identifier, frequency, ALARM_BUZZER_DUTY, PWM_OFF, &alarm->buzzer);
+}
+
+
+int32_t alarm_fire_at(Alarm *alarm, int64_t deadline_ns) {
+    int32_t result = 1;
+    int64_t woke_ns = 0;
+    int64_t done_ns = 0;
+    int64_t onset_ns = 0;
+
+    wait_until(alarm, deadline_ns);
+    woke_ns = rt_now_ns();
+
+    // One pwrite on the enable file opened ahead of time.
+    if (alarm->buzzer.enable_fd >= 0 && write_pwm_enable_fast(&alarm->buzzer, PWM_ON) != 1) {
+        alarm->stats.write_failures++;
+        result = 0;
+    }
+
+    done_ns = rt_now_ns();
+    onset_ns = done_ns - deadline_ns;
+
+    alarm->stats.fired++;
+    alarm->stats.sum_onset_ns += onset_ns;
+    if (onset_ns < alarm->stats.min_onset_ns) {
+        alarm->stats.min_onset_ns = onset_ns;
+    }
+    if (onset_ns > alarm->stats.max_onset_ns) {
+        alarm->stats.max_onset_ns = onset_ns;
+    }
+    if (woke_ns - deadline_ns > alarm->stats.max_wakeup_ns) {
+        alarm->stats.max_wakeup_ns = woke_ns - deadline_ns;
+    }
+    if (done_ns - woke_ns > alarm->stats.max_write_ns) {
+        alarm->stats.max_write_ns = done_ns - woke_ns;
+    }
+
+    return result;
+}
+
+
+void alarm_silence(Alarm *alarm) {
+    if (alarm->buzzer.enable_fd >= 0) {
+        (void) write_pwm_enable_fast(&alarm->buzzer, PWM_OFF);
+    }
+}
+
+
+void alarm_print_report(const Alarm *alarm) {
+    const AlarmStats *stats = &alarm->stats;
+
+    (void) printf("Alarm onset error (%s, %s):\n", (alarm->wait_method == ALARM_WAIT_TIMERFD) ? "timerfd" : "clock_nanosleep",
+                  (alarm->buzzer.enable_fd >= 0) ? "pre-armed buzzer" : "no buzzer");
+
+    if (stats->fired == 0U) {
+        (void) printf("  no alarms fired\n");
+    }
+    else {
+        (void) printf("  %llu alarms, min %.1f us, avg %.1f us, max %.1f us\n", (unsigned long long) stats->fired,
+                      (double) stats->min_onset_ns / 1e3, (double) stats->sum_onset_ns / (1e3 * (double) stats->fired),
+                      (double) stats->max_onset_ns / 1e3);
+        (void) printf("  worst wakeup lateness %.1f us, worst enable write %.1f us, write failures %llu\n",
+                      (double) stats->max_wakeup_ns / 1e3, (double) stats->max_write_ns / 1e3, (unsigned long long) stats->write_failures);
+    }
+}
+
+
+void alarm_close(Alarm *alarm) {
+    alarm_silence(alarm);
+
+    close_pwm_handle(&alarm->buzzer);
+    if (alarm->timer_fd >= 0) {
+        (void) close(alarm->timer_fd);
+        alarm->timer_fd = -1;
+    }
+}
@@ -0,0 +1,96 @@
+/*
+This file is for defining pre-armed alarms: a PWM buzzer that sounds at an absolute CLOCK_MONOTONIC deadline.
+Why? Setting up a PWM channel through sysfs means exporting it, muxing the pin and writing the period and duty cycle,
+which takes milliseconds. Doing that when the countdown reaches zero makes every beep late by that much. Instead the
+channel is set up ahead of time (enabled and then disabled again) and its enable file is kept open, so firing the
+alarm is a single write of "1" to an already open file.
+
+The wait until the deadline is absolute, either with a timerfd (TFD_TIMER_ABSTIME) or clock_nanosleep (TIMER_ABSTIME),
+so the deadlines of an interval series never drift. Every alarm records its onset error (when the enable write
+finished compared to the deadline), split into the wakeup lateness and the cost of the write itself.
+
+Sources:
+https://man7.org/linux/man-pages/man2/timerfd_create.2.html
+*/
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdint.h>
+#include "bbbio.h"
+#include "bbbio_fast.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// How the alarm waits for its deadline.
+#define ALARM_WAIT_TIMERFD ((int32_t) 0)
+
+#define ALARM_WAIT_NANOSLEEP ((int32_t) 1)
+
+// Buzzer duty cycle (a square wave is the loudest for a piezo).
+#define ALARM_BUZZER_DUTY ((float32_t) 50.0f)
+
+
+typedef struct {
+    uint64_t fired;
+    uint64_t write_failures;
+    int64_t min_onset_ns;       // Onset error: enable write done - deadline
+    int64_t max_onset_ns;
+    int64_t sum_onset_ns;
+    int64_t max_wakeup_ns;      // Part of it that was the wakeup being late
+    int64_t max_write_ns;       // Part of it that was the enable write
+} AlarmStats;
+
+typedef struct {
+    int32_t wait_method;
+    int32_t timer_fd;           // -1 when waiting with clock_nanosleep
+    PwmHandle buzzer;           // Open files of the buzzer channel, fds -1 without a buzzer
+    AlarmStats stats;
+} Alarm;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Prepares an alarm without a buzzer (it still waits and measures its onset error).
+// Parameters:
+// alarm       - The alarm
+// wait_method - ALARM_WAIT_TIMERFD or ALARM_WAIT_NANOSLEEP
+// Returns - 1 on success, 0 if the timerfd could not be created.
+int32_t alarm_init(Alarm *alarm, int32_t wait_method);
+
+
+// Description: Sets up a PWM channel as the buzzer of an alarm (open_pwm_channel, it never sounds) and leaves it
+// disabled with its files open. Call this long before the first deadline, the export and pinmux take a while.
+// Parameters:
+// alarm          - The alarm
+// pin_identifier - The PWM channel (e.g. "1A", "1B", "2A", "2B")
+// frequency      - Buzzer tone in Hz
+// Returns - 1 on success, 0 on failure (the alarm then stays silent).
+int32_t alarm_attach_buzzer(Alarm *alarm, Buffer pin_identifier, int32_t frequency);
+
+
+// Description: Blocks until the deadline and then turns the buzzer on with one write.
+// Parameters:
+// alarm       - The alarm
+// deadline_ns - Absolute CLOCK_MONOTONIC time in nanoseconds
+// Returns - 1 on success, 0 if the enable write failed.
+int32_t alarm_fire_at(Alarm *alarm, int64_t deadline_ns);
+
+
+// Description: Turns the buzzer off. Not time critical, it just uses the same open file.
+// Parameters: alarm - The alarm
+void alarm_silence(Alarm *alarm);
+
+
+// Description: Prints the onset error statistics to stdout.
+// Parameters: alarm - The alarm
+void alarm_print_report(const Alarm *alarm);
+
+
+// Description: Silences the buzzer and closes the files of an alarm.
+// Parameters: alarm - The alarm
+void alarm_close(Alarm *alarm);
+
+
+#endif // End of include guard
@@ -8,7 +8,62 @@ PLEASE CHECK BBBBIO.H TO SEE HOW TO USE THESE FUNCTIONS.
 */
 
 
+#include <fcntl.h>
 #include "bbbio.h" 
+#include "bbbio_fast.h"
+#include "probes.h"
+
+
+// Not static: the inline functions of bbbio_fast.h read them.
+GpioIoHook bbbio_gpio_io_hook = NULL;
+
+uint32_t bbbio_gpio_write_failures = 0U;
+
+const uint8_t decimal_digit_pairs[200] = {
+    '0','0', '0','1', '0','2', '0','3', '0','4', '0','5', '0','6', '0','7', '0','8', '0','9',
+    '1','0', '1','1', '1','2', '1','3', '1','4', '1','5', '1','6', '1','7', '1','8', '1','9',
+    '2','0', '2','1', '2','2', '2','3', '2','4', '2','5', '2','6', '2','7', '2','8', '2','9',
+    '3','0', '3','1', '3','2', '3','3', '3','4', '3','5', '3','6', '3','7', '3','8', '3','9',
+    '4','0', '4','1', '4','2', '4','3', '4','4', '4','5', '4','6', '4','7', '4','8', '4','9',
+    '5','0', '5','1', '5','2', '5','3', '5','4', '5','5', '5','6', '5','7', '5','8', '5','9',
+    '6','0', '6','1', '6','2', '6','3', '6','4', '6','5', '6','6', '6','7', '6','8', '6','9',
+    '7','0', '7','1', '7','2', '7','3', '7','4', '7','5', '7','6', '7','7', '7','8', '7','9',
+    '8','0', '8','1', '8','2', '8','3', '8','4', '8','5', '8','6', '8','7', '8','8', '8','9',
+    '9','0', '9','1', '9','2', '9','3', '9','4', '9','5', '9','6', '9','7', '9','8', '9','9'
+};
+
+// Directory of each pwm_channel_index, the last one for PWM_CHANNEL_INVALID.
+static const BufferPointer pwm_channel_paths[PWM_CHANNEL_COUNT + 1] = {
+    (BufferPointer) PWM1PINA_PATH, (BufferPointer) PWM1PINB_PATH, (BufferPointer) PWM2PINA_PATH, (BufferPointer) PWM2PINB_PATH,
+    (BufferPointer) NULL_STR
+};
+
+// USDT probes (see probes.h): <function>_entry with the arguments, <function>_return with the arguments, the result and
+// the duration in nanoseconds (0 unless a tracer is attached to the _return probe).
+BBB_PROBE_SEMAPHORE(bbbio, set_pinmux_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_pinmux_return);
+BBB_PROBE_SEMAPHORE(bbbio, get_pinmux_entry);
+BBB_PROBE_SEMAPHORE(bbbio, get_pinmux_return);
+BBB_PROBE_SEMAPHORE(bbbio, set_pinmux_batch_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_pinmux_batch_return);
+BBB_PROBE_SEMAPHORE(bbbio, set_gpio_pull_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_gpio_pull_return);
+BBB_PROBE_SEMAPHORE(bbbio, write_gpio_value_entry);
+BBB_PROBE_SEMAPHORE(bbbio, write_gpio_value_return);
+BBB_PROBE_SEMAPHORE(bbbio, setup_gpio_pin_entry);
+BBB_PROBE_SEMAPHORE(bbbio, setup_gpio_pin_return);
+BBB_PROBE_SEMAPHORE(bbbio, read_gpio_value_entry);
+BBB_PROBE_SEMAPHORE(bbbio, read_gpio_value_return);
+BBB_PROBE_SEMAPHORE(bbbio, set_gpio_edge_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_gpio_edge_return);
+BBB_PROBE_SEMAPHORE(bbbio, set_pwm_enable_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_pwm_enable_return);
+BBB_PROBE_SEMAPHORE(bbbio, set_pwm_duty_cycle_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_pwm_duty_cycle_return);
+BBB_PROBE_SEMAPHORE(bbbio, set_pwm_frequency_entry);
+BBB_PROBE_SEMAPHORE(bbbio, set_pwm_frequency_return);
+BBB_PROBE_SEMAPHORE(bbbio, setup_pwm_entry);
+BBB_PROBE_SEMAPHORE(bbbio, setup_pwm_return);
 
 
 static int32_t file_exists(Buffer file_path) {
@@ -23,6 +78,25 @@ static int32_t file_exists(Buffer file_path) {
 }
 
 
+// Waits for a file created by an export to be writable. Returns 1 once it is, 0 if it didn't happen within EXPORT_TIMEOUT_US.
+static int32_t wait_for_writable(Buffer file_path) {
+    int32_t result = 0;
+    int32_t waited_us = 0;
+
+    while (result == 0 && waited_us <= EXPORT_TIMEOUT_US) {
+        if (access((char *) file_path, W_OK) == 0) {
+            result = 1;
+        }
+        else {
+            int32_t u = usleep(EXPORT_POLL_US);
+            waited_us += EXPORT_POLL_US;
+        }
+    }
+
+    return result;
+}
+
+
 static int32_t write_to_file(Buffer file_path, Buffer value) {
     int32_t result = 0;
 
@@ -47,8 +121,10 @@ static int32_t write_to_file_int(Buffer file_path, int32_t value) {
     int32_t result = 0;
     Buffer value_str;
 
-    // Convert the integer value to a string
-    if (snprintf((char *) value_str, sizeof(value_str), "%d", value) > 0) {
+    // Convert the integer value to a string (nothing bbbio writes is negative)
+    if (value >= 0) {
+        value_str[format_decimal((uint32_t) value, value_str)] = '\0';
+
         // Call the other function to write to the file
         result = write_to_file(file_path, value_str);
     }
@@ -77,16 +153,226 @@ static int32_t read_from_file(Buffer file_path, Buffer buff) {
 }
 
 
+// Header pin of every GPIO that is broken out on P8 / P9 (BeagleBone Black System Reference Manual, tables 12 and 13).
+typedef struct {
+    int32_t gpio;
+    BufferPointer pin_name;
+} HeaderPin;
+
+static const HeaderPin header_pins[] = {
+    { 38, (BufferPointer) "P8_03" }, { 39, (BufferPointer) "P8_04" }, { 34, (BufferPointer) "P8_05" }, { 35, (BufferPointer) "P8_06" },
+    { 66, (BufferPointer) "P8_07" }, { 67, (BufferPointer) "P8_08" }, { 69, (BufferPointer) "P8_09" }, { 68, (BufferPointer) "P8_10" },
+    { 45, (BufferPointer) "P8_11" }, { 44, (BufferPointer) "P8_12" }, { 23, (BufferPointer) "P8_13" }, { 26, (BufferPointer) "P8_14" },
+    { 47, (BufferPointer) "P8_15" }, { 46, (BufferPointer) "P8_16" }, { 27, (BufferPointer) "P8_17" }, { 65, (BufferPointer) "P8_18" },
+    { 22, (BufferPointer) "P8_19" }, { 63, (BufferPointer) "P8_20" }, { 62, (BufferPointer) "P8_21" }, { 37, (BufferPointer) "P8_22" },
+    { 36, (BufferPointer) "P8_23" }, { 33, (BufferPointer) "P8_24" }, { 32, (BufferPointer) "P8_25" }, { 61, (BufferPointer) "P8_26" },
+    { 86, (BufferPointer) "P8_27" }, { 88, (BufferPointer) "P8_28" }, { 87, (BufferPointer) "P8_29" }, { 89, (BufferPointer) "P8_30" },
+    { 10, (BufferPointer) "P8_31" }, { 11, (BufferPointer) "P8_32" }, { 9, (BufferPointer) "P8_33" },  { 81, (BufferPointer) "P8_34" },
+    { 8, (BufferPointer) "P8_35" },  { 80, (BufferPointer) "P8_36" }, { 78, (BufferPointer) "P8_37" }, { 79, (BufferPointer) "P8_38" },
+    { 76, (BufferPointer) "P8_39" }, { 77, (BufferPointer) "P8_40" }, { 74, (BufferPointer) "P8_41" }, { 75, (BufferPointer) "P8_42" },
+    { 72, (BufferPointer) "P8_43" }, { 73, (BufferPointer) "P8_44" }, { 70, (BufferPointer) "P8_45" }, { 71, (BufferPointer) "P8_46" },
+    { 30, (BufferPointer) "P9_11" }, { 60, (BufferPointer) "P9_12" }, { 31, (BufferPointer) "P9_13" }, { 50, (BufferPointer) "P9_14" },
+    { 48, (BufferPointer) "P9_15" }, { 51, (BufferPointer) "P9_16" }, { 5, (BufferPointer) "P9_17" },  { 4, (BufferPointer) "P9_18" },
+    { 13, (BufferPointer) "P9_19" }, { 12, (BufferPointer) "P9_20" }, { 3, (BufferPointer) "P9_21" },  { 2, (BufferPointer) "P9_22" },
+    { 49, (BufferPointer) "P9_23" }, { 15, (BufferPointer) "P9_24" }, { 117, (BufferPointer) "P9_25" }, { 14, (BufferPointer) "P9_26" },
+    { 115, (BufferPointer) "P9_27" }, { 113, (BufferPointer) "P9_28" }, { 111, (BufferPointer) "P9_29" }, { 112, (BufferPointer) "P9_30" },
+    { 110, (BufferPointer) "P9_31" }, { 20, (BufferPointer) "P9_41" }, { 7, (BufferPointer) "P9_42" }
+};
+
+// Last known pinmux state of each pin we have touched, so we only read a state file once and only write it on a change.
+typedef struct {
+    uint8_t pin_name[8];
+    uint8_t state[PINMUX_STATE_LENGTH];
+} PinmuxCacheEntry;
+
+static PinmuxCacheEntry pinmux_cache[PINMUX_CACHE_SIZE];
+
+static int32_t pinmux_cache_count = 0;
+
+
+// Finds the cache entry of a pin, or adds it by reading its state file. Returns NULL if the pin can't be read or the cache is full.
+static PinmuxCacheEntry *pinmux_cache_lookup(Buffer pin_name) {
+    PinmuxCacheEntry *entry = NULL;
+    int32_t i = 0;
+
+    for (i = 0; i < pinmux_cache_count && entry == NULL; i++) {
+        if (strncmp((char *) pinmux_cache[i].pin_name, (char *) pin_name, sizeof(pinmux_cache[i].pin_name)) == 0) {
+            entry = &pinmux_cache[i];
+        }
+    }
+
+    if (entry == NULL && pinmux_cache_count < PINMUX_CACHE_SIZE && strlen((char *) pin_name) < sizeof(pinmux_cache[0].pin_name)) {
+        Buffer state_path;
+        Buffer state;
+
+        if (snprintf((char *) state_path, sizeof(state_path), PINMUX_STATE_PATH, (char *) pin_name) > 0 &&
+            read_from_file(state_path, state) == 1) {
+
+            entry = &pinmux_cache[pinmux_cache_count];
+            state[strcspn((char *) state, "\n")] = '\0';
+            (void) snprintf((char *) entry->pin_name, sizeof(entry->pin_name), "%s", (char *) pin_name);
+            (void) snprintf((char *) entry->state, sizeof(entry->state), "%s", (char *) state);
+            pinmux_cache_count++;
+        }
+    }
+
+    return entry;
+}
+
+
+int32_t set_pinmux(Buffer pin_name, Buffer state) {
+    int32_t result = 0;
+    PinmuxCacheEntry *entry = NULL;
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_pinmux_return);
+
+    BBB_PROBE2(bbbio, set_pinmux_entry, pin_name, state);
+
+    if (pin_name != NULL && state != NULL && strlen((char *) state) < (size_t) PINMUX_STATE_LENGTH) {
+        entry = pinmux_cache_lookup(pin_name);
+    }
+
+    if (entry != NULL) {
+        if (strncmp((char *) entry->state, (char *) state, sizeof(entry->state)) == 0) {
+            result = 1;  // Already in that state, nothing to write
+        }
+        else {
+            Buffer state_path;
+
+            if (snprintf((char *) state_path, sizeof(state_path), PINMUX_STATE_PATH, (char *) pin_name) > 0) {
+                result = write_to_file(state_path, state);
+            }
+
+            if (result == 1) {
+                (void) snprintf((char *) entry->state, sizeof(entry->state), "%s", (char *) state);
+            }
+        }
+    }
+
+    BBB_PROBE4(bbbio, set_pinmux_return, pin_name, state, result, BBB_PROBE_ELAPSED(probe_start));
+    return result;
+}
+
+
+int32_t get_pinmux(Buffer pin_name, Buffer state) {
+    int32_t result = 0;
+    PinmuxCacheEntry *entry = NULL;
+    int64_t probe_start = BBB_PROBE_START(bbbio, get_pinmux_return);
+
+    BBB_PROBE1(bbbio, get_pinmux_entry, pin_name);
+
+    if (pin_name != NULL && state != NULL) {
+        entry = pinmux_cache_lookup(pin_name);
+    }
+
+    if (entry != NULL) {
+        (void) snprintf((char *) state, (size_t) PINMUX_STATE_LENGTH, "%s", (char *) entry->state);
+        result = 1;
+    }
+
+    BBB_PROBE4(bbbio, get_pinmux_return, pin_name, state, result, BBB_PROBE_ELAPSED(probe_start));
+    return result;
+}
+
+
+int32_t set_pinmux_batch(const PinmuxConfig *configs, int32_t count) {
+    int32_t failures = 0;
+    int32_t i = 0;
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_pinmux_batch_return);
+
+    BBB_PROBE2(bbbio, set_pinmux_batch_entry, configs, count);
+    for (i = 0; i < count; i++) {
+        if (set_pinmux(configs[i].pin_name, configs[i].state) != 1) {
+            failures++;
+        }
+    }
+
+    BBB_PROBE4(bbbio, set_pinmux_batch_return, configs, count, failures, BBB_PROBE_ELAPSED(probe_start));
+    return failures;
+}
+
+
+BufferPointer get_gpio_header_pin(int32_t pin) {
+    BufferPointer pin_name = (BufferPointer) NULL_STR;
+    int32_t i = 0;
+
+    for (i = 0; i < (int32_t) (sizeof(header_pins) / sizeof(header_pins[0])); i++) {
+        if (header_pins[i].gpio == pin) {
+            pin_name = header_pins[i].pin_name;
+        }
+    }
+
+    return pin_name;
+}
+
+
+int32_t set_gpio_pull(int32_t pin, Buffer pull) {
+    int32_t result = 0;
+    BufferPointer pin_name = get_gpio_header_pin(pin);
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_gpio_pull_return);
+
+    BBB_PROBE2(bbbio, set_gpio_pull_entry, pin, pull);
+    if (strncmp((char *) pin_name, (char *) NULL_STR, sizeof(NULL_STR)) != 0) {
+        result = set_pinmux(pin_name, pull);
+    }
+
+    BBB_PROBE4(bbbio, set_gpio_pull_return, pin, pull, result, BBB_PROBE_ELAPSED(probe_start));
+    return result;
+}
+
+
+void set_gpio_io_hook(GpioIoHook hook) {
+    bbbio_gpio_io_hook = hook;
+}
+
+
+int32_t run_gpio_io_hook(int32_t op, int32_t bank, uint32_t mask) {
+    int32_t result = 0;
+    GpioIoHook hook = bbbio_gpio_io_hook;
+
+    if (hook != NULL) {
+        result = hook(op, bank, mask);
+    }
+
+    return result;
+}
+
+
+// The hook for a single pin.
+static int32_t run_pin_hook(int32_t op, int32_t pin) {
+    int32_t result = 0;
+
+    if (bbbio_gpio_io_hook != NULL && pin >= 0) {
+        result = run_gpio_io_hook(op, pin / 32, (uint32_t) 1U << ((uint32_t) pin % 32U));
+    }
+
+    return result;
+}
+
+
+uint32_t get_gpio_write_failures(void) {
+    return __atomic_load_n(&bbbio_gpio_write_failures, __ATOMIC_RELAXED);
+}
+
+
 int32_t write_gpio_value(int32_t pin, int32_t value) {
     int32_t result = 0;
     Buffer value_file_path; 
+    int64_t probe_start = BBB_PROBE_START(bbbio, write_gpio_value_return);
+
+    BBB_PROBE2(bbbio, write_gpio_value_entry, pin, value);
 
     // If we were able to successfully create the file path, try to write to it. 
-    if (snprintf((char *) value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
+    if (run_pin_hook(GPIO_IO_VALUE_WRITE, pin) == 0 &&
+        snprintf((char *) value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
 
         result = write_to_file_int(value_file_path, value);
     }
 
+    if (result != 1) {
+        (void) __atomic_fetch_add(&bbbio_gpio_write_failures, 1U, __ATOMIC_RELAXED);
+    }
+
+    BBB_PROBE4(bbbio, write_gpio_value_return, pin, value, result, BBB_PROBE_ELAPSED(probe_start));
     return result;
 }
 
@@ -94,8 +380,13 @@ int32_t write_gpio_value(int32_t pin, int32_t value) {
 int32_t setup_gpio_pin(int32_t pin, Buffer direction) {
     int32_t result = 0;
     Buffer value_file_path;
+    Buffer direction_file_path;
+    int64_t probe_start = BBB_PROBE_START(bbbio, setup_gpio_pin_return);
 
-    if (snprintf((char *) value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
+    BBB_PROBE2(bbbio, setup_gpio_pin_entry, pin, direction);
+
+    if (snprintf((char *) value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0 &&
+        snprintf((char *) direction_file_path, sizeof(direction_file_path), GPIO_DIRECTION_PATH, pin) > 0) {
 
         if (file_exists(value_file_path) == 1) {
             result = 1;  // File already exists, pin already exported
@@ -105,19 +396,17 @@ int32_t setup_gpio_pin(int32_t pin, Buffer direction) {
             result = write_to_file_int((BufferPointer) GPIO_EXPORT_PATH, pin);
 
             if (result == 1) {
-                int32_t u = usleep(500000);
+                result = wait_for_writable(direction_file_path);
             }
         }
     }
 
     // Set the direction
     if (result == 1) {
-        Buffer direction_file_path;
-        if (snprintf((char *) direction_file_path, sizeof(direction_file_path), GPIO_DIRECTION_PATH, pin) > 0) {
-            result = write_to_file(direction_file_path, direction);
-        }
+        result = write_to_file(direction_file_path, direction);
     }
 
+    BBB_PROBE4(bbbio, setup_gpio_pin_return, pin, direction, result, BBB_PROBE_ELAPSED(probe_start));
     return result;
 }
 
@@ -136,9 +425,12 @@ int32_t read_gpio_value(int32_t pin) {
     int32_t result = -1;
     Buffer value_file_path;
     Buffer buff;
+    int64_t probe_start = BBB_PROBE_START(bbbio, read_gpio_value_return);
+
+    BBB_PROBE1(bbbio, read_gpio_value_entry, pin);
 
     // Create the file path for the GPIO value
-    if (snprintf((char *)value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
+    if (run_pin_hook(GPIO_IO_VALUE_READ, pin) == 0 && snprintf((char *)value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
         if (read_from_file(value_file_path, buff) == 1) {
 
             // Check the value read from the file
@@ -154,29 +446,125 @@ int32_t read_gpio_value(int32_t pin) {
         }
     }
 
+    BBB_PROBE3(bbbio, read_gpio_value_return, pin, result, BBB_PROBE_ELAPSED(probe_start));
     return result;
 }
 
 
-void set_pwm_enable(Buffer pin_identifier, int32_t value) {
+int32_t set_gpio_edge(int32_t pin, Buffer edge) {
     int32_t result = 0;
-    BufferPointer channel_path = (BufferPointer) NULL_STR;
+    Buffer edge_file_path;
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_gpio_edge_return);
 
-    if (pin_identifier[0] == '1' && pin_identifier[1] == 'A') {
-        channel_path = (BufferPointer) PWM1PINA_PATH;
-    } 
-    else if (pin_identifier[0] == '1' && pin_identifier[1] == 'B') {
-        channel_path = (BufferPointer) PWM1PINB_PATH;
-    } 
-    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'A') {
-        channel_path = (BufferPointer) PWM2PINA_PATH;
-    } 
-    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'B') {
-        channel_path = (BufferPointer) PWM2PINB_PATH;
+    BBB_PROBE2(bbbio, set_gpio_edge_entry, pin, edge);
+    if (snprintf((char *) edge_file_path, sizeof(edge_file_path), GPIO_EDGE_PATH, pin) > 0) {
+        result = write_to_file(edge_file_path, edge);
     }
-    else {
-        channel_path = (BufferPointer) NULL_STR;
+
+    BBB_PROBE4(bbbio, set_gpio_edge_return, pin, edge, result, BBB_PROBE_ELAPSED(probe_start));
+    return result;
+}
+
+
+BufferPointer get_pwm_channel_path(Buffer pin_identifier) {
+    return pwm_channel_paths[pwm_channel_index(pin_identifier)];
+}
+
+
+int32_t open_gpio_handle(int32_t pin, GpioHandle *handle) {
+    int32_t result = 0;
+    Buffer value_file_path;
+
+    handle->fd = -1;
+    handle->bank = pin / 32;
+    handle->mask = (uint32_t) 1U << ((uint32_t) pin % 32U);
+
+    if (pin >= 0 && snprintf((char *) value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
+        handle->fd = open((char *) value_file_path, O_RDWR | O_CLOEXEC);
+        result = (int32_t) (handle->fd >= 0);
+    }
+
+    return result;
+}
+
+
+void close_gpio_handle(GpioHandle *handle) {
+    if (handle->fd >= 0) {
+        int32_t u = close(handle->fd);
+        handle->fd = -1;
+    }
+}
+
+
+int32_t open_pwm_handle(Buffer pin_identifier, PwmHandle *handle) {
+    int32_t result = 0;
+    BufferPointer channel_path = get_pwm_channel_path(pin_identifier);
+    Buffer file_path;
+
+    clear_pwm_handle(handle);
+
+    if (strncmp((char *) channel_path, (char *) NULL_STR, sizeof(NULL_STR)) != 0) {
+        if (snprintf((char *) file_path, sizeof(file_path), "%s%s", (char *) channel_path, PWM_PERIOD_PATH) > 0) {
+            handle->period_fd = open((char *) file_path, O_WRONLY | O_CLOEXEC);
+        }
+        if (snprintf((char *) file_path, sizeof(file_path), "%s%s", (char *) channel_path, PWM_DUTY_CYCLE_PATH) > 0) {
+            handle->duty_fd = open((char *) file_path, O_WRONLY | O_CLOEXEC);
+        }
+        if (snprintf((char *) file_path, sizeof(file_path), "%s%s", (char *) channel_path, PWM_ENABLE_PATH) > 0) {
+            handle->enable_fd = open((char *) file_path, O_WRONLY | O_CLOEXEC);
+        }
+        result = (int32_t) (handle->period_fd >= 0 && handle->duty_fd >= 0 && handle->enable_fd >= 0);
+    }
+
+    if (result == 0) {
+        close_pwm_handle(handle);
+    }
+
+    return result;
+}
+
+
+void close_pwm_handle(PwmHandle *handle) {
+    if (handle->period_fd >= 0) {
+        int32_t u = close(handle->period_fd);
+        handle->period_fd = -1;
+    }
+    if (handle->duty_fd >= 0) {
+        int32_t u = close(handle->duty_fd);
+        handle->duty_fd = -1;
     }
+    if (handle->enable_fd >= 0) {
+        int32_t u = close(handle->enable_fd);
+        handle->enable_fd = -1;
+    }
+}
+
+
+int32_t open_pwm_channel(Buffer pin_identifier, int32_t frequency, float32_t duty_percent, int32_t enable, PwmHandle *handle) {
+    int32_t result = 0;
+
+    clear_pwm_handle(handle);
+
+    if (prepare_pwm(pin_identifier, frequency, duty_percent) == 1 && open_pwm_handle(pin_identifier, handle) == 1) {
+        result = write_pwm_enable_fast(handle, enable);
+    }
+
+    if (result == 0) {
+        close_pwm_handle(handle);
+    }
+
+    return result;
+}
+
+
+void set_pwm_enable(Buffer pin_identifier, int32_t value) {
+    int32_t result = 0;
+    BufferPointer channel_path = (BufferPointer) NULL_STR;
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_pwm_enable_return);
+
+    BBB_PROBE2(bbbio, set_pwm_enable_entry, pin_identifier, value);
+
+    channel_path = get_pwm_channel_path(pin_identifier);
 
     if (strncmp((char *) channel_path, (char *) NULL_STR, sizeof(NULL_STR)) == 0) {
         result = 0;
@@ -187,28 +575,20 @@ void set_pwm_enable(Buffer pin_identifier, int32_t value) {
             result = write_to_file_int(enable_path, value);
         }
     }
+
+    BBB_PROBE4(bbbio, set_pwm_enable_return, pin_identifier, value, result, BBB_PROBE_ELAPSED(probe_start));
 }
 
 
 void set_pwm_duty_cycle(Buffer pin_identifier, int32_t frequency, float32_t duty_percent) {
     int32_t result = 0;
     BufferPointer channel_path = (BufferPointer) NULL_STR;
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_pwm_duty_cycle_return);
 
-    if (pin_identifier[0] == '1' && pin_identifier[1] == 'A') {
-        channel_path = (BufferPointer) PWM1PINA_PATH;
-    } 
-    else if (pin_identifier[0] == '1' && pin_identifier[1] == 'B') {
-        channel_path = (BufferPointer) PWM1PINB_PATH;
-    } 
-    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'A') {
-        channel_path = (BufferPointer) PWM2PINA_PATH;
-    } 
-    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'B') {
-        channel_path = (BufferPointer) PWM2PINB_PATH;
-    }
-    else {
-        channel_path = (BufferPointer) NULL_STR;
-    }
+    // Probe arguments are integers: the duty cycle goes in hundredths of a percent.
+    BBB_PROBE3(bbbio, set_pwm_duty_cycle_entry, pin_identifier, frequency, (int32_t) (duty_percent * 100.0f));
+
+    channel_path = get_pwm_channel_path(pin_identifier);
 
     if (strncmp((char *) channel_path, (char*) NULL_STR, sizeof(NULL_STR)) == 0) {
         result = 0;
@@ -221,7 +601,7 @@ void set_pwm_duty_cycle(Buffer pin_identifier, int32_t frequency, float32_t duty
             result = 0;
         }
         else {
-            period_ns = (int32_t)(1000000000.0f / frequency);
+            period_ns = (int32_t) pwm_period_ns(frequency);
             duty_ns = (period_ns * (duty_percent / 100.0f));
         }
 
@@ -233,28 +613,19 @@ void set_pwm_duty_cycle(Buffer pin_identifier, int32_t frequency, float32_t duty
             }
         }
     }
+
+    BBB_PROBE4(bbbio, set_pwm_duty_cycle_return, pin_identifier, (int32_t) (duty_percent * 100.0f), result, BBB_PROBE_ELAPSED(probe_start));
 }
 
 
 void set_pwm_frequency(Buffer pin_identifier, int32_t frequency) {
     int32_t result = 0;
     BufferPointer channel_path = (BufferPointer) NULL_STR;
+    int64_t probe_start = BBB_PROBE_START(bbbio, set_pwm_frequency_return);
 
-    if (pin_identifier[0] == '1' && pin_identifier[1] == 'A') {
-        channel_path = (BufferPointer) PWM1PINA_PATH;
-    } 
-    else if (pin_identifier[0] == '1' && pin_identifier[1] == 'B') {
-        channel_path = (BufferPointer) PWM1PINB_PATH;
-    } 
-    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'A') {
-        channel_path = (BufferPointer) PWM2PINA_PATH;
-    } 
-    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'B') {
-        channel_path = (BufferPointer) PWM2PINB_PATH;
-    }
-    else {
-        channel_path = (BufferPointer) NULL_STR;
-    }
+    BBB_PROBE2(bbbio, set_pwm_frequency_entry, pin_identifier, frequency);
+
+    channel_path = get_pwm_channel_path(pin_identifier);
 
     if (strncmp((char *) channel_path, (char *)NULL_STR, sizeof(NULL_STR)) == 0) {
         result = 0;
@@ -266,7 +637,7 @@ void set_pwm_frequency(Buffer pin_identifier, int32_t frequency) {
             result = 0;
         }
         else {
-            period_ns = (int32_t)(1000000000.0f / frequency);
+            period_ns = (int32_t) pwm_period_ns(frequency);
         }
 
         if (period_ns >= 0) {
@@ -276,10 +647,12 @@ void set_pwm_frequency(Buffer pin_identifier, int32_t frequency) {
             }
         }
     }
+
+    BBB_PROBE4(bbbio, set_pwm_frequency_return, pin_identifier, frequency, result, BBB_PROBE_ELAPSED(probe_start));
 }
 
 
-int32_t setup_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_percent) {
+int32_t prepare_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_percent) {
 
     int32_t result = 1;           // Default to success; will clear on error
     Buffer file_path;
@@ -287,13 +660,13 @@ int32_t setup_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_perce
     int32_t channel_number = -1;
     int32_t period_ns = 0;
     int32_t duty_ns = 0;
-    
+
     // Validate duty_percent and frequency
     if ((int) (duty_percent <= 0.0f) || (int) (duty_percent > 100.0f) || frequency <= 0) {
         result = 0;
     }
     else {
-        period_ns = (int32_t)(1000000000.0f / frequency);
+        period_ns = (int32_t) pwm_period_ns(frequency);
         duty_ns = (period_ns * (duty_percent / 100.0f));
     }
     
@@ -303,27 +676,27 @@ int32_t setup_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_perce
             channel_path = (BufferPointer) PWM1PINA_PATH;
             channel_number = 0;
 
-            // Configure pin to pwm mode - config-pin {PIN} pwm
-            result = write_to_file((BufferPointer) PWM1PINA_STATE_PATH, (BufferPointer) PWM_STATE);
+            // Configure pin to pwm mode - config-pin {PIN} pwm (only written if the pin isn't already in pwm mode)
+            result = set_pinmux((BufferPointer) PWM1PINA_PIN_NAME, (BufferPointer) PINMUX_PWM);
         } 
         else if (pin_identifier[0] == '1' && pin_identifier[1] == 'B') {
             channel_path = (BufferPointer) PWM1PINB_PATH;
             channel_number = 1;
 
-            result = write_to_file((BufferPointer) PWM1PINB_STATE_PATH, (BufferPointer) PWM_STATE);
+            result = set_pinmux((BufferPointer) PWM1PINB_PIN_NAME, (BufferPointer) PINMUX_PWM);
 
         } 
         else if (pin_identifier[0] == '2' && pin_identifier[1] == 'A') {
             channel_path = (BufferPointer) PWM2PINA_PATH;
             channel_number = 0;
 
-            result = write_to_file((BufferPointer) PWM2PINA_STATE_PATH, (BufferPointer) PWM_STATE);
+            result = set_pinmux((BufferPointer) PWM2PINA_PIN_NAME, (BufferPointer) PINMUX_PWM);
         } 
         else if (pin_identifier[0] == '2' && pin_identifier[1] == 'B') {
             channel_path = (BufferPointer) PWM2PINB_PATH;
             channel_number = 1;
 
-            result = write_to_file((BufferPointer) PWM2PINB_STATE_PATH, (BufferPointer) PWM_STATE);
+            result = set_pinmux((BufferPointer) PWM2PINB_PIN_NAME, (BufferPointer) PINMUX_PWM);
         }
         else {
             result = 0;
@@ -345,7 +718,6 @@ int32_t setup_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_perce
                     result = 0;
                 }
                 else {
-                    int32_t u = usleep(500000);
                     result = 1;
                 }
             } 
@@ -354,23 +726,56 @@ int32_t setup_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_perce
                     result = 0;
                 }
                 else {
-                    int32_t u = usleep(500000);
                     result = 1;
                 }
             }
             else {
                 result = 0;
             }
+
+            // Wait for the channel's period and enable files instead of sleeping for the worst case. udev makes each
+            // attribute writable on its own, the enable file is the last one setup_pwm writes.
+            if (result == 1) {
+                if (snprintf((char *) file_path, sizeof(file_path), "%s%s", (char *) channel_path, PWM_PERIOD_PATH) > 0) {
+                    result = wait_for_writable(file_path);
+                }
+                else {
+                    result = 0;
+                }
+            }
+            if (result == 1) {
+                if (snprintf((char *) file_path, sizeof(file_path), "%s%s", (char *) channel_path, PWM_ENABLE_PATH) > 0) {
+                    result = wait_for_writable(file_path);
+                }
+                else {
+                    result = 0;
+                }
+            }
         }
     }    
 
     if (result == 1) {
         set_pwm_frequency(pin_identifier, frequency);
         set_pwm_duty_cycle(pin_identifier, frequency, duty_percent);
+    }
+
+    return result;
+}
+
+
+int32_t setup_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_percent) {
+    int32_t result = 0;
+    int64_t probe_start = BBB_PROBE_START(bbbio, setup_pwm_return);
+
+    BBB_PROBE3(bbbio, setup_pwm_entry, pin_identifier, frequency, (int32_t) (duty_percent * 100.0f));
+
+    // No settling sleep: prepare_pwm waited for a fresh export's files to be writable, the output starts on this write.
+    result = prepare_pwm(pin_identifier, frequency, duty_percent);
+    if (result == 1) {
         set_pwm_enable(pin_identifier, PWM_ON);
-        int32_t u = usleep(500000);
     }
-    
+
+    BBB_PROBE4(bbbio, setup_pwm_return, pin_identifier, frequency, result, BBB_PROBE_ELAPSED(probe_start));
     return result;
 }
 
@@ -41,11 +41,25 @@ typedef uint8_t Buffer[FILE_PATH_LENGTH];
 
 typedef float float32_t;
 
+// After exporting a pin, udev needs a moment to create the files and fix their permissions.
+// Instead of always sleeping for the worst case we poll for the file to become writable every EXPORT_POLL_US, up to EXPORT_TIMEOUT_US.
+#define EXPORT_TIMEOUT_US ((int32_t) 500000)
+
+#define EXPORT_POLL_US ((int32_t) 1000)
+
+
+
+// Directory every sysfs path below is under. Empty on the BeagleBone. Off-target, build with it pointing at a mounted
+// sysfs emulator (see sysfs_emu.c), e.g. make SYSFS_ROOT=/tmp/bbbfs
+#ifndef SYSFS_ROOT
+#define SYSFS_ROOT ""
+#endif
+
 
 
 /// ----------- GPIO CONSTANTS ----------- ///
 // The GPIO path for the BBB.
-#define GLOBAL_GPIO_PATH "/sys/class/gpio/" 
+#define GLOBAL_GPIO_PATH SYSFS_ROOT "/sys/class/gpio/" 
 
 // The value for the off state of a gpio pin (low voltage). 
 #define GPIO_OFF ((int32_t) 0) 
@@ -69,11 +83,23 @@ typedef float float32_t;
 // The GPIO Export path for the BBB.
 #define GPIO_EXPORT_PATH GLOBAL_GPIO_PATH "export"
 
+// Same principle as above, but for the edge file (which edges make poll() on the value file return).
+#define GPIO_EDGE_PATH GLOBAL_GPIO_PATH "gpio%d/edge"
+
+// Values for the edge file.
+#define GPIO_EDGE_NONE "none"
+
+#define GPIO_EDGE_RISING "rising"
+
+#define GPIO_EDGE_FALLING "falling"
+
+#define GPIO_EDGE_BOTH "both"
+
 
 
 
 /// ----------- PWM CONSTANTS ----------- ///
-#define DEVICES_PATH "/sys/devices/platform/ocp/"
+#define DEVICES_PATH SYSFS_ROOT "/sys/devices/platform/ocp/"
 
 #define PWM_BASE_PATH_TEMPLATE(EPWMSS_ADDR, PWM_ADDR, CHIP) DEVICES_PATH EPWMSS_ADDR ".epwmss/" PWM_ADDR ".pwm/pwm/pwmchip" CHIP "/"
 
@@ -134,10 +160,74 @@ typedef float float32_t;
 
 #define PWM_STATE "pwm"
 
+
+
+
+/// ----------- PINMUX CONSTANTS ----------- ///
+// Every header pin has a pinmux helper (from the cape-universal overlay) whose state file selects what the pin does.
+// Writing it is the same as running config-pin {PIN} {STATE}. The %s is the header pin name, e.g. "P9_14".
+#define PINMUX_STATE_PATH DEVICES_PATH "ocp:%s_pinmux/state"
+
+// Common states. Not every pin supports every state, run "config-pin -l {PIN}" on the BeagleBone to list a pin's states.
+#define PINMUX_DEFAULT "default"
+
+#define PINMUX_GPIO "gpio"
+
+#define PINMUX_GPIO_PU "gpio_pu"
+
+#define PINMUX_GPIO_PD "gpio_pd"
+
+#define PINMUX_GPIO_INPUT "gpio_input"
+
+#define PINMUX_PWM PWM_STATE
+
+#define PINMUX_SPI "spi"
+
+#define PINMUX_SPI_CS "spi_cs"
+
+#define PINMUX_SPI_SCLK "spi_sclk"
+
+#define PINMUX_I2C "i2c"
+
+#define PINMUX_UART "uart"
+
+#define PINMUX_TIMER "timer"
+
+#define PINMUX_PRU_OUT "pruout"
+
+#define PINMUX_PRU_IN "pruin"
+
+// Longest state name we keep in the cache (including the terminator).
+#define PINMUX_STATE_LENGTH ((int32_t) 16)
+
+// Number of pins the pinmux cache can remember (both headers together have 92 pins).
+#define PINMUX_CACHE_SIZE ((int32_t) 92)
+
+// One entry of a batch pinmux configuration.
+typedef struct {
+    BufferPointer pin_name;     // Header pin, e.g. "P8_19"
+    BufferPointer state;        // One of the PINMUX_ states
+} PinmuxConfig;
+
 #define PWM_ON ((int32_t) 1)
 
 #define PWM_OFF ((int32_t) 0)
 
+// Operations passed to the GPIO I/O hook (see set_gpio_io_hook).
+#define GPIO_IO_VALUE_WRITE ((int32_t) 0)   // write_gpio_value, set_gpio_on / off
+
+#define GPIO_IO_VALUE_READ ((int32_t) 1)    // read_gpio_value and the gpioinput reads
+
+#define GPIO_IO_BANK_WRITE ((int32_t) 2)    // gpio_bank_write, any backend
+
+#define GPIO_IO_BANK_READ ((int32_t) 3)     // gpio_bank_read, any backend
+
+#define GPIO_IO_OP_COUNT ((int32_t) 4)
+
+// Called before every GPIO operation with the pins it touches (mask of bank). Returns 0 to let the operation go ahead,
+// or an errno value to fail it without touching the pins. May take as long as it likes, that is the point of it.
+typedef int32_t (*GpioIoHook)(int32_t op, int32_t bank, uint32_t mask);
+
 
 
 
@@ -169,6 +259,26 @@ void set_gpio_on(int32_t pin);
 void set_gpio_off(int32_t pin);
 
 
+// Description: Returns how many write_gpio_value calls failed so far, including the ones from set_gpio_on / set_gpio_off
+// which have no return value.
+uint32_t get_gpio_write_failures(void);
+
+
+// Description: Installs the hook called before every GPIO value and bank operation, used to inject faults and latency
+// (see fault.h). Install it before starting the threads that do GPIO operations.
+// Parameters: hook - The hook, NULL to remove it
+void set_gpio_io_hook(GpioIoHook hook);
+
+
+// Description: Runs the installed GPIO I/O hook, for modules doing GPIO operations outside bbbio (gpiobank, gpioinput).
+// Parameters:
+// op   - One of the GPIO_IO_ operations
+// bank - Bank of the pins (GPIO number / 32)
+// mask - Pins of that bank the operation touches
+// Returns - 0 if the operation can go ahead (always when no hook is installed), otherwise the errno value to fail it with.
+int32_t run_gpio_io_hook(int32_t op, int32_t bank, uint32_t mask);
+
+
 // Description: Reads the value of the specified GPIO pin.
 // Parameters: 
 // pin - The GPIO pin number
@@ -176,6 +286,59 @@ void set_gpio_off(int32_t pin);
 int32_t read_gpio_value(int32_t pin);
 
 
+// Description: Selects which edges of an input pin generate an interrupt (make poll() on its value file return).
+// Parameters:
+// pin  - The GPIO pin number
+// edge - Use GPIO_EDGE_NONE, GPIO_EDGE_RISING, GPIO_EDGE_FALLING or GPIO_EDGE_BOTH macros.
+// Returns - Returns 1 on success, 0 on failure (for example the pin can't generate interrupts).
+int32_t set_gpio_edge(int32_t pin, Buffer edge);
+
+
+// Description: Sets the pinmux state of a header pin (same as config-pin {PIN} {STATE}).
+// The current state of each pin is read once and cached, the state file is only written when the state actually changes.
+// Parameters:
+// pin_name - The header pin, e.g. "P9_14"
+// state    - The state to set. Use the PINMUX_ macros.
+// Returns - Returns 1 on success (or if the pin already was in that state), 0 on failure.
+int32_t set_pinmux(Buffer pin_name, Buffer state);
+
+
+// Description: Gets the pinmux state of a header pin (from the cache after the first call for that pin).
+// Parameters:
+// pin_name - The header pin, e.g. "P9_14"
+// state    - Where the state is stored (at least PINMUX_STATE_LENGTH bytes)
+// Returns - Returns 1 on success, 0 on failure.
+int32_t get_pinmux(Buffer pin_name, Buffer state);
+
+
+// Description: Sets the pinmux state of many pins in one pass. Pins already in the requested state are not written.
+// Parameters:
+// configs - The pins and the states to set them to
+// count   - Number of entries in configs
+// Returns - Returns the number of pins that could not be configured (0 means all succeeded).
+int32_t set_pinmux_batch(const PinmuxConfig *configs, int32_t count);
+
+
+// Description: Finds the header pin of a GPIO number, e.g. 60 -> "P9_12".
+// Parameters: pin - The GPIO pin number
+// Returns - The header pin name, or NULL_STR if the GPIO is not on the headers.
+BufferPointer get_gpio_header_pin(int32_t pin);
+
+
+// Description: Sets the internal pull resistor of a GPIO pin through its pinmux, so buttons don't need external resistors.
+// Parameters:
+// pin  - The GPIO pin number
+// pull - PINMUX_GPIO_PU (pull-up), PINMUX_GPIO_PD (pull-down) or PINMUX_GPIO (no pull resistor)
+// Returns - Returns 1 on success, 0 on failure (GPIO not on the headers or the pinmux can't be written).
+int32_t set_gpio_pull(int32_t pin, Buffer pull);
+
+
+// Description: Finds the sysfs directory of a PWM channel, for code that keeps the channel files open itself.
+// Parameters: pin_identifier - The pin identifier for the PWM channel (e.g. "1A", "1B", "2A", "2B")
+// Returns - The channel directory (ending in '/'), or NULL_STR for an unknown identifier.
+BufferPointer get_pwm_channel_path(Buffer pin_identifier);
+
+
 // Description: Sets the duty cycle of the specified PWM channel.
 // Parameters:
 // pin_identifier - The pin identifier for the PWM channel (e.g. "1A", "1B", "2A", "2B")
@@ -198,6 +361,16 @@ void set_pwm_frequency(Buffer pin_identifier, int32_t frequency);
 void set_pwm_enable(Buffer pin_identifier, int32_t value);
 
 
+// Description: Sets up the specified PWM channel like setup_pwm (pinmux, export, period and duty cycle) without enabling
+// it, for a channel that has to stay silent until later.
+// Parameters:
+// pin_identifier - The pin identifier for the PWM channel (e.g. "1A", "1B", "2A", "2B")
+// frequency      - Frequency in Hz
+// duty_percent   - Duty cycle percentage (must be > 0 and <= 100)
+// Returns - Returns 1 on success, 0 on failure.
+int32_t prepare_pwm(Buffer pin_identifier, int32_t frequency, float32_t duty_percent);
+
+
 // Description: Sets up the specified PWM channel with the given frequency (in Hz) and duty cycle (as a percentage).
 // Parameters:
 // pin_identifier - The pin identifier for the PWM channel (e.g. "1A", "1B", "2A", "2B")
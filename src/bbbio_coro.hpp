@@ -0,0 +1,662 @@
+/*
+This file is the C++20 coroutine layer for bbbio.
+Instead of a thread per job with usleep loops (like stopwatch.c), every job is a coroutine and they all run on one
+thread, on a scheduler built around epoll:
+- co_await sleep_until(t)           resumes at the absolute CLOCK_MONOTONIC time t (one timerfd for all timers)
+- co_await gpio.edge(Edge::Rising)  resumes on the next matching edge (sysfs edge interrupt, EPOLLPRI)
+- co_await pwm.ramp(...)            runs a duty cycle ramp and resumes when it is done
+- co_await task                     runs another coroutine and resumes when it finishes
+Because only one coroutine runs at a time, state shared between them needs no mutex.
+
+Coroutine frames never come from the heap: they are carved out of a fixed arena of FRAME_BLOCK_COUNT blocks of
+FRAME_BLOCK_SIZE bytes. A frame that doesn't fit (or an arena that is full) gives an empty Task instead of allocating.
+spawn() refuses an empty Task, and co_await on one calls std::terminate.
+
+This is header only. The bbbio C code is linked from libbbbio.a (see the coro target in the Makefile).
+
+Sources:
+https://en.cppreference.com/w/cpp/language/coroutines
+*/
+
+#ifndef BBBIO_CORO_HPP
+#define BBBIO_CORO_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+#include "bbbio.h"
+#include "rtutil.h"
+}
+
+namespace bbbio {
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+constexpr std::size_t FRAME_BLOCK_SIZE = 1024;
+
+constexpr int32_t FRAME_BLOCK_COUNT = 64;
+
+// Maximum coroutines waiting on a timer / ready to run at the same time.
+constexpr int32_t MAX_TIMERS = 64;
+
+constexpr int32_t MAX_READY = 64;
+
+// Sampling period for GPIOs whose value file can't be watched with epoll (no edge support).
+constexpr int64_t GPIO_SAMPLE_NS = 10000000;
+
+// Default time after an accepted edge during which further edges are ignored (button bounce).
+constexpr int64_t GPIO_DEFAULT_HOLDOFF_NS = 20000000;
+
+
+/* --------------------------------------------- FRAME ARENA ---------------------------------------------*/
+
+class FrameArena {
+public:
+    // Description: Takes a block for a coroutine frame. Returns nullptr if size is too big or all blocks are used.
+    static void *allocate(std::size_t size) noexcept {
+        void *block = nullptr;
+
+        if (size <= FRAME_BLOCK_SIZE && free_list != nullptr) {
+            block = free_list;
+            free_list = free_list->next;
+            in_use++;
+            if (in_use > high_water) {
+                high_water = in_use;
+            }
+        }
+
+        return block;
+    }
+
+    // Description: Gives a block back.
+    static void release(void *block) noexcept {
+        FreeBlock *b = static_cast<FreeBlock *>(block);
+
+        b->next = free_list;
+        free_list = b;
+        in_use--;
+    }
+
+    static int32_t blocks_in_use() noexcept { return in_use; }
+
+    static int32_t blocks_high_water() noexcept { return high_water; }
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct alignas(std::max_align_t) Block {
+        unsigned char bytes[FRAME_BLOCK_SIZE];
+    };
+
+    static FreeBlock *build_free_list() noexcept {
+        for (int32_t i = FRAME_BLOCK_COUNT - 1; i >= 0; i--) {
+            FreeBlock *b = reinterpret_cast<FreeBlock *>(&blocks[i]);
+            b->next = (i == (FRAME_BLOCK_COUNT - 1)) ? nullptr : reinterpret_cast<FreeBlock *>(&blocks[i + 1]);
+        }
+        return reinterpret_cast<FreeBlock *>(&blocks[0]);
+    }
+
+    static inline Block blocks[FRAME_BLOCK_COUNT];
+    static inline FreeBlock *free_list = build_free_list();
+    static inline int32_t in_use = 0;
+    static inline int32_t high_water = 0;
+};
+
+
+/* --------------------------------------------- SCHEDULER ---------------------------------------------*/
+
+// Something that is woken up by the scheduler: a timer expiring or an fd becoming ready.
+struct Waiter {
+    void (*fire)(Waiter *self, uint32_t events) = nullptr;
+    std::coroutine_handle<> handle{};
+    void *context = nullptr;    // Whatever fire needs to find its owner
+};
+
+class Scheduler {
+public:
+    Scheduler() noexcept {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;  // nullptr marks the timerfd
+        (void) epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+
+        current_scheduler = this;
+    }
+
+    ~Scheduler() {
+        (void) close(timer_fd);
+        (void) close(epoll_fd);
+        if (current_scheduler == this) {
+            current_scheduler = nullptr;
+        }
+    }
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // Description: The scheduler of this program (there is only one, it runs on the thread that calls run()).
+    static Scheduler &current() noexcept { return *current_scheduler; }
+
+    // Description: Makes a coroutine runnable. Returns false if the ready queue is full.
+    bool schedule(std::coroutine_handle<> h) noexcept {
+        bool ok = false;
+
+        if (ready_count < MAX_READY) {
+            ready[(ready_head + ready_count) % MAX_READY] = h;
+            ready_count++;
+            ok = true;
+        }
+
+        return ok;
+    }
+
+    // Description: Calls w->fire once deadline_ns (CLOCK_MONOTONIC) has passed. Returns false if there are too many timers.
+    bool add_timer(int64_t deadline_ns, Waiter *w) noexcept {
+        bool ok = false;
+
+        // Binary min-heap on the deadline, so the next timer is always timers[0].
+        if (timer_count < MAX_TIMERS) {
+            int32_t i = timer_count;
+            timer_count++;
+
+            while (i > 0 && timers[(i - 1) / 2].deadline_ns > deadline_ns) {
+                timers[i] = timers[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            timers[i].deadline_ns = deadline_ns;
+            timers[i].waiter = w;
+            ok = true;
+        }
+
+        return ok;
+    }
+
+    // Description: Calls w->fire with the epoll events every time fd is ready. Returns false if epoll refused the fd.
+    bool watch_fd(int32_t fd, uint32_t events, Waiter *w) noexcept {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = w;
+
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    void unwatch_fd(int32_t fd) noexcept {
+        (void) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // Description: Runs coroutines until stop() is called or no spawned task is left.
+    void run() noexcept {
+        stopped = false;
+
+        while (!stopped && live_tasks > 0) {
+            run_ready();
+            fire_due_timers(rt_now_ns());
+
+            if (ready_count == 0 && !stopped && live_tasks > 0) {
+                wait_for_events();
+            }
+        }
+    }
+
+    void stop() noexcept { stopped = true; }
+
+    // Spawned tasks that haven't finished. Used by Task, not meant to be called directly.
+    void task_started() noexcept { live_tasks++; }
+    void task_finished() noexcept { live_tasks--; }
+
+    // Number of times a coroutine was resumed by the scheduler, and number of epoll_wait calls.
+    uint64_t resumes = 0;
+    uint64_t epoll_waits = 0;
+
+private:
+    struct TimerEntry {
+        int64_t deadline_ns;
+        Waiter *waiter;
+    };
+
+    void run_ready() noexcept {
+        while (ready_count > 0) {
+            std::coroutine_handle<> h = ready[ready_head];
+            ready_head = (ready_head + 1) % MAX_READY;
+            ready_count--;
+            resumes++;
+            h.resume();
+        }
+    }
+
+    void pop_timer() noexcept {
+        TimerEntry last = timers[timer_count - 1];
+        int32_t i = 0;
+
+        timer_count--;
+        while ((2 * i) + 1 < timer_count) {
+            int32_t child = (2 * i) + 1;
+            if (child + 1 < timer_count && timers[child + 1].deadline_ns < timers[child].deadline_ns) {
+                child++;
+            }
+            if (timers[child].deadline_ns >= last.deadline_ns) {
+                break;
+            }
+            timers[i] = timers[child];
+            i = child;
+        }
+        timers[i] = last;
+    }
+
+    void fire_due_timers(int64_t now_ns) noexcept {
+        while (timer_count > 0 && timers[0].deadline_ns <= now_ns) {
+            Waiter *w = timers[0].waiter;
+            pop_timer();
+            w->fire(w, 0U);
+        }
+    }
+
+    void wait_for_events() noexcept {
+        epoll_event events[16];
+        itimerspec spec{};
+
+        // Arm the timerfd for the earliest timer (absolute time so it can't drift), or disarm it.
+        if (timer_count > 0) {
+            spec.it_value.tv_sec = static_cast<time_t>(timers[0].deadline_ns / NS_PER_SEC);
+            spec.it_value.tv_nsec = static_cast<long>(timers[0].deadline_ns % NS_PER_SEC);
+        }
+        (void) timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+        epoll_waits++;
+        int32_t n = epoll_wait(epoll_fd, events, 16, -1);
+
+        for (int32_t i = 0; i < n; i++) {
+            Waiter *w = static_cast<Waiter *>(events[i].data.ptr);
+
+            if (w == nullptr) {
+                uint64_t expirations = 0;
+                (void) read(timer_fd, &expirations, sizeof(expirations));
+            }
+            else {
+                w->fire(w, events[i].events);
+            }
+        }
+    }
+
+    static inline Scheduler *current_scheduler = nullptr;
+
+    int32_t epoll_fd = -1;
+    int32_t timer_fd = -1;
+    TimerEntry timers[MAX_TIMERS]{};
+    int32_t timer_count = 0;
+    std::coroutine_handle<> ready[MAX_READY]{};
+    int32_t ready_head = 0;
+    int32_t ready_count = 0;
+    int32_t live_tasks = 0;
+    bool stopped = false;
+};
+
+
+// Waiter that just makes its coroutine runnable.
+inline void resume_waiter(Waiter *self, uint32_t events) {
+    (void) events;
+    (void) Scheduler::current().schedule(self->handle);
+}
+
+
+/* --------------------------------------------- TASK ---------------------------------------------*/
+
+// A coroutine returning nothing. Either co_await it from another coroutine, or hand it to spawn() to run on its own.
+class [[nodiscard]] Task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation{};
+        bool detached = false;
+
+        static void *operator new(std::size_t size) noexcept { return FrameArena::allocate(size); }
+
+        static void operator delete(void *frame) noexcept { FrameArena::release(frame); }
+
+        static Task get_return_object_on_allocation_failure() noexcept { return Task{}; }
+
+        Task get_return_object() noexcept { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> next = std::noop_coroutine();
+
+                if (h.promise().detached) {
+                    // Nobody owns a spawned task, it cleans up after itself.
+                    Scheduler::current().task_finished();
+                    h.destroy();
+                }
+                else if (h.promise().continuation) {
+                    next = h.promise().continuation;
+                }
+                else {
+                }
+
+                return next;
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    Task() noexcept = default;
+
+    explicit Task(std::coroutine_handle<promise_type> h) noexcept : handle(h) {}
+
+    Task(Task &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = other.handle;
+            other.handle = nullptr;
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // Description: False if the frame could not be allocated from the arena.
+    bool valid() const noexcept { return static_cast<bool>(handle); }
+
+    // An empty task is never ready: awaiting it ends up in await_suspend, which stops the program.
+    bool await_ready() const noexcept { return handle && handle.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        // The arena was full and the task never ran. Carrying on would skip its body as if it had finished, so fail
+        // like an exception in a task does (unhandled_exception). Check valid() first to handle a full arena.
+        if (!handle) {
+            std::terminate();
+        }
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() const noexcept {}
+
+    // Gives up ownership so the task can run detached (used by spawn).
+    std::coroutine_handle<promise_type> release() noexcept {
+        std::coroutine_handle<promise_type> h = handle;
+        handle = nullptr;
+        return h;
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle{};
+};
+
+
+// Description: Runs a task on its own on the current scheduler. Returns false if the task is empty (arena full) or the ready queue is full.
+inline bool spawn(Task task) noexcept {
+    bool ok = false;
+
+    if (task.valid()) {
+        std::coroutine_handle<Task::promise_type> h = task.release();
+        h.promise().detached = true;
+
+        if (Scheduler::current().schedule(h)) {
+            Scheduler::current().task_started();
+            ok = true;
+        }
+        else {
+            h.destroy();
+        }
+    }
+
+    return ok;
+}
+
+
+/* --------------------------------------------- AWAITABLES ---------------------------------------------*/
+
+// co_await sleep_until(t): resumes once CLOCK_MONOTONIC reaches t (nanoseconds).
+class SleepUntil {
+public:
+    explicit SleepUntil(int64_t deadline_ns) noexcept : deadline(deadline_ns) {}
+
+    bool await_ready() const noexcept { return deadline <= rt_now_ns(); }
+
+    bool await_suspend(std::coroutine_handle<> h) noexcept {
+        waiter.fire = &resume_waiter;
+        waiter.handle = h;
+
+        // If the timer can't be added don't suspend, better late than never woken up.
+        return Scheduler::current().add_timer(deadline, &waiter);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    int64_t deadline;
+    Waiter waiter{};
+};
+
+inline SleepUntil sleep_until(int64_t deadline_ns) noexcept {
+    return SleepUntil(deadline_ns);
+}
+
+
+// A one-shot signal between coroutines: one coroutine does co_await event.wait(), another calls event.set().
+class Event {
+public:
+    void set() noexcept {
+        if (waiter.handle) {
+            std::coroutine_handle<> h = waiter.handle;
+            waiter.handle = nullptr;
+            (void) Scheduler::current().schedule(h);
+        }
+        else {
+            is_set = true;
+        }
+    }
+
+    struct Awaiter {
+        Event &event;
+
+        bool await_ready() const noexcept { return event.is_set; }
+
+        void await_suspend(std::coroutine_handle<> h) noexcept { event.waiter.handle = h; }
+
+        void await_resume() const noexcept { event.is_set = false; }
+    };
+
+    Awaiter wait() noexcept { return Awaiter{*this}; }
+
+private:
+    Waiter waiter{};
+    bool is_set = false;
+};
+
+
+enum class Edge { Rising, Falling, Both };
+
+struct EdgeEvent {
+    int32_t value;      // Level after the edge
+    int64_t time_ns;    // CLOCK_MONOTONIC time the edge was seen
+};
+
+// An input pin. The pin must already be set up as an input (setup_gpio_pin). One coroutine at a time can wait on it.
+class Gpio {
+public:
+    explicit Gpio(int32_t gpio_pin, int64_t holdoff = GPIO_DEFAULT_HOLDOFF_NS) noexcept : pin(gpio_pin), holdoff_ns(holdoff) {
+        Buffer value_path;
+
+        io_waiter.fire = &on_io;
+        io_waiter.context = this;
+        sample_waiter.fire = &on_sample;
+        sample_waiter.context = this;
+
+        if (set_gpio_edge(pin, (BufferPointer) GPIO_EDGE_BOTH) == 1 &&
+            snprintf((char *) value_path, sizeof(value_path), GPIO_VALUE_PATH, pin) > 0) {
+            fd = open((char *) value_path, O_RDONLY | O_CLOEXEC);
+        }
+
+        level = read_level();
+
+        // Regular files (no edge support) can't go in epoll, those pins are sampled instead.
+        if (fd >= 0 && !Scheduler::current().watch_fd(fd, EPOLLPRI | EPOLLERR, &io_waiter)) {
+            (void) close(fd);
+            fd = -1;
+        }
+    }
+
+    ~Gpio() {
+        if (fd >= 0) {
+            Scheduler::current().unwatch_fd(fd);
+            (void) close(fd);
+        }
+    }
+
+    Gpio(const Gpio &) = delete;
+    Gpio &operator=(const Gpio &) = delete;
+
+    struct EdgeAwaiter {
+        Gpio &gpio;
+        Edge wanted;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h) noexcept {
+            gpio.waiting = h;
+            gpio.wanted = wanted;
+            if (gpio.fd < 0) {
+                (void) Scheduler::current().add_timer(rt_now_ns() + GPIO_SAMPLE_NS, &gpio.sample_waiter);
+            }
+        }
+
+        EdgeEvent await_resume() const noexcept { return gpio.last_event; }
+    };
+
+    // Description: co_await gpio.edge(Edge::Rising) resumes on the next rising edge and gives the EdgeEvent.
+    EdgeAwaiter edge(Edge wanted_edge) noexcept { return EdgeAwaiter{*this, wanted_edge}; }
+
+    int32_t value() const noexcept { return level; }
+
+    const int32_t pin;
+
+private:
+    int32_t read_level() const noexcept {
+        int32_t result = -1;
+
+        if (fd >= 0) {
+            char buff[2];
+            if (pread(fd, buff, sizeof(buff), 0) > 0) {
+                result = (buff[0] == '1') ? 1 : 0;
+            }
+        }
+        else {
+            result = read_gpio_value(pin);
+        }
+
+        return result;
+    }
+
+    // A new level was read: resume the waiting coroutine if it is the edge it wants (and we are out of the hold-off).
+    void new_level(int32_t new_value, int64_t now_ns) noexcept {
+        if (new_value >= 0 && new_value != level) {
+            level = new_value;
+
+            bool matches = (wanted == Edge::Both) || (wanted == Edge::Rising && level == 1) || (wanted == Edge::Falling && level == 0);
+
+            if (waiting && matches && (now_ns - last_event.time_ns) >= holdoff_ns) {
+                std::coroutine_handle<> h = waiting;
+                waiting = nullptr;
+                last_event.value = level;
+                last_event.time_ns = now_ns;
+                (void) Scheduler::current().schedule(h);
+            }
+        }
+    }
+
+    static void on_io(Waiter *w, uint32_t events) noexcept {
+        Gpio *g = static_cast<Gpio *>(w->context);
+        (void) events;
+        g->new_level(g->read_level(), rt_now_ns());
+    }
+
+    static void on_sample(Waiter *w, uint32_t events) noexcept {
+        Gpio *g = static_cast<Gpio *>(w->context);
+        (void) events;
+        g->new_level(g->read_level(), rt_now_ns());
+
+        if (g->waiting) {
+            (void) Scheduler::current().add_timer(rt_now_ns() + GPIO_SAMPLE_NS, &g->sample_waiter);
+        }
+    }
+
+    int64_t holdoff_ns;
+    int32_t fd = -1;
+    int32_t level = -1;
+    Edge wanted = Edge::Both;
+    std::coroutine_handle<> waiting{};
+    EdgeEvent last_event{ -1, INT64_MIN / 2 };
+    Waiter io_waiter{};
+    Waiter sample_waiter{};
+};
+
+
+// A PWM channel that has already been set up with setup_pwm.
+class Pwm {
+public:
+    Pwm(const char *pin_identifier, int32_t frequency_hz) noexcept : frequency(frequency_hz) {
+        id[0] = (uint8_t) pin_identifier[0];
+        id[1] = (uint8_t) pin_identifier[1];
+        id[2] = 0U;
+    }
+
+    void set_duty(float32_t duty_percent) noexcept { set_pwm_duty_cycle(id, frequency, duty_percent); }
+
+    // Description: co_await pwm.ramp(from, to, duration, steps) moves the duty cycle from one percentage to another in
+    // equal steps, each on an absolute deadline, and resumes when the last step has been written.
+    Task ramp(float32_t from_percent, float32_t to_percent, int64_t duration_ns, int32_t steps) {
+        int64_t start_ns = rt_now_ns();
+
+        if (steps < 1) {
+            steps = 1;
+        }
+
+        for (int32_t i = 0; i <= steps; i++) {
+            co_await sleep_until(start_ns + ((duration_ns * i) / steps));
+            set_duty(from_percent + (((to_percent - from_percent) * (float32_t) i) / (float32_t) steps));
+        }
+    }
+
+private:
+    uint8_t id[FILE_PATH_LENGTH]{};
+    int32_t frequency;
+};
+
+} // namespace bbbio
+
+#endif // End of include guard
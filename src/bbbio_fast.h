@@ -0,0 +1,249 @@
+/*
+This file is for defining the fast path of bbbio: GPIO values and PWM duty cycles written and read through handles that
+keep the sysfs file open, with the read / write functions inlined into the caller.
+
+A call of the regular API (write_gpio_value, set_pwm_duty_cycle) formats a path with snprintf, compares the PWM pin
+identifier character by character, formats the value with snprintf, then opens, writes and closes the file through stdio,
+all behind two or three calls that can't be inlined from another file. The handles do all of that once:
+- open_gpio_handle / open_pwm_handle resolve the pin and open its files. The PWM identifier becomes a table index with
+  plain arithmetic (pwm_channel_index), without a branch per identifier. open_pwm_channel sets a PWM channel up and
+  opens its handle in one call, for the modules that keep a channel for themselves.
+- write_gpio_fast, read_gpio_fast, write_pwm_duty_fast, write_pwm_period_fast and write_pwm_enable_fast are static
+  inline: one pwrite / pread on the open file, with integers formatted two digits at a time from a table
+  (format_decimal) instead of snprintf.
+
+The GPIO I/O hook (set_gpio_io_hook) runs on the fast path too, and failed GPIO writes are counted with the others
+(get_gpio_write_failures). There are no USDT probes on it.
+
+Sources:
+https://man7.org/linux/man-pages/man2/pwrite.2.html
+https://www.kernel.org/doc/Documentation/gpio/sysfs.txt ("value" can be written and read repeatedly while it is open)
+*/
+
+#ifndef BBBIO_FAST_H
+#define BBBIO_FAST_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "bbbio.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// pwm_channel_index of "1A", "1B", "2A" and "2B" are 0 to 3, anything else is PWM_CHANNEL_INVALID.
+#define PWM_CHANNEL_COUNT ((int32_t) 4)
+
+#define PWM_CHANNEL_INVALID PWM_CHANNEL_COUNT
+
+// Longest decimal uint32_t.
+#define DECIMAL_MAX_DIGITS ((int32_t) 10)
+
+
+typedef struct {
+    int32_t fd;             // value file, -1 when closed
+    int32_t bank;           // For the GPIO I/O hook
+    uint32_t mask;
+} GpioHandle;
+
+typedef struct {
+    int32_t period_fd;      // -1 when closed
+    int32_t duty_fd;
+    int32_t enable_fd;
+} PwmHandle;
+
+// "00" "01" ... "99", defined in bbbio.c.
+extern const uint8_t decimal_digit_pairs[200];
+
+// State of bbbio read by the inline functions. Use set_gpio_io_hook and get_gpio_write_failures, not these.
+extern GpioIoHook bbbio_gpio_io_hook;
+
+extern uint32_t bbbio_gpio_write_failures;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Opens the value file of a GPIO pin for write_gpio_fast / read_gpio_fast. The pin must already be set up
+// (setup_gpio_pin).
+// Parameters:
+// pin    - The GPIO pin number
+// handle - The handle
+// Returns - 1 on success, 0 on failure (handle->fd is -1).
+int32_t open_gpio_handle(int32_t pin, GpioHandle *handle);
+
+
+// Description: Closes a GPIO handle (does nothing if it is closed).
+// Parameters: handle - The handle
+void close_gpio_handle(GpioHandle *handle);
+
+
+// Description: Opens the period, duty_cycle and enable files of a PWM channel for write_pwm_period_fast,
+// write_pwm_duty_fast and write_pwm_enable_fast. The channel must already be set up (setup_pwm or prepare_pwm).
+// Parameters:
+// pin_identifier - The pin identifier for the PWM channel (e.g. "1A", "1B", "2A", "2B")
+// handle         - The handle
+// Returns - 1 on success, 0 on failure (unknown identifier or the files can't be opened, all fds are -1).
+int32_t open_pwm_handle(Buffer pin_identifier, PwmHandle *handle);
+
+
+// Description: Sets up a PWM channel (prepare_pwm), opens its handle and then enables or disables it through the handle.
+// Parameters:
+// pin_identifier - The pin identifier for the PWM channel (e.g. "1A", "1B", "2A", "2B")
+// frequency      - Frequency in Hz
+// duty_percent   - Duty cycle percentage (must be > 0 and <= 100)
+// enable         - PWM_ON to start the output right away, PWM_OFF to leave it silent
+// handle         - The handle
+// Returns - 1 on success, 0 on failure (all fds are -1).
+int32_t open_pwm_channel(Buffer pin_identifier, int32_t frequency, float32_t duty_percent, int32_t enable, PwmHandle *handle);
+
+
+// Description: Closes a PWM handle (does nothing if it is closed).
+// Parameters: handle - The handle
+void close_pwm_handle(PwmHandle *handle);
+
+
+// Description: Marks a PWM handle closed without opening anything, for a simulated channel.
+// Parameters: handle - The handle
+static inline void clear_pwm_handle(PwmHandle *handle) {
+    handle->period_fd = -1;
+    handle->duty_fd = -1;
+    handle->enable_fd = -1;
+}
+
+
+// Description: Period that bbbio writes for a frequency (setup_pwm, set_pwm_frequency, open_pwm_channel).
+// Parameters: frequency - Frequency in Hz (> 0)
+// Returns - Period in nanoseconds.
+static inline uint32_t pwm_period_ns(int32_t frequency) {
+    return (uint32_t) (1000000000.0f / (float32_t) frequency);
+}
+
+
+// Description: Finds the channel of a PWM pin identifier without branching on it.
+// Parameters: pin_identifier - "1A", "1B", "2A" or "2B" (at least 2 readable bytes)
+// Returns - 0 to 3, or PWM_CHANNEL_INVALID.
+static inline int32_t pwm_channel_index(const uint8_t *pin_identifier) {
+    uint32_t module = (uint32_t) pin_identifier[0] - (uint32_t) '1';
+    uint32_t output = (uint32_t) pin_identifier[1] - (uint32_t) 'A';
+    uint32_t valid = (uint32_t) (module < 2U) & (uint32_t) (output < 2U);
+
+    // All ones when valid and all zeros when not, to pick the index or PWM_CHANNEL_INVALID.
+    return (int32_t) ((((module << 1) | output) & (0U - valid)) | ((uint32_t) PWM_CHANNEL_INVALID & (valid - 1U)));
+}
+
+
+// Description: Formats an unsigned integer in decimal, two digits per division. No terminator is written.
+// Parameters:
+// value - The value
+// out   - Where the digits are stored (at least DECIMAL_MAX_DIGITS bytes)
+// Returns - Number of digits stored.
+static inline int32_t format_decimal(uint32_t value, uint8_t *out) {
+    uint8_t digits[DECIMAL_MAX_DIGITS];
+    int32_t position = DECIMAL_MAX_DIGITS;
+    uint32_t rest = value;
+
+    while (rest >= 100U) {
+        uint32_t pair = (rest % 100U) * 2U;
+
+        rest /= 100U;
+        position -= 2;
+        digits[position] = decimal_digit_pairs[pair];
+        digits[position + 1] = decimal_digit_pairs[pair + 1U];
+    }
+    if (rest >= 10U) {
+        position -= 2;
+        digits[position] = decimal_digit_pairs[rest * 2U];
+        digits[position + 1] = decimal_digit_pairs[(rest * 2U) + 1U];
+    }
+    else {
+        position--;
+        digits[position] = (uint8_t) ('0' + rest);
+    }
+    (void) memcpy(out, &digits[position], (size_t) (DECIMAL_MAX_DIGITS - position));
+
+    return DECIMAL_MAX_DIGITS - position;
+}
+
+
+// Description: Writes a value to a GPIO pin through its handle.
+// Parameters:
+// handle - From open_gpio_handle
+// value  - 0 for off, anything else for on
+// Returns - 1 on success, 0 on failure.
+static inline int32_t write_gpio_fast(const GpioHandle *handle, int32_t value) {
+    int32_t result = 0;
+    uint8_t level = (uint8_t) ((uint32_t) '0' + (uint32_t) (value != 0));
+
+    if (__builtin_expect(bbbio_gpio_io_hook == NULL, 1) || run_gpio_io_hook(GPIO_IO_VALUE_WRITE, handle->bank, handle->mask) == 0) {
+        result = (int32_t) (pwrite(handle->fd, &level, 1U, 0) == 1);
+    }
+    if (result != 1) {
+        (void) __atomic_fetch_add(&bbbio_gpio_write_failures, 1U, __ATOMIC_RELAXED);
+    }
+
+    return result;
+}
+
+
+// Description: Reads the value of a GPIO pin through its handle.
+// Parameters: handle - From open_gpio_handle
+// Returns - 1 or 0, -1 on failure.
+static inline int32_t read_gpio_fast(const GpioHandle *handle) {
+    int32_t result = -1;
+    uint8_t text[2];
+
+    if ((__builtin_expect(bbbio_gpio_io_hook == NULL, 1) || run_gpio_io_hook(GPIO_IO_VALUE_READ, handle->bank, handle->mask) == 0) &&
+        pread(handle->fd, text, sizeof(text), 0) > 0) {
+        uint32_t level = (uint32_t) text[0] - (uint32_t) '0';
+
+        result = (level <= 1U) ? (int32_t) level : -1;
+    }
+
+    return result;
+}
+
+
+// Writes a value as decimal text to an open sysfs attribute. Returns 1 on success.
+static inline int32_t write_decimal_fast(int32_t fd, uint32_t value) {
+    uint8_t text[DECIMAL_MAX_DIGITS];
+    int32_t length = format_decimal(value, text);
+
+    return (int32_t) (pwrite(fd, text, (size_t) length, 0) == (ssize_t) length);
+}
+
+
+// Description: Writes the duty cycle of a PWM channel through its handle. The kernel refuses a duty cycle longer than
+// the period.
+// Parameters:
+// handle  - From open_pwm_handle
+// duty_ns - Duty cycle in nanoseconds
+// Returns - 1 on success, 0 on failure.
+static inline int32_t write_pwm_duty_fast(const PwmHandle *handle, uint32_t duty_ns) {
+    return write_decimal_fast(handle->duty_fd, duty_ns);
+}
+
+
+// Description: Writes the period of a PWM channel through its handle. The kernel refuses a period shorter than the duty
+// cycle, so shorten the duty cycle first.
+// Parameters:
+// handle    - From open_pwm_handle
+// period_ns - Period in nanoseconds
+// Returns - 1 on success, 0 on failure.
+static inline int32_t write_pwm_period_fast(const PwmHandle *handle, uint32_t period_ns) {
+    return write_decimal_fast(handle->period_fd, period_ns);
+}
+
+
+// Description: Enables or disables a PWM channel through its handle.
+// Parameters:
+// handle - From open_pwm_handle
+// value  - PWM_OFF to disable, anything else to enable
+// Returns - 1 on success, 0 on failure.
+static inline int32_t write_pwm_enable_fast(const PwmHandle *handle, int32_t value) {
+    uint8_t level = (uint8_t) ((uint32_t) '0' + (uint32_t) (value != PWM_OFF));
+
+    return (int32_t) (pwrite(handle->enable_fd, &level, 1U, 0) == 1);
+}
+
+
+#endif // End of include guard
@@ -0,0 +1,2247 @@
+/*
+This file is the benchmark program for bbbio and the modules built on it.
+Each benchmark is a function in the table at the bottom. Run "./bench" to list them, "./bench <name>" to run one or
+"./bench all" to run everything. They only need a backend that works on the machine, so they run on any Linux box.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "rtutil.h"
+#include "edgescan.h"
+#include "gpiobank.h"
+#include "deferred.h"
+#include "spi.h"
+#include "i2c.h"
+#include "alarm.h"
+#include "photogate.h"
+#include "journal.h"
+#include "fault.h"
+#include "waveform.h"
+#include "control.h"
+#include "perfstat.h"
+#include "tracemark.h"
+#include "probes.h"
+#include "onewire.h"
+#include "keypad.h"
+#include "pwmbox.h"
+#include "bbbio_fast.h"
+#include "swcore.h"
+#include "sequencer.h"
+
+
+typedef struct {
+    const char *name;
+    const char *description;
+    int32_t (*run)(void);
+} Benchmark;
+
+
+/// ----------- EDGE EXTRACTION ----------- ///
+
+#define EDGE_BENCH_SAMPLES ((int32_t) (8 * 1024 * 1024))
+
+#define EDGE_BENCH_REPEATS ((int32_t) 5)
+
+// Fills the capture with a bank value that changes every "spacing" samples (and a few bits flip at once).
+static void fill_capture(uint32_t *samples, int32_t count, int32_t spacing) {
+    uint32_t value = 0x5A5A0000U;
+    uint32_t lfsr = 0xACE1U;
+    int32_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        if ((i % spacing) == 0) {
+            lfsr = (lfsr >> 1U) ^ ((uint32_t) (-(int32_t) (lfsr & 1U)) & 0xB400U);
+            value ^= (lfsr | 1U);
+        }
+        samples[i] = value;
+    }
+}
+
+
+// Scans the whole capture in one call and returns the best time over a few runs. Also returns a checksum of the output.
+static int64_t time_scan(const uint32_t *samples, int32_t count, EdgeRecord *out, int32_t *records, uint32_t *checksum) {
+    int64_t best_ns = INT64_MAX;
+    int32_t r = 0;
+
+    for (r = 0; r < EDGE_BENCH_REPEATS; r++) {
+        EdgeScanState state;
+        int32_t consumed = 0;
+        int64_t start_ns = 0;
+        int64_t elapsed_ns = 0;
+
+        edge_scan_init(&state, samples[0]);
+        start_ns = rt_now_ns();
+        *records = edge_scan(&state, samples, count, out, count, &consumed);
+        elapsed_ns = rt_now_ns() - start_ns;
+
+        if (elapsed_ns < best_ns) {
+            best_ns = elapsed_ns;
+        }
+    }
+
+    *checksum = 0U;
+    for (r = 0; r < *records; r++) {
+        *checksum = (*checksum * 31U) + out[r].index + out[r].changed;
+    }
+
+    return best_ns;
+}
+
+
+static int32_t bench_edges(void) {
+    static const int32_t kernels[4] = { EDGE_KERNEL_SCALAR, EDGE_KERNEL_SSE2, EDGE_KERNEL_AVX2, EDGE_KERNEL_NEON };
+    static const int32_t spacings[3] = { 4096, 64, 4 };
+    int32_t result = 0;
+    uint32_t *samples = (uint32_t *) malloc((size_t) EDGE_BENCH_SAMPLES * sizeof(uint32_t));
+    EdgeRecord *out = (EdgeRecord *) malloc((size_t) EDGE_BENCH_SAMPLES * sizeof(EdgeRecord));
+    int32_t s = 0;
+    int32_t k = 0;
+
+    if (samples == NULL || out == NULL) {
+        (void) printf("edges: out of memory\n");
+        result = 1;
+    }
+    else {
+        (void) printf("Edge extraction, %d samples (%d MB) per run\n", EDGE_BENCH_SAMPLES, (int32_t) ((EDGE_BENCH_SAMPLES * 4) / (1024 * 1024)));
+        (void) printf("  kernel   edge every   records     time(ms)   GB/s     output\n");
+
+        for (s = 0; s < 3; s++) {
+            int32_t reference_records = -1;
+            uint32_t reference_checksum = 0U;
+
+            fill_capture(samples, EDGE_BENCH_SAMPLES, spacings[s]);
+
+            for (k = 0; k < 4; k++) {
+                if (edge_scan_set_kernel(kernels[k]) == 1) {
+                    int32_t records = 0;
+                    uint32_t checksum = 0U;
+                    int64_t ns = time_scan(samples, EDGE_BENCH_SAMPLES, out, &records, &checksum);
+                    double gbps = ((double) EDGE_BENCH_SAMPLES * 4.0) / (double) ns;
+                    const char *verdict = "ok";
+
+                    // The scalar kernel runs first and every other kernel has to match it exactly.
+                    if (reference_records < 0) {
+                        reference_records = records;
+                        reference_checksum = checksum;
+                        verdict = "reference";
+                    }
+                    else if (records != reference_records || checksum != reference_checksum) {
+                        verdict = "MISMATCH";
+                        result = 1;
+                    }
+                    else {
+                    }
+
+                    (void) printf("  %-8s %-12d %-11d %-10.3f %-8.2f %s\n",
+                                  edge_scan_kernel_name(kernels[k]), spacings[s], records, (double) ns / 1e6, gbps, verdict);
+                }
+            }
+        }
+
+        (void) edge_scan_set_kernel(EDGE_KERNEL_BEST);
+    }
+
+    free(samples);
+    free(out);
+
+    return result;
+}
+
+
+/// ----------- DEFERRED WRITES ----------- ///
+
+#define DEFERRED_BENCH_POSTS ((int32_t) 1000000)
+
+// Status LED style load: a few pins of bank 1 toggled from a fast loop, flushed every 5 ms on the sim backend.
+static int32_t bench_deferred(void) {
+    int32_t result = 0;
+    int32_t i = 0;
+
+    if (gpio_bank_open(GPIO_BACKEND_SIM) != 1 || deferred_start(DEFERRED_DEFAULT_PERIOD_NS, RT_PRIORITY_NONE) != 1) {
+        (void) printf("deferred: could not start the flusher\n");
+        result = 1;
+    }
+    else {
+        int64_t start_ns = rt_now_ns();
+
+        for (i = 0; i < DEFERRED_BENCH_POSTS; i++) {
+            (void) deferred_gpio_write(GPIO_PINS_PER_BANK + (i % 4), i & 1);
+        }
+
+        int64_t post_ns = rt_now_ns() - start_ns;
+
+        deferred_stop();
+        (void) printf("Deferred writes, %d posts over 4 pins: %.1f ns per post\n", DEFERRED_BENCH_POSTS, (double) post_ns / (double) DEFERRED_BENCH_POSTS);
+        deferred_print_stats();
+        gpio_bank_close();
+    }
+
+    return result;
+}
+
+
+/// ----------- SPI FRAMES ----------- ///
+
+#define SPI_BENCH_FRAMES ((int32_t) 100000)
+
+#define SPI_BENCH_SPEED_HZ ((uint32_t) 10000000)
+
+// A MAX7219 style 8 digit display: 8 register writes of 2 bytes, each latched by chip select, one ioctl per refresh.
+#define SPI_BENCH_DIGITS ((uint32_t) 8)
+
+static int32_t run_spi_frames(int32_t handle, int32_t frames) {
+    int32_t result = 0;
+    SpiFrame frame;
+    int32_t i = 0;
+    uint32_t digit = 0U;
+
+    if (spi_frame_init(&frame, SPI_BENCH_DIGITS * 2U, 2U) == 1) {
+        for (i = 0; i < frames && result == 0; i++) {
+            uint8_t *back = spi_frame_back(&frame);
+
+            for (digit = 0U; digit < SPI_BENCH_DIGITS; digit++) {
+                back[digit * 2U] = (uint8_t) (digit + 1U);
+                back[(digit * 2U) + 1U] = (uint8_t) ((i >> (digit * 4U)) & 0xF);
+            }
+
+            if (spi_frame_commit(handle, &frame) != 1) {
+                result = 1;
+            }
+        }
+    }
+    else {
+        result = 1;
+    }
+
+    return result;
+}
+
+static int32_t bench_spi(void) {
+    int32_t result = 0;
+    int32_t handle = -1;
+    SpiSimRecord record;
+
+    spi_use_simulator(1);
+    handle = spi_open(1, 0, 0U, SPI_BENCH_SPEED_HZ);
+
+    if (handle < 0 || run_spi_frames(handle, SPI_BENCH_FRAMES) != 0) {
+        (void) printf("spi: simulated device failed\n");
+        result = 1;
+    }
+    else {
+        // The last segment recorded is the last digit of the last frame.
+        if (spi_sim_get_record(0, &record) != 1 || record.len != 2U || record.data[0] != (uint8_t) SPI_BENCH_DIGITS ||
+            record.data[1] != (uint8_t) (((SPI_BENCH_FRAMES - 1) >> ((SPI_BENCH_DIGITS - 1U) * 4U)) & 0xF)) {
+            (void) printf("spi: simulated device recorded the wrong data\n");
+            result = 1;
+        }
+        (void) printf("SPI, %d frames of %u bytes (%u latched segments):\n", SPI_BENCH_FRAMES, SPI_BENCH_DIGITS * 2U, SPI_BENCH_DIGITS);
+        spi_print_stats(handle);
+    }
+    spi_close(handle);
+
+    // The real device too, if there is one.
+    spi_use_simulator(0);
+    handle = spi_open(1, 0, 0U, SPI_BENCH_SPEED_HZ);
+    if (handle >= 0) {
+        if (run_spi_frames(handle, SPI_BENCH_FRAMES / 100) != 0) {
+            result = 1;
+        }
+        spi_print_stats(handle);
+        spi_close(handle);
+    }
+    else {
+        (void) printf("(no " SPI_DEV_PATH " device, only the simulator was measured)\n", 1, 0);
+    }
+
+    return result;
+}
+
+
+/// ----------- I2C TRANSACTIONS ----------- ///
+
+#define I2C_BENCH_ROUNDS ((int32_t) 200000)
+
+#define I2C_BENCH_ADDR ((uint8_t) 0x68)
+
+// IMU style register map: a config register, 6 bytes of sample data and a clear-on-write interrupt status.
+#define I2C_BENCH_CONFIG_REG ((uint8_t) 0x1A)
+
+#define I2C_BENCH_STATUS_REG ((uint8_t) 0x3A)
+
+#define I2C_BENCH_DATA_REG ((uint8_t) 0x3B)
+
+#define I2C_BENCH_DATA_LEN ((int32_t) 6)
+
+// Every round rewrites the config register (changing it only every 4th round) and burst reads the sample data. The
+// data and the status register are volatile, every 8th round clears the status and one round in 64 forces the config
+// write although the value didn't change.
+static int32_t bench_i2c(void) {
+    int32_t result = 0;
+    int32_t handle = -1;
+    int32_t i = 0;
+    uint8_t data[I2C_BENCH_DATA_LEN];
+    uint8_t value = 0U;
+
+    i2c_use_simulator(1);
+    (void) i2c_sim_attach(1, I2C_BENCH_ADDR);
+    for (i = 0; i < I2C_BENCH_DATA_LEN; i++) {
+        (void) i2c_sim_set_reg(1, I2C_BENCH_ADDR, (uint8_t) (I2C_BENCH_DATA_REG + (uint8_t) i), (uint8_t) (0xA0 + i));
+    }
+
+    handle = i2c_open(1, I2C_BENCH_ADDR);
+    if (handle < 0 || i2c_set_volatile(handle, I2C_BENCH_STATUS_REG, 1 + I2C_BENCH_DATA_LEN) != 1) {
+        (void) printf("i2c: could not open the simulated device\n");
+        result = 1;
+    }
+
+    for (i = 0; i < I2C_BENCH_ROUNDS && result == 0; i++) {
+        uint8_t config = (uint8_t) ((i / 4) & 0x7);
+
+        if (((i % 64) == 1 ? i2c_write_regs_force(handle, I2C_BENCH_CONFIG_REG, &config, 1) : i2c_write_reg(handle, I2C_BENCH_CONFIG_REG, config)) != 1 ||
+            ((i % 8) == 0 && i2c_write_reg(handle, I2C_BENCH_STATUS_REG, 0x01U) != 1) ||
+            i2c_read_regs(handle, I2C_BENCH_DATA_REG, data, I2C_BENCH_DATA_LEN) != 1 || data[5] != 0xA5U) {
+            (void) printf("i2c: transaction %d failed\n", i);
+            result = 1;
+        }
+    }
+
+    if (result == 0) {
+        // A read per round, a config write every 4th (when it changes) plus the forced ones (it didn't change), and
+        // every status write although its value never changes.
+        uint64_t expected = (uint64_t) (I2C_BENCH_ROUNDS + (I2C_BENCH_ROUNDS / 4) + (I2C_BENCH_ROUNDS / 64) + (I2C_BENCH_ROUNDS / 8));
+        I2cStats stats;
+
+        i2c_get_stats(handle, &stats);
+        (void) i2c_sim_get_reg(1, I2C_BENCH_ADDR, I2C_BENCH_CONFIG_REG, &value);
+        (void) printf("I2C, %d rounds of one config write and one %d byte burst read, status cleared every 8th (device has config 0x%02x):\n",
+                      I2C_BENCH_ROUNDS, I2C_BENCH_DATA_LEN, value);
+        i2c_print_stats(handle);
+        if (stats.transactions != expected) {
+            (void) printf("i2c: %llu transactions, %llu expected\n", (unsigned long long) stats.transactions, (unsigned long long) expected);
+            result = 1;
+        }
+    }
+    i2c_close(handle);
+
+    return result;
+}
+
+
+/// ----------- ALARM ONSET ----------- ///
+
+#define ALARM_BENCH_COUNT ((int32_t) 200)
+
+#define ALARM_BENCH_PERIOD_NS ((int64_t) (2 * NS_PER_MS))
+
+// Countdown style alarms on absolute deadlines, without a buzzer, once per wait method.
+static int32_t bench_alarm(void) {
+    int32_t result = 0;
+    const int32_t methods[2] = { ALARM_WAIT_TIMERFD, ALARM_WAIT_NANOSLEEP };
+    int32_t m = 0;
+    int32_t i = 0;
+    Alarm alarm;
+
+    for (m = 0; m < 2 && result == 0; m++) {
+        if (alarm_init(&alarm, methods[m]) != 1) {
+            (void) printf("alarm: could not create the timer\n");
+            result = 1;
+        }
+        else {
+            int64_t deadline_ns = rt_now_ns();
+
+            for (i = 0; i < ALARM_BENCH_COUNT; i++) {
+                deadline_ns += ALARM_BENCH_PERIOD_NS;
+                (void) alarm_fire_at(&alarm, deadline_ns);
+            }
+            alarm_print_report(&alarm);
+            alarm_close(&alarm);
+        }
+    }
+
+    return result;
+}
+
+
+/// ----------- PHOTOGATE ----------- ///
+
+// Start, one split and stop gate on bank 1 (P9_12, P9_15, P9_23).
+#define GATE_BENCH_PINS { 60, 48, 49 }
+
+#define GATE_BENCH_SPLIT_NS ((int64_t) (30 * NS_PER_MS))
+
+#define GATE_BENCH_STOP_NS ((int64_t) (70 * NS_PER_MS))
+
+#define GATE_BENCH_BREAK_NS ((int64_t) (5 * NS_PER_MS))
+
+// Breaks the beam of a simulated gate, with some contact-like bounce before it settles. Returns when the beam broke.
+static int64_t sim_break_beam(int32_t pin, int64_t at_ns) {
+    uint32_t bit = GPIO_BIT_OF(pin);
+    int64_t broke_ns = 0;
+
+    rt_sleep_until_ns(at_ns);
+    gpio_bank_sim_set(GPIO_BANK_OF(pin), bit, bit);
+    broke_ns = rt_now_ns();
+    rt_sleep_until_ns(at_ns + (2 * PHOTOGATE_DEFAULT_MIN_BREAK_NS));
+    gpio_bank_sim_set(GPIO_BANK_OF(pin), bit, 0U);
+    rt_sleep_until_ns(at_ns + (3 * PHOTOGATE_DEFAULT_MIN_BREAK_NS));
+    gpio_bank_sim_set(GPIO_BANK_OF(pin), bit, bit);
+    rt_sleep_until_ns(at_ns + GATE_BENCH_BREAK_NS);
+    gpio_bank_sim_set(GPIO_BANK_OF(pin), bit, 0U);
+
+    return broke_ns;
+}
+
+static int32_t bench_photogate(void) {
+    int32_t result = 0;
+    const int32_t pins[3] = GATE_BENCH_PINS;
+    PhotogateConfig config;
+    PhotogateRun run;
+    Photogate gate;
+    int32_t i = 0;
+    uint32_t probe = 0U;
+
+    photogate_default_config(&config);
+    for (i = 0; i < 3; i++) {
+        config.pins[i] = pins[i];
+    }
+    config.count = 3;
+    // The SIM backend has no edge interrupts, the simulated run goes through the sampler.
+    config.mode = PHOTOGATE_MODE_SAMPLED;
+
+    // Simulated run with a known start, split and stop, plus a glitch (shorter than the minimum break) on the start gate first.
+    if (gpio_bank_open(GPIO_BACKEND_SIM) != 1 || photogate_start(&gate, &config, RT_PRIORITY_NONE) != 1) {
+        (void) printf("photogate: could not start the sampler\n");
+        result = 1;
+    }
+    else {
+        int64_t base_ns = rt_now_ns() + (10 * NS_PER_MS);
+        int64_t start_ns = 0;
+        int64_t split_ns = 0;
+        int64_t stop_ns = 0;
+
+        gpio_bank_sim_set(GPIO_BANK_OF(pins[0]), GPIO_BIT_OF(pins[0]), GPIO_BIT_OF(pins[0]));
+        rt_sleep_until_ns(rt_now_ns() + (PHOTOGATE_DEFAULT_MIN_BREAK_NS / 2));
+        gpio_bank_sim_set(GPIO_BANK_OF(pins[0]), GPIO_BIT_OF(pins[0]), 0U);
+
+        start_ns = sim_break_beam(pins[0], base_ns);
+        split_ns = sim_break_beam(pins[1], base_ns + GATE_BENCH_SPLIT_NS);
+        stop_ns = sim_break_beam(pins[2], base_ns + GATE_BENCH_STOP_NS);
+
+        if (photogate_wait_run(&gate, &run, 1000) != 1) {
+            (void) printf("photogate: the simulated run was not detected\n");
+            result = 1;
+        }
+        else {
+            (void) printf("Photogate, simulated run (true split %.6f s, true stop %.6f s):\n",
+                          (double) (split_ns - start_ns) / (double) NS_PER_SEC, (double) (stop_ns - start_ns) / (double) NS_PER_SEC);
+            photogate_print_run(&run);
+            (void) printf("  errors: split %+.1f us, stop %+.1f us\n",
+                          (double) (photogate_elapsed_ns(&run, 1) - (split_ns - start_ns)) / 1e3,
+                          (double) (photogate_elapsed_ns(&run, 2) - (stop_ns - start_ns)) / 1e3);
+        }
+        photogate_print_resolution(&gate);
+        photogate_stop(&gate);
+    }
+
+    // The real gates: only the resolution and the wakeups, there is nobody to break the beams.
+    if (gpio_bank_open(GPIO_BACKEND_MMAP) == 1 && gpio_bank_read(GPIO_BANK_OF(pins[0]), GPIO_BIT_OF(pins[0]), &probe) == 1 &&
+        photogate_start(&gate, &config, RT_PRIORITY_NONE) == 1) {
+        rt_sleep_until_ns(rt_now_ns() + (200 * NS_PER_MS));
+        photogate_stop(&gate);
+        photogate_print_resolution(&gate);
+    }
+    else {
+        (void) printf("(mmap sampler not usable here)\n");
+    }
+    gpio_bank_close();
+
+    config.mode = PHOTOGATE_MODE_EDGES;
+    if (photogate_start(&gate, &config, RT_PRIORITY_NONE) == 1) {
+        rt_sleep_until_ns(rt_now_ns() + (200 * NS_PER_MS));
+        photogate_print_resolution(&gate);
+        photogate_stop(&gate);
+    }
+    else {
+        (void) printf("(edge interrupts not usable here)\n");
+    }
+
+    return result;
+}
+
+
+/// ----------- SESSION JOURNAL ----------- ///
+
+#define JOURNAL_BENCH_APPENDS ((int32_t) 200000)
+
+// Appends between two journal_sync calls, like a periodic sync from another thread would leave.
+#define JOURNAL_BENCH_SYNC_EVERY ((int32_t) 256)
+
+// Appends into a throwaway journal under /tmp. The worst case is an append that had to start a new segment.
+static int32_t bench_journal(void) {
+    int32_t result = 0;
+    char dir[] = "/tmp/bbbio-journal-XXXXXX";
+    Journal journal;
+    int64_t worst_ns = 0;
+    int64_t total_ns = 0;
+    int64_t rotation_ns = 0;
+    uint64_t rotations = 0U;
+    int32_t i = 0;
+
+    if (mkdtemp(dir) == NULL || journal_open(&journal, dir) != 1) {
+        (void) printf("journal: could not create a journal in /tmp\n");
+        result = 1;
+    }
+    else {
+        for (i = 0; i < JOURNAL_BENCH_APPENDS && result == 0; i++) {
+            int64_t start_ns = rt_now_ns();
+
+            if (journal_append(&journal, (uint16_t) (JOURNAL_EVENT_START + (i % 4)), (int64_t) i * NS_PER_MS, 60) != 1) {
+                result = 1;
+            }
+            start_ns = rt_now_ns() - start_ns;
+
+            // Appends that started a new segment are the slow path, keep them apart.
+            if (journal.rotations != rotations) {
+                rotations = journal.rotations;
+                rotation_ns += start_ns;
+                if (start_ns > worst_ns) {
+                    worst_ns = start_ns;
+                }
+            }
+            else {
+                total_ns += start_ns;
+            }
+
+            if ((i % JOURNAL_BENCH_SYNC_EVERY) == 0) {
+                journal_sync(&journal);
+            }
+        }
+
+        (void) printf("Journal, %d appends of %d byte records:\n", JOURNAL_BENCH_APPENDS, (int32_t) sizeof(JournalRecord));
+        (void) printf("  in segment: avg %.1f ns per append\n", (double) total_ns / (double) (JOURNAL_BENCH_APPENDS - (int32_t) rotations));
+        (void) printf("  %llu segment rotations (%llu without a spare): avg %.1f us, worst %.1f us\n", (unsigned long long) rotations,
+                      (unsigned long long) journal.late_rotations,
+                      (rotations > 0U) ? ((double) rotation_ns / (1e3 * (double) rotations)) : 0.0, (double) worst_ns / 1e3);
+        if (journal.late_rotations != 0U) {
+            result = 1;
+        }
+        journal_close(&journal);
+        (void) printf("  (left in %s, try ./journalq %s)\n", dir, dir);
+    }
+
+    return result;
+}
+
+
+/// ----------- FAULT INJECTION ----------- ///
+
+// The stopwatch's button path on the SIM backend: a button thread samples the button every ms and updates an LED on a
+// press, while a timer thread runs every 10 ms. Presses come every 20 ms. Same deadlines as the stopwatch.
+#define FAULT_BENCH_BUTTON_PIN ((int32_t) 60)
+
+#define FAULT_BENCH_LED_PIN ((int32_t) 48)
+
+#define FAULT_BENCH_PRESSES ((int32_t) 50)
+
+#define FAULT_BENCH_PRESS_PERIOD_NS ((int64_t) (20 * NS_PER_MS))
+
+#define FAULT_BENCH_DEADLINE_NS ((int64_t) (10 * NS_PER_MS))
+
+typedef struct {
+    _Atomic int64_t press_ns;       // When the current press started, 0 when released
+    _Atomic int32_t stop;
+    uint32_t presses;
+    uint32_t press_misses;
+    uint32_t failed_ops;
+    int64_t sum_latency_ns;
+    int64_t max_latency_ns;
+    uint32_t timer_runs;
+    uint32_t timer_misses;
+    int64_t max_timer_late_ns;
+} FaultBench;
+
+static void *fault_button_thread(void *arg) {
+    FaultBench *b = (FaultBench *) arg;
+    int64_t next_ns = rt_now_ns();
+    uint32_t last = 0U;
+    uint32_t level = 0U;
+
+    while (atomic_load(&b->stop) == 0) {
+        if (gpio_bank_read(GPIO_BANK_OF(FAULT_BENCH_BUTTON_PIN), GPIO_BIT_OF(FAULT_BENCH_BUTTON_PIN), &level) != 1) {
+            b->failed_ops++;
+        }
+        else {
+            if (level != 0U && last == 0U) {
+                int64_t latency_ns = 0;
+
+                if (gpio_bank_write(GPIO_BANK_OF(FAULT_BENCH_LED_PIN), GPIO_BIT_OF(FAULT_BENCH_LED_PIN), GPIO_BIT_OF(FAULT_BENCH_LED_PIN)) != 1) {
+                    b->failed_ops++;
+                }
+                latency_ns = rt_now_ns() - atomic_load(&b->press_ns);
+                b->presses++;
+                b->sum_latency_ns += latency_ns;
+                if (latency_ns > b->max_latency_ns) {
+                    b->max_latency_ns = latency_ns;
+                }
+                if (latency_ns > FAULT_BENCH_DEADLINE_NS) {
+                    b->press_misses++;
+                }
+            }
+            last = level;
+        }
+
+        next_ns += NS_PER_MS;
+        if (next_ns < rt_now_ns()) {
+            next_ns = rt_now_ns();
+        }
+        rt_sleep_until_ns(next_ns);
+    }
+
+    return NULL;
+}
+
+static void *fault_timer_thread(void *arg) {
+    FaultBench *b = (FaultBench *) arg;
+    int64_t next_ns = rt_now_ns() + (10 * NS_PER_MS);
+
+    while (atomic_load(&b->stop) == 0) {
+        int64_t late_ns = 0;
+
+        rt_sleep_until_ns(next_ns);
+        late_ns = rt_now_ns() - next_ns;
+        b->timer_runs++;
+        if (late_ns > b->max_timer_late_ns) {
+            b->max_timer_late_ns = late_ns;
+        }
+        if (late_ns > FAULT_BENCH_DEADLINE_NS) {
+            b->timer_misses++;
+        }
+        next_ns += 10 * NS_PER_MS;
+    }
+
+    return NULL;
+}
+
+static int32_t bench_fault(void) {
+    int32_t result = 0;
+    const char *const profiles[] = {
+        NULL,
+        "op=bank_read,lat=uniform:20:200",
+        "op=bank_write,lat=exp:1000;op=bank_read,lat=exp:100,fail=1,err=EBUSY",
+        "op=bank_write,lat=exp:3000,fail=2,err=EIO;op=any,stall=2:15"
+    };
+    int32_t p = 0;
+    int32_t i = 0;
+
+    (void) printf("Stopwatch button path under fault injection (SIM backend, %d presses, %.0f ms deadline):\n",
+                  FAULT_BENCH_PRESSES, (double) FAULT_BENCH_DEADLINE_NS / 1e6);
+    (void) printf("  %-70s  %8s  %8s  %6s  %6s  %6s\n", "rules", "avg us", "max us", "missed", "timer", "failed");
+
+    for (p = 0; p < (int32_t) (sizeof(profiles) / sizeof(profiles[0])) && result == 0; p++) {
+        FaultBench b;
+        pthread_t button;
+        pthread_t timer;
+
+        (void) memset(&b, 0, sizeof(b));
+        fault_init((uint64_t) (p + 1));
+        if (gpio_bank_open(GPIO_BACKEND_SIM) != 1 || (profiles[p] != NULL && fault_parse(profiles[p]) <= 0)) {
+            (void) printf("fault: could not set up profile %d\n", p);
+            result = 1;
+        }
+        else {
+            gpio_bank_sim_set(GPIO_BANK_OF(FAULT_BENCH_BUTTON_PIN), GPIO_BIT_OF(FAULT_BENCH_BUTTON_PIN), 0U);
+            fault_enable((profiles[p] != NULL) ? 1 : 0);
+            (void) rt_thread_start(&button, RT_PRIORITY_NONE, &fault_button_thread, &b);
+            (void) rt_thread_start(&timer, RT_PRIORITY_NONE, &fault_timer_thread, &b);
+
+            for (i = 0; i < FAULT_BENCH_PRESSES; i++) {
+                int64_t at_ns = rt_now_ns() + FAULT_BENCH_PRESS_PERIOD_NS;
+
+                rt_sleep_until_ns(at_ns);
+                atomic_store(&b.press_ns, rt_now_ns());
+                gpio_bank_sim_set(GPIO_BANK_OF(FAULT_BENCH_BUTTON_PIN), GPIO_BIT_OF(FAULT_BENCH_BUTTON_PIN), GPIO_BIT_OF(FAULT_BENCH_BUTTON_PIN));
+                rt_sleep_until_ns(at_ns + (FAULT_BENCH_PRESS_PERIOD_NS / 2));
+                gpio_bank_sim_set(GPIO_BANK_OF(FAULT_BENCH_BUTTON_PIN), GPIO_BIT_OF(FAULT_BENCH_BUTTON_PIN), 0U);
+            }
+
+            atomic_store(&b.stop, 1);
+            (void) pthread_join(button, NULL);
+            (void) pthread_join(timer, NULL);
+            fault_enable(0);
+
+            // A press missed entirely (every read of it failed) counts as a missed deadline too.
+            (void) printf("  %-70s  %8.1f  %8.1f  %6u  %6u  %6u\n", (profiles[p] != NULL) ? profiles[p] : "(none)",
+                          (b.presses > 0U) ? ((double) b.sum_latency_ns / (1e3 * (double) b.presses)) : 0.0, (double) b.max_latency_ns / 1e3,
+                          b.press_misses + ((uint32_t) FAULT_BENCH_PRESSES - b.presses), b.timer_misses, b.failed_ops);
+        }
+    }
+    gpio_bank_close();
+    (void) printf("  (missed: presses over the deadline or never seen, timer: 10 ms timer runs more than a period late)\n");
+
+    return result;
+}
+
+
+/// ----------- VIRTUAL WIRING ----------- ///
+
+// P9_15 (GPIO 48) wired back into P9_12 (GPIO 60), and P8_11 (GPIO 45) as a button wired into P8_12 (GPIO 44).
+#define LOOP_BENCH_OUT_PIN ((int32_t) 48)
+
+#define LOOP_BENCH_IN_PIN ((int32_t) 60)
+
+#define LOOP_BENCH_BUTTON_PIN ((int32_t) 45)
+
+#define LOOP_BENCH_CONTACT_PIN ((int32_t) 44)
+
+#define LOOP_BENCH_TOGGLES ((int32_t) 2000)
+
+#define LOOP_BENCH_PWM_PERIOD_NS ((int64_t) NS_PER_MS)
+
+#define LOOP_BENCH_PWM_HIGH_NS ((int64_t) (250 * NS_PER_US))
+
+#define LOOP_BENCH_PWM_PERIODS ((int32_t) 200)
+
+#define LOOP_BENCH_PRESSES ((int32_t) 100)
+
+static void pin_write(int32_t pin, int32_t level) {
+    (void) gpio_bank_write(GPIO_BANK_OF(pin), GPIO_BIT_OF(pin), (level == 1) ? GPIO_BIT_OF(pin) : 0U);
+}
+
+static int32_t pin_read(int32_t pin) {
+    uint32_t value = 0U;
+
+    (void) gpio_bank_read(GPIO_BANK_OF(pin), GPIO_BIT_OF(pin), &value);
+
+    return (value != 0U) ? 1 : 0;
+}
+
+static int32_t bench_loopback(void) {
+    int32_t result = 0;
+    GpioSimWire wire;
+    GpioSimEdge edge;
+    int64_t sum_seen_ns = 0;
+    int64_t max_seen_ns = 0;
+    int64_t max_stamp_error_ns = 0;
+    int64_t next_ns = 0;
+    int64_t rise_ns = -1;
+    int64_t fall_ns = -1;
+    int64_t sum_period_ns = 0;
+    int64_t sum_high_ns = 0;
+    uint32_t periods = 0U;
+    uint32_t edges = 0U;
+    uint64_t dropped_log = 0U;
+    uint64_t dropped_pending = 0U;
+    int32_t i = 0;
+
+    if (gpio_bank_open(GPIO_BACKEND_SIM) != 1) {
+        (void) printf("loopback: no SIM backend\n");
+        return 1;
+    }
+    gpio_bank_sim_disconnect_all();
+
+    // 1. Loopback latency: toggle the output, spin reading the input until it follows.
+    (void) memset(&wire, 0, sizeof(wire));
+    wire.from_pin = LOOP_BENCH_OUT_PIN;
+    wire.to_pin = LOOP_BENCH_IN_PIN;
+    wire.delay_ns = 5 * NS_PER_US;
+    (void) gpio_bank_sim_connect(&wire);
+
+    for (i = 0; i < LOOP_BENCH_TOGGLES; i++) {
+        int32_t level = (i + 1) % 2;
+        int64_t start_ns = rt_now_ns();
+        int64_t seen_ns = 0;
+
+        pin_write(LOOP_BENCH_OUT_PIN, level);
+        while (pin_read(LOOP_BENCH_IN_PIN) != level) {
+        }
+        seen_ns = rt_now_ns() - start_ns;
+        sum_seen_ns += seen_ns;
+        if (seen_ns > max_seen_ns) {
+            max_seen_ns = seen_ns;
+        }
+        // The logged edge must be exactly the wire delay after the write.
+        if (gpio_bank_sim_pop_edge(&edge) == 1 && edge.time_ns - start_ns - wire.delay_ns > max_stamp_error_ns) {
+            max_stamp_error_ns = edge.time_ns - start_ns - wire.delay_ns;
+        }
+    }
+    (void) printf("Loopback %d -> %d (%.1f us wire), %d toggles:\n", LOOP_BENCH_OUT_PIN, LOOP_BENCH_IN_PIN,
+                  (double) wire.delay_ns / 1e3, LOOP_BENCH_TOGGLES);
+    (void) printf("  write to input seen: avg %.2f us, max %.2f us; edge timestamp at most %.2f us after write + delay\n",
+                  (double) sum_seen_ns / (1e3 * (double) LOOP_BENCH_TOGGLES), (double) max_seen_ns / 1e3, (double) max_stamp_error_ns / 1e3);
+
+    // 2. PWM into a capture input: square wave on the output, period and duty measured from the input edge timestamps.
+    gpio_bank_sim_disconnect_all();
+    wire.delay_ns = 2 * NS_PER_US;
+    wire.jitter_ns = NS_PER_US;
+    pin_write(LOOP_BENCH_OUT_PIN, 0);
+    (void) gpio_bank_sim_connect(&wire);
+
+    next_ns = rt_now_ns() + NS_PER_MS;
+    for (i = 0; i < LOOP_BENCH_PWM_PERIODS; i++) {
+        rt_sleep_until_ns(next_ns);
+        pin_write(LOOP_BENCH_OUT_PIN, 1);
+        rt_sleep_until_ns(next_ns + LOOP_BENCH_PWM_HIGH_NS);
+        pin_write(LOOP_BENCH_OUT_PIN, 0);
+        next_ns += LOOP_BENCH_PWM_PERIOD_NS;
+    }
+    rt_sleep_until_ns(next_ns);
+
+    while (gpio_bank_sim_pop_edge(&edge) == 1) {
+        if (edge.level == 1) {
+            if (rise_ns >= 0 && fall_ns > rise_ns) {
+                sum_period_ns += edge.time_ns - rise_ns;
+                sum_high_ns += fall_ns - rise_ns;
+                periods++;
+            }
+            rise_ns = edge.time_ns;
+        }
+        else {
+            fall_ns = edge.time_ns;
+        }
+    }
+    if (periods > 0U) {
+        (void) printf("PWM %.3f kHz %.1f %% through the wire (%.0f us jitter), captured over %u periods: %.3f kHz %.1f %%\n",
+                      1e6 / (double) LOOP_BENCH_PWM_PERIOD_NS, 100.0 * (double) LOOP_BENCH_PWM_HIGH_NS / (double) LOOP_BENCH_PWM_PERIOD_NS,
+                      (double) wire.jitter_ns / 1e3, periods, 1e6 * (double) periods / (double) sum_period_ns,
+                      100.0 * (double) sum_high_ns / (double) sum_period_ns);
+        (void) printf("  (the generator is this thread waking on absolute deadlines, its own jitter is included)\n");
+    }
+    else {
+        (void) printf("loopback: no PWM periods captured\n");
+        result = 1;
+    }
+
+    // 3. Bouncing contact: a button press seen through a wire with bounce and occasional glitches.
+    gpio_bank_sim_disconnect_all();
+    (void) memset(&wire, 0, sizeof(wire));
+    wire.from_pin = LOOP_BENCH_BUTTON_PIN;
+    wire.to_pin = LOOP_BENCH_CONTACT_PIN;
+    wire.delay_ns = NS_PER_US;
+    wire.bounce_count = 3;
+    wire.bounce_ns = 2 * NS_PER_MS;
+    wire.glitch_ppm = 50000U;
+    wire.glitch_ns = 20 * NS_PER_US;
+    gpio_bank_sim_set(GPIO_BANK_OF(LOOP_BENCH_BUTTON_PIN), GPIO_BIT_OF(LOOP_BENCH_BUTTON_PIN), 0U);
+    (void) gpio_bank_sim_connect(&wire);
+
+    for (i = 0; i < LOOP_BENCH_PRESSES; i++) {
+        gpio_bank_sim_set(GPIO_BANK_OF(LOOP_BENCH_BUTTON_PIN), GPIO_BIT_OF(LOOP_BENCH_BUTTON_PIN), (i % 2 == 0) ? GPIO_BIT_OF(LOOP_BENCH_BUTTON_PIN) : 0U);
+        rt_sleep_until_ns(rt_now_ns() + (4 * NS_PER_MS));
+        while (gpio_bank_sim_pop_edge(&edge) == 1) {
+            edges++;
+        }
+    }
+    gpio_bank_sim_dropped(&dropped_log, &dropped_pending);
+    (void) printf("Bouncing contact (%d bounces over %.0f ms, %.0f %% glitches): %d level changes gave %u input edges "
+                  "(%.1f per change), %llu + %llu dropped\n", wire.bounce_count, (double) wire.bounce_ns / 1e6,
+                  (double) wire.glitch_ppm / 1e4, LOOP_BENCH_PRESSES, edges, (double) edges / (double) LOOP_BENCH_PRESSES,
+                  (unsigned long long) dropped_log, (unsigned long long) dropped_pending);
+
+    gpio_bank_sim_disconnect_all();
+    gpio_bank_close();
+
+    return result;
+}
+
+
+/// ----------- WAVEFORM MODULATOR ----------- ///
+
+#define WAVE_BENCH_RATE_HZ ((int32_t) 1000)
+
+#define WAVE_BENCH_RUN_NS ((int64_t) (2 * NS_PER_SEC))
+
+#define WAVE_BENCH_STEPS ((int32_t) 1000000)
+
+#define WAVE_BENCH_PWM_HZ ((int32_t) 1000)
+
+// Double pulse of a heartbeat, for the custom table.
+static const uint16_t heartbeat_levels[16] = { 0, 30000, 65535, 20000, 0, 40000, 52000, 10000, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+// What an application loop calling set_pwm_duty_cycle pays per update before any file I/O: float duty math, the path
+// and the value formatted.
+static uint32_t naive_update(int32_t tick, float32_t wave_hz, Buffer path) {
+    float32_t phase = (float32_t) tick * wave_hz / (float32_t) WAVE_BENCH_RATE_HZ;
+    float32_t frac = phase - (float32_t) (int32_t) phase;
+    float32_t duty_percent = 10.0f + (80.0f * ((frac < 0.5f) ? (2.0f * frac) : (2.0f - (2.0f * frac))));
+    int32_t period_ns = (int32_t) (1000000000.0f / (float32_t) WAVE_BENCH_PWM_HZ);
+    int32_t duty_ns = (int32_t) ((float32_t) period_ns * (duty_percent / 100.0f));
+    Buffer value;
+
+    (void) snprintf((char *) path, sizeof(Buffer), "%s%s", PWM1PINA_PATH, PWM_DUTY_CYCLE_PATH);
+    (void) snprintf((char *) value, sizeof(value), "%d", duty_ns);
+
+    return (uint32_t) value[0];
+}
+
+static int32_t bench_wave(void) {
+    int32_t result = 0;
+    WaveModulator mod;
+    WaveConfig config;
+    const char *const pins[WAVE_MAX_CHANNELS] = { "1A", "1B", "2A", "2B" };
+    const int32_t shapes[WAVE_MAX_CHANNELS] = { WAVE_SINE, WAVE_TRIANGLE, WAVE_SAWTOOTH, WAVE_CUSTOM };
+    const uint32_t frequencies_mhz[WAVE_MAX_CHANNELS] = { 500U, 1000U, 2000U, 1200U };
+    Buffer path;
+    uint32_t sink = 0U;
+    int64_t start_ns = 0;
+    int64_t step_ns = 0;
+    int64_t naive_ns = 0;
+    int32_t i = 0;
+
+    wave_use_simulator(1);
+    (void) wave_init(&mod, WAVE_BENCH_RATE_HZ);
+    (void) memset(&config, 0, sizeof(config));
+    config.min_duty_percent = 10.0f;
+    config.max_duty_percent = 90.0f;
+    config.custom = heartbeat_levels;
+    config.custom_count = 16;
+
+    for (i = 0; i < WAVE_MAX_CHANNELS; i++) {
+        config.shape = shapes[i];
+        config.frequency_mhz = frequencies_mhz[i];
+        if (wave_add_channel(&mod, (BufferPointer) pins[i], WAVE_BENCH_PWM_HZ, &config) != i) {
+            (void) printf("wave: could not add channel %s\n", pins[i]);
+            result = 1;
+        }
+    }
+
+    if (result == 0 && wave_start(&mod, RT_PRIORITY_NONE) == 1) {
+        rt_sleep_until_ns(rt_now_ns() + WAVE_BENCH_RUN_NS);
+        wave_stop(&mod);
+        (void) printf("4 simulated channels (sine 0.5 Hz, triangle 1 Hz, sawtooth 2 Hz, heartbeat 1.2 Hz) for %.0f s:\n",
+                      (double) WAVE_BENCH_RUN_NS / 1e9);
+        wave_print_stats(&mod);
+    }
+    else {
+        result = 1;
+    }
+
+    // Cost of the update itself: table lookup and change check vs the float math and formatting of the naive loop.
+    start_ns = rt_now_ns();
+    for (i = 0; i < WAVE_BENCH_STEPS; i++) {
+        wave_step(&mod);
+    }
+    step_ns = rt_now_ns() - start_ns;
+
+    start_ns = rt_now_ns();
+    for (i = 0; i < WAVE_BENCH_STEPS; i++) {
+        sink += naive_update(i, 1.0f, path);
+    }
+    naive_ns = rt_now_ns() - start_ns;
+
+    (void) printf("Per channel update, excluding the write: phase accumulator %.1f ns, float duty + formatting %.1f ns (%u)\n",
+                  (double) step_ns / ((double) WAVE_BENCH_STEPS * (double) mod.channel_count), (double) naive_ns / (double) WAVE_BENCH_STEPS, sink & 1U);
+
+    wave_close(&mod);
+    wave_use_simulator(0);
+
+    return result;
+}
+
+
+/// ----------- CONTROL LOOPS ----------- ///
+
+#define CONTROL_BENCH_LOOPS ((int32_t) 12)
+
+#define CONTROL_BENCH_RUN_NS ((int64_t) (2 * NS_PER_SEC))
+
+#define CONTROL_BENCH_PID_STEPS ((int32_t) 1000000)
+
+// Simulated fan: first order lag from the PWM duty to the speed, 3000 rpm at 100 % with a 200 ms time constant.
+#define FAN_MAX_RPM (3000.0)
+
+#define FAN_TAU_NS (200.0 * 1e6)
+
+typedef struct {
+    ControlPwm pwm;
+    double rpm;
+    int64_t last_ns;
+} SimFan;
+
+static int32_t fan_read(void *context, int32_t *measurement) {
+    SimFan *fan = (SimFan *) context;
+    int64_t now_ns = rt_now_ns();
+    double duty = (fan->pwm.last_duty_ns == 0xFFFFFFFFU) ? 0.0 : ((double) fan->pwm.last_duty_ns / (double) fan->pwm.period_ns);
+    double dt = (double) (now_ns - fan->last_ns);
+
+    if (fan->last_ns != 0) {
+        fan->rpm += ((duty * FAN_MAX_RPM) - fan->rpm) * ((dt < FAN_TAU_NS) ? (dt / FAN_TAU_NS) : 1.0);
+    }
+    fan->last_ns = now_ns;
+    *measurement = (int32_t) fan->rpm;
+
+    return 1;
+}
+
+static int32_t bench_control(void) {
+    int32_t result = 0;
+    static ControlExecutor ex;
+    static SimFan fans[CONTROL_BENCH_LOOPS];
+    const int64_t periods_ns[3] = { NS_PER_MS, 2 * NS_PER_MS, 10 * NS_PER_MS };
+    ControlLoopConfig config;
+    ControlLoopStats s;
+    ControlPid pid;
+    char names[CONTROL_BENCH_LOOPS][CONTROL_NAME_LENGTH];
+    int32_t settled = 0;
+    int32_t sink = 0;
+    int64_t start_ns = 0;
+    int32_t i = 0;
+
+    control_init(&ex);
+    (void) memset(fans, 0, sizeof(fans));
+    (void) memset(&config, 0, sizeof(config));
+
+    // Fastest loops first, they run first when several are due at the same wakeup.
+    for (i = 0; i < CONTROL_BENCH_LOOPS && result == 0; i++) {
+        int64_t period_ns = periods_ns[(i * 3) / CONTROL_BENCH_LOOPS];
+
+        (void) control_pwm_open(&fans[i].pwm, NULL, 25000);
+        (void) snprintf(names[i], sizeof(names[i]), "fan%d", i);
+        config.name = names[i];
+        config.period_ns = period_ns;
+        config.reader = &fan_read;
+        config.reader_context = &fans[i];
+        config.writer = &control_pwm_write;
+        config.writer_context = &fans[i].pwm;
+        // PI: 5 duty steps per rpm of error, integral time of one fan time constant (ki is per run, so scaled by the period).
+        config.kp = CONTROL_GAIN(5.0);
+        config.ki = CONTROL_GAIN(5.0 * (double) period_ns / FAN_TAU_NS);
+        config.kd = 0;
+        config.setpoint = 1000 + (100 * i);
+        config.out_min = 0;
+        config.out_max = CONTROL_DUTY_FULL;
+        if (control_add_loop(&ex, &config) != i) {
+            (void) printf("control: could not add loop %d\n", i);
+            result = 1;
+        }
+    }
+
+    if (result == 0 && control_start(&ex, RT_PRIORITY_NONE) == 1) {
+        // Half way through, ask fan0 for more than it can do: without anti-windup it would overshoot badly on the way back.
+        rt_sleep_until_ns(rt_now_ns() + (CONTROL_BENCH_RUN_NS / 4));
+        control_set_setpoint(&ex, 0, 3500);
+        rt_sleep_until_ns(rt_now_ns() + (CONTROL_BENCH_RUN_NS / 4));
+        control_set_setpoint(&ex, 0, 1000);
+        rt_sleep_until_ns(rt_now_ns() + (CONTROL_BENCH_RUN_NS / 2));
+        control_stop(&ex);
+
+        (void) printf("%d simulated fan loops (4 at 1 kHz, 4 at 500 Hz, 4 at 100 Hz) for %.0f s:\n", CONTROL_BENCH_LOOPS,
+                      (double) CONTROL_BENCH_RUN_NS / 1e9);
+        control_print_report(&ex);
+
+        for (i = 0; i < CONTROL_BENCH_LOOPS; i++) {
+            int32_t setpoint = atomic_load(&ex.loops[i].setpoint);
+
+            control_get_stats(&ex, i, &s);
+            if ((s.last_measurement - setpoint) * 50 <= setpoint && (setpoint - s.last_measurement) * 50 <= setpoint) {
+                settled++;
+            }
+        }
+        (void) printf("Within 2 %% of the setpoint at the end: %d of %d loops\n", settled, CONTROL_BENCH_LOOPS);
+        if (settled != CONTROL_BENCH_LOOPS) {
+            result = 1;
+        }
+    }
+    else {
+        result = 1;
+    }
+
+    // Cost of the fixed point PID alone.
+    control_pid_init(&pid, CONTROL_GAIN(2.0), CONTROL_GAIN(0.01), CONTROL_GAIN(0.5), 0, CONTROL_DUTY_FULL);
+    start_ns = rt_now_ns();
+    for (i = 0; i < CONTROL_BENCH_PID_STEPS; i++) {
+        sink += control_pid_step(&pid, 1500, 1400 + (i & 255));
+    }
+    (void) printf("PID step: %.1f ns (%d)\n", (double) (rt_now_ns() - start_ns) / (double) CONTROL_BENCH_PID_STEPS, sink & 1);
+
+    for (i = 0; i < CONTROL_BENCH_LOOPS; i++) {
+        control_pwm_close(&fans[i].pwm);
+    }
+
+    return result;
+}
+
+
+/// ----------- PERFORMANCE COUNTERS ----------- ///
+
+#define PERF_BENCH_WORDS ((int32_t) (1024 * 1024))
+
+#define PERF_BENCH_ITERATIONS ((int32_t) 10)
+
+#define PERF_BENCH_EMPTY ((int32_t) 100000)
+
+// Walks the buffer following the links (a random permutation makes every step a likely cache miss).
+static uint32_t walk_links(const uint32_t *links, int32_t steps) {
+    uint32_t at = 0U;
+    int32_t i = 0;
+
+    for (i = 0; i < steps; i++) {
+        at = links[at];
+    }
+
+    return at;
+}
+
+static int32_t bench_perf(void) {
+    int32_t result = 0;
+    PerfThread sequential;
+    PerfThread random_walk;
+    PerfThread empty;
+    uint32_t *links = (uint32_t *) malloc(sizeof(uint32_t) * (size_t) PERF_BENCH_WORDS);
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint32_t sink = 0U;
+    int64_t start_ns = 0;
+    int32_t i = 0;
+
+    if (links == NULL) {
+        return 1;
+    }
+
+    if (perf_thread_open(&sequential, "sequential") != 1) {
+        (void) printf("perf_event_open not permitted here (perf_event_paranoid, container or no PMU), nothing to measure.\n");
+        free(links);
+        return 0;
+    }
+    (void) perf_thread_open(&random_walk, "random walk");
+    (void) perf_thread_open(&empty, "empty");
+
+    // Sequential links: i -> i + 1.
+    for (i = 0; i < PERF_BENCH_WORDS; i++) {
+        links[i] = (uint32_t) ((i + 1) % PERF_BENCH_WORDS);
+    }
+    for (i = 0; i < PERF_BENCH_ITERATIONS; i++) {
+        perf_iteration_begin(&sequential);
+        sink += walk_links(links, PERF_BENCH_WORDS);
+        perf_iteration_end(&sequential);
+    }
+
+    // One random cycle through the whole buffer (Sattolo's shuffle).
+    for (i = 0; i < PERF_BENCH_WORDS; i++) {
+        links[i] = (uint32_t) i;
+    }
+    for (i = PERF_BENCH_WORDS - 1; i > 0; i--) {
+        uint32_t j = 0U;
+        uint32_t swap = 0U;
+
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        j = (uint32_t) (state % (uint64_t) i);
+        swap = links[i];
+        links[i] = links[j];
+        links[j] = swap;
+    }
+    for (i = 0; i < PERF_BENCH_ITERATIONS; i++) {
+        perf_iteration_begin(&random_walk);
+        sink += walk_links(links, PERF_BENCH_WORDS);
+        perf_iteration_end(&random_walk);
+    }
+
+    // What bracketing an iteration costs: two group reads.
+    start_ns = rt_now_ns();
+    for (i = 0; i < PERF_BENCH_EMPTY; i++) {
+        perf_iteration_begin(&empty);
+        perf_iteration_end(&empty);
+    }
+
+    (void) printf("Walking %d MB of links, %d iterations each (%u):\n", (int32_t) ((sizeof(uint32_t) * (size_t) PERF_BENCH_WORDS) >> 20),
+                  PERF_BENCH_ITERATIONS, sink & 1U);
+    perf_print_report(&sequential);
+    perf_print_report(&random_walk);
+    (void) printf("Counter overhead: %.2f us per iteration (begin + end)\n", (double) (rt_now_ns() - start_ns) / (1e3 * (double) PERF_BENCH_EMPTY));
+
+    perf_thread_close(&sequential);
+    perf_thread_close(&random_walk);
+    perf_thread_close(&empty);
+    free(links);
+
+    return result;
+}
+
+
+/// ----------- TRACE MARKERS ----------- ///
+
+#define TRACE_BENCH_RECORDS ((int32_t) 200000)
+
+#define TRACE_BENCH_FILE "/tmp/bbbio_bench_trace.txt"
+
+// Average cost of a press record in nanoseconds.
+static double time_trace_marks(void) {
+    int64_t start_ns = rt_now_ns();
+    int32_t i = 0;
+
+    for (i = 0; i < TRACE_BENCH_RECORDS; i++) {
+        trace_mark(TRACE_EVENT_PRESS, 60, (int64_t) i);
+    }
+
+    return (double) (rt_now_ns() - start_ns) / (double) TRACE_BENCH_RECORDS;
+}
+
+static int32_t bench_trace(void) {
+    int32_t result = 0;
+    uint64_t written = 0U;
+    uint64_t failed = 0U;
+    double disabled_ns = 0.0;
+    double enabled_ns = 0.0;
+    double naive_ns = 0.0;
+    int64_t start_ns = 0;
+    int32_t fd = -1;
+    int32_t i = 0;
+
+    (void) unlink(TRACE_BENCH_FILE);
+    if (trace_open(TRACE_BENCH_FILE) != 1) {
+        (void) printf("trace: could not open %s\n", TRACE_BENCH_FILE);
+        return 1;
+    }
+
+    trace_enable(0);
+    disabled_ns = time_trace_marks();
+    trace_enable(1);
+    enabled_ns = time_trace_marks();
+    trace_get_counts(&written, &failed);
+    trace_close();
+
+    // The same record with snprintf and an open/write/close of the file, like a debug print would.
+    start_ns = rt_now_ns();
+    for (i = 0; i < TRACE_BENCH_RECORDS / 10; i++) {
+        char record[TRACE_RECORD_LENGTH];
+        int32_t length = snprintf(record, sizeof(record), "stopwatch: press pin=%d edge_us=%d\n", 60, i);
+
+        fd = open(TRACE_BENCH_FILE, O_WRONLY | O_APPEND);
+        if (fd >= 0) {
+            (void) write(fd, record, (size_t) length);
+            (void) close(fd);
+        }
+    }
+    naive_ns = (double) (rt_now_ns() - start_ns) / (double) (TRACE_BENCH_RECORDS / 10);
+
+    (void) printf("Record to a file: disabled %.1f ns, enabled %.2f us (%llu written, %llu failed), snprintf + open/write/close %.2f us\n",
+                  disabled_ns, enabled_ns / 1e3, (unsigned long long) written, (unsigned long long) failed, naive_ns / 1e3);
+    if (written != (uint64_t) TRACE_BENCH_RECORDS || failed != 0U) {
+        result = 1;
+    }
+
+    // The kernel trace buffer, where permitted.
+    if (trace_open(NULL) == 1) {
+        trace_enable(1);
+        (void) printf("Record to the kernel trace_marker: %.2f us\n", time_trace_marks() / 1e3);
+        trace_close();
+    }
+    else {
+        (void) printf("Kernel trace_marker not available here (no tracefs or not root).\n");
+    }
+    (void) unlink(TRACE_BENCH_FILE);
+
+    return result;
+}
+
+
+/// ----------- USDT PROBES ----------- ///
+
+#define PROBE_BENCH_CALLS ((int32_t) 20000000)
+
+BBB_PROBE_SEMAPHORE(bench, hot_path_entry);
+BBB_PROBE_SEMAPHORE(bench, hot_path_return);
+
+// The kind of work a hot path GPIO call does around its system call: pin to bank and mask.
+static __attribute__((noinline)) int32_t hot_path_plain(int32_t pin, int32_t value) {
+    uint32_t mask = (uint32_t) 1U << ((uint32_t) pin % 32U);
+
+    return (int32_t) ((value != 0) ? mask : ~mask) + (pin / 32);
+}
+
+// Same work with an entry and a return probe, instrumented like the bbbio functions.
+static __attribute__((noinline)) int32_t hot_path_probed(int32_t pin, int32_t value) {
+    int64_t probe_start = BBB_PROBE_START(bench, hot_path_return);
+    uint32_t mask = (uint32_t) 1U << ((uint32_t) pin % 32U);
+    int32_t result = 0;
+
+    BBB_PROBE2(bench, hot_path_entry, pin, value);
+    result = (int32_t) ((value != 0) ? mask : ~mask) + (pin / 32);
+    BBB_PROBE4(bench, hot_path_return, pin, value, result, BBB_PROBE_ELAPSED(probe_start));
+
+    return result;
+}
+
+// Best of 5 runs of PROBE_BENCH_CALLS calls, in ns per call.
+static double time_hot_path(int32_t (*func)(int32_t, int32_t), int32_t *sink) {
+    double best = 0.0;
+    int32_t run = 0;
+    int32_t i = 0;
+
+    for (run = 0; run < 5; run++) {
+        int64_t start_ns = rt_now_ns();
+        double ns = 0.0;
+
+        for (i = 0; i < PROBE_BENCH_CALLS; i++) {
+            *sink += func(i & 127, i & 1);
+        }
+        ns = (double) (rt_now_ns() - start_ns) / (double) PROBE_BENCH_CALLS;
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+static int32_t bench_probes(void) {
+    int32_t sink = 0;
+    double plain_ns = 0.0;
+    double probed_ns = 0.0;
+
+#ifdef BBB_PROBES
+    (void) printf("USDT probes compiled in (sys/sdt.h found).\n");
+#else
+    (void) printf("USDT probes compiled out (no sys/sdt.h), the probed function is the plain one.\n");
+#endif
+
+    plain_ns = time_hot_path(&hot_path_plain, &sink);
+    probed_ns = time_hot_path(&hot_path_probed, &sink);
+    (void) printf("Per call, no tracer attached: plain %.2f ns, with entry + return probes %.2f ns (difference %+.2f ns) (%d)\n",
+                  plain_ns, probed_ns, probed_ns - plain_ns, sink & 1);
+
+#ifdef BBB_PROBES
+    // What a call costs while a tracer is attached to the return probe: the semaphore is set, so the duration is measured
+    // (the tracer's own trap is not included).
+    bench_hot_path_return_semaphore++;
+    (void) printf("Semaphore set (tracer attached, trap excluded): %.2f ns\n", time_hot_path(&hot_path_probed, &sink));
+    bench_hot_path_return_semaphore--;
+#endif
+
+    return 0;
+}
+
+
+/// ----------- 1-WIRE ----------- ///
+
+#define ONEWIRE_BENCH_DEVICES ((int32_t) 5)
+
+#define ONEWIRE_BENCH_ROUNDS ((int32_t) 10)
+
+// Whole searches tried before giving up, for a machine where the thread gets preempted inside slots.
+#define ONEWIRE_BENCH_SEARCHES ((int32_t) 20)
+
+typedef struct {
+    OneWire ow;
+    OneWireSim sim;
+    int32_t isolated;
+    int32_t searches;
+    int32_t found;
+    int32_t reads;
+    int32_t wrong;
+    int64_t round_ns;
+} OneWireBench;
+
+// Search, then rounds of convert + read every sensor, from an RT thread pinned to the last CPU.
+static void *onewire_bench_thread(void *arg) {
+    OneWireBench *b = (OneWireBench *) arg;
+    uint64_t roms[ONEWIRE_SIM_MAX_DEVICES];
+    int32_t round = 0;
+    int32_t i = 0;
+
+    b->isolated = onewire_isolate_thread(-1);
+    b->found = -1;
+    while (b->found < 0 && b->searches < ONEWIRE_BENCH_SEARCHES) {
+        b->found = onewire_search(&b->ow, roms, ONEWIRE_SIM_MAX_DEVICES);
+        b->searches++;
+    }
+
+    // Every ROM code found must be one of the simulated devices.
+    for (i = 0; i < b->found; i++) {
+        int32_t known = 0;
+        int32_t d = 0;
+
+        for (d = 0; d < b->sim.device_count; d++) {
+            known |= (int32_t) (b->sim.devices[d].rom == roms[i]);
+        }
+        if (known == 0) {
+            b->wrong++;
+        }
+    }
+
+    for (round = 0; round < ONEWIRE_BENCH_ROUNDS && b->found > 0; round++) {
+        int64_t start_ns = rt_now_ns();
+
+        if (onewire_convert_all(&b->ow) == 1) {
+            for (i = 0; i < b->found; i++) {
+                int32_t milli_c = 0;
+                int32_t d = 0;
+
+                if (onewire_read_temperature(&b->ow, roms[i], &milli_c) == 1) {
+                    b->reads++;
+                    // The reading must be the one of the simulated device with that ROM code.
+                    for (d = 0; d < b->sim.device_count; d++) {
+                        if (b->sim.devices[d].rom == roms[i] && ((b->sim.devices[d].temperature_16 * 1000) / 16) != milli_c) {
+                            b->wrong++;
+                        }
+                    }
+                }
+            }
+        }
+        b->round_ns += rt_now_ns() - start_ns;
+    }
+
+    return NULL;
+}
+
+static int32_t bench_onewire(void) {
+    int32_t result = 0;
+    static OneWireBench b;
+    OneWireBusOps ops;
+    OneWireGpio gpio;
+    pthread_t thread;
+    const int32_t temperatures[ONEWIRE_BENCH_DEVICES] = { 21500, -10125, 85000, 36750, 0 };
+    int32_t i = 0;
+
+    // The sysfs backend is refused: a write takes longer than a slot.
+    (void) gpio_bank_open(GPIO_BACKEND_SYSFS);
+    (void) printf("Bus on the sysfs backend: %s\n", (onewire_gpio_bus(&gpio, 60, 48, 0, &ops) == 1) ? "accepted" : "refused");
+    gpio_bank_close();
+
+    (void) memset(&b, 0, sizeof(b));
+    onewire_sim_init(&b.sim, &ops);
+    for (i = 0; i < ONEWIRE_BENCH_DEVICES; i++) {
+        (void) onewire_sim_add_device(&b.sim, 0x0000A1B2C3D4ULL + ((uint64_t) i * 0x010203ULL), temperatures[i]);
+    }
+    onewire_init(&b.ow, &ops);
+
+    if (rt_thread_start(&thread, sched_get_priority_max(SCHED_FIFO), &onewire_bench_thread, &b) == 0) {
+        (void) pthread_join(thread, NULL);
+        (void) printf("%d simulated DS18B20 on the bus, search found %d after %d searches%s, %d rounds of convert + read all: %d reads, %d wrong, %.1f ms per round\n",
+                      ONEWIRE_BENCH_DEVICES, b.found, b.searches, (b.isolated == 1) ? " (thread pinned to the last CPU)" : "",
+                      ONEWIRE_BENCH_ROUNDS, b.reads, b.wrong, (double) b.round_ns / (1e6 * (double) ONEWIRE_BENCH_ROUNDS));
+        onewire_print_stats(&b.ow);
+        // Late slots only cost retries: a wrong ROM code or reading must never get through, and with every slot on
+        // time the search must find all the devices.
+        if (b.wrong != 0 || (b.found >= 0 && b.found != ONEWIRE_BENCH_DEVICES) || (b.found < 0 && b.ow.stats.slot_errors == 0U)) {
+            result = 1;
+        }
+        else if (b.found < 0) {
+            (void) printf("Search failed on late slots only: this CPU is not isolated enough for bit-banged 1-Wire\n");
+        }
+        else {
+        }
+    }
+    else {
+        result = 1;
+    }
+
+    return result;
+}
+
+
+/// ----------- KEYPAD MATRIX ----------- ///
+
+// 4x4 keypad, rows on bank 2 and columns on bank 1.
+#define KEYPAD_BENCH_ROW_PINS { 66, 67, 68, 69 }
+
+#define KEYPAD_BENCH_COLUMN_PINS { 44, 45, 46, 47 }
+
+#define KEYPAD_BENCH_PRESSES ((int32_t) 6)
+
+// Contact bounce: the key toggles every period for bounce_ns after it is pressed.
+#define KEYPAD_BENCH_BOUNCE_PERIOD_NS ((int64_t) 700000)
+
+#define KEYPAD_BENCH_SCANS ((int32_t) 2000)
+
+typedef struct {
+    int32_t key;
+    int64_t press_ns;       // From the start of the script
+    int64_t release_ns;
+    int64_t bounce_ns;
+} KeypadBenchPress;
+
+// Keys 5, 6 and 9 make a rectangle from 40 to 100 ms with the ghost key 10, which must never be reported. Key 9 is
+// reported when the rectangle goes away, the others at their real times.
+static const KeypadBenchPress keypad_script[KEYPAD_BENCH_PRESSES] = {
+    { 0, 0, 40000000, 3000000 },
+    { 5, 20000000, 100000000, 0 },
+    { 6, 22000000, 100000000, 2000000 },
+    { 9, 40000000, 120000000, 0 },
+    { 15, 60000000, 80000000, 4000000 },
+    { 3, 130000000, 150000000, 1000000 }
+};
+
+static int64_t keypad_script_start_ns = 0;
+
+static int32_t keypad_model_busy = 0;
+
+// Keys held down at now_ns, bit per key.
+static uint64_t keypad_model_pressed(int64_t now_ns) {
+    uint64_t pressed = 0U;
+    int32_t i = 0;
+
+    for (i = 0; i < KEYPAD_BENCH_PRESSES; i++) {
+        const KeypadBenchPress *p = &keypad_script[i];
+        int64_t t_ns = now_ns - keypad_script_start_ns - p->press_ns;
+
+        if (t_ns >= 0 && t_ns < (p->release_ns - p->press_ns) && (t_ns >= p->bounce_ns || ((t_ns / KEYPAD_BENCH_BOUNCE_PERIOD_NS) % 2) == 0)) {
+            pressed |= (uint64_t) 1U << p->key;
+        }
+    }
+
+    return pressed;
+}
+
+// The keypad, without diodes: before every column read, the columns get the level of the rows they are connected to
+// through pressed keys, directly or through other rows and columns (ghosting).
+static int32_t keypad_model_hook(int32_t op, int32_t bank, uint32_t mask) {
+    const int32_t rows[4] = KEYPAD_BENCH_ROW_PINS;
+    const int32_t columns[4] = KEYPAD_BENCH_COLUMN_PINS;
+
+    if (op == GPIO_IO_BANK_READ && bank == GPIO_BANK_OF(columns[0]) && keypad_model_busy == 0) {
+        uint64_t pressed = keypad_model_pressed(rt_now_ns());
+        uint32_t row_levels = 0U;
+        uint32_t reached_rows = 0U;
+        uint32_t reached_columns = 0U;
+        uint32_t value = 0U;
+        int32_t grew = 1;
+        int32_t r = 0;
+        int32_t c = 0;
+
+        keypad_model_busy = 1;
+        (void) gpio_bank_read(GPIO_BANK_OF(rows[0]), 0xFFFFFFFFU, &row_levels);
+        keypad_model_busy = 0;
+
+        for (r = 0; r < 4; r++) {
+            if ((row_levels & GPIO_BIT_OF(rows[r])) != 0U) {
+                reached_rows |= 1U << r;
+            }
+        }
+        while (grew == 1) {
+            grew = 0;
+            for (r = 0; r < 4; r++) {
+                for (c = 0; c < 4; c++) {
+                    if (((pressed >> ((r * 4) + c)) & 1U) != 0U && ((reached_rows >> r) & 1U) != ((reached_columns >> c) & 1U)) {
+                        reached_rows |= 1U << r;
+                        reached_columns |= 1U << c;
+                        grew = 1;
+                    }
+                }
+            }
+        }
+        for (c = 0; c < 4; c++) {
+            if (((reached_columns >> c) & 1U) != 0U) {
+                value |= GPIO_BIT_OF(columns[c]);
+            }
+        }
+        gpio_bank_sim_set(bank, mask, value);
+    }
+
+    return 0;
+}
+
+static int32_t bench_keypad(void) {
+    int32_t result = 0;
+    const int32_t rows[4] = KEYPAD_BENCH_ROW_PINS;
+    const int32_t columns[4] = KEYPAD_BENCH_COLUMN_PINS;
+    const int32_t backends[3] = { GPIO_BACKEND_SIM, GPIO_BACKEND_MMAP, GPIO_BACKEND_SYSFS };
+    KeypadConfig config;
+    static Keypad keypad;
+    GpioInputSet inputs;
+    GpioEvent event;
+    int32_t presses[KEYPAD_MAX_KEYS];
+    int32_t releases[KEYPAD_MAX_KEYS];
+    int32_t ghost_events = 0;
+    int64_t max_error_ns = 0;
+    int64_t key9_late_ns = 0;
+    int32_t i = 0;
+
+    keypad_default_config(&config);
+    for (i = 0; i < 4; i++) {
+        config.row_pins[i] = rows[i];
+        config.column_pins[i] = columns[i];
+    }
+    config.row_count = 4;
+    config.column_count = 4;
+    (void) memset(presses, 0, sizeof(presses));
+    (void) memset(releases, 0, sizeof(releases));
+
+    // Scripted presses through the input set, like the stopwatch's button thread.
+    if (gpio_bank_open(GPIO_BACKEND_SIM) != 1 || keypad_init(&keypad, &config) != 1) {
+        (void) printf("keypad: could not set up the simulated keypad\n");
+        return 1;
+    }
+    gpio_input_init(&inputs, NULL);
+    (void) keypad_attach(&keypad, &inputs);
+    set_gpio_io_hook(&keypad_model_hook);
+    keypad_script_start_ns = rt_now_ns() + (10 * NS_PER_MS);
+
+    while (rt_now_ns() < keypad_script_start_ns + (200 * NS_PER_MS)) {
+        if (gpio_input_wait(&inputs, &event, 10) == 1) {
+            if (event.type == GPIO_EVENT_GHOSTING) {
+                ghost_events++;
+            }
+            else if (event.type == GPIO_EVENT_KEY) {
+                for (i = 0; i < KEYPAD_BENCH_PRESSES; i++) {
+                    const KeypadBenchPress *p = &keypad_script[i];
+                    int64_t true_ns = keypad_script_start_ns + ((event.value == 1) ? p->press_ns : p->release_ns);
+
+                    if (p->key != event.pin) {
+                    }
+                    // Key 9 is pressed inside the rectangle, it can only be seen when the rectangle is gone.
+                    else if (p->key == 9 && event.value == 1) {
+                        key9_late_ns = event.time_ns - true_ns;
+                    }
+                    // Releases of keys in the rectangle are seen when it goes away, which is the release of key 5 / 6.
+                    else if (event.time_ns - true_ns > max_error_ns) {
+                        max_error_ns = event.time_ns - true_ns;
+                    }
+                    else {
+                    }
+                }
+                if (event.value == 1) {
+                    presses[event.pin]++;
+                }
+                else {
+                    releases[event.pin]++;
+                }
+            }
+            else {
+            }
+        }
+    }
+    set_gpio_io_hook(NULL);
+
+    (void) printf("Simulated 4x4 keypad without diodes, %d scripted presses (with bounce and a ghosting rectangle):\n", KEYPAD_BENCH_PRESSES);
+    keypad_print_stats(&keypad);
+    (void) printf("  latest event %.2f ms after the real edge (scan every %.1f ms, bounce included), key 9 seen %.1f ms late (inside the rectangle), %d ghosting events\n",
+                  (double) max_error_ns / 1e6, (double) config.scan_period_ns / 1e6, (double) key9_late_ns / 1e6, ghost_events);
+
+    for (i = 0; i < KEYPAD_BENCH_PRESSES; i++) {
+        if (presses[keypad_script[i].key] != 1 || releases[keypad_script[i].key] != 1) {
+            (void) printf("keypad: key %d pressed %d and released %d times, expected once each\n", keypad_script[i].key,
+                          presses[keypad_script[i].key], releases[keypad_script[i].key]);
+            result = 1;
+        }
+    }
+    if (presses[10] != 0 || ghost_events == 0) {
+        (void) printf("keypad: the ghost key was reported or the ghosting was not detected\n");
+        result = 1;
+    }
+
+    // Scan cycle time per backend, with nobody pressing anything.
+    (void) printf("Scan cycle per backend (%d rows, settle %.1f us per row):\n", config.row_count, (double) config.settle_ns / 1e3);
+    for (i = 0; i < 3; i++) {
+        uint32_t probe = 0U;
+
+        if (gpio_bank_open(backends[i]) == 1 && gpio_bank_read(GPIO_BANK_OF(columns[0]), GPIO_BIT_OF(columns[0]), &probe) == 1 &&
+            keypad_init(&keypad, &config) == 1) {
+            int32_t scans = (backends[i] == GPIO_BACKEND_SYSFS) ? (KEYPAD_BENCH_SCANS / 10) : KEYPAD_BENCH_SCANS;
+            int32_t n = 0;
+
+            for (n = 0; n < scans; n++) {
+                (void) keypad_scan(&keypad, rt_now_ns(), &event, 1);
+            }
+            keypad_print_stats(&keypad);
+        }
+        else {
+            (void) printf("(%s backend not usable here)\n", gpio_bank_backend_name(backends[i]));
+        }
+    }
+    gpio_bank_close();
+
+    return result;
+}
+
+
+/// ----------- PWM MAILBOX ----------- ///
+
+#define PWMBOX_BENCH_NS ((int64_t) 200000000)
+
+#define PWMBOX_BENCH_CHANNELS ((int32_t) 3)
+
+// A control loop at 1 kHz PWM on two channels and a servo at 50 Hz, all posted to as fast as one thread can.
+static const int32_t pwmbox_bench_frequencies[PWMBOX_BENCH_CHANNELS] = { 1000, 1000, 50 };
+
+static int32_t bench_pwmbox(void) {
+    int32_t result = 0;
+    int32_t channels[PWMBOX_BENCH_CHANNELS];
+    uint32_t periods[PWMBOX_BENCH_CHANNELS];
+    uint32_t last_duty[PWMBOX_BENCH_CHANNELS];
+    uint64_t posts = 0U;
+    int32_t c = 0;
+
+    for (c = 0; c < PWMBOX_BENCH_CHANNELS; c++) {
+        channels[c] = pwmbox_open(NULL, pwmbox_bench_frequencies[c]);
+        periods[c] = (uint32_t) (1000000000 / pwmbox_bench_frequencies[c]);
+        last_duty[c] = 0U;
+        if (channels[c] < 0) {
+            result = 1;
+        }
+    }
+
+    if (result != 0 || pwmbox_start(PWMBOX_EVERY_PWM_PERIOD, RT_PRIORITY_NONE) != 1) {
+        (void) printf("pwmbox: could not open the simulated channels\n");
+        result = 1;
+    }
+    else {
+        int64_t start_ns = rt_now_ns();
+        int64_t elapsed_ns = 0;
+        int64_t post_ns = 0;
+
+        while (elapsed_ns < PWMBOX_BENCH_NS) {
+            int64_t batch_ns = rt_now_ns();
+            int32_t i = 0;
+
+            for (i = 0; i < 1000; i++) {
+                c = i % PWMBOX_BENCH_CHANNELS;
+                last_duty[c] = (uint32_t) ((posts * 7919U) % periods[c]);
+                (void) pwmbox_post(channels[c], periods[c], last_duty[c]);
+                posts++;
+            }
+            elapsed_ns = rt_now_ns() - start_ns;
+            post_ns += rt_now_ns() - batch_ns;
+        }
+        pwmbox_stop();
+
+        (void) printf("PWM mailbox, %llu posts over %d channels in %.0f ms: %.1f ns per post\n", (unsigned long long) posts,
+                      PWMBOX_BENCH_CHANNELS, (double) elapsed_ns / 1e6, (double) post_ns / (double) posts);
+        pwmbox_print_stats();
+
+        for (c = 0; c < PWMBOX_BENCH_CHANNELS; c++) {
+            PwmboxStats s;
+            uint64_t max_applies = (uint64_t) (elapsed_ns / (int64_t) periods[c]) + 2U;
+
+            pwmbox_get_stats(channels[c], &s);
+            if (s.duty_ns != last_duty[c] || s.period_ns != periods[c]) {
+                (void) printf("pwmbox: channel %d ended at %u / %u ns, last post was %u / %u ns\n", c, s.period_ns, s.duty_ns,
+                              periods[c], last_duty[c]);
+                result = 1;
+            }
+            if (s.applies > max_applies) {
+                (void) printf("pwmbox: channel %d applied %llu times, at most %llu expected\n", c,
+                              (unsigned long long) s.applies, (unsigned long long) max_applies);
+                result = 1;
+            }
+        }
+
+        // Closed channels can't be restarted, opening after a stop starts a new set.
+        if (pwmbox_start(PWMBOX_EVERY_PWM_PERIOD, RT_PRIORITY_NONE) != 0 || pwmbox_open(NULL, 1000) != 0 ||
+            pwmbox_start(PWMBOX_EVERY_PWM_PERIOD, RT_PRIORITY_NONE) != 1) {
+            (void) printf("pwmbox: restart after a stop misbehaved\n");
+            result = 1;
+        }
+        pwmbox_stop();
+    }
+
+    return result;
+}
+
+
+/// ----------- BBBIO FAST PATH ----------- ///
+
+#define FAST_BENCH_CALLS ((int32_t) 1000000)
+
+// Calls that open and close a file each time are much slower, fewer of them.
+#define FAST_BENCH_FILE_CALLS ((int32_t) 20000)
+
+#define FAST_BENCH_FILE "/tmp/bbbio_bench_fast_value"
+
+typedef struct {
+    int64_t start_ns;
+    uint64_t start_cycles;
+    double ns;              // Per call
+    double cycles;
+} FastMeasure;
+
+static void fast_begin(PerfThread *pt, FastMeasure *m) {
+    m->start_cycles = pt->sum[PERF_COUNTER_CYCLES];
+    perf_iteration_begin(pt);
+    m->start_ns = rt_now_ns();
+}
+
+static void fast_end(PerfThread *pt, FastMeasure *m, int32_t calls) {
+    m->ns = (double) (rt_now_ns() - m->start_ns) / (double) calls;
+    perf_iteration_end(pt);
+    m->cycles = (double) (pt->sum[PERF_COUNTER_CYCLES] - m->start_cycles) / (double) calls;
+}
+
+static void fast_report(const char *step, const FastMeasure *regular, const FastMeasure *fast) {
+    (void) printf("  %-28s %9.1f %11.0f %9.1f %11.0f %14.0f\n", step, regular->ns, regular->cycles, fast->ns, fast->cycles,
+                  regular->cycles - fast->cycles);
+}
+
+// The identifier chain every PWM function of bbbio had before pwm_channel_index.
+static BufferPointer chained_channel_path(Buffer pin_identifier) {
+    BufferPointer channel_path = (BufferPointer) NULL_STR;
+
+    if (pin_identifier[0] == '1' && pin_identifier[1] == 'A') {
+        channel_path = (BufferPointer) PWM1PINA_PATH;
+    }
+    else if (pin_identifier[0] == '1' && pin_identifier[1] == 'B') {
+        channel_path = (BufferPointer) PWM1PINB_PATH;
+    }
+    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'A') {
+        channel_path = (BufferPointer) PWM2PINA_PATH;
+    }
+    else if (pin_identifier[0] == '2' && pin_identifier[1] == 'B') {
+        channel_path = (BufferPointer) PWM2PINB_PATH;
+    }
+    else {
+        channel_path = (BufferPointer) NULL_STR;
+    }
+
+    return channel_path;
+}
+
+// What write_gpio_value does around the write itself, on a regular file: path and value through snprintf, stdio open,
+// write and close.
+static int32_t regular_file_write(int32_t pin, int32_t value) {
+    int32_t result = 0;
+    Buffer path;
+    Buffer text;
+
+    if (snprintf((char *) path, sizeof(path), "%s", FAST_BENCH_FILE) > 0 && snprintf((char *) text, sizeof(text), "%d", value) > 0 &&
+        pin >= 0) {
+        FILE *file = fopen((char *) path, "w");
+
+        if (file != NULL) {
+            result = (int32_t) (fprintf(file, "%s", text) > 0);
+            (void) fclose(file);
+        }
+    }
+
+    return result;
+}
+
+static int32_t bench_fastpath(void) {
+    int32_t result = 0;
+    PerfThread pt;
+    FastMeasure regular;
+    FastMeasure fast;
+    GpioHandle gpio;
+    PwmHandle pwm;
+    const char *const identifiers[8] = { "1A", "2B", "1B", "2A", "2B", "1A", "2A", "1B" };
+    uint8_t text[DECIMAL_MAX_DIGITS + 1];
+    uint32_t sink = 0U;
+    int32_t i = 0;
+
+    (void) perf_thread_open(&pt, "fastpath");
+    gpio.fd = open(FAST_BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    gpio.bank = 1;
+    gpio.mask = 1U << 28;
+    pwm.period_fd = gpio.fd;
+    pwm.duty_fd = gpio.fd;
+    pwm.enable_fd = gpio.fd;
+
+    if (gpio.fd < 0) {
+        (void) printf("fastpath: could not create %s\n", FAST_BENCH_FILE);
+        perf_thread_close(&pt);
+        return 1;
+    }
+
+    // A regular file stands in for the sysfs attribute, so the savings are the bbbio work around the write, not the driver.
+    (void) printf("Per call, regular API vs fast path (cycles: %s):\n",
+                  (pt.leader_fd < 0) ? "no counters here, 0" : ((pt.software_cycles == 1) ? "no PMU, task clock ns" : "CPU cycles"));
+    (void) printf("  %-28s %9s %11s %9s %11s %14s\n", "", "ns", "cycles", "fast ns", "fast cycles", "cycles saved");
+
+    fast_begin(&pt, &regular);
+    for (i = 0; i < FAST_BENCH_CALLS; i++) {
+        sink += (uint32_t) snprintf((char *) text, sizeof(text), "%d", (int32_t) (((uint32_t) i * 7919U) % 1000000U));
+    }
+    fast_end(&pt, &regular, FAST_BENCH_CALLS);
+    fast_begin(&pt, &fast);
+    for (i = 0; i < FAST_BENCH_CALLS; i++) {
+        sink += (uint32_t) format_decimal(((uint32_t) i * 7919U) % 1000000U, text);
+    }
+    fast_end(&pt, &fast, FAST_BENCH_CALLS);
+    fast_report("format duty (snprintf/table)", &regular, &fast);
+
+    // Per call, the regular API resolves the identifier and formats the file path. A handle only needs the index, once.
+    // The identifiers rotate so the chain's branches can't all be predicted from the last call.
+    fast_begin(&pt, &regular);
+    for (i = 0; i < FAST_BENCH_CALLS; i++) {
+        BufferPointer path = chained_channel_path((BufferPointer) identifiers[(((uint32_t) i * 2654435761U) >> 29)]);
+        Buffer duty_path;
+
+        if (strncmp((char *) path, (char *) NULL_STR, sizeof(NULL_STR)) != 0) {
+            sink += (uint32_t) snprintf((char *) duty_path, sizeof(duty_path), "%s%s", (char *) path, PWM_DUTY_CYCLE_PATH);
+        }
+    }
+    fast_end(&pt, &regular, FAST_BENCH_CALLS);
+    fast_begin(&pt, &fast);
+    for (i = 0; i < FAST_BENCH_CALLS; i++) {
+        sink += (uint32_t) (pwm_channel_index((const uint8_t *) identifiers[(((uint32_t) i * 2654435761U) >> 29)]) != PWM_CHANNEL_INVALID);
+    }
+    fast_end(&pt, &fast, FAST_BENCH_CALLS);
+    fast_report("PWM identifier to file", &regular, &fast);
+
+    fast_begin(&pt, &regular);
+    for (i = 0; i < FAST_BENCH_FILE_CALLS; i++) {
+        sink += (uint32_t) regular_file_write(60, i & 1);
+    }
+    fast_end(&pt, &regular, FAST_BENCH_FILE_CALLS);
+    fast_begin(&pt, &fast);
+    for (i = 0; i < FAST_BENCH_CALLS; i++) {
+        if (write_gpio_fast(&gpio, i & 1) != 1) {
+            result = 1;
+        }
+    }
+    fast_end(&pt, &fast, FAST_BENCH_CALLS);
+    fast_report("GPIO write (file)", &regular, &fast);
+
+    fast_begin(&pt, &regular);
+    for (i = 0; i < FAST_BENCH_FILE_CALLS; i++) {
+        sink += (uint32_t) regular_file_write(60, (int32_t) (((uint32_t) i * 7919U) % 1000000U));
+    }
+    fast_end(&pt, &regular, FAST_BENCH_FILE_CALLS);
+    fast_begin(&pt, &fast);
+    for (i = 0; i < FAST_BENCH_CALLS; i++) {
+        if (write_pwm_duty_fast(&pwm, ((uint32_t) i * 7919U) % 1000000U) != 1) {
+            result = 1;
+        }
+    }
+    fast_end(&pt, &fast, FAST_BENCH_CALLS);
+    fast_report("PWM duty write (file)", &regular, &fast);
+
+    // The last duty cycle must read back as written, and a GPIO read must see the last digit.
+    if (write_pwm_duty_fast(&pwm, 1234567U) != 1 || pread(gpio.fd, text, 7U, 0) != 7 || memcmp(text, "1234567", 7U) != 0 ||
+        read_gpio_fast(&gpio) != 1 || format_decimal(0U, text) != 1 || text[0] != (uint8_t) '0' ||
+        format_decimal(4294967295U, text) != 10 || memcmp(text, "4294967295", 10U) != 0 ||
+        pwm_channel_index((const uint8_t *) "3A") != PWM_CHANNEL_INVALID || pwm_channel_index((const uint8_t *) "2B") != 3) {
+        (void) printf("fastpath: values don't read back as written\n");
+        result = 1;
+    }
+    (void) printf("  (%u)\n", sink & 1U);
+
+    (void) close(gpio.fd);
+    (void) unlink(FAST_BENCH_FILE);
+    perf_thread_close(&pt);
+
+    return result;
+}
+
+
+/// ----------- STOPWATCH CORE ----------- ///
+
+#define SWCORE_BENCH_EVENTS ((int32_t) 10000000)
+
+#define SWCORE_BENCH_PRODUCERS ((int32_t) 3)
+
+#define SWCORE_BENCH_PUSHES ((int32_t) 200000)
+
+#define SWCORE_MS ((int64_t) 1000000)
+
+// A session, with what each event must record (elapsed ms at the event) and the state it leaves. The reset at 4.5 s
+// comes while running, the reset stamped 5.2 s is pushed after the lap at 5.25 s (two producers racing).
+typedef struct {
+    SwEvent event;
+    int32_t effect;
+    int64_t elapsed_ms;
+    int32_t state;
+} SwcoreStep;
+
+static const SwcoreStep swcore_script[] = {
+    { { SW_EVENT_TOGGLE, 0, 1000 * SWCORE_MS }, SW_EFFECT_START, 0, SW_STATE_RUNNING },
+    { { SW_EVENT_LAP, 5, 2500 * SWCORE_MS }, SW_EFFECT_LAP, 1500, SW_STATE_RUNNING },
+    { { SW_EVENT_TOGGLE, 0, 3000 * SWCORE_MS }, SW_EFFECT_STOP, 2000, SW_STATE_STOPPED },
+    { { SW_EVENT_STOP, 0, 3200 * SWCORE_MS }, SW_EFFECT_NONE, 2000, SW_STATE_STOPPED },
+    { { SW_EVENT_START, 0, 4000 * SWCORE_MS }, SW_EFFECT_START, 2000, SW_STATE_RUNNING },
+    { { SW_EVENT_RESET, 1, 4500 * SWCORE_MS }, SW_EFFECT_RESET, 2500, SW_STATE_RUNNING },
+    { { SW_EVENT_LAP, 6, 5250 * SWCORE_MS }, SW_EFFECT_LAP, 750, SW_STATE_RUNNING },
+    { { SW_EVENT_RESET, 1, 5200 * SWCORE_MS }, SW_EFFECT_RESET, 750, SW_STATE_RUNNING },
+    { { SW_EVENT_TOGGLE, 0, 6000 * SWCORE_MS }, SW_EFFECT_STOP, 750, SW_STATE_STOPPED },
+    { { SW_EVENT_RESET, 1, 7000 * SWCORE_MS }, SW_EFFECT_RESET, 750, SW_STATE_ZERO }
+};
+
+#define SWCORE_SCRIPT_STEPS ((int32_t) (sizeof(swcore_script) / sizeof(swcore_script[0])))
+
+typedef struct {
+    SwQueue *queue;
+    int32_t id;
+    uint64_t full;          // Pushes retried on a full queue
+} SwcoreProducer;
+
+// Pushes SWCORE_BENCH_PUSHES events numbered 0, 1, ... in time_ns, retrying while the queue is full.
+static void *swcore_producer_thread(void *arg) {
+    SwcoreProducer *producer = (SwcoreProducer *) arg;
+    SwEvent event;
+    int32_t i = 0;
+
+    event.type = SW_EVENT_LAP;
+    event.source = producer->id;
+    for (i = 0; i < SWCORE_BENCH_PUSHES; i++) {
+        event.time_ns = i;
+        while (sw_queue_push(producer->queue, &event) != 1) {
+            producer->full++;
+            (void) sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static int32_t bench_swcore(void) {
+    int32_t result = 0;
+    SwCore core;
+    SwCore replayed;
+    SwOutput output;
+    SwEvent event;
+    static SwEvent events[SWCORE_SCRIPT_STEPS];
+    static SwQueue queue;
+    SwcoreProducer producers[SWCORE_BENCH_PRODUCERS];
+    pthread_t threads[SWCORE_BENCH_PRODUCERS];
+    int64_t next[SWCORE_BENCH_PRODUCERS];
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    int64_t sink = 0;
+    int64_t start_ns = 0;
+    int64_t apply_ns = 0;
+    int64_t queue_ns = 0;
+    int32_t popped = 0;
+    int32_t i = 0;
+
+    // The script, then the same events replayed into a fresh core.
+    swcore_init(&core, 0);
+    for (i = 0; i < SWCORE_SCRIPT_STEPS; i++) {
+        const SwcoreStep *step = &swcore_script[i];
+
+        events[i] = step->event;
+        if (swcore_apply(&core, &step->event, &output) != step->effect || output.elapsed_ns != step->elapsed_ms * SWCORE_MS ||
+            output.state != step->state) {
+            (void) printf("swcore: step %d gave effect %d at %lld ms in state %d, expected %d at %lld ms in state %d\n", i, output.effect,
+                          (long long) (output.elapsed_ns / SWCORE_MS), output.state, step->effect, (long long) step->elapsed_ms, step->state);
+            result = 1;
+        }
+    }
+    swcore_init(&replayed, 0);
+    (void) swcore_replay(&replayed, events, SWCORE_SCRIPT_STEPS);
+    if (memcmp(&core, &replayed, sizeof(core)) != 0 || core.reordered != 1U || swcore_elapsed_ns(&core, 9000 * SWCORE_MS) != 0) {
+        (void) printf("swcore: the replay doesn't match the session\n");
+        result = 1;
+    }
+    (void) printf("Scripted session: %d events, %llu without effect, %llu out of order, replay %s\n", SWCORE_SCRIPT_STEPS,
+                  (unsigned long long) core.no_effect, (unsigned long long) core.reordered, (result == 0) ? "identical" : "DIFFERENT");
+
+    // Transition cost: random events 1 ms apart.
+    swcore_init(&core, 0);
+    event.source = 0;
+    start_ns = rt_now_ns();
+    for (i = 0; i < SWCORE_BENCH_EVENTS; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        event.type = (int32_t) (state % (uint64_t) SW_EVENT_COUNT);
+        event.time_ns = (int64_t) i * SWCORE_MS;
+        sink += (int64_t) swcore_apply(&core, &event, &output) + output.elapsed_ns;
+    }
+    apply_ns = rt_now_ns() - start_ns;
+
+    // Queue cost without contention: push then pop.
+    sw_queue_init(&queue);
+    start_ns = rt_now_ns();
+    for (i = 0; i < SWCORE_BENCH_EVENTS; i++) {
+        event.time_ns = i;
+        (void) sw_queue_push(&queue, &event);
+        (void) sw_queue_pop(&queue, &event);
+        sink += event.time_ns;
+    }
+    queue_ns = rt_now_ns() - start_ns;
+
+    (void) printf("Per event: apply %.1f ns, queue push + pop %.1f ns (%lld)\n", (double) apply_ns / (double) SWCORE_BENCH_EVENTS,
+                  (double) queue_ns / (double) SWCORE_BENCH_EVENTS, (long long) (sink & 1));
+
+    // Producers racing: nothing lost, and each producer's events come out in its order.
+    sw_queue_init(&queue);
+    for (i = 0; i < SWCORE_BENCH_PRODUCERS; i++) {
+        producers[i].queue = &queue;
+        producers[i].id = i;
+        producers[i].full = 0U;
+        next[i] = 0;
+        if (rt_thread_start(&threads[i], RT_PRIORITY_NONE, &swcore_producer_thread, &producers[i]) != 0) {
+            (void) printf("swcore: could not start producer %d\n", i);
+            return 1;
+        }
+    }
+    start_ns = rt_now_ns();
+    while (popped < SWCORE_BENCH_PRODUCERS * SWCORE_BENCH_PUSHES && rt_now_ns() - start_ns < (int64_t) (10 * NS_PER_SEC)) {
+        if (sw_queue_pop(&queue, &event) == 1) {
+            if (event.source < 0 || event.source >= SWCORE_BENCH_PRODUCERS || event.time_ns != next[event.source]) {
+                result = 1;
+            }
+            else {
+                next[event.source]++;
+            }
+            popped++;
+        }
+        else {
+            (void) sched_yield();
+        }
+    }
+    for (i = 0; i < SWCORE_BENCH_PRODUCERS; i++) {
+        (void) pthread_join(threads[i], NULL);
+        (void) printf("  producer %d: %lld events in order, %llu retries on a full queue\n", i, (long long) next[i],
+                      (unsigned long long) producers[i].full);
+        if (next[i] != SWCORE_BENCH_PUSHES) {
+            result = 1;
+        }
+    }
+    (void) printf("%d producers x %d pushes: %d popped in %.0f ms%s\n", SWCORE_BENCH_PRODUCERS, SWCORE_BENCH_PUSHES, popped,
+                  (double) (rt_now_ns() - start_ns) / 1e6, (result == 0) ? "" : ", LOST OR OUT OF ORDER");
+
+    return result;
+}
+
+
+/// ----------- GPIO SEQUENCER ----------- ///
+
+#define SEQ_BENCH_STEPS ((int32_t) 4)
+
+#define SEQ_BENCH_BANK ((int32_t) 1)
+
+// On bank 0, so the table (bank 1) can't trigger itself.
+#define SEQ_BENCH_TRIGGER_PIN ((int32_t) 26)
+
+#define SEQ_BENCH_LOOP_NS ((int64_t) 200000000)
+
+// Long against a pass (1 ms) and the trigger poll (50 us), so no edge is missed even on a loaded machine.
+#define SEQ_BENCH_SETTLE_NS ((int64_t) 20000000)
+
+// A 1 ms pass: a short pulse on two pins, then a slower one on a third.
+static const SeqStep seq_bench_steps[SEQ_BENCH_STEPS] = {
+    { 0x00006000U, 0x00006000U, 100000U },
+    { 0x00006000U, 0x00000000U, 200000U },
+    { 0x00008000U, 0x00008000U, 300000U },
+    { 0x00008000U, 0x00000000U, 400000U }
+};
+
+// Runs one sequencer on the table and checks the number of passes and the write failures.
+static int32_t run_sequencer(int32_t mode, const char *name) {
+    int32_t result = 0;
+    Sequencer seq;
+    SeqStepStats stats[SEQ_BENCH_STEPS];
+    uint32_t trigger_bit = GPIO_BIT_OF(SEQ_BENCH_TRIGGER_PIN);
+    uint32_t expected = 0U;
+    int32_t i = 0;
+
+    gpio_bank_sim_set(GPIO_BANK_OF(SEQ_BENCH_TRIGGER_PIN), trigger_bit, 0U);
+
+    if (sequencer_init(&seq, SEQ_BENCH_BANK, seq_bench_steps, stats, SEQ_BENCH_STEPS, mode, SEQ_BENCH_TRIGGER_PIN) != 1 ||
+        sequencer_start(&seq, RT_PRIORITY_NONE) != 1) {
+        (void) printf("sequencer: could not start the %s sequencer\n", name);
+        result = 1;
+    }
+    else {
+        if (mode == SEQ_MODE_LOOP) {
+            rt_sleep_until_ns(rt_now_ns() + SEQ_BENCH_LOOP_NS);
+            sequencer_stop(&seq);
+        }
+        else if (mode == SEQ_MODE_ONESHOT) {
+            sequencer_wait(&seq);
+            expected = 1U;
+        }
+        else {
+            // Two rising edges, each followed by a full pass.
+            for (i = 0; i < 2; i++) {
+                rt_sleep_until_ns(rt_now_ns() + SEQ_BENCH_SETTLE_NS);
+                gpio_bank_sim_set(GPIO_BANK_OF(SEQ_BENCH_TRIGGER_PIN), trigger_bit, trigger_bit);
+                rt_sleep_until_ns(rt_now_ns() + SEQ_BENCH_SETTLE_NS);
+                gpio_bank_sim_set(GPIO_BANK_OF(SEQ_BENCH_TRIGGER_PIN), trigger_bit, 0U);
+            }
+            rt_sleep_until_ns(rt_now_ns() + SEQ_BENCH_SETTLE_NS);
+            sequencer_stop(&seq);
+            expected = 2U;
+        }
+
+        // Both must be no-ops on a sequencer that was already joined.
+        sequencer_stop(&seq);
+        sequencer_wait(&seq);
+
+        (void) printf("%s: %u passes\n", name, seq.passes);
+        sequencer_print_report(&seq);
+
+        if ((expected == 0U && seq.passes == 0U) || (expected != 0U && seq.passes != expected)) {
+            (void) printf("sequencer: %s played %u passes\n", name, seq.passes);
+            result = 1;
+        }
+        for (i = 0; i < SEQ_BENCH_STEPS; i++) {
+            if (stats[i].write_failures != 0U) {
+                result = 1;
+            }
+        }
+    }
+
+    return result;
+}
+
+
+static int32_t bench_sequencer(void) {
+    int32_t result = 0;
+
+    if (gpio_bank_open(GPIO_BACKEND_SIM) != 1) {
+        (void) printf("sequencer: could not open the SIM backend\n");
+        result = 1;
+    }
+    else {
+        result |= run_sequencer(SEQ_MODE_LOOP, "Loop");
+        result |= run_sequencer(SEQ_MODE_ONESHOT, "One-shot");
+        result |= run_sequencer(SEQ_MODE_TRIGGERED, "Triggered");
+        gpio_bank_close();
+    }
+
+    return result;
+}
+
+
+static const Benchmark benchmarks[] = {
+    { "edges", "SIMD edge extraction over a captured bank buffer (GB/s per kernel)", &bench_edges },
+    { "deferred", "Deferred GPIO writes: cost per post and coalescing ratio", &bench_deferred },
+    { "spi", "SPI display refresh: one ioctl per double buffered frame (frames/s)", &bench_spi },
+    { "i2c", "I2C combined transactions and register cache (transactions/s)", &bench_i2c },
+    { "alarm", "Alarm onset error on absolute deadlines, timerfd vs clock_nanosleep", &bench_alarm },
+    { "photogate", "Light gate timing from edge timestamps: error and resolution, sampler vs edge interrupts", &bench_photogate },
+    { "journal", "Session journal append cost (mmap'd segments, rotation included)", &bench_journal },
+    { "fault", "Press latency and deadline misses of the button path under injected GPIO faults", &bench_fault },
+    { "loopback", "Virtual wires on the SIM backend: loopback latency, PWM capture, contact bounce", &bench_loopback },
+    { "wave", "PWM waveform modulator: writes avoided and update cost vs float duty math", &bench_wave },
+    { "control", "Fixed rate PID loops sharing one thread: execution time, jitter and settling", &bench_control },
+    { "perf", "Per thread performance counters: cache behaviour of two walks and the cost of sampling", &bench_perf },
+    { "trace", "ftrace trace_marker records: cost disabled, enabled and vs a formatted debug write", &bench_trace },
+    { "probes", "USDT probes: cost of a probed hot path call with no tracer attached", &bench_probes },
+    { "onewire", "Bit-banged 1-Wire master vs simulated DS18B20s: search, reads, slot timing errors and retries", &bench_onewire },
+    { "keypad", "Keypad matrix scanner: debounce, ghosting and scan cycle time per backend", &bench_keypad },
+    { "pwmbox", "PWM update mailbox: cost per post and post / apply ratio (sysfs writes avoided)", &bench_pwmbox },
+    { "fastpath", "bbbio fast path: cycles per call saved by handles, inlining and the digit table", &bench_fastpath },
+    { "swcore", "Stopwatch core: scripted session and replay, cost per transition, MPSC queue under racing producers", &bench_swcore },
+    { "sequencer", "GPIO pattern sequencer on the SIM backend: loop, one-shot and triggered passes, per step timing error", &bench_sequencer }
+};
+
+#define BENCHMARK_COUNT ((int32_t) (sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+
+int32_t main(int32_t argc, char **argv) {
+    int32_t result = 0;
+    int32_t found = 0;
+    int32_t i = 0;
+
+    if (argc < 2) {
+        (void) printf("Usage: %s <benchmark>|all\n", argv[0]);
+        for (i = 0; i < BENCHMARK_COUNT; i++) {
+            (void) printf("  %-12s %s\n", benchmarks[i].name, benchmarks[i].description);
+        }
+    }
+    else {
+        for (i = 0; i < BENCHMARK_COUNT; i++) {
+            if (strcmp(argv[1], "all") == 0 || strcmp(argv[1], benchmarks[i].name) == 0) {
+                found = 1;
+                if (benchmarks[i].run() != 0) {
+                    result = 1;
+                }
+                (void) printf("\n");
+            }
+        }
+
+        if (found == 0) {
+            (void) printf("Unknown benchmark: %s\n", argv[1]);
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,311 @@
+/*
+This file implements all the functions defined in control.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN CONTROL.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "rtutil.h"
+#include "control.h"
+
+
+static int32_t clamp(int64_t value, int32_t low, int32_t high) {
+    int32_t result = (int32_t) value;
+
+    if (value < (int64_t) low) {
+        result = low;
+    }
+    else if (value > (int64_t) high) {
+        result = high;
+    }
+    else {
+    }
+
+    return result;
+}
+
+
+void control_pid_init(ControlPid *pid, int32_t kp, int32_t ki, int32_t kd, int32_t out_min, int32_t out_max) {
+    (void) memset(pid, 0, sizeof(*pid));
+    pid->kp = kp;
+    pid->ki = ki;
+    pid->kd = kd;
+    pid->out_min = out_min;
+    pid->out_max = out_max;
+}
+
+
+int32_t control_pid_step(ControlPid *pid, int32_t setpoint, int32_t measurement) {
+    int64_t error = (int64_t) setpoint - (int64_t) measurement;
+    int64_t i_step = (int64_t) pid->ki * error;
+    int64_t derivative = 0;
+    int64_t sum = 0;
+    int32_t output = 0;
+
+    // Conditional integration: while saturated, only integrate towards getting out of saturation.
+    if (pid->saturated == 0 || (pid->saturated > 0 && i_step < 0) || (pid->saturated < 0 && i_step > 0)) {
+        pid->integral += i_step;
+    }
+    if (pid->integral > ((int64_t) pid->out_max << 16)) {
+        pid->integral = (int64_t) pid->out_max << 16;
+    }
+    else if (pid->integral < ((int64_t) pid->out_min << 16)) {
+        pid->integral = (int64_t) pid->out_min << 16;
+    }
+    else {
+    }
+
+    if (pid->primed == 1) {
+        derivative = (int64_t) pid->kd * ((int64_t) pid->last_measurement - (int64_t) measurement);
+    }
+    pid->last_measurement = measurement;
+    pid->primed = 1;
+
+    // Round to nearest on the way out of Q16.16.
+    sum = ((int64_t) pid->kp * error) + pid->integral + derivative;
+    output = clamp((sum + ((int64_t) 1 << 15)) >> 16, pid->out_min, pid->out_max);
+
+    pid->saturated = 0;
+    if (output == pid->out_max && sum > ((int64_t) pid->out_max << 16)) {
+        pid->saturated = 1;
+    }
+    else if (output == pid->out_min && sum < ((int64_t) pid->out_min << 16)) {
+        pid->saturated = -1;
+    }
+    else {
+    }
+
+    return output;
+}
+
+
+// Runs one loop whose deadline has come.
+static void run_loop(ControlExecutor *ex, ControlLoop *loop, int64_t now_ns) {
+    int64_t start_ns = rt_now_ns();
+    int64_t jitter_ns = start_ns - loop->next_ns;
+    int64_t exec_ns = 0;
+    int32_t measurement = 0;
+    int32_t output = 0;
+    int32_t read_ok = loop->reader(loop->reader_context, &measurement);
+    int32_t write_ok = 1;
+
+    if (read_ok == 1) {
+        output = control_pid_step(&loop->pid, atomic_load_explicit(&loop->setpoint, memory_order_relaxed), measurement);
+        write_ok = loop->writer(loop->writer_context, output);
+    }
+    exec_ns = rt_now_ns() - start_ns;
+
+    (void) pthread_mutex_lock(&ex->lock);
+    loop->stats.runs++;
+    loop->stats.sum_exec_ns += exec_ns;
+    loop->stats.sum_jitter_ns += jitter_ns;
+    if (exec_ns > loop->stats.max_exec_ns) {
+        loop->stats.max_exec_ns = exec_ns;
+    }
+    if (jitter_ns > loop->stats.max_jitter_ns) {
+        loop->stats.max_jitter_ns = jitter_ns;
+    }
+    if (read_ok != 1) {
+        loop->stats.read_failures++;
+    }
+    else {
+        loop->stats.last_measurement = measurement;
+        loop->stats.last_output = output;
+        if (loop->pid.saturated != 0) {
+            loop->stats.saturated_runs++;
+        }
+    }
+    if (write_ok != 1) {
+        loop->stats.write_failures++;
+    }
+
+    // Next deadline. A loop that fell a whole period behind skips the deadlines it missed instead of running back to back.
+    loop->next_ns += loop->period_ns;
+    if (loop->next_ns <= now_ns) {
+        int64_t behind = ((now_ns - loop->next_ns) / loop->period_ns) + 1;
+
+        loop->stats.overruns += (uint64_t) behind;
+        loop->next_ns += behind * loop->period_ns;
+    }
+    (void) pthread_mutex_unlock(&ex->lock);
+}
+
+
+static void *executor_thread_func(void *arg) {
+    ControlExecutor *ex = (ControlExecutor *) arg;
+    int32_t i = 0;
+
+    while (atomic_load(&ex->stop_requested) == 0) {
+        int64_t wake_ns = ex->loops[0].next_ns;
+        int64_t now_ns = 0;
+
+        for (i = 1; i < ex->loop_count; i++) {
+            if (ex->loops[i].next_ns < wake_ns) {
+                wake_ns = ex->loops[i].next_ns;
+            }
+        }
+
+        rt_sleep_until_ns(wake_ns);
+        now_ns = rt_now_ns();
+        ex->wakeups++;
+
+        // Every loop that is due, in the order they were added (put the fastest ones first).
+        for (i = 0; i < ex->loop_count; i++) {
+            if (ex->loops[i].next_ns <= now_ns) {
+                run_loop(ex, &ex->loops[i], now_ns);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+void control_init(ControlExecutor *ex) {
+    (void) memset(ex, 0, sizeof(*ex));
+    (void) pthread_mutex_init(&ex->lock, NULL);
+    atomic_init(&ex->stop_requested, 0);
+}
+
+
+int32_t control_add_loop(ControlExecutor *ex, const ControlLoopConfig *config) {
+    int32_t result = -1;
+
+    if (ex->running == 0 && ex->loop_count < CONTROL_MAX_LOOPS && config->period_ns > 0 && config->reader != NULL &&
+        config->writer != NULL && config->out_min < config->out_max) {
+        ControlLoop *loop = &ex->loops[ex->loop_count];
+
+        (void) memset(loop, 0, sizeof(*loop));
+        (void) snprintf(loop->name, sizeof(loop->name), "%s", (config->name != NULL) ? config->name : "loop");
+        loop->period_ns = config->period_ns;
+        loop->reader = config->reader;
+        loop->reader_context = config->reader_context;
+        loop->writer = config->writer;
+        loop->writer_context = config->writer_context;
+        atomic_init(&loop->setpoint, config->setpoint);
+        control_pid_init(&loop->pid, config->kp, config->ki, config->kd, config->out_min, config->out_max);
+
+        result = ex->loop_count;
+        ex->loop_count++;
+    }
+
+    return result;
+}
+
+
+void control_set_setpoint(ControlExecutor *ex, int32_t loop, int32_t setpoint) {
+    if (loop >= 0 && loop < ex->loop_count) {
+        atomic_store_explicit(&ex->loops[loop].setpoint, setpoint, memory_order_relaxed);
+    }
+}
+
+
+int32_t control_start(ControlExecutor *ex, int32_t priority) {
+    int32_t result = 0;
+    int64_t now_ns = rt_now_ns();
+    int32_t i = 0;
+
+    if (ex->running == 0 && ex->loop_count > 0) {
+        for (i = 0; i < ex->loop_count; i++) {
+            ex->loops[i].next_ns = now_ns + ex->loops[i].period_ns;
+        }
+        atomic_store(&ex->stop_requested, 0);
+        if (rt_thread_start(&ex->thread, priority, &executor_thread_func, ex) == 0) {
+            ex->running = 1;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+void control_stop(ControlExecutor *ex) {
+    if (ex->running == 1) {
+        atomic_store(&ex->stop_requested, 1);
+        (void) pthread_join(ex->thread, NULL);
+        ex->running = 0;
+    }
+}
+
+
+void control_get_stats(ControlExecutor *ex, int32_t loop, ControlLoopStats *stats) {
+    (void) memset(stats, 0, sizeof(*stats));
+
+    if (loop >= 0 && loop < ex->loop_count) {
+        (void) pthread_mutex_lock(&ex->lock);
+        *stats = ex->loops[loop].stats;
+        (void) pthread_mutex_unlock(&ex->lock);
+    }
+}
+
+
+void control_print_report(ControlExecutor *ex) {
+    ControlLoopStats s;
+    int32_t i = 0;
+
+    (void) printf("Control executor: %d loops on one thread, %llu wakeups\n", ex->loop_count, (unsigned long long) ex->wakeups);
+    (void) printf("  %-15s %8s %8s %8s %9s %9s %9s %9s %8s %8s\n", "loop", "rate Hz", "runs", "overrun", "exec avg", "exec max",
+                  "jit avg", "jit max", "setpoint", "value");
+    for (i = 0; i < ex->loop_count; i++) {
+        control_get_stats(ex, i, &s);
+        (void) printf("  %-15s %8.1f %8llu %8llu %7.2fus %7.2fus %7.1fus %7.1fus %8d %8d", ex->loops[i].name,
+                      1e9 / (double) ex->loops[i].period_ns, (unsigned long long) s.runs, (unsigned long long) s.overruns,
+                      (s.runs > 0U) ? ((double) s.sum_exec_ns / (1e3 * (double) s.runs)) : 0.0, (double) s.max_exec_ns / 1e3,
+                      (s.runs > 0U) ? ((double) s.sum_jitter_ns / (1e3 * (double) s.runs)) : 0.0, (double) s.max_jitter_ns / 1e3,
+                      atomic_load(&ex->loops[i].setpoint), s.last_measurement);
+        if (s.read_failures > 0U || s.write_failures > 0U) {
+            (void) printf("  (%llu read, %llu write failures)", (unsigned long long) s.read_failures, (unsigned long long) s.write_failures);
+        }
+        (void) printf("\n");
+    }
+}
+
+
+int32_t control_pwm_open(ControlPwm *pwm, Buffer pin_identifier, int32_t frequency) {
+    int32_t result = 0;
+
+    (void) memset(pwm, 0, sizeof(*pwm));
+    clear_pwm_handle(&pwm->channel);
+    pwm->last_duty_ns = 0xFFFFFFFFU;
+
+    if (frequency > 0) {
+        pwm->period_ns = pwm_period_ns(frequency);
+
+        if (pin_identifier == NULL) {
+            pwm->simulated = 1;
+            result = 1;
+        }
+        else {
+            result = open_pwm_channel(pin_identifier, frequency, 1.0f, PWM_ON, &pwm->channel);
+        }
+    }
+
+    return result;
+}
+
+
+int32_t control_pwm_write(void *context, int32_t output) {
+    ControlPwm *pwm = (ControlPwm *) context;
+    int32_t result = 1;
+    uint32_t duty_ns = (uint32_t) (((uint64_t) pwm->period_ns * (uint64_t) clamp((int64_t) output, 0, CONTROL_DUTY_FULL)) / (uint64_t) CONTROL_DUTY_FULL);
+
+    if (duty_ns != pwm->last_duty_ns) {
+        if (pwm->simulated == 0) {
+            result = write_pwm_duty_fast(&pwm->channel, duty_ns);
+        }
+        if (result == 1) {
+            pwm->last_duty_ns = duty_ns;
+        }
+    }
+
+    return result;
+}
+
+
+void control_pwm_close(ControlPwm *pwm) {
+    close_pwm_handle(&pwm->channel);
+}
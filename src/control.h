@@ -0,0 +1,214 @@
+/*
+This file is for defining the control loop framework: fixed rate loops of (read the input, PID, write the output), for
+things like a fan speed from a tachometer or an LED brightness from a light sensor.
+
+All the loops of a ControlExecutor run on one thread. Every loop has its own period and absolute deadlines; the thread
+sleeps until the earliest deadline of all the loops and runs every loop that is due, so ten loops cost one thread and
+one wakeup per deadline instead of ten threads each sleeping with usleep (which also drifts by the time the loop takes).
+
+The PID is integer only (gains in Q16.16 fixed point, see CONTROL_GAIN), with two anti-windup measures:
+- The integral is clamped to the output range.
+- While the output is saturated, the integral only changes in the direction that brings it back out.
+The derivative is taken on the measurement rather than on the error, so a setpoint change doesn't kick the output.
+
+Every loop keeps its timing: execution time (read + PID + write) and jitter (how late it started compared to its deadline).
+
+Inputs and outputs are callbacks, so a loop can read a GPIO, an I2C sensor or anything else. control_pwm_write is a
+ready made output that drives a PWM channel's duty cycle through its open duty_cycle file.
+*/
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "bbbio.h"
+#include "bbbio_fast.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define CONTROL_MAX_LOOPS ((int32_t) 16)
+
+#define CONTROL_NAME_LENGTH ((int32_t) 16)
+
+// Converts a gain to Q16.16, e.g. CONTROL_GAIN(0.25).
+#define CONTROL_GAIN(X) ((int32_t) ((X) * 65536.0))
+
+// Full scale of control_pwm_write's input: 10000 = 100.00 % duty.
+#define CONTROL_DUTY_FULL ((int32_t) 10000)
+
+// Reads the input of a loop. Returns 1 and stores the measurement on success, 0 on failure (the loop run is skipped).
+typedef int32_t (*ControlReader)(void *context, int32_t *measurement);
+
+// Writes the output of a loop. Returns 1 on success.
+typedef int32_t (*ControlWriter)(void *context, int32_t output);
+
+
+typedef struct {
+    int32_t kp;             // Q16.16 gains, per run of the loop (the period is folded into ki and kd)
+    int32_t ki;
+    int32_t kd;
+    int32_t out_min;
+    int32_t out_max;
+    int64_t integral;       // Q16.16
+    int32_t last_measurement;
+    int32_t primed;         // 0 until the first run (no derivative on it)
+    int32_t saturated;      // The last output was clamped
+} ControlPid;
+
+typedef struct {
+    const char *name;
+    int64_t period_ns;
+    ControlReader reader;
+    void *reader_context;
+    ControlWriter writer;
+    void *writer_context;
+    int32_t kp;             // Q16.16
+    int32_t ki;
+    int32_t kd;
+    int32_t setpoint;
+    int32_t out_min;
+    int32_t out_max;
+} ControlLoopConfig;
+
+typedef struct {
+    uint64_t runs;
+    uint64_t overruns;          // Deadlines skipped because the loop was a whole period or more late
+    uint64_t read_failures;
+    uint64_t write_failures;
+    uint64_t saturated_runs;
+    int64_t sum_exec_ns;
+    int64_t max_exec_ns;
+    int64_t sum_jitter_ns;
+    int64_t max_jitter_ns;
+    int32_t last_measurement;
+    int32_t last_output;
+} ControlLoopStats;
+
+typedef struct {
+    char name[CONTROL_NAME_LENGTH];
+    int64_t period_ns;
+    int64_t next_ns;
+    ControlReader reader;
+    void *reader_context;
+    ControlWriter writer;
+    void *writer_context;
+    _Atomic int32_t setpoint;
+    ControlPid pid;
+    ControlLoopStats stats;     // Under the executor lock
+} ControlLoop;
+
+typedef struct {
+    ControlLoop loops[CONTROL_MAX_LOOPS];
+    int32_t loop_count;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    _Atomic int32_t stop_requested;
+    int32_t running;
+    uint64_t wakeups;
+} ControlExecutor;
+
+// Output to a PWM channel for control_pwm_write.
+typedef struct {
+    PwmHandle channel;
+    uint32_t period_ns;
+    uint32_t last_duty_ns;
+    int32_t simulated;          // No channel, only last_duty_ns is kept (for running loops off-target)
+} ControlPwm;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Prepares an executor with no loops.
+// Parameters: ex - The executor
+void control_init(ControlExecutor *ex);
+
+
+// Description: Registers a loop. Add all the loops before control_start.
+// Parameters:
+// ex     - The executor
+// config - The loop (name is copied)
+// Returns - Index of the loop, -1 on failure (bad config, running or CONTROL_MAX_LOOPS loops).
+int32_t control_add_loop(ControlExecutor *ex, const ControlLoopConfig *config);
+
+
+// Description: Changes the setpoint of a loop. Safe while the executor is running.
+// Parameters:
+// ex       - The executor
+// loop     - Index returned by control_add_loop
+// setpoint - New setpoint, in the units of the loop's measurement
+void control_set_setpoint(ControlExecutor *ex, int32_t loop, int32_t setpoint);
+
+
+// Description: Starts the executor thread. The first run of every loop is one period after this.
+// Parameters:
+// ex       - The executor
+// priority - SCHED_FIFO priority, or RT_PRIORITY_NONE
+// Returns - 1 on success, 0 on failure.
+int32_t control_start(ControlExecutor *ex, int32_t priority);
+
+
+// Description: Stops the executor thread. The outputs keep their last value.
+// Parameters: ex - The executor
+void control_stop(ControlExecutor *ex);
+
+
+// Description: Copies the statistics of a loop.
+// Parameters:
+// ex    - The executor
+// loop  - Index returned by control_add_loop
+// stats - Where to store them
+void control_get_stats(ControlExecutor *ex, int32_t loop, ControlLoopStats *stats);
+
+
+// Description: Prints the timing and state of every loop.
+// Parameters: ex - The executor
+void control_print_report(ControlExecutor *ex);
+
+
+// Description: Prepares a PID with no history.
+// Parameters:
+// pid     - The PID
+// kp      - Gains in Q16.16 (CONTROL_GAIN)
+// ki
+// kd
+// out_min - Output range
+// out_max
+void control_pid_init(ControlPid *pid, int32_t kp, int32_t ki, int32_t kd, int32_t out_min, int32_t out_max);
+
+
+// Description: Runs one step of a PID.
+// Parameters:
+// pid         - The PID
+// setpoint    - Wanted value
+// measurement - Measured value
+// Returns - The output, within the PID's output range.
+int32_t control_pid_step(ControlPid *pid, int32_t setpoint, int32_t measurement);
+
+
+// Description: Sets up and opens a PWM channel (open_pwm_channel) for control_pwm_write.
+// Parameters:
+// pwm            - The output
+// pin_identifier - PWM channel, e.g. "1A", or NULL for a simulated output
+// frequency      - PWM frequency in Hz
+// Returns - 1 on success, 0 on failure.
+int32_t control_pwm_open(ControlPwm *pwm, Buffer pin_identifier, int32_t frequency);
+
+
+// Description: ControlWriter for a ControlPwm: output 0 to CONTROL_DUTY_FULL is the duty cycle. Only writes when the
+// duty cycle in nanoseconds changes, with one pwrite.
+// Parameters:
+// context - The ControlPwm
+// output  - Duty cycle, CONTROL_DUTY_FULL is 100 %
+// Returns - 1 on success.
+int32_t control_pwm_write(void *context, int32_t output);
+
+
+// Description: Closes the duty_cycle file of a ControlPwm.
+// Parameters: pwm - The output
+void control_pwm_close(ControlPwm *pwm);
+
+
+#endif // End of include guard
@@ -0,0 +1,158 @@
+/*
+This file benchmarks the coroutine layer (bbbio_coro.hpp) against the pthread way stopwatch.c is written.
+Two measurements:
+- Handoff: two coroutines waking each other up through an Event, against two threads waking each other through
+  semaphores. This is the cost of one wakeup when there is no waiting involved.
+- Timer: a 1 ms periodic loop on absolute deadlines, co_await sleep_until against clock_nanosleep in a SCHED_FIFO thread.
+  This is how late each wakeup is compared to its deadline.
+*/
+
+#include <cstdio>
+#include <pthread.h>
+#include <semaphore.h>
+#include "bbbio_coro.hpp"
+
+using namespace bbbio;
+
+constexpr int32_t HANDOFF_ROUNDS = 200000;
+
+constexpr int32_t TIMER_ITERATIONS = 1000;
+
+constexpr int64_t TIMER_PERIOD_NS = NS_PER_MS;
+
+constexpr int32_t TIMER_PRIORITY = 80;
+
+struct LatencyStats {
+    int64_t sum_ns = 0;
+    int64_t max_ns = 0;
+    int32_t count = 0;
+
+    void add(int64_t late_ns) {
+        sum_ns += late_ns;
+        count++;
+        if (late_ns > max_ns) {
+            max_ns = late_ns;
+        }
+    }
+};
+
+
+/// ----------- HANDOFF ----------- ///
+
+static Event ping_event;
+static Event pong_event;
+
+static Task ping_task() {
+    for (int32_t i = 0; i < HANDOFF_ROUNDS; i++) {
+        ping_event.set();
+        co_await pong_event.wait();
+    }
+}
+
+static Task pong_task() {
+    for (int32_t i = 0; i < HANDOFF_ROUNDS; i++) {
+        co_await ping_event.wait();
+        pong_event.set();
+    }
+}
+
+static sem_t ping_sem;
+static sem_t pong_sem;
+
+static void *pong_thread_func(void *arg) {
+    (void) arg;
+    for (int32_t i = 0; i < HANDOFF_ROUNDS; i++) {
+        (void) sem_wait(&ping_sem);
+        (void) sem_post(&pong_sem);
+    }
+    return nullptr;
+}
+
+static void bench_handoff() {
+    Scheduler scheduler;
+    pthread_t pong_thread;
+
+    int64_t start_ns = rt_now_ns();
+    (void) spawn(pong_task());
+    (void) spawn(ping_task());
+    scheduler.run();
+    int64_t coro_ns = rt_now_ns() - start_ns;
+
+    (void) sem_init(&ping_sem, 0, 0);
+    (void) sem_init(&pong_sem, 0, 0);
+    start_ns = rt_now_ns();
+    (void) pthread_create(&pong_thread, nullptr, &pong_thread_func, nullptr);
+    for (int32_t i = 0; i < HANDOFF_ROUNDS; i++) {
+        (void) sem_post(&ping_sem);
+        (void) sem_wait(&pong_sem);
+    }
+    (void) pthread_join(pong_thread, nullptr);
+    int64_t thread_ns = rt_now_ns() - start_ns;
+
+    // Every round is two wakeups (ping wakes pong, pong wakes ping).
+    (void) printf("Handoff, %d rounds:\n", HANDOFF_ROUNDS);
+    (void) printf("  coroutine: %8.1f ns per wakeup\n", (double) coro_ns / (2.0 * HANDOFF_ROUNDS));
+    (void) printf("  pthread:   %8.1f ns per wakeup\n", (double) thread_ns / (2.0 * HANDOFF_ROUNDS));
+}
+
+
+/// ----------- TIMER ----------- ///
+
+static LatencyStats coro_timer_stats;
+static LatencyStats thread_timer_stats;
+
+static Task timer_task() {
+    int64_t next_ns = rt_now_ns();
+
+    for (int32_t i = 0; i < TIMER_ITERATIONS; i++) {
+        next_ns += TIMER_PERIOD_NS;
+        co_await sleep_until(next_ns);
+        coro_timer_stats.add(rt_now_ns() - next_ns);
+    }
+}
+
+static void *timer_thread_func(void *arg) {
+    int64_t next_ns = rt_now_ns();
+
+    (void) arg;
+    for (int32_t i = 0; i < TIMER_ITERATIONS; i++) {
+        next_ns += TIMER_PERIOD_NS;
+        rt_sleep_until_ns(next_ns);
+        thread_timer_stats.add(rt_now_ns() - next_ns);
+    }
+    return nullptr;
+}
+
+// The scheduler thread gets the same priority as the pthread version so the comparison is fair.
+static void *coro_timer_thread_func(void *arg) {
+    Scheduler scheduler;
+
+    (void) arg;
+    (void) spawn(timer_task());
+    scheduler.run();
+    return nullptr;
+}
+
+static void bench_timer() {
+    pthread_t thread;
+
+    (void) rt_thread_start(&thread, TIMER_PRIORITY, &coro_timer_thread_func, nullptr);
+    (void) pthread_join(thread, nullptr);
+    (void) rt_thread_start(&thread, TIMER_PRIORITY, &timer_thread_func, nullptr);
+    (void) pthread_join(thread, nullptr);
+
+    (void) printf("Timer, %d wakeups at %.1f ms (late by, us):\n", TIMER_ITERATIONS, (double) TIMER_PERIOD_NS / 1e6);
+    (void) printf("  coroutine: avg %8.1f  max %8.1f\n", (double) coro_timer_stats.sum_ns / (1e3 * coro_timer_stats.count), (double) coro_timer_stats.max_ns / 1e3);
+    (void) printf("  pthread:   avg %8.1f  max %8.1f\n", (double) thread_timer_stats.sum_ns / (1e3 * thread_timer_stats.count), (double) thread_timer_stats.max_ns / 1e3);
+}
+
+
+int main() {
+    bench_handoff();
+    bench_timer();
+
+    (void) printf("Frame arena: %d of %d blocks used at most, %d still in use\n",
+                  FrameArena::blocks_high_water(), FRAME_BLOCK_COUNT, FrameArena::blocks_in_use());
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+This file is the stopwatch from stopwatch.c rewritten on the coroutine layer (bbbio_coro.hpp), as a sample of how it is used.
+Same pins, same prompt and same behavior, but instead of three real-time threads polling every 10 ms:
+- one coroutine per button waits for its rising edge (edge interrupt, no polling)
+- one coroutine redraws the display every 100 ms on absolute deadlines
+All on one thread, so the stopwatch state needs no mutex. Elapsed time is computed from timestamps when it is needed
+instead of being accumulated every 10 ms, so there is no timer coroutine at all.
+*/
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include "bbbio_coro.hpp"
+
+using namespace bbbio;
+
+// Set by asking user for GPIO pins.
+static int32_t START_STOP_BUTTON_PIN = -1;
+static int32_t RESET_BUTTON_PIN = -1;
+static int32_t RED_LED_PIN = -1;
+static int32_t GREEN_LED_PIN = -1;
+
+// Display refresh period.
+constexpr int64_t DISPLAY_PERIOD_NS = 100 * NS_PER_MS;
+
+struct StopwatchState {
+    bool running = false;
+    int64_t accumulated_ns = 0;     // Time counted before the current run started
+    int64_t started_ns = 0;         // When the current run started (only valid while running)
+
+    int64_t elapsed_ns(int64_t now_ns) const {
+        return running ? (accumulated_ns + (now_ns - started_ns)) : accumulated_ns;
+    }
+};
+
+static StopwatchState state;
+
+
+static void show_state_on_leds(bool running) {
+    if (running) {
+        set_gpio_off(RED_LED_PIN);
+        set_gpio_on(GREEN_LED_PIN);
+    }
+    else {
+        set_gpio_on(RED_LED_PIN);
+        set_gpio_off(GREEN_LED_PIN);
+    }
+}
+
+
+// Start/stop button: toggle on every press, using the edge timestamp so the time is exact to the press.
+static Task start_stop_task(Gpio &button) {
+    while (true) {
+        EdgeEvent press = co_await button.edge(Edge::Rising);
+
+        if (state.running) {
+            state.accumulated_ns += press.time_ns - state.started_ns;
+            state.running = false;
+        }
+        else {
+            state.started_ns = press.time_ns;
+            state.running = true;
+        }
+
+        show_state_on_leds(state.running);
+    }
+}
+
+
+// Reset button: back to zero right away (a running stopwatch keeps running from zero).
+static Task reset_task(Gpio &button) {
+    while (true) {
+        EdgeEvent press = co_await button.edge(Edge::Rising);
+
+        state.accumulated_ns = 0;
+        state.started_ns = press.time_ns;
+    }
+}
+
+
+static Task display_task() {
+    int64_t next_ns = rt_now_ns();
+
+    while (true) {
+        double seconds = (double) state.elapsed_ns(rt_now_ns()) / (double) NS_PER_SEC;
+
+        // Clear the current line
+        (void) printf("\r                                                                 \r");
+
+        if (state.running) {
+            (void) printf("Time: %.1f seconds", seconds);
+        }
+        else {
+            (void) printf("Time: %.2f seconds", seconds);
+        }
+        (void) fflush(stdout);
+
+        next_ns += DISPLAY_PERIOD_NS;
+        co_await sleep_until(next_ns);
+    }
+}
+
+
+static int32_t get_input_and_initialize_gpio() {
+    Buffer input;
+    int32_t ret = -1;
+
+    (void) printf("Please provide GPIO pin numbers for the buttons and LEDs. Format:\n");
+    (void) printf("Button 1 GPIO Pin (timer stop/start),Button 2 GPIO Pin (Reset),Red LED GPIO Pin,Green LED GPIO Pin\n");
+
+    if (fgets((char *) input, sizeof(input), stdin) != nullptr &&
+        sscanf((char *) input, "%d,%d,%d,%d", &START_STOP_BUTTON_PIN, &RESET_BUTTON_PIN, &RED_LED_PIN, &GREEN_LED_PIN) == 4 &&
+        setup_gpio_pin(START_STOP_BUTTON_PIN, (BufferPointer) GPIO_INPUT_MODE) == 1 &&
+        setup_gpio_pin(RESET_BUTTON_PIN, (BufferPointer) GPIO_INPUT_MODE) == 1 &&
+        setup_gpio_pin(RED_LED_PIN, (BufferPointer) GPIO_OUTPUT_MODE) == 1 &&
+        setup_gpio_pin(GREEN_LED_PIN, (BufferPointer) GPIO_OUTPUT_MODE) == 1) {
+
+        show_state_on_leds(false);
+        ret = 0;
+    }
+
+    return ret;
+}
+
+
+static void cleanup(int signum) {
+    (void) signum;
+    set_gpio_off(RED_LED_PIN);
+    set_gpio_off(GREEN_LED_PIN);
+
+    (void) printf("\nStopwatch application terminated. Frame arena high water: %d of %d blocks.\n",
+                  FrameArena::blocks_high_water(), FRAME_BLOCK_COUNT);
+    exit(0);
+}
+
+
+int main() {
+    (void) signal(SIGINT, &cleanup); // CTRL+C
+    (void) signal(SIGTSTP, &cleanup); // CTRL+Z
+    (void) signal(SIGTERM, &cleanup); // Kill command
+    (void) signal(SIGQUIT, &cleanup); // CTRL+ \ /
+
+    if (get_input_and_initialize_gpio() != 0) {
+        (void) printf("[ERROR] gpio_setup failed\n");
+        return 1;
+    }
+
+    Scheduler scheduler;
+    Gpio start_stop_button(START_STOP_BUTTON_PIN);
+    Gpio reset_button(RESET_BUTTON_PIN);
+
+    if (!spawn(start_stop_task(start_stop_button)) || !spawn(reset_task(reset_button)) || !spawn(display_task())) {
+        (void) printf("[ERROR] Could not start the stopwatch tasks\n");
+        return 1;
+    }
+
+    scheduler.run();
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+This file is the countdown / interval timer for timed trials, the counterpart of the count-up stopwatch in stopwatch.c.
+It counts down to zero and beeps, then optionally beeps again every interval for a number of intervals.
+
+All deadlines are computed up front from one start time (zero = start + countdown, then zero + k * interval), and the
+alarm thread sleeps until each of them with an absolute timer, so nothing drifts no matter how long a beep or the
+display takes. The buzzer PWM channel is set up before the countdown starts (see alarm.h), so a beep is one write.
+At the end (or on CTRL+C) the onset error of every beep against its deadline is reported.
+
+Usage: ./countdown [nanosleep]   (waits with a timerfd by default, "nanosleep" uses clock_nanosleep instead)
+*/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "bbbio.h"
+#include "rtutil.h"
+#include "alarm.h"
+
+// How long each beep lasts.
+#define BEEP_NS ((int64_t) (150 * NS_PER_MS))
+
+// Display refresh period.
+#define DISPLAY_PERIOD_NS ((int64_t) (100 * NS_PER_MS))
+
+// Longest interval series we accept.
+#define MAX_INTERVALS ((int32_t) 1000)
+
+// Set by asking the user.
+static float32_t countdown_seconds = 0.0f;
+static float32_t interval_seconds = 0.0f;
+static int32_t interval_count = 0;
+static Buffer buzzer_channel;
+static int32_t buzzer_frequency = 0;
+
+// No file descriptors until alarm_init runs: a Ctrl+C at the prompts must not report a buzzer or close stdin.
+static Alarm alarm_state = { .timer_fd = -1, .buzzer = { .period_fd = -1, .duty_fd = -1, .enable_fd = -1 } };
+
+// When the countdown reaches zero, and the deadline of the next beep (for the display).
+static int64_t zero_ns = 0;
+static _Atomic int64_t next_deadline_ns = 0;
+static atomic_int alarms_done = 0;
+static atomic_int finished = 0;
+
+
+// Alarm thread - fires every alarm at its absolute deadline.
+static void *alarm_thread_func(void *arg) {
+    int32_t total = 1 + ((interval_seconds > 0.0f) ? interval_count : 0);
+    int64_t interval_ns = (int64_t) ((double) interval_seconds * (double) NS_PER_SEC);
+    int32_t i = 0;
+
+    (void) arg;
+
+    for (i = 0; i < total; i++) {
+        int64_t deadline_ns = zero_ns + ((int64_t) i * interval_ns);
+
+        if (alarm_fire_at(&alarm_state, deadline_ns) != 1) {
+            (void) printf("\n[WARNING] Buzzer enable write failed.\n");
+        }
+
+        // Let the display count towards the next beep while this one is still sounding.
+        atomic_store(&next_deadline_ns, deadline_ns + interval_ns);
+        atomic_store(&alarms_done, i + 1);
+
+        rt_sleep_until_ns(deadline_ns + BEEP_NS);
+        alarm_silence(&alarm_state);
+    }
+
+    atomic_store(&finished, 1);
+
+    return NULL;
+}
+
+
+// Shows the time left until zero, then the interval progress.
+static void display(int64_t now_ns) {
+    int32_t done = atomic_load(&alarms_done);
+    double left = (double) (atomic_load(&next_deadline_ns) - now_ns) / (double) NS_PER_SEC;
+
+    if (left < 0.0) {
+        left = 0.0;
+    }
+
+    // Clear the current line
+    (void) printf("\r                                                                 \r");
+
+    if (done == 0) {
+        (void) printf("Countdown: %.1f seconds", left);
+    }
+    else if (done <= interval_count) {
+        (void) printf("Interval %d of %d, next beep in %.1f seconds", done, interval_count, left);
+    }
+    else {
+        (void) printf("Done");
+    }
+    (void) fflush(stdout);
+}
+
+
+// Asks for the timings and the buzzer and pre-arms the buzzer. 0 on success, -1 otherwise.
+static int32_t get_input_and_initialize(int32_t wait_method) {
+    Buffer input;
+    int32_t ret = -1;
+
+    (void) printf("Please provide the countdown and the buzzer. Format:\n");
+    (void) printf("Countdown seconds,Interval seconds (0 for none),Number of intervals,Buzzer PWM channel (1A/1B/2A/2B),Buzzer frequency (Hz)\n");
+
+    if (fgets((char *) input, sizeof(input), stdin) != NULL &&
+        sscanf((char *) input, "%f,%f,%d,%2s,%d", &countdown_seconds, &interval_seconds, &interval_count, (char *) buzzer_channel, &buzzer_frequency) == 5) {
+        if (countdown_seconds < 0.0f || interval_seconds < 0.0f || interval_count < 0 || interval_count > MAX_INTERVALS || buzzer_frequency <= 0) {
+            (void) printf("Invalid values. Times can't be negative and there can be at most %d intervals.\n", MAX_INTERVALS);
+        }
+        else if (interval_seconds > 0.0f && interval_count > 0 && ((double) interval_seconds * (double) NS_PER_SEC) <= (double) BEEP_NS) {
+            // A beep is silenced at its deadline + BEEP_NS, past the next deadline: the next beep would fire late.
+            (void) printf("Invalid values. The interval must be longer than a beep (%.2f seconds).\n", (double) BEEP_NS / (double) NS_PER_SEC);
+        }
+        else if (alarm_init(&alarm_state, wait_method) != 1) {
+            (void) printf("[ERROR] Could not create the alarm timer.\n");
+        }
+        else {
+            // Not fatal: the countdown still runs and measures its onset error, just silently.
+            if (alarm_attach_buzzer(&alarm_state, buzzer_channel, buzzer_frequency) != 1) {
+                (void) printf("[WARNING] Could not set up the buzzer on PWM %s, running without sound.\n", (char *) buzzer_channel);
+            }
+            ret = 0;
+        }
+    }
+    else {
+        (void) printf("Invalid input format.\n");
+    }
+
+    return ret;
+}
+
+
+// Cleanup function - silences the buzzer and reports what was measured so far.
+static void cleanup(int32_t signum) {
+    (void) signum;
+    // Report first: closing releases the buzzer, and the report would then say there is none.
+    (void) printf("\n");
+    alarm_print_report(&alarm_state);
+    alarm_close(&alarm_state);
+    (void) printf("Countdown application terminated.\n");
+    exit(0);
+}
+
+
+int32_t main(int32_t argc, char **argv) {
+    pthread_t alarm_thread;
+    int32_t wait_method = ALARM_WAIT_TIMERFD;
+    int32_t error = 0;
+
+    if (argc > 1 && strcmp(argv[1], "nanosleep") == 0) {
+        wait_method = ALARM_WAIT_NANOSLEEP;
+    }
+
+    (void) signal(SIGINT, &cleanup); // CTRL+C
+    (void) signal(SIGTSTP, &cleanup); // CTRL+Z
+    (void) signal(SIGTERM, &cleanup); // Kill command
+    (void) signal(SIGQUIT, &cleanup); // CTRL+ \ /
+
+    if (get_input_and_initialize(wait_method) != 0) {
+        return 1;
+    }
+
+    // Every deadline is fixed from this one point in time.
+    zero_ns = rt_now_ns() + (int64_t) ((double) countdown_seconds * (double) NS_PER_SEC);
+    atomic_store(&next_deadline_ns, zero_ns);
+
+    // The alarm thread gets the highest priority, it is the only one with a deadline that matters.
+    error = rt_thread_start(&alarm_thread, sched_get_priority_max(SCHED_FIFO), &alarm_thread_func, NULL);
+    if (error != 0) {
+        (void) printf("[ERROR] pthread_create (alarm): %s\n", strerror(error));
+        return 1;
+    }
+
+    int64_t next_ns = rt_now_ns();
+    while (atomic_load(&finished) == 0) {
+        display(rt_now_ns());
+        next_ns += DISPLAY_PERIOD_NS;
+        rt_sleep_until_ns(next_ns);
+    }
+
+    (void) pthread_join(alarm_thread, NULL);
+    cleanup(0);
+
+    return 0;
+}
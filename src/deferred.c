@@ -0,0 +1,182 @@
+/*
+This file implements all the functions defined in deferred.h.
+Each mailbox holds the last posted value with MAILBOX_PENDING set, or 0 once the flusher took it. A per-bank dirty mask
+tells the flusher which mailboxes to look at so it doesn't have to scan all of them.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN DEFERRED.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "bbbio.h"
+#include "rtutil.h"
+#include "deferred.h"
+
+
+#define MAILBOX_PENDING ((uint32_t) 0x100U)
+
+static atomic_uint mailboxes[DEFERRED_MAX_PINS];
+
+static atomic_uint dirty[GPIO_BANK_COUNT];
+
+static atomic_int stop_requested;
+
+static int32_t started = 0;
+
+static int64_t flush_period_ns = DEFERRED_DEFAULT_PERIOD_NS;
+
+static pthread_t flusher_thread;
+
+// Written by posters (posts, coalesced) and by the flusher (the rest), so every counter is atomic.
+static atomic_ullong stat_posts;
+static atomic_ullong stat_coalesced;
+static atomic_ullong stat_applied;
+static atomic_ullong stat_flushes;
+static atomic_ullong stat_bank_writes;
+static atomic_ullong stat_failed_writes;
+static atomic_uint stat_max_depth;
+static atomic_ullong stat_depth_sum;
+
+
+// Takes every pending mailbox and applies them, one gpio_bank_write per bank.
+static void flush_pending(void) {
+    int32_t bank = 0;
+    uint32_t depth = 0U;
+
+    for (bank = 0; bank < GPIO_BANK_COUNT; bank++) {
+        uint32_t bank_dirty = atomic_exchange(&dirty[bank], 0U);
+        uint32_t mask = 0U;
+        uint32_t values = 0U;
+
+        while (bank_dirty != 0U) {
+            int32_t bit = (int32_t) __builtin_ctz(bank_dirty);
+            uint32_t slot = atomic_exchange(&mailboxes[(bank * GPIO_PINS_PER_BANK) + bit], 0U);
+
+            // The dirty bit can be seen before the value was taken by an earlier flush, only write real posts.
+            if ((slot & MAILBOX_PENDING) != 0U) {
+                mask |= ((uint32_t) 1U << (uint32_t) bit);
+                if ((slot & 1U) != 0U) {
+                    values |= ((uint32_t) 1U << (uint32_t) bit);
+                }
+            }
+
+            bank_dirty &= bank_dirty - 1U;
+        }
+
+        if (mask != 0U) {
+            uint32_t count = (uint32_t) __builtin_popcount(mask);
+
+            depth += count;
+            (void) atomic_fetch_add(&stat_applied, (unsigned long long) count);
+            (void) atomic_fetch_add(&stat_bank_writes, 1ULL);
+
+            if (gpio_bank_write(bank, mask, values) != 1) {
+                (void) atomic_fetch_add(&stat_failed_writes, 1ULL);
+            }
+        }
+    }
+
+    if (depth > 0U) {
+        (void) atomic_fetch_add(&stat_flushes, 1ULL);
+        (void) atomic_fetch_add(&stat_depth_sum, (unsigned long long) depth);
+        if (depth > atomic_load(&stat_max_depth)) {
+            atomic_store(&stat_max_depth, depth);
+        }
+    }
+}
+
+
+static void *flusher_thread_func(void *arg) {
+    int64_t next_ns = rt_now_ns();
+
+    (void) arg;
+
+    while (atomic_load(&stop_requested) == 0) {
+        next_ns += flush_period_ns;
+        rt_sleep_until_ns(next_ns);
+        flush_pending();
+    }
+
+    // Whatever was posted before the stop still goes out.
+    flush_pending();
+
+    return NULL;
+}
+
+
+int32_t deferred_start(int64_t period_ns, int32_t priority) {
+    int32_t result = 0;
+
+    if (started == 0 && period_ns > 0) {
+        flush_period_ns = period_ns;
+        atomic_store(&stop_requested, 0);
+
+        if (rt_thread_start(&flusher_thread, priority, &flusher_thread_func, NULL) == 0) {
+            started = 1;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+void deferred_stop(void) {
+    if (started == 1) {
+        atomic_store(&stop_requested, 1);
+        (void) pthread_join(flusher_thread, NULL);
+        started = 0;
+    }
+}
+
+
+int32_t deferred_gpio_write(int32_t pin, int32_t value) {
+    int32_t result = 0;
+
+    if (pin >= 0 && pin < DEFERRED_MAX_PINS) {
+        uint32_t slot = MAILBOX_PENDING | ((value != GPIO_OFF) ? 1U : 0U);
+
+        // Store the value first, then mark the bank dirty, so the flusher always finds the value behind a dirty bit.
+        uint32_t previous = atomic_exchange(&mailboxes[pin], slot);
+        (void) atomic_fetch_or(&dirty[GPIO_BANK_OF(pin)], GPIO_BIT_OF(pin));
+
+        (void) atomic_fetch_add(&stat_posts, 1ULL);
+        if ((previous & MAILBOX_PENDING) != 0U) {
+            (void) atomic_fetch_add(&stat_coalesced, 1ULL);
+        }
+
+        result = 1;
+    }
+
+    return result;
+}
+
+
+void deferred_get_stats(DeferredStats *stats) {
+    stats->posts = atomic_load(&stat_posts);
+    stats->applied = atomic_load(&stat_applied);
+    stats->coalesced = atomic_load(&stat_coalesced);
+    stats->flushes = atomic_load(&stat_flushes);
+    stats->bank_writes = atomic_load(&stat_bank_writes);
+    stats->failed_writes = atomic_load(&stat_failed_writes);
+    stats->max_depth = atomic_load(&stat_max_depth);
+    stats->depth_sum = atomic_load(&stat_depth_sum);
+}
+
+
+void deferred_print_stats(void) {
+    DeferredStats stats;
+
+    deferred_get_stats(&stats);
+
+    (void) printf("Deferred writes (flush every %.3f ms):\n", (double) flush_period_ns / 1e6);
+    (void) printf("  posts %llu, applied %llu, coalesced %llu (%.1f%% of posts never reached the pin)\n",
+                  (unsigned long long) stats.posts, (unsigned long long) stats.applied, (unsigned long long) stats.coalesced,
+                  (stats.posts > 0ULL) ? (100.0 * (double) stats.coalesced / (double) stats.posts) : 0.0);
+    (void) printf("  flushes %llu, bank writes %llu, failed %llu\n",
+                  (unsigned long long) stats.flushes, (unsigned long long) stats.bank_writes, (unsigned long long) stats.failed_writes);
+    (void) printf("  queue depth at flush: max %u, average %.2f pins\n", stats.max_depth,
+                  (stats.flushes > 0ULL) ? ((double) stats.depth_sum / (double) stats.flushes) : 0.0);
+}
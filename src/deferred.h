@@ -0,0 +1,69 @@
+/*
+This file is for defining deferred (non-urgent) GPIO writes.
+The normal bbbio.h calls (write_gpio_value, set_gpio_on, ...) stay the urgent path: they write right away on the
+caller's thread. Outputs that can lag by a few milliseconds, like status LEDs and diagnostic pins, can use
+deferred_gpio_write instead. It only stores the value in a per-pin mailbox (a single atomic exchange, no syscall) and
+returns. A low priority flusher thread wakes up every flush period and applies all the pending pins of a bank with one
+gpio_bank_write. If a pin is written several times before a flush only the last value is applied, so a pin toggled
+from a fast loop costs at most one real write per flush period.
+*/
+
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <stdint.h>
+#include "gpiobank.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// One mailbox per GPIO number of all the banks.
+#define DEFERRED_MAX_PINS ((int32_t) (GPIO_BANK_COUNT * GPIO_PINS_PER_BANK))
+
+#define DEFERRED_DEFAULT_PERIOD_NS ((int64_t) 5000000)
+
+
+typedef struct {
+    uint64_t posts;             // deferred_gpio_write calls accepted
+    uint64_t applied;           // Pin writes actually done by the flusher
+    uint64_t coalesced;         // Posts overwritten by a later post before they were applied
+    uint64_t flushes;           // Flush rounds that had something to write
+    uint64_t bank_writes;       // gpio_bank_write calls done by the flusher
+    uint64_t failed_writes;     // gpio_bank_write calls that failed
+    uint32_t max_depth;         // Most pins pending at once when a flush started
+    uint64_t depth_sum;         // Sum of the pending pin counts, for the average depth
+} DeferredStats;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Starts the flusher thread. The pins written through it must already be set up as outputs.
+// Parameters:
+// period_ns - How often pending writes are applied (DEFERRED_DEFAULT_PERIOD_NS is a good default)
+// priority  - Priority of the flusher thread, keep it below every real-time thread (RT_PRIORITY_NONE is fine)
+// Returns - 1 on success, 0 on failure (already started or the thread could not be created).
+int32_t deferred_start(int64_t period_ns, int32_t priority);
+
+
+// Description: Stops the flusher thread after applying everything still pending.
+void deferred_stop(void);
+
+
+// Description: Queues a write of value to pin. Never blocks and never makes a syscall.
+// Parameters:
+// pin   - The GPIO pin number
+// value - GPIO_ON or GPIO_OFF
+// Returns - 1 if the write was queued, 0 if the pin number is out of range.
+int32_t deferred_gpio_write(int32_t pin, int32_t value);
+
+
+// Description: Copies the current counters.
+// Parameters: stats - Where the counters are copied
+void deferred_get_stats(DeferredStats *stats);
+
+
+// Description: Prints the queue depths and coalescing ratio to stdout.
+void deferred_print_stats(void);
+
+
+#endif // End of include guard
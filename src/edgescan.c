@@ -0,0 +1,307 @@
+/*
+This file implements all the functions defined in edgescan.h.
+Every vector kernel works the same way: XOR a block of samples with the same block shifted back by one sample,
+check if the whole block is zero (the common case, nothing changed) and only if not, store the block and write out the
+lanes that are non-zero. The block is only started if out has room for all of its lanes, the scalar loop takes care of
+the last few samples and of filling out exactly to the end.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN EDGESCAN.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stddef.h>
+#include "edgescan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EDGE_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define EDGE_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+// A vector kernel scans from *pos (which must be >= 1) and returns the new record count. *pos is left at the first unscanned sample.
+typedef int32_t (*EdgeVectorFn)(const uint32_t *samples, int32_t count, uint32_t base, EdgeRecord *out, int32_t max_out, int32_t n, int32_t *pos);
+
+// Not picked yet, edge_scan picks the best kernel on its first call.
+#define EDGE_KERNEL_UNSET ((int32_t) -2)
+
+static int32_t current_kernel = EDGE_KERNEL_UNSET;
+
+static EdgeVectorFn vector_kernel = NULL;
+
+
+// Writes the non-zero lanes of a block that is known to contain at least one edge.
+static int32_t emit_lanes(const uint32_t *changed, int32_t lanes, uint32_t index, EdgeRecord *out, int32_t n) {
+    int32_t j = 0;
+
+    for (j = 0; j < lanes; j++) {
+        if (changed[j] != 0U) {
+            out[n].index = index + (uint32_t) j;
+            out[n].changed = changed[j];
+            n++;
+        }
+    }
+
+    return n;
+}
+
+
+static int32_t scan_scalar(const uint32_t *samples, int32_t count, uint32_t base, EdgeRecord *out, int32_t max_out, int32_t n, int32_t *pos) {
+    int32_t i = *pos;
+    int32_t full = 0;
+
+    while (i < count && full == 0) {
+        uint32_t changed = samples[i] ^ samples[i - 1];
+
+        if (changed == 0U) {
+            i++;
+        }
+        else if (n < max_out) {
+            out[n].index = base + (uint32_t) i;
+            out[n].changed = changed;
+            n++;
+            i++;
+        }
+        else {
+            full = 1;
+        }
+    }
+
+    *pos = i;
+
+    return n;
+}
+
+
+#ifdef EDGE_HAVE_X86
+
+static int32_t scan_sse2(const uint32_t *samples, int32_t count, uint32_t base, EdgeRecord *out, int32_t max_out, int32_t n, int32_t *pos) {
+    int32_t i = *pos;
+    uint32_t changed[4];
+    const __m128i zero = _mm_setzero_si128();
+
+    while ((i + 4) <= count && (n + 4) <= max_out) {
+        __m128i cur = _mm_loadu_si128((const __m128i *) &samples[i]);
+        __m128i prev = _mm_loadu_si128((const __m128i *) &samples[i - 1]);
+        __m128i x = _mm_xor_si128(cur, prev);
+
+        // All 16 bytes equal to zero means no lane changed.
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(x, zero)) != 0xFFFF) {
+            _mm_storeu_si128((__m128i *) changed, x);
+            n = emit_lanes(changed, 4, base + (uint32_t) i, out, n);
+        }
+
+        i += 4;
+    }
+
+    *pos = i;
+
+    return n;
+}
+
+
+__attribute__((target("avx2")))
+static int32_t scan_avx2(const uint32_t *samples, int32_t count, uint32_t base, EdgeRecord *out, int32_t max_out, int32_t n, int32_t *pos) {
+    int32_t i = *pos;
+    uint32_t changed[8];
+
+    while ((i + 8) <= count && (n + 8) <= max_out) {
+        __m256i cur = _mm256_loadu_si256((const __m256i *) &samples[i]);
+        __m256i prev = _mm256_loadu_si256((const __m256i *) &samples[i - 1]);
+        __m256i x = _mm256_xor_si256(cur, prev);
+
+        if (_mm256_testz_si256(x, x) == 0) {
+            _mm256_storeu_si256((__m256i *) changed, x);
+            n = emit_lanes(changed, 8, base + (uint32_t) i, out, n);
+        }
+
+        i += 8;
+    }
+
+    *pos = i;
+
+    return n;
+}
+
+#endif
+
+
+#ifdef EDGE_HAVE_NEON
+
+static int32_t scan_neon(const uint32_t *samples, int32_t count, uint32_t base, EdgeRecord *out, int32_t max_out, int32_t n, int32_t *pos) {
+    int32_t i = *pos;
+    uint32_t changed[4];
+
+    while ((i + 4) <= count && (n + 4) <= max_out) {
+        uint32x4_t x = veorq_u32(vld1q_u32(&samples[i]), vld1q_u32(&samples[i - 1]));
+
+        // ARMv7 NEON has no horizontal max, so OR the two halves together and check both lanes.
+        uint32x2_t folded = vorr_u32(vget_low_u32(x), vget_high_u32(x));
+
+        if ((vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0U) {
+            vst1q_u32(changed, x);
+            n = emit_lanes(changed, 4, base + (uint32_t) i, out, n);
+        }
+
+        i += 4;
+    }
+
+    *pos = i;
+
+    return n;
+}
+
+#endif
+
+
+static int32_t kernel_available(int32_t kernel) {
+    int32_t result = 0;
+
+    if (kernel == EDGE_KERNEL_SCALAR) {
+        result = 1;
+    }
+#ifdef EDGE_HAVE_X86
+    else if (kernel == EDGE_KERNEL_SSE2) {
+        result = (int32_t) (__builtin_cpu_supports("sse2") != 0);
+    }
+    else if (kernel == EDGE_KERNEL_AVX2) {
+        result = (int32_t) (__builtin_cpu_supports("avx2") != 0);
+    }
+#endif
+#ifdef EDGE_HAVE_NEON
+    else if (kernel == EDGE_KERNEL_NEON) {
+        result = 1;
+    }
+#endif
+    else {
+        result = 0;
+    }
+
+    return result;
+}
+
+
+static EdgeVectorFn kernel_function(int32_t kernel) {
+    EdgeVectorFn fn = &scan_scalar;
+
+#ifdef EDGE_HAVE_X86
+    if (kernel == EDGE_KERNEL_SSE2) {
+        fn = &scan_sse2;
+    }
+    else if (kernel == EDGE_KERNEL_AVX2) {
+        fn = &scan_avx2;
+    }
+    else {
+    }
+#endif
+#ifdef EDGE_HAVE_NEON
+    if (kernel == EDGE_KERNEL_NEON) {
+        fn = &scan_neon;
+    }
+#endif
+
+    return fn;
+}
+
+
+int32_t edge_scan_set_kernel(int32_t kernel) {
+    int32_t result = 0;
+
+    if (kernel == EDGE_KERNEL_BEST) {
+        if (kernel_available(EDGE_KERNEL_NEON) == 1) {
+            kernel = EDGE_KERNEL_NEON;
+        }
+        else if (kernel_available(EDGE_KERNEL_AVX2) == 1) {
+            kernel = EDGE_KERNEL_AVX2;
+        }
+        else if (kernel_available(EDGE_KERNEL_SSE2) == 1) {
+            kernel = EDGE_KERNEL_SSE2;
+        }
+        else {
+            kernel = EDGE_KERNEL_SCALAR;
+        }
+    }
+
+    if (kernel_available(kernel) == 1) {
+        current_kernel = kernel;
+        vector_kernel = kernel_function(kernel);
+        result = 1;
+    }
+
+    return result;
+}
+
+
+int32_t edge_scan_kernel(void) {
+    if (current_kernel == EDGE_KERNEL_UNSET) {
+        (void) edge_scan_set_kernel(EDGE_KERNEL_BEST);
+    }
+
+    return current_kernel;
+}
+
+
+const char *edge_scan_kernel_name(int32_t kernel) {
+    const char *name = "unknown";
+
+    if (kernel == EDGE_KERNEL_SCALAR) {
+        name = "scalar";
+    }
+    else if (kernel == EDGE_KERNEL_SSE2) {
+        name = "sse2";
+    }
+    else if (kernel == EDGE_KERNEL_AVX2) {
+        name = "avx2";
+    }
+    else if (kernel == EDGE_KERNEL_NEON) {
+        name = "neon";
+    }
+    else {
+        name = "unknown";
+    }
+
+    return name;
+}
+
+
+void edge_scan_init(EdgeScanState *state, uint32_t initial) {
+    state->prev = initial;
+    state->next_index = 0U;
+}
+
+
+int32_t edge_scan(EdgeScanState *state, const uint32_t *samples, int32_t count, EdgeRecord *out, int32_t max_out, int32_t *consumed) {
+    int32_t n = 0;
+    int32_t i = 0;
+    uint32_t base = state->next_index;
+
+    (void) edge_scan_kernel();
+
+    if (samples != NULL && out != NULL && count > 0 && max_out > 0) {
+        // The first sample is compared against the state since its previous sample is in the last chunk.
+        uint32_t first_changed = samples[0] ^ state->prev;
+
+        if (first_changed != 0U) {
+            out[n].index = base;
+            out[n].changed = first_changed;
+            n++;
+        }
+        i = 1;
+
+        n = vector_kernel(samples, count, base, out, max_out, n, &i);
+        n = scan_scalar(samples, count, base, out, max_out, n, &i);
+
+        state->prev = samples[i - 1];
+        state->next_index = base + (uint32_t) i;
+    }
+
+    if (consumed != NULL) {
+        *consumed = i;
+    }
+
+    return n;
+}
@@ -0,0 +1,85 @@
+/*
+This file is for defining the edge extraction kernel used on captured GPIO bank samples.
+A capture is a buffer of 32-bit words, one per sample, where each word is a whole GPIO bank (see gpiobank.h).
+Almost all consecutive samples are equal, so instead of keeping the raw buffer we only keep a record for each sample
+that differs from the one before it: (sample index, changed bits). The changed bits are the XOR of the two samples,
+so with the starting value the original capture can be rebuilt exactly.
+
+The scan is vectorized because it runs over every captured word:
+- NEON on ARM (the BeagleBone's Cortex-A8), 4 samples per step
+- AVX2 on x86 hosts that have it (checked at run time), 8 samples per step
+- SSE2 on any other x86-64 host, 4 samples per step
+- Plain C everywhere else
+All kernels give exactly the same output as the scalar one.
+*/
+
+#ifndef EDGESCAN_H
+#define EDGESCAN_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define EDGE_KERNEL_SCALAR ((int32_t) 0)
+
+#define EDGE_KERNEL_SSE2 ((int32_t) 1)
+
+#define EDGE_KERNEL_AVX2 ((int32_t) 2)
+
+#define EDGE_KERNEL_NEON ((int32_t) 3)
+
+// Pass this to edge_scan_set_kernel to go back to the fastest kernel the machine supports.
+#define EDGE_KERNEL_BEST ((int32_t) -1)
+
+
+typedef struct {
+    uint32_t index;     // Sample index (counted from the start of the capture, not the chunk)
+    uint32_t changed;   // Bits that changed compared to the previous sample
+} EdgeRecord;
+
+// Carries the scan across chunks so a capture can be processed in pieces.
+typedef struct {
+    uint32_t prev;          // Last sample seen
+    uint32_t next_index;    // Capture index of the next sample to scan
+} EdgeScanState;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Starts a new scan.
+// Parameters:
+// state   - The scan state to initialize
+// initial - Bank value before the first sample (the first sample is an edge if it differs from this)
+void edge_scan_init(EdgeScanState *state, uint32_t initial);
+
+
+// Description: Scans a chunk of samples and writes a record for every sample that differs from the previous one.
+// Stops early if out is full; the samples that were not scanned should be passed again in the next call.
+// Parameters:
+// state    - Scan state, updated so the next call continues where this one stopped
+// samples  - Captured bank words
+// count    - Number of samples
+// out      - Where the edge records are written
+// max_out  - Capacity of out
+// consumed - Number of samples scanned (equals count unless out filled up)
+// Returns - Number of records written to out.
+int32_t edge_scan(EdgeScanState *state, const uint32_t *samples, int32_t count, EdgeRecord *out, int32_t max_out, int32_t *consumed);
+
+
+// Description: Forces a specific kernel (for benchmarking). Kernels the machine can't run are refused.
+// Parameters: kernel - One of the EDGE_KERNEL_ macros
+// Returns - 1 if the kernel is now used, 0 if it is not available.
+int32_t edge_scan_set_kernel(int32_t kernel);
+
+
+// Description: Returns the kernel currently used by edge_scan.
+int32_t edge_scan_kernel(void);
+
+
+// Description: Returns a printable name for a kernel, e.g. "avx2".
+// Parameters: kernel - One of the EDGE_KERNEL_ macros
+const char *edge_scan_kernel_name(int32_t kernel);
+
+
+#endif // End of include guard
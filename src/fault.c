@@ -0,0 +1,343 @@
+/*
+This file implements all the functions defined in fault.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN FAULT.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "rtutil.h"
+#include "fault.h"
+
+
+#define LN2 (0.69314718055994531)
+
+#define SPEC_LENGTH ((size_t) 512)
+
+
+static FaultRule rules[FAULT_MAX_RULES];
+
+static int32_t rule_count = 0;
+
+static FaultStats stats[GPIO_IO_OP_COUNT];
+
+static uint64_t random_state = 1U;
+
+// The hook runs in whatever thread does the GPIO operation: the random numbers and statistics are shared.
+static pthread_mutex_t fault_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const op_names[GPIO_IO_OP_COUNT] = { "write", "read", "bank_write", "bank_read" };
+
+
+// xorshift64*: fast, and good enough to decide which operations fail.
+static uint64_t next_random(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+
+    return random_state * (uint64_t) 2685821657736338717U;
+}
+
+
+static int32_t chance(uint32_t ppm) {
+    return (int32_t) (ppm > 0U && (uint32_t) (next_random() % (uint64_t) FAULT_PPM) < ppm);
+}
+
+
+// -ln(u) for a uniform u in (0, 1), without libm. u = m * 2^-k with m in [0.5, 1), so -ln(u) = k ln 2 - ln(m), and
+// ln(m) comes from the atanh series, which converges fast on that range.
+static double exponential_unit(void) {
+    uint64_t r = next_random() | 1U;
+    int32_t k = __builtin_clzll(r);
+    double m = (double) (r << (uint32_t) k) / 18446744073709551616.0;
+    double z = (m - 1.0) / (m + 1.0);
+    double z2 = z * z;
+    double ln_m = 2.0 * z * (1.0 + (z2 * ((1.0 / 3.0) + (z2 * ((1.0 / 5.0) + (z2 * ((1.0 / 7.0) + (z2 / 9.0))))))));
+
+    return ((double) k * LN2) - ln_m;
+}
+
+
+static int64_t draw_latency(const FaultRule *rule) {
+    int64_t result = 0;
+
+    switch (rule->latency) {
+        case FAULT_LATENCY_FIXED:
+            result = rule->latency_a_ns;
+            break;
+        case FAULT_LATENCY_UNIFORM:
+            if (rule->latency_b_ns > rule->latency_a_ns) {
+                result = rule->latency_a_ns + (int64_t) (next_random() % (uint64_t) (rule->latency_b_ns - rule->latency_a_ns + 1));
+            }
+            else {
+                result = rule->latency_a_ns;
+            }
+            break;
+        case FAULT_LATENCY_EXPONENTIAL:
+            result = (int64_t) ((double) rule->latency_a_ns * exponential_unit());
+            break;
+        default:
+            result = 0;
+            break;
+    }
+
+    return result;
+}
+
+
+static int32_t rule_matches(const FaultRule *rule, int32_t op, int32_t bank, uint32_t mask) {
+    return (int32_t) ((rule->op == FAULT_ANY || rule->op == op) &&
+                      (rule->pin == FAULT_ANY || (rule->pin / 32 == bank && (mask & ((uint32_t) 1U << ((uint32_t) rule->pin % 32U))) != 0U)));
+}
+
+
+static int32_t fault_hook(int32_t op, int32_t bank, uint32_t mask) {
+    int32_t result = 0;
+    int64_t latency_ns = 0;
+    int64_t stall_ns = 0;
+    int32_t i = 0;
+    const FaultRule *rule = NULL;
+
+    (void) pthread_mutex_lock(&fault_lock);
+
+    for (i = 0; i < rule_count && rule == NULL; i++) {
+        if (rule_matches(&rules[i], op, bank, mask) == 1) {
+            rule = &rules[i];
+        }
+    }
+
+    if (op >= 0 && op < GPIO_IO_OP_COUNT) {
+        stats[op].operations++;
+
+        if (rule != NULL) {
+            stats[op].matched++;
+            latency_ns = draw_latency(rule);
+            if (chance(rule->stall_ppm) == 1) {
+                stall_ns = rule->stall_ns;
+                stats[op].stalls++;
+            }
+            if (chance(rule->fail_ppm) == 1) {
+                result = rule->fail_errno;
+                stats[op].failures++;
+            }
+            stats[op].sum_delay_ns += latency_ns + stall_ns;
+            if (latency_ns + stall_ns > stats[op].max_delay_ns) {
+                stats[op].max_delay_ns = latency_ns + stall_ns;
+            }
+        }
+    }
+
+    (void) pthread_mutex_unlock(&fault_lock);
+
+    // The delays happen outside the lock, other threads' operations aren't held up by this one.
+    if (latency_ns > 0) {
+        int64_t until_ns = rt_now_ns() + latency_ns;
+
+        while (rt_now_ns() < until_ns) {
+        }
+    }
+    if (stall_ns > 0) {
+        rt_sleep_until_ns(rt_now_ns() + stall_ns);
+    }
+
+    return result;
+}
+
+
+void fault_init(uint64_t seed) {
+    (void) pthread_mutex_lock(&fault_lock);
+    (void) memset(rules, 0, sizeof(rules));
+    (void) memset(stats, 0, sizeof(stats));
+    rule_count = 0;
+    // xorshift must not start at 0.
+    random_state = (seed != 0U) ? seed : (uint64_t) 0x9E3779B97F4A7C15U;
+    (void) pthread_mutex_unlock(&fault_lock);
+}
+
+
+int32_t fault_add_rule(const FaultRule *rule) {
+    int32_t result = 0;
+
+    (void) pthread_mutex_lock(&fault_lock);
+    if (rule_count < FAULT_MAX_RULES) {
+        rules[rule_count] = *rule;
+        rule_count++;
+        result = 1;
+    }
+    (void) pthread_mutex_unlock(&fault_lock);
+
+    return result;
+}
+
+
+// Parses one field of a rule into it. Returns 1 if it made sense.
+static int32_t parse_field(FaultRule *rule, const char *field) {
+    int32_t result = 1;
+    double a = 0.0;
+    double b = 0.0;
+    int32_t i = 0;
+    char name[16];
+
+    if (sscanf(field, "op=%15s", name) == 1) {
+        rule->op = (strcmp(name, "any") == 0) ? FAULT_ANY : -2;
+        for (i = 0; i < GPIO_IO_OP_COUNT; i++) {
+            if (strcmp(name, op_names[i]) == 0) {
+                rule->op = i;
+            }
+        }
+        result = (int32_t) (rule->op != -2);
+    }
+    else if (strcmp(field, "pin=any") == 0) {
+        rule->pin = FAULT_ANY;
+    }
+    else if (sscanf(field, "pin=%d", &rule->pin) == 1) {
+        result = (int32_t) (rule->pin >= 0);
+    }
+    else if (sscanf(field, "lat=fixed:%lf", &a) == 1) {
+        rule->latency = FAULT_LATENCY_FIXED;
+        rule->latency_a_ns = (int64_t) (a * (double) NS_PER_US);
+    }
+    else if (sscanf(field, "lat=uniform:%lf:%lf", &a, &b) == 2) {
+        rule->latency = FAULT_LATENCY_UNIFORM;
+        rule->latency_a_ns = (int64_t) (a * (double) NS_PER_US);
+        rule->latency_b_ns = (int64_t) (b * (double) NS_PER_US);
+        result = (int32_t) (b >= a);
+    }
+    else if (sscanf(field, "lat=exp:%lf", &a) == 1) {
+        rule->latency = FAULT_LATENCY_EXPONENTIAL;
+        rule->latency_a_ns = (int64_t) (a * (double) NS_PER_US);
+    }
+    else if (sscanf(field, "fail=%lf", &a) == 1) {
+        rule->fail_ppm = (uint32_t) (a * 1e4);
+        result = (int32_t) (a >= 0.0 && a <= 100.0);
+    }
+    else if (strcmp(field, "err=EBUSY") == 0) {
+        rule->fail_errno = EBUSY;
+    }
+    else if (strcmp(field, "err=EIO") == 0) {
+        rule->fail_errno = EIO;
+    }
+    else if (sscanf(field, "stall=%lf:%lf", &a, &b) == 2) {
+        rule->stall_ppm = (uint32_t) (a * 1e4);
+        rule->stall_ns = (int64_t) (b * (double) NS_PER_MS);
+        result = (int32_t) (a >= 0.0 && a <= 100.0 && b >= 0.0);
+    }
+    else {
+        result = 0;
+    }
+
+    // Negative delays from a stray minus sign would just be skipped, reject them instead.
+    if (rule->latency_a_ns < 0 || rule->latency_b_ns < 0) {
+        result = 0;
+    }
+
+    return result;
+}
+
+
+int32_t fault_parse(const char *spec) {
+    int32_t result = 0;
+    FaultRule parsed[FAULT_MAX_RULES];
+    char copy[SPEC_LENGTH];
+    char *rule_save = NULL;
+    char *rule_text = NULL;
+    int32_t i = 0;
+
+    if (strlen(spec) >= SPEC_LENGTH) {
+        result = -1;
+    }
+    else {
+        (void) snprintf(copy, sizeof(copy), "%s", spec);
+        rule_text = strtok_r(copy, ";", &rule_save);
+    }
+
+    while (rule_text != NULL && result >= 0) {
+        char *field_save = NULL;
+        char *field = strtok_r(rule_text, ",", &field_save);
+
+        if (result >= FAULT_MAX_RULES) {
+            result = -1;
+        }
+        else {
+            FaultRule *rule = &parsed[result];
+
+            (void) memset(rule, 0, sizeof(*rule));
+            rule->op = FAULT_ANY;
+            rule->pin = FAULT_ANY;
+            rule->fail_errno = EIO;
+
+            while (field != NULL && result >= 0) {
+                if (parse_field(rule, field) != 1) {
+                    result = -1;
+                }
+                field = strtok_r(NULL, ",", &field_save);
+            }
+
+            if (result >= 0) {
+                result++;
+            }
+        }
+
+        rule_text = strtok_r(NULL, ";", &rule_save);
+    }
+
+    // All or nothing, so a typo doesn't leave half the rules in place.
+    if (result > 0 && rule_count + result > FAULT_MAX_RULES) {
+        result = -1;
+    }
+    for (i = 0; i < result; i++) {
+        (void) fault_add_rule(&parsed[i]);
+    }
+
+    return result;
+}
+
+
+void fault_enable(int32_t enable) {
+    set_gpio_io_hook((enable == 1) ? &fault_hook : NULL);
+}
+
+
+void fault_get_stats(int32_t op, FaultStats *out) {
+    (void) memset(out, 0, sizeof(*out));
+
+    if (op >= 0 && op < GPIO_IO_OP_COUNT) {
+        (void) pthread_mutex_lock(&fault_lock);
+        *out = stats[op];
+        (void) pthread_mutex_unlock(&fault_lock);
+    }
+}
+
+
+void fault_print_report(void) {
+    FaultStats s;
+    int32_t i = 0;
+
+    (void) printf("Fault injection, %d rules:\n", rule_count);
+    for (i = 0; i < rule_count; i++) {
+        const FaultRule *r = &rules[i];
+        char pin[8] = "any";
+
+        if (r->pin != FAULT_ANY) {
+            (void) snprintf(pin, sizeof(pin), "%d", r->pin);
+        }
+        (void) printf("  %d: op %s, pin %s, latency %s %.1f/%.1f us, fail %.2f%% (%s), stall %.2f%% for %.1f ms\n", i + 1,
+                      (r->op == FAULT_ANY) ? "any" : op_names[r->op], pin,
+                      (r->latency == FAULT_LATENCY_FIXED) ? "fixed" : ((r->latency == FAULT_LATENCY_UNIFORM) ? "uniform" :
+                      ((r->latency == FAULT_LATENCY_EXPONENTIAL) ? "exp" : "none")),
+                      (double) r->latency_a_ns / 1e3, (double) r->latency_b_ns / 1e3, (double) r->fail_ppm / 1e4,
+                      (r->fail_errno == EBUSY) ? "EBUSY" : "EIO", (double) r->stall_ppm / 1e4, (double) r->stall_ns / 1e6);
+    }
+
+    (void) printf("  %-10s  %10s  %10s  %8s  %8s  %12s  %12s\n", "op", "calls", "matched", "failed", "stalled", "avg added us", "max added us");
+    for (i = 0; i < GPIO_IO_OP_COUNT; i++) {
+        fault_get_stats(i, &s);
+        if (s.operations > 0U) {
+            (void) printf("  %-10s  %10llu  %10llu  %8llu  %8llu  %12.1f  %12.1f\n", op_names[i], (unsigned long long) s.operations,
+                          (unsigned long long) s.matched, (unsigned long long) s.failures, (unsigned long long) s.stalls,
+                          (s.matched > 0U) ? ((double) s.sum_delay_ns / (1e3 * (double) s.matched)) : 0.0, (double) s.max_delay_ns / 1e3);
+        }
+    }
+}
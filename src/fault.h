@@ -0,0 +1,109 @@
+/*
+This file is for defining the fault and latency injection layer used to test how the real-time code copes with a slow or
+failing GPIO path. On a loaded BeagleBone a sysfs write occasionally takes milliseconds, and that is hard to reproduce
+on demand, so instead the layer delays or fails GPIO operations on purpose, following a list of rules.
+
+It sits on the bbbio GPIO I/O hook (see set_gpio_io_hook), so it works over every backend: the bbbio value functions,
+the gpioinput reads and gpio_bank_write / gpio_bank_read on SYSFS, MMAP or SIM. (With the SYSFS backend a bank
+operation also runs through the value operations of each of its pins.)
+
+A rule matches an operation type and a pin (or any of either). The first rule that matches an operation decides what
+happens to it:
+- Latency: a fixed, uniform or exponential delay, spent busy waiting. That is what a slow sysfs write does to the
+  caller: it keeps the CPU, so lower priority threads don't run either.
+- Stall:   with some probability the caller sleeps for a while instead (blocked on a lock in the driver).
+- Failure: with some probability the operation fails with EBUSY or EIO without touching the pin.
+
+Rules can be written as text, which is how the stopwatch takes them (./stopwatch fault "<rules>"):
+    op=write,pin=60,lat=exp:800,fail=1,err=EIO;op=any,stall=0.5:20
+Rules are separated by ';', fields by ','. All fields are optional:
+    op=write|read|bank_write|bank_read|any    pin=N|any
+    lat=fixed:US | uniform:MIN_US:MAX_US | exp:MEAN_US
+    fail=PERCENT    err=EBUSY|EIO    stall=PERCENT:MS
+*/
+
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "bbbio.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define FAULT_MAX_RULES ((int32_t) 16)
+
+// Matches every operation type or every pin.
+#define FAULT_ANY ((int32_t) -1)
+
+#define FAULT_LATENCY_NONE ((int32_t) 0)
+
+#define FAULT_LATENCY_FIXED ((int32_t) 1)      // Always latency_a_ns
+
+#define FAULT_LATENCY_UNIFORM ((int32_t) 2)    // Between latency_a_ns and latency_b_ns
+
+#define FAULT_LATENCY_EXPONENTIAL ((int32_t) 3) // Mean latency_a_ns: mostly short, with a long tail
+
+// Probabilities are in parts per million.
+#define FAULT_PPM ((uint32_t) 1000000)
+
+
+typedef struct {
+    int32_t op;             // One of the GPIO_IO_ operations, or FAULT_ANY
+    int32_t pin;            // GPIO number, or FAULT_ANY
+    int32_t latency;        // One of the FAULT_LATENCY_ distributions
+    int64_t latency_a_ns;
+    int64_t latency_b_ns;
+    uint32_t fail_ppm;      // Chance of failing the operation
+    int32_t fail_errno;     // EBUSY or EIO
+    uint32_t stall_ppm;     // Chance of stalling the caller
+    int64_t stall_ns;
+} FaultRule;
+
+typedef struct {
+    uint64_t operations;    // Operations that went through the hook
+    uint64_t matched;       // Operations a rule applied to
+    uint64_t failures;
+    uint64_t stalls;
+    int64_t sum_delay_ns;   // Latency and stalls added
+    int64_t max_delay_ns;
+} FaultStats;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Removes all rules, clears the statistics and seeds the random numbers. Doesn't enable injection.
+// Parameters: seed - Seed of the random numbers, the same seed and rules give the same faults
+void fault_init(uint64_t seed);
+
+
+// Description: Adds a rule after the existing ones.
+// Parameters: rule - The rule
+// Returns - 1 on success, 0 if there are already FAULT_MAX_RULES rules.
+int32_t fault_add_rule(const FaultRule *rule);
+
+
+// Description: Adds the rules written as text (format at the top of this file).
+// Parameters: spec - The rules
+// Returns - The number of rules added, -1 if the text has a mistake (nothing is added then).
+int32_t fault_parse(const char *spec);
+
+
+// Description: Turns injection on or off by installing or removing the bbbio GPIO I/O hook.
+// Parameters: enable - 1 to turn it on, 0 to turn it off
+void fault_enable(int32_t enable);
+
+
+// Description: Copies the statistics of one operation type.
+// Parameters:
+// op    - One of the GPIO_IO_ operations
+// stats - Where to store them
+void fault_get_stats(int32_t op, FaultStats *stats);
+
+
+// Description: Prints the rules and what was injected per operation type.
+void fault_print_report(void);
+
+
+#endif // End of include guard
@@ -0,0 +1,499 @@
+/*
+This file implements all the functions defined in gpiobank.h.
+Each backend is a small table of function pointers so the bank functions only have to call through the selected one.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN GPIOBANK.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "bbbio.h"
+#include "rtutil.h"
+#include "gpiobank.h"
+
+
+typedef struct {
+    int32_t (*open)(void);
+    void (*close)(void);
+    int32_t (*write)(int32_t bank, uint32_t mask, uint32_t value);
+    int32_t (*read)(int32_t bank, uint32_t mask, uint32_t *value);
+} GpioBankOps;
+
+
+static const uint32_t bank_base_addr[GPIO_BANK_COUNT] = {
+    GPIO0_BASE_ADDR, GPIO1_BASE_ADDR, GPIO2_BASE_ADDR, GPIO3_BASE_ADDR
+};
+
+// Register pointers for the MMAP backend. volatile so every access really goes to the hardware.
+static volatile uint32_t *bank_regs[GPIO_BANK_COUNT] = { NULL, NULL, NULL, NULL };
+
+// Pin levels for the SIM backend.
+static uint32_t sim_levels[GPIO_BANK_COUNT] = { 0U, 0U, 0U, 0U };
+
+
+static int32_t bank_valid(int32_t bank) {
+    return (int32_t) (bank >= 0 && bank < GPIO_BANK_COUNT);
+}
+
+
+/// ----------- SYSFS BACKEND ----------- ///
+
+static int32_t sysfs_open(void) {
+    return 1;
+}
+
+
+static void sysfs_close(void) {
+}
+
+
+static int32_t sysfs_write(int32_t bank, uint32_t mask, uint32_t value) {
+    int32_t result = 1;
+    int32_t bit = 0;
+
+    for (bit = 0; bit < GPIO_PINS_PER_BANK; bit++) {
+        if ((mask & ((uint32_t) 1U << (uint32_t) bit)) != 0U) {
+            int32_t level = (int32_t) ((value >> (uint32_t) bit) & 1U);
+
+            if (write_gpio_value((bank * GPIO_PINS_PER_BANK) + bit, level) != 1) {
+                result = 0;
+            }
+        }
+    }
+
+    return result;
+}
+
+
+static int32_t sysfs_read(int32_t bank, uint32_t mask, uint32_t *value) {
+    int32_t result = 1;
+    int32_t bit = 0;
+    uint32_t levels = 0U;
+
+    for (bit = 0; bit < GPIO_PINS_PER_BANK; bit++) {
+        if ((mask & ((uint32_t) 1U << (uint32_t) bit)) != 0U) {
+            int32_t level = read_gpio_value((bank * GPIO_PINS_PER_BANK) + bit);
+
+            if (level == 1) {
+                levels |= ((uint32_t) 1U << (uint32_t) bit);
+            }
+            else if (level != 0) {
+                result = 0;
+            }
+            else {
+            }
+        }
+    }
+
+    *value = levels;
+
+    return result;
+}
+
+
+/// ----------- MMAP BACKEND ----------- ///
+
+static void mmap_close(void) {
+    int32_t bank = 0;
+
+    for (bank = 0; bank < GPIO_BANK_COUNT; bank++) {
+        if (bank_regs[bank] != NULL) {
+            (void) munmap((void *) bank_regs[bank], GPIO_BANK_MAP_SIZE);
+            bank_regs[bank] = NULL;
+        }
+    }
+}
+
+
+static int32_t mmap_open(void) {
+    int32_t result = 1;
+    int32_t bank = 0;
+    int32_t fd = open(DEV_MEM_PATH, O_RDWR | O_SYNC);
+
+    if (fd < 0) {
+        result = 0;
+    }
+    else {
+        for (bank = 0; bank < GPIO_BANK_COUNT; bank++) {
+            void *map = mmap(NULL, GPIO_BANK_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t) bank_base_addr[bank]);
+
+            if (map == MAP_FAILED) {
+                result = 0;
+            }
+            else {
+                bank_regs[bank] = (volatile uint32_t *) map;
+            }
+        }
+
+        // The mappings stay valid after the file descriptor is closed.
+        (void) close(fd);
+
+        if (result == 0) {
+            mmap_close();
+        }
+    }
+
+    return result;
+}
+
+
+static int32_t mmap_write(int32_t bank, uint32_t mask, uint32_t value) {
+    volatile uint32_t *regs = bank_regs[bank];
+
+    // SETDATAOUT / CLEARDATAOUT only affect the bits written as 1, so no read-modify-write of DATAOUT is needed
+    // and another thread driving different pins of the same bank can't be overwritten.
+    regs[GPIO_SETDATAOUT_OFFSET / sizeof(uint32_t)] = mask & value;
+    regs[GPIO_CLEARDATAOUT_OFFSET / sizeof(uint32_t)] = mask & ~value;
+
+    return 1;
+}
+
+
+static int32_t mmap_read(int32_t bank, uint32_t mask, uint32_t *value) {
+    *value = bank_regs[bank][GPIO_DATAIN_OFFSET / sizeof(uint32_t)] & mask;
+
+    return 1;
+}
+
+
+/// ----------- SIM BACKEND ----------- ///
+
+// Virtual wires of the SIM backend. The SIM state is shared by every thread using the backend, so it is all under sim_lock.
+static GpioSimWire sim_wires[GPIO_SIM_MAX_WIRES];
+
+static int32_t sim_wire_count = 0;
+
+// Edges on their way, sorted by time.
+static GpioSimEdge sim_pending[GPIO_SIM_MAX_PENDING];
+
+static int32_t sim_pending_count = 0;
+
+static GpioSimEdge sim_log[GPIO_SIM_EDGE_LOG];
+
+static int32_t sim_log_head = 0;
+
+static int32_t sim_log_count = 0;
+
+static uint64_t sim_dropped_log = 0U;
+
+static uint64_t sim_dropped_pending = 0U;
+
+static uint64_t sim_random_state = (uint64_t) 0x9E3779B97F4A7C15U;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Random 0 to range (inclusive), for jitter, bounce and glitch times. xorshift64.
+static int64_t sim_random(int64_t range) {
+    int64_t result = 0;
+
+    sim_random_state ^= sim_random_state << 13;
+    sim_random_state ^= sim_random_state >> 7;
+    sim_random_state ^= sim_random_state << 17;
+    if (range > 0) {
+        result = (int64_t) (sim_random_state % (uint64_t) (range + 1));
+    }
+
+    return result;
+}
+
+
+static void sim_schedule(int64_t time_ns, int32_t pin, int32_t level, int32_t wire) {
+    int32_t i = sim_pending_count;
+
+    if (sim_pending_count >= GPIO_SIM_MAX_PENDING) {
+        sim_dropped_pending++;
+    }
+    else {
+        // Edges mostly arrive in time order, so the insertion point is usually the end.
+        while (i > 0 && sim_pending[i - 1].time_ns > time_ns) {
+            sim_pending[i] = sim_pending[i - 1];
+            i--;
+        }
+        sim_pending[i].time_ns = time_ns;
+        sim_pending[i].pin = pin;
+        sim_pending[i].level = level;
+        sim_pending[i].wire = wire;
+        sim_pending_count++;
+    }
+}
+
+
+// Schedules what every wire driven by pin does after it changed to level at time_ns.
+static void sim_propagate(int32_t pin, int32_t level, int64_t time_ns) {
+    int32_t w = 0;
+    int32_t k = 0;
+
+    for (w = 0; w < sim_wire_count; w++) {
+        const GpioSimWire *wire = &sim_wires[w];
+
+        if (wire->from_pin == pin) {
+            int32_t out = level ^ wire->invert;
+            int64_t at_ns = time_ns + wire->delay_ns + sim_random(wire->jitter_ns);
+
+            sim_schedule(at_ns, wire->to_pin, out, w);
+
+            // Bounce: 2 * bounce_count transitions, one in each slot of the bounce time, ending at the new level.
+            if (wire->bounce_count > 0 && wire->bounce_ns > 0) {
+                int64_t slot_ns = wire->bounce_ns / (2 * (int64_t) wire->bounce_count);
+
+                for (k = 0; k < 2 * wire->bounce_count; k++) {
+                    sim_schedule(at_ns + ((int64_t) k * slot_ns) + 1 + sim_random(slot_ns - 1), wire->to_pin, ((k % 2) == 0) ? (out ^ 1) : out, w);
+                }
+            }
+
+            if (wire->glitch_ppm > 0U && sim_random((int64_t) 999999) < (int64_t) wire->glitch_ppm) {
+                int64_t glitch_at_ns = at_ns + wire->bounce_ns + 1 + sim_random(GPIO_SIM_GLITCH_WINDOW_NS);
+
+                sim_schedule(glitch_at_ns, wire->to_pin, out ^ 1, w);
+                sim_schedule(glitch_at_ns + wire->glitch_ns, wire->to_pin, out, w);
+            }
+        }
+    }
+}
+
+
+// Changes the levels of some pins at time_ns, and sends the changes down the wires.
+static void sim_drive(int32_t bank, uint32_t mask, uint32_t value, int64_t time_ns) {
+    uint32_t changed = (sim_levels[bank] ^ value) & mask;
+    int32_t bit = 0;
+
+    sim_levels[bank] = (sim_levels[bank] & ~mask) | (value & mask);
+
+    for (bit = 0; bit < GPIO_PINS_PER_BANK && changed != 0U && sim_wire_count > 0; bit++) {
+        if ((changed & ((uint32_t) 1U << (uint32_t) bit)) != 0U) {
+            sim_propagate((bank * GPIO_PINS_PER_BANK) + bit, (int32_t) ((value >> (uint32_t) bit) & 1U), time_ns);
+        }
+    }
+}
+
+
+// Applies every wire edge due by now, in time order. An edge can cause more (wires chained through a pin).
+static void sim_apply_due(int64_t now_ns) {
+    while (sim_pending_count > 0 && sim_pending[0].time_ns <= now_ns) {
+        GpioSimEdge edge = sim_pending[0];
+        int32_t bank = GPIO_BANK_OF(edge.pin);
+        uint32_t bit = GPIO_BIT_OF(edge.pin);
+
+        sim_pending_count--;
+        (void) memmove(&sim_pending[0], &sim_pending[1], (size_t) sim_pending_count * sizeof(sim_pending[0]));
+
+        if (((sim_levels[bank] & bit) != 0U) != (edge.level == 1)) {
+            if (sim_log_count == GPIO_SIM_EDGE_LOG) {
+                sim_log_head = (sim_log_head + 1) % GPIO_SIM_EDGE_LOG;
+                sim_log_count--;
+                sim_dropped_log++;
+            }
+            sim_log[(sim_log_head + sim_log_count) % GPIO_SIM_EDGE_LOG] = edge;
+            sim_log_count++;
+
+            sim_drive(bank, bit, (edge.level == 1) ? bit : 0U, edge.time_ns);
+        }
+    }
+}
+
+
+// The time to bring the wires up to. Reading the clock is skipped while nothing is wired.
+static int64_t sim_now_ns(void) {
+    return (sim_wire_count > 0) ? rt_now_ns() : 0;
+}
+
+
+static int32_t sim_open(void) {
+    return 1;
+}
+
+
+static void sim_close(void) {
+}
+
+
+static int32_t sim_write(int32_t bank, uint32_t mask, uint32_t value) {
+    int64_t now_ns = 0;
+
+    (void) pthread_mutex_lock(&sim_lock);
+    now_ns = sim_now_ns();
+    sim_apply_due(now_ns);
+    sim_drive(bank, mask, value, now_ns);
+    (void) pthread_mutex_unlock(&sim_lock);
+
+    return 1;
+}
+
+
+static int32_t sim_read(int32_t bank, uint32_t mask, uint32_t *value) {
+    (void) pthread_mutex_lock(&sim_lock);
+    sim_apply_due(sim_now_ns());
+    *value = sim_levels[bank] & mask;
+    (void) pthread_mutex_unlock(&sim_lock);
+
+    return 1;
+}
+
+
+static const GpioBankOps backend_ops[3] = {
+    { &sysfs_open, &sysfs_close, &sysfs_write, &sysfs_read },
+    { &mmap_open, &mmap_close, &mmap_write, &mmap_read },
+    { &sim_open, &sim_close, &sim_write, &sim_read }
+};
+
+static int32_t current_backend = GPIO_BACKEND_SYSFS;
+
+
+int32_t gpio_bank_open(int32_t backend) {
+    int32_t result = 0;
+
+    if (backend >= GPIO_BACKEND_SYSFS && backend <= GPIO_BACKEND_SIM) {
+        if (backend == current_backend) {
+            result = 1;
+        }
+        else if (backend_ops[backend].open() == 1) {
+            backend_ops[current_backend].close();
+            current_backend = backend;
+            result = 1;
+        }
+        else {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+
+void gpio_bank_close(void) {
+    backend_ops[current_backend].close();
+    current_backend = GPIO_BACKEND_SYSFS;
+}
+
+
+int32_t gpio_bank_backend(void) {
+    return current_backend;
+}
+
+
+const char *gpio_bank_backend_name(int32_t backend) {
+    const char *name = NULL_STR;
+
+    if (backend == GPIO_BACKEND_SYSFS) {
+        name = "sysfs";
+    }
+    else if (backend == GPIO_BACKEND_MMAP) {
+        name = "mmap";
+    }
+    else if (backend == GPIO_BACKEND_SIM) {
+        name = "sim";
+    }
+    else {
+        name = NULL_STR;
+    }
+
+    return name;
+}
+
+
+int32_t gpio_bank_write(int32_t bank, uint32_t mask, uint32_t value) {
+    int32_t result = 0;
+
+    if (bank_valid(bank) == 1 && run_gpio_io_hook(GPIO_IO_BANK_WRITE, bank, mask) == 0) {
+        result = backend_ops[current_backend].write(bank, mask, value);
+    }
+
+    return result;
+}
+
+
+int32_t gpio_bank_read(int32_t bank, uint32_t mask, uint32_t *value) {
+    int32_t result = 0;
+
+    if (bank_valid(bank) == 1 && value != NULL && run_gpio_io_hook(GPIO_IO_BANK_READ, bank, mask) == 0) {
+        result = backend_ops[current_backend].read(bank, mask, value);
+    }
+
+    return result;
+}
+
+
+void gpio_bank_sim_set(int32_t bank, uint32_t mask, uint32_t value) {
+    if (bank_valid(bank) == 1) {
+        (void) sim_write(bank, mask, value);
+    }
+}
+
+
+int32_t gpio_bank_sim_connect(const GpioSimWire *wire) {
+    int32_t result = -1;
+    int32_t taken = 0;
+    int32_t w = 0;
+    const int32_t pin_count = GPIO_BANK_COUNT * GPIO_PINS_PER_BANK;
+
+    (void) pthread_mutex_lock(&sim_lock);
+
+    for (w = 0; w < sim_wire_count; w++) {
+        if (sim_wires[w].to_pin == wire->to_pin) {
+            taken = 1;
+        }
+    }
+
+    if (taken == 0 && sim_wire_count < GPIO_SIM_MAX_WIRES && wire->from_pin >= 0 && wire->from_pin < pin_count &&
+        wire->to_pin >= 0 && wire->to_pin < pin_count && wire->from_pin != wire->to_pin && wire->delay_ns >= 0 &&
+        wire->jitter_ns >= 0 && wire->bounce_count >= 0 && wire->bounce_ns >= 0 && wire->glitch_ns >= 0) {
+        int32_t level = (int32_t) ((sim_levels[GPIO_BANK_OF(wire->from_pin)] & GPIO_BIT_OF(wire->from_pin)) != 0U);
+        uint32_t bit = GPIO_BIT_OF(wire->to_pin);
+
+        sim_wires[sim_wire_count] = *wire;
+        sim_wires[sim_wire_count].invert = (wire->invert != 0) ? 1 : 0;
+        result = sim_wire_count;
+        sim_wire_count++;
+
+        // The input starts at the level of the source, no edge for that.
+        sim_drive(GPIO_BANK_OF(wire->to_pin), bit, ((level ^ sim_wires[result].invert) == 1) ? bit : 0U, rt_now_ns());
+    }
+
+    (void) pthread_mutex_unlock(&sim_lock);
+
+    return result;
+}
+
+
+void gpio_bank_sim_disconnect_all(void) {
+    (void) pthread_mutex_lock(&sim_lock);
+    sim_wire_count = 0;
+    sim_pending_count = 0;
+    sim_log_head = 0;
+    sim_log_count = 0;
+    sim_dropped_log = 0U;
+    sim_dropped_pending = 0U;
+    (void) pthread_mutex_unlock(&sim_lock);
+}
+
+
+int32_t gpio_bank_sim_pop_edge(GpioSimEdge *edge) {
+    int32_t result = 0;
+
+    (void) pthread_mutex_lock(&sim_lock);
+    sim_apply_due(sim_now_ns());
+    if (sim_log_count > 0) {
+        *edge = sim_log[sim_log_head];
+        sim_log_head = (sim_log_head + 1) % GPIO_SIM_EDGE_LOG;
+        sim_log_count--;
+        result = 1;
+    }
+    (void) pthread_mutex_unlock(&sim_lock);
+
+    return result;
+}
+
+
+void gpio_bank_sim_dropped(uint64_t *dropped_log, uint64_t *dropped_pending) {
+    (void) pthread_mutex_lock(&sim_lock);
+    if (dropped_log != NULL) {
+        *dropped_log = sim_dropped_log;
+    }
+    if (dropped_pending != NULL) {
+        *dropped_pending = sim_dropped_pending;
+    }
+    (void) pthread_mutex_unlock(&sim_lock);
+}
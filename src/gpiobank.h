@@ -0,0 +1,177 @@
+/*
+This file is for defining whole-bank GPIO access on the BeagleBone Black.
+The AM335x has 4 GPIO banks of 32 pins each, and GPIO number N lives in bank N / 32 at bit N % 32.
+Working on a bank at a time lets us change several pins with one operation (a "mask write") instead of a loop of
+write_gpio_value calls, which is what makes multi-pin timing consistent.
+
+There are three backends:
+- SYSFS: Goes through the normal bbbio.h functions one pin at a time. Slow but works wherever bbbio works.
+- MMAP:  Maps the GPIO registers from /dev/mem and writes SETDATAOUT / CLEARDATAOUT directly. Needs root on the BeagleBone.
+- SIM:   Keeps the bank levels in memory. Used to run the higher level modules on a machine without GPIOs.
+         Pins can be connected with virtual wires (gpio_bank_sim_connect): a change of the source pin reaches the
+         connected input after the wire's propagation delay, optionally inverted, with timing jitter, contact bounce
+         and random glitches. Every edge a wire produces is logged with the time it happened (gpio_bank_sim_pop_edge),
+         so loops like an output toggling an input, or a PWM output feeding a capture input, run off-target.
+         Wire edges are applied when the SIM backend is next used, with their own timestamps, so a read always sees
+         the level the input had at the time of the read. No thread is needed.
+
+Sources:
+https://www.ti.com/lit/ug/spruh73q/spruh73q.pdf
+Chapter 2 (Memory Map) has the bank base addresses and chapter 25 (GPIO) has the register offsets used here.
+*/
+
+#ifndef GPIOBANK_H
+#define GPIOBANK_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define GPIO_BANK_COUNT ((int32_t) 4)
+
+#define GPIO_PINS_PER_BANK ((int32_t) 32)
+
+// Helpers to go from a GPIO number (the one used in /sys/class/gpio/gpioN) to its bank and bit.
+#define GPIO_BANK_OF(PIN) ((int32_t) (PIN) / GPIO_PINS_PER_BANK)
+
+#define GPIO_BIT_OF(PIN) ((uint32_t) 1U << ((uint32_t) (PIN) % (uint32_t) GPIO_PINS_PER_BANK))
+
+#define GPIO_BACKEND_SYSFS ((int32_t) 0)
+
+#define GPIO_BACKEND_MMAP ((int32_t) 1)
+
+#define GPIO_BACKEND_SIM ((int32_t) 2)
+
+// Physical base addresses of the 4 GPIO banks (AM335x TRM, table 2-2 and 2-3).
+#define GPIO0_BASE_ADDR ((uint32_t) 0x44E07000U)
+
+#define GPIO1_BASE_ADDR ((uint32_t) 0x4804C000U)
+
+#define GPIO2_BASE_ADDR ((uint32_t) 0x481AC000U)
+
+#define GPIO3_BASE_ADDR ((uint32_t) 0x481AE000U)
+
+#define GPIO_BANK_MAP_SIZE ((uint32_t) 0x1000U)
+
+// Register offsets within a bank (AM335x TRM, section 25.4.1).
+#define GPIO_OE_OFFSET ((uint32_t) 0x134U)
+
+#define GPIO_DATAIN_OFFSET ((uint32_t) 0x138U)
+
+#define GPIO_DATAOUT_OFFSET ((uint32_t) 0x13CU)
+
+#define GPIO_CLEARDATAOUT_OFFSET ((uint32_t) 0x190U)
+
+#define GPIO_SETDATAOUT_OFFSET ((uint32_t) 0x194U)
+
+#define DEV_MEM_PATH "/dev/mem"
+
+// SIM backend wiring.
+#define GPIO_SIM_MAX_WIRES ((int32_t) 16)
+
+// Edges scheduled on wires but not due yet.
+#define GPIO_SIM_MAX_PENDING ((int32_t) 512)
+
+// Edges kept in the log until gpio_bank_sim_pop_edge takes them, the oldest are dropped when it is full.
+#define GPIO_SIM_EDGE_LOG ((int32_t) 1024)
+
+// A glitch happens at a random time within this long after the edge that caused it settles.
+#define GPIO_SIM_GLITCH_WINDOW_NS ((int64_t) 1000000)
+
+
+typedef struct {
+    int32_t from_pin;       // Pin whose level drives the wire (an output, or a pin forced with gpio_bank_sim_set)
+    int32_t to_pin;         // Input pin at the other end
+    int64_t delay_ns;       // Propagation delay
+    int64_t jitter_ns;      // Each edge is late by a random extra 0 to jitter_ns
+    int32_t invert;         // 1 for an inverting wire (an open collector stage, an active low signal)
+    int32_t bounce_count;   // Extra back and forth transitions after each edge, like a mechanical contact
+    int64_t bounce_ns;      // Time the bounce is spread over before the level settles
+    uint32_t glitch_ppm;    // Chance per edge (parts per million) of one short pulse of the wrong level afterwards
+    int64_t glitch_ns;      // Length of a glitch
+} GpioSimWire;
+
+typedef struct {
+    int64_t time_ns;        // CLOCK_MONOTONIC time the input changed
+    int32_t pin;
+    int32_t level;
+    int32_t wire;           // Index of the wire that produced it
+} GpioSimEdge;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Selects and opens the backend used by all the other gpio_bank functions. Can be called again to switch backend.
+// Parameters:
+// backend - GPIO_BACKEND_SYSFS, GPIO_BACKEND_MMAP or GPIO_BACKEND_SIM
+// Returns - 1 on success, 0 on failure (for example /dev/mem could not be mapped). On failure the previous backend stays selected.
+int32_t gpio_bank_open(int32_t backend);
+
+
+// Description: Releases whatever the current backend holds (the /dev/mem mappings for MMAP). The SYSFS backend is selected afterwards.
+void gpio_bank_close(void);
+
+
+// Description: Returns the currently selected backend (one of the GPIO_BACKEND_ macros).
+int32_t gpio_bank_backend(void);
+
+
+// Description: Returns a printable name for a backend, e.g. "mmap".
+// Parameters: backend - One of the GPIO_BACKEND_ macros
+const char *gpio_bank_backend_name(int32_t backend);
+
+
+// Description: Drives the pins selected by mask to the matching bits of value, in one operation where the backend allows it.
+// Pins outside mask are not touched. The pins must already be set up as outputs (setup_gpio_pin).
+// Parameters:
+// bank  - Bank number (0 to 3)
+// mask  - Bit i set means GPIO (bank * 32 + i) is written
+// value - Bit i is the level to write for that pin
+// Returns - 1 on success, 0 on failure.
+int32_t gpio_bank_write(int32_t bank, uint32_t mask, uint32_t value);
+
+
+// Description: Reads the level of the pins selected by mask.
+// Parameters:
+// bank  - Bank number (0 to 3)
+// mask  - Pins to read. The SYSFS backend only reads these pins, the other backends read the whole bank anyway.
+// value - Where the levels are stored (bits outside mask are 0)
+// Returns - 1 on success, 0 on failure.
+int32_t gpio_bank_read(int32_t bank, uint32_t mask, uint32_t *value);
+
+
+// Description: SIM backend only. Forces the level of input pins, as if something external was driving them.
+// Parameters:
+// bank  - Bank number (0 to 3)
+// mask  - Pins to force
+// value - Levels to force them to
+void gpio_bank_sim_set(int32_t bank, uint32_t mask, uint32_t value);
+
+
+// Description: SIM backend only. Connects two pins with a virtual wire. The input takes the (possibly inverted) level of
+// the source right away, without an edge. A pin can be the end of only one wire.
+// Parameters: wire - The wire
+// Returns - The index of the wire, -1 if it is invalid, the input already has a wire or there are GPIO_SIM_MAX_WIRES wires.
+int32_t gpio_bank_sim_connect(const GpioSimWire *wire);
+
+
+// Description: SIM backend only. Removes all wires, the edges still on their way and the edge log. Levels stay as they are.
+void gpio_bank_sim_disconnect_all(void);
+
+
+// Description: SIM backend only. Takes the oldest edge from the wire edge log (only edges that already happened).
+// Parameters: edge - Where to store it
+// Returns - 1 if there was one, 0 if the log is empty.
+int32_t gpio_bank_sim_pop_edge(GpioSimEdge *edge);
+
+
+// Description: SIM backend only. Returns how many edges were dropped because the edge log was full, and how many
+// could not be scheduled because too many were on their way.
+// Parameters:
+// dropped_log     - Where to store the first count (NULL to skip)
+// dropped_pending - Where to store the second count (NULL to skip)
+void gpio_bank_sim_dropped(uint64_t *dropped_log, uint64_t *dropped_pending);
+
+
+#endif // End of include guard
@@ -0,0 +1,437 @@
+/*
+This file implements all the functions defined in gpioinput.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN GPIOINPUT.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include "rtutil.h"
+#include "gpioinput.h"
+
+
+// Reads the level from an open value file. Returns 0 or 1, -1 on failure.
+static int32_t read_level_fd(int32_t fd) {
+    int32_t result = -1;
+    char buff[2];
+
+    // Reading from offset 0 is also what acknowledges the interrupt for the next poll().
+    if (pread(fd, buff, sizeof(buff), 0) > 0) {
+        if (buff[0] == '1') {
+            result = 1;
+        }
+        else if (buff[0] == '0') {
+            result = 0;
+        }
+        else {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+
+static int32_t read_level(const GpioInputPin *p) {
+    int32_t result = -1;
+
+    if (p->fd < 0) {
+        result = read_gpio_value(p->pin);
+    }
+    else {
+        int32_t hook_error = run_gpio_io_hook(GPIO_IO_VALUE_READ, p->pin / 32, (uint32_t) 1U << ((uint32_t) p->pin % 32U));
+
+        // Always read: the read is what acknowledges the edge, otherwise POLLPRI stays set and poll returns at once forever.
+        result = read_level_fd(p->fd);
+        if (hook_error != 0) {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+
+// Nanoseconds of budget one edge costs. A pin can save up storm_burst of these.
+static int64_t edge_cost_ns(const GpioInputLimits *limits) {
+    return NS_PER_SEC / (int64_t) limits->storm_rate;
+}
+
+
+static void push_event(GpioInputSet *set, int32_t type, const GpioInputPin *p, int32_t value, int64_t time_ns, uint32_t merged) {
+    int32_t capacity = (int32_t) (sizeof(set->ready) / sizeof(set->ready[0]));
+
+    // Every pin produces at most two events per round (an edge and a quarantine) and the scanner at most
+    // GPIO_INPUT_MAX_SCAN_EVENTS, so the queue can't really fill up.
+    if (set->ready_count < capacity) {
+        GpioEvent *e = &set->ready[(set->ready_head + set->ready_count) % capacity];
+
+        e->type = type;
+        e->pin = p->pin;
+        e->value = value;
+        e->time_ns = time_ns;
+        e->merged = merged;
+        set->ready_count++;
+    }
+}
+
+
+static void quarantine_pin(GpioInputSet *set, GpioInputPin *p, int64_t now_ns) {
+    p->quarantined = 1;
+    p->quarantine_until_ns = now_ns + set->limits.quarantine_ns;
+    p->quarantines++;
+    p->merged_total += p->pending_merged;
+    p->pending_merged = 0U;
+
+    // Stop the interrupt so the pin can't keep waking us up.
+    if (p->fd >= 0) {
+        (void) set_gpio_edge(p->pin, (BufferPointer) GPIO_EDGE_NONE);
+    }
+
+    push_event(set, GPIO_EVENT_QUARANTINE, p, p->last_level, now_ns, 0U);
+}
+
+
+// Runs one raw edge through the storm bucket and the hold-off.
+static void filter_edge(GpioInputSet *set, GpioInputPin *p, int32_t level, int64_t now_ns) {
+    int64_t cost_ns = edge_cost_ns(&set->limits);
+    int64_t max_credit_ns = cost_ns * (int64_t) set->limits.storm_burst;
+
+    if (p->quarantined == 0 && level >= 0 && level != p->last_level) {
+        p->raw_edges++;
+
+        // Refill the bucket for the time since the last edge, then take this edge out of it.
+        p->credit_ns += now_ns - p->last_raw_ns;
+        if (p->credit_ns > max_credit_ns) {
+            p->credit_ns = max_credit_ns;
+        }
+        p->credit_ns -= cost_ns;
+
+        p->last_level = level;
+        p->last_raw_ns = now_ns;
+
+        if (p->credit_ns < 0) {
+            quarantine_pin(set, p, now_ns);
+        }
+        else if (p->pending_merged == 0U && (now_ns - p->last_delivered_ns) >= set->limits.holdoff_ns) {
+            p->delivered_level = level;
+            p->last_delivered_ns = now_ns;
+            p->delivered++;
+            push_event(set, GPIO_EVENT_EDGE, p, level, now_ns, 0U);
+        }
+        else {
+            p->pending_merged++;
+        }
+    }
+}
+
+
+// Handles what happens with time alone: hold-offs ending and quarantines running out.
+static void check_timers(GpioInputSet *set, int64_t now_ns) {
+    int32_t i = 0;
+
+    for (i = 0; i < set->count; i++) {
+        GpioInputPin *p = &set->pins[i];
+
+        if (p->quarantined == 1 && now_ns >= p->quarantine_until_ns) {
+            p->quarantined = 0;
+            p->credit_ns = edge_cost_ns(&set->limits) * (int64_t) set->limits.storm_burst;
+            if (p->fd >= 0) {
+                (void) set_gpio_edge(p->pin, (BufferPointer) GPIO_EDGE_BOTH);
+            }
+
+            // The level may have changed while we weren't looking, start over from the current one.
+            p->last_level = read_level(p);
+            p->delivered_level = p->last_level;
+            p->last_raw_ns = now_ns;
+            push_event(set, GPIO_EVENT_RELEASED, p, p->last_level, now_ns, 0U);
+        }
+        else if (p->pending_merged > 0U && (now_ns - p->last_delivered_ns) >= set->limits.holdoff_ns) {
+            // Only deliver if the bouncing left the pin at a different level, otherwise the edges cancelled out.
+            if (p->last_level != p->delivered_level) {
+                p->delivered_level = p->last_level;
+                p->last_delivered_ns = p->last_raw_ns;
+                p->delivered++;
+                p->merged_total += p->pending_merged - 1U;
+                push_event(set, GPIO_EVENT_EDGE, p, p->last_level, p->last_raw_ns, p->pending_merged - 1U);
+            }
+            else {
+                p->merged_total += p->pending_merged;
+            }
+            p->pending_merged = 0U;
+        }
+        else {
+        }
+    }
+}
+
+
+// Time until the next thing check_timers or the sampling has to do, or the deadline if that comes first.
+static int64_t next_wakeup_ns(const GpioInputSet *set, int64_t deadline_ns) {
+    int64_t wakeup_ns = deadline_ns;
+    int32_t i = 0;
+
+    for (i = 0; i < set->count; i++) {
+        const GpioInputPin *p = &set->pins[i];
+        int64_t t_ns = INT64_MAX;
+
+        if (p->quarantined == 1) {
+            t_ns = p->quarantine_until_ns;
+        }
+        else if (p->pending_merged > 0U) {
+            t_ns = p->last_delivered_ns + set->limits.holdoff_ns;
+        }
+        else {
+        }
+
+        // Sampled pins also need the next sampling time, whatever else they are waiting for.
+        if (p->fd < 0 && p->quarantined == 0 && set->next_sample_ns < t_ns) {
+            t_ns = set->next_sample_ns;
+        }
+
+        if (t_ns < wakeup_ns) {
+            wakeup_ns = t_ns;
+        }
+    }
+
+    if (set->scanner != NULL && set->next_scan_ns < wakeup_ns) {
+        wakeup_ns = set->next_scan_ns;
+    }
+
+    return wakeup_ns;
+}
+
+
+static void run_scanner(GpioInputSet *set, int64_t now_ns) {
+    int32_t capacity = (int32_t) (sizeof(set->ready) / sizeof(set->ready[0]));
+    GpioEvent events[GPIO_INPUT_MAX_SCAN_EVENTS];
+    int32_t count = 0;
+    int32_t i = 0;
+
+    if (set->scanner != NULL && now_ns >= set->next_scan_ns) {
+        count = set->scanner(set->scanner_context, now_ns, events, GPIO_INPUT_MAX_SCAN_EVENTS);
+
+        for (i = 0; i < count && set->ready_count < capacity; i++) {
+            set->ready[(set->ready_head + set->ready_count) % capacity] = events[i];
+            set->ready_count++;
+        }
+
+        while (set->next_scan_ns <= now_ns) {
+            set->next_scan_ns += set->scan_period_ns;
+        }
+    }
+}
+
+
+static void sample_polled_pins(GpioInputSet *set, int64_t now_ns) {
+    int32_t i = 0;
+
+    if (now_ns >= set->next_sample_ns) {
+        for (i = 0; i < set->count; i++) {
+            if (set->pins[i].fd < 0) {
+                filter_edge(set, &set->pins[i], read_level(&set->pins[i]), now_ns);
+            }
+        }
+
+        // Keep the sampling on a fixed grid, skipping any periods we missed.
+        while (set->next_sample_ns <= now_ns) {
+            set->next_sample_ns += GPIO_INPUT_POLL_NS;
+        }
+    }
+}
+
+
+void gpio_input_init(GpioInputSet *set, const GpioInputLimits *limits) {
+    set->count = 0;
+    set->ready_head = 0;
+    set->ready_count = 0;
+    set->next_sample_ns = rt_now_ns();
+    set->scanner = NULL;
+    set->scanner_context = NULL;
+    set->scan_period_ns = 0;
+    set->next_scan_ns = 0;
+
+    if (limits != NULL) {
+        set->limits = *limits;
+    }
+    else {
+        set->limits.holdoff_ns = GPIO_INPUT_DEFAULT_HOLDOFF_NS;
+        set->limits.storm_rate = GPIO_INPUT_DEFAULT_STORM_RATE;
+        set->limits.storm_burst = GPIO_INPUT_DEFAULT_STORM_BURST;
+        set->limits.quarantine_ns = GPIO_INPUT_DEFAULT_QUARANTINE_NS;
+    }
+
+    if (set->limits.storm_rate <= 0) {
+        set->limits.storm_rate = GPIO_INPUT_DEFAULT_STORM_RATE;
+    }
+    if (set->limits.storm_burst <= 0) {
+        set->limits.storm_burst = GPIO_INPUT_DEFAULT_STORM_BURST;
+    }
+}
+
+
+int32_t gpio_input_add(GpioInputSet *set, int32_t pin) {
+    int32_t result = 0;
+    Buffer value_file_path;
+
+    if (set->count < GPIO_INPUT_MAX_PINS) {
+        GpioInputPin *p = &set->pins[set->count];
+        int64_t now_ns = rt_now_ns();
+
+        p->pin = pin;
+        p->fd = -1;
+
+        // Use the interrupt if the pin supports it, otherwise the pin gets sampled.
+        if (set_gpio_edge(pin, (BufferPointer) GPIO_EDGE_BOTH) == 1 &&
+            snprintf((char *) value_file_path, sizeof(value_file_path), GPIO_VALUE_PATH, pin) > 0) {
+            p->fd = open((char *) value_file_path, O_RDONLY | O_CLOEXEC);
+        }
+
+        p->last_level = read_level(p);
+        if (p->last_level >= 0) {
+            p->delivered_level = p->last_level;
+            p->last_delivered_ns = now_ns - set->limits.holdoff_ns;
+            p->last_raw_ns = now_ns;
+            p->pending_merged = 0U;
+            p->credit_ns = edge_cost_ns(&set->limits) * (int64_t) set->limits.storm_burst;
+            p->quarantined = 0;
+            p->quarantine_until_ns = 0;
+            p->raw_edges = 0U;
+            p->delivered = 0U;
+            p->merged_total = 0U;
+            p->quarantines = 0U;
+            set->count++;
+            result = 1;
+        }
+        else if (p->fd >= 0) {
+            (void) close(p->fd);
+        }
+        else {
+        }
+    }
+
+    return result;
+}
+
+
+int32_t gpio_input_add_scanner(GpioInputSet *set, GpioInputScanner scanner, void *context, int64_t period_ns) {
+    int32_t result = 0;
+
+    if (set->scanner == NULL && scanner != NULL && period_ns > 0) {
+        set->scanner = scanner;
+        set->scanner_context = context;
+        set->scan_period_ns = period_ns;
+        set->next_scan_ns = rt_now_ns();
+        result = 1;
+    }
+
+    return result;
+}
+
+
+int32_t gpio_input_wait(GpioInputSet *set, GpioEvent *event, int32_t timeout_ms) {
+    int32_t result = 0;
+    int32_t failed = 0;
+    int64_t deadline_ns = (timeout_ms < 0) ? INT64_MAX : (rt_now_ns() + ((int64_t) timeout_ms * NS_PER_MS));
+    struct pollfd fds[GPIO_INPUT_MAX_PINS];
+    int32_t fd_pin[GPIO_INPUT_MAX_PINS];
+
+    while (set->ready_count == 0 && failed == 0) {
+        int64_t now_ns = rt_now_ns();
+        int32_t nfds = 0;
+        int32_t i = 0;
+
+        check_timers(set, now_ns);
+        sample_polled_pins(set, now_ns);
+        run_scanner(set, now_ns);
+
+        if (set->ready_count == 0) {
+            int64_t wakeup_ns = next_wakeup_ns(set, deadline_ns);
+            int32_t wait_ms = -1;
+
+            if (now_ns >= deadline_ns) {
+                break;
+            }
+
+            if (wakeup_ns != INT64_MAX) {
+                // Round up so we don't wake up just before the thing we are waiting for.
+                wait_ms = (int32_t) (((wakeup_ns - now_ns) + NS_PER_MS - 1) / NS_PER_MS);
+            }
+
+            for (i = 0; i < set->count; i++) {
+                if (set->pins[i].fd >= 0 && set->pins[i].quarantined == 0) {
+                    fds[nfds].fd = set->pins[i].fd;
+                    fds[nfds].events = POLLPRI | POLLERR;
+                    fds[nfds].revents = 0;
+                    fd_pin[nfds] = i;
+                    nfds++;
+                }
+            }
+
+            int32_t ready = (int32_t) poll(fds, (nfds_t) nfds, wait_ms);
+            now_ns = rt_now_ns();
+
+            if (ready < 0 && errno != EINTR) {
+                failed = 1;
+            }
+            else {
+                for (i = 0; i < nfds && ready > 0; i++) {
+                    if ((fds[i].revents & (POLLPRI | POLLERR)) != 0) {
+                        GpioInputPin *p = &set->pins[fd_pin[i]];
+                        filter_edge(set, p, read_level(p), now_ns);
+                    }
+                }
+            }
+        }
+    }
+
+    if (set->ready_count > 0) {
+        int32_t capacity = (int32_t) (sizeof(set->ready) / sizeof(set->ready[0]));
+
+        *event = set->ready[set->ready_head];
+        set->ready_head = (set->ready_head + 1) % capacity;
+        set->ready_count--;
+        result = 1;
+    }
+    else if (failed == 1) {
+        result = -1;
+    }
+    else {
+        result = 0;
+    }
+
+    return result;
+}
+
+
+void gpio_input_print_stats(const GpioInputSet *set) {
+    int32_t i = 0;
+
+    (void) printf("Input stats:\n");
+    (void) printf("  pin   mode     raw edges   delivered   merged      quarantines   state\n");
+
+    for (i = 0; i < set->count; i++) {
+        const GpioInputPin *p = &set->pins[i];
+
+        (void) printf("  %-5d %-8s %-11u %-11u %-11u %-13u %s\n", p->pin, (p->fd >= 0) ? "irq" : "sampled",
+                      p->raw_edges, p->delivered, p->merged_total, p->quarantines,
+                      (p->quarantined == 1) ? "QUARANTINED" : "ok");
+    }
+}
+
+
+void gpio_input_close(GpioInputSet *set) {
+    int32_t i = 0;
+
+    for (i = 0; i < set->count; i++) {
+        if (set->pins[i].fd >= 0) {
+            (void) set_gpio_edge(set->pins[i].pin, (BufferPointer) GPIO_EDGE_NONE);
+            (void) close(set->pins[i].fd);
+            set->pins[i].fd = -1;
+        }
+    }
+
+    set->count = 0;
+}
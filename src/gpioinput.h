@@ -0,0 +1,162 @@
+/*
+This file is for defining the event based GPIO input path with storm protection.
+Pins are watched with the sysfs edge interrupt (poll() with POLLPRI on the value file) when the pin supports it,
+otherwise they are sampled every GPIO_INPUT_POLL_NS. Every raw edge then goes through two per-pin limits before
+anything reaches the application:
+
+- Hold-off: after an event is delivered, edges for the next holdoff_ns are not delivered one by one. They are merged and,
+  if the pin ended up at a different level than the one last delivered, a single event is delivered when the
+  hold-off ends. GpioEvent.merged says how many raw edges were folded into it.
+- Storm quarantine: a token bucket allows storm_rate edges per second with bursts of storm_burst. A pin that runs the
+  bucket dry is quarantined: its interrupt is turned off (edge = none) for quarantine_ns and a GPIO_EVENT_QUARANTINE
+  event is delivered so the application can report it. When the time is up the pin is re-armed and a
+  GPIO_EVENT_RELEASED event is delivered.
+So a floating line can cost at most storm_burst wakeups before it stops waking up the reading thread at all.
+
+A set can also have a scanner (gpio_input_add_scanner): a source that is called on its own period, like a keypad matrix
+(keypad.h), and produces its own events. They come out of gpio_input_wait with the pin events, in the same queue.
+
+Sources:
+https://www.kernel.org/doc/Documentation/gpio/sysfs.txt
+"If the pin can be configured as interrupt-generating interrupt and if it has been configured to generate interrupts
+(see the description of "edge"), you can poll(2) on that file and poll(2) will return whenever the interrupt was triggered."
+*/
+
+#ifndef GPIOINPUT_H
+#define GPIOINPUT_H
+
+#include <stdint.h>
+#include "bbbio.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// Maximum number of pins in one GpioInputSet.
+#define GPIO_INPUT_MAX_PINS ((int32_t) 8)
+
+// Sampling period for pins that don't support edge interrupts.
+#define GPIO_INPUT_POLL_NS ((int64_t) 10000000)
+
+// Default limits, good for push buttons.
+#define GPIO_INPUT_DEFAULT_HOLDOFF_NS ((int64_t) 20000000)
+
+#define GPIO_INPUT_DEFAULT_STORM_RATE ((int32_t) 50)
+
+#define GPIO_INPUT_DEFAULT_STORM_BURST ((int32_t) 20)
+
+#define GPIO_INPUT_DEFAULT_QUARANTINE_NS ((int64_t) 5000000000)
+
+#define GPIO_EVENT_EDGE ((int32_t) 0)
+
+#define GPIO_EVENT_QUARANTINE ((int32_t) 1)
+
+#define GPIO_EVENT_RELEASED ((int32_t) 2)
+
+// Scanner events (keypad.h): pin is the key number, value 1 for a press and 0 for a release.
+#define GPIO_EVENT_KEY ((int32_t) 3)
+
+// Scanner events: keys are being ignored because their state can't be told apart (keypad ghosting), value is how many.
+#define GPIO_EVENT_GHOSTING ((int32_t) 4)
+
+// Most events one call of a scanner can produce.
+#define GPIO_INPUT_MAX_SCAN_EVENTS ((int32_t) 64)
+
+
+typedef struct {
+    int32_t type;       // One of the GPIO_EVENT_ values
+    int32_t pin;
+    int32_t value;      // Level after the edge (EDGE events)
+    int64_t time_ns;    // CLOCK_MONOTONIC time the edge was seen
+    uint32_t merged;    // Raw edges folded into this event on top of the one it reports
+} GpioEvent;
+
+typedef struct {
+    int64_t holdoff_ns;     // Minimum time between two delivered events on a pin
+    int32_t storm_rate;     // Sustained raw edges per second allowed before quarantine
+    int32_t storm_burst;    // Raw edges allowed in a burst
+    int64_t quarantine_ns;  // How long a storming pin is ignored
+} GpioInputLimits;
+
+typedef struct {
+    int32_t pin;
+    int32_t fd;                 // Value file kept open for poll(), -1 for sampled pins
+    int32_t last_level;         // Level after the last raw edge
+    int32_t delivered_level;    // Level of the last delivered event
+    int64_t last_delivered_ns;
+    int64_t last_raw_ns;
+    uint32_t pending_merged;    // Raw edges held back by the hold-off
+    int64_t credit_ns;          // Token bucket, in nanoseconds of edge budget
+    int32_t quarantined;
+    int64_t quarantine_until_ns;
+    uint32_t raw_edges;
+    uint32_t delivered;
+    uint32_t merged_total;
+    uint32_t quarantines;
+} GpioInputPin;
+
+// A scanner: looks at its inputs at now_ns and stores up to max events. Returns how many it stored.
+typedef int32_t (*GpioInputScanner)(void *context, int64_t now_ns, GpioEvent *events, int32_t max);
+
+typedef struct {
+    GpioInputPin pins[GPIO_INPUT_MAX_PINS];
+    int32_t count;
+    GpioInputLimits limits;
+    int64_t next_sample_ns;
+    GpioInputScanner scanner;                   // NULL when there is none
+    void *scanner_context;
+    int64_t scan_period_ns;
+    int64_t next_scan_ns;
+    GpioEvent ready[(GPIO_INPUT_MAX_PINS * 2) + GPIO_INPUT_MAX_SCAN_EVENTS];   // Events produced but not handed out yet
+    int32_t ready_head;
+    int32_t ready_count;
+} GpioInputSet;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Initializes an empty input set.
+// Parameters:
+// set    - The set to initialize
+// limits - Rate limits for every pin of the set, NULL for the GPIO_INPUT_DEFAULT_ values
+void gpio_input_init(GpioInputSet *set, const GpioInputLimits *limits);
+
+
+// Description: Adds a pin to the set. The pin must already be set up as an input (setup_gpio_pin).
+// Tries to use the edge interrupt and falls back to sampling if the pin doesn't support it.
+// Parameters:
+// set  - The input set
+// pin  - The GPIO pin number
+// Returns - 1 on success, 0 on failure (set full or the pin can't be read).
+int32_t gpio_input_add(GpioInputSet *set, int32_t pin);
+
+
+// Description: Adds the scanner of the set, called every period_ns on a fixed grid from gpio_input_wait.
+// Parameters:
+// set       - The input set
+// scanner   - The scanner
+// context   - Passed to the scanner
+// period_ns - Time between two calls
+// Returns - 1 on success, 0 if the set already has a scanner or the period isn't positive.
+int32_t gpio_input_add_scanner(GpioInputSet *set, GpioInputScanner scanner, void *context, int64_t period_ns);
+
+
+// Description: Waits for the next event on any pin of the set, or from its scanner.
+// Parameters:
+// set        - The input set
+// event      - Where the event is stored
+// timeout_ms - Maximum time to wait, -1 to wait forever
+// Returns - 1 if an event was stored, 0 on timeout, -1 on error.
+int32_t gpio_input_wait(GpioInputSet *set, GpioEvent *event, int32_t timeout_ms);
+
+
+// Description: Prints raw edges, delivered events, merged edges and quarantines for every pin to stdout.
+// Parameters: set - The input set
+void gpio_input_print_stats(const GpioInputSet *set);
+
+
+// Description: Turns the edge interrupts off and closes the files of every pin in the set.
+// Parameters: set - The input set
+void gpio_input_close(GpioInputSet *set);
+
+
+#endif // End of include guard
@@ -0,0 +1,450 @@
+/*
+This file implements all the functions defined in i2c.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN I2C.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "rtutil.h"
+#include "i2c.h"
+
+
+#define CACHE_WORDS ((int32_t) (I2C_REGISTER_COUNT / 32))
+
+typedef struct {
+    int32_t bus;
+    int32_t simulated;
+    int32_t fd;
+    int32_t users;      // Open devices on this bus, the bus is closed when it gets to 0
+} I2cBus;
+
+typedef struct {
+    int32_t in_use;
+    int32_t bus_index;
+    uint8_t addr;
+    uint8_t cache[I2C_REGISTER_COUNT];
+    uint32_t cache_valid[CACHE_WORDS];
+    uint32_t volatile_regs[CACHE_WORDS];    // Never cached (i2c_set_volatile)
+    I2cStats stats;
+} I2cDevice;
+
+typedef struct {
+    int32_t attached;
+    int32_t bus;
+    uint8_t addr;
+    uint8_t pointer;    // Register address pointer, auto incremented like on most devices
+    uint8_t regs[I2C_REGISTER_COUNT];
+} I2cSimDevice;
+
+static I2cBus buses[I2C_MAX_BUSES];
+
+static I2cDevice devices[I2C_MAX_DEVICES];
+
+static I2cSimDevice sim_devices[I2C_SIM_MAX_DEVICES];
+
+static int32_t simulator_enabled = 0;
+
+static uint64_t sim_transactions = 0U;
+
+
+static int32_t handle_valid(int32_t handle) {
+    return (int32_t) (handle >= 0 && handle < I2C_MAX_DEVICES && devices[handle].in_use == 1);
+}
+
+
+static I2cSimDevice *find_sim_device(int32_t bus, uint8_t addr) {
+    I2cSimDevice *found = NULL;
+    int32_t i = 0;
+
+    for (i = 0; i < I2C_SIM_MAX_DEVICES && found == NULL; i++) {
+        if (sim_devices[i].attached == 1 && sim_devices[i].bus == bus && sim_devices[i].addr == addr) {
+            found = &sim_devices[i];
+        }
+    }
+
+    return found;
+}
+
+
+// The simulated bus: a write message sets the register pointer with its first byte and writes the rest,
+// a read message reads from the pointer. Both auto increment. A message to an address nobody answers fails (NACK).
+static int32_t sim_transfer(int32_t bus, struct i2c_msg *msgs, int32_t count) {
+    int32_t result = 1;
+    int32_t i = 0;
+    uint16_t j = 0U;
+
+    for (i = 0; i < count && result == 1; i++) {
+        I2cSimDevice *dev = find_sim_device(bus, (uint8_t) msgs[i].addr);
+
+        if (dev == NULL) {
+            result = 0;
+        }
+        else if ((msgs[i].flags & I2C_M_RD) != 0U) {
+            for (j = 0U; j < msgs[i].len; j++) {
+                msgs[i].buf[j] = dev->regs[dev->pointer];
+                dev->pointer++;
+            }
+        }
+        else {
+            for (j = 0U; j < msgs[i].len; j++) {
+                if (j == 0U) {
+                    dev->pointer = msgs[i].buf[0];
+                }
+                else {
+                    dev->regs[dev->pointer] = msgs[i].buf[j];
+                    dev->pointer++;
+                }
+            }
+        }
+    }
+
+    sim_transactions++;
+
+    return result;
+}
+
+
+// One transaction (one ioctl) with every message joined by repeated starts.
+static int32_t transfer(I2cDevice *dev, struct i2c_msg *msgs, int32_t count) {
+    int32_t result = 0;
+    I2cBus *bus = &buses[dev->bus_index];
+    int64_t start_ns = rt_now_ns();
+    int32_t i = 0;
+
+    if (bus->simulated == 1) {
+        result = sim_transfer(bus->bus, msgs, count);
+    }
+    else {
+        struct i2c_rdwr_ioctl_data data;
+
+        data.msgs = msgs;
+        data.nmsgs = (uint32_t) count;
+        if (ioctl(bus->fd, I2C_RDWR, &data) >= 0) {
+            result = 1;
+        }
+    }
+
+    dev->stats.busy_ns += rt_now_ns() - start_ns;
+    dev->stats.transactions++;
+    for (i = 0; i < count; i++) {
+        dev->stats.bytes += msgs[i].len;
+    }
+    if (result != 1) {
+        dev->stats.failures++;
+    }
+
+    return result;
+}
+
+
+static int32_t cache_has(const I2cDevice *dev, uint8_t reg, uint8_t value) {
+    return (int32_t) (((dev->cache_valid[reg / 32U] >> (reg % 32U)) & 1U) == 1U && dev->cache[reg] == value);
+}
+
+
+static void cache_store(I2cDevice *dev, uint8_t reg, uint8_t value) {
+    dev->cache[reg] = value;
+    dev->cache_valid[reg / 32U] |= ((uint32_t) 1U << (reg % 32U)) & ~dev->volatile_regs[reg / 32U];
+}
+
+
+static int32_t open_bus(int32_t bus) {
+    int32_t index = -1;
+    int32_t free_slot = -1;
+    int32_t i = 0;
+
+    for (i = 0; i < I2C_MAX_BUSES && index < 0; i++) {
+        if (buses[i].users > 0 && buses[i].bus == bus && buses[i].simulated == simulator_enabled) {
+            index = i;
+        }
+        else if (buses[i].users == 0 && free_slot < 0) {
+            free_slot = i;
+        }
+        else {
+        }
+    }
+
+    if (index < 0 && free_slot >= 0) {
+        char path[32];
+
+        buses[free_slot].bus = bus;
+        buses[free_slot].simulated = simulator_enabled;
+        buses[free_slot].fd = -1;
+
+        if (simulator_enabled == 1) {
+            index = free_slot;
+        }
+        else if (snprintf(path, sizeof(path), I2C_DEV_PATH, bus) > 0) {
+            buses[free_slot].fd = open(path, O_RDWR | O_CLOEXEC);
+            if (buses[free_slot].fd >= 0) {
+                index = free_slot;
+            }
+        }
+        else {
+        }
+    }
+
+    if (index >= 0) {
+        buses[index].users++;
+    }
+
+    return index;
+}
+
+
+static void release_bus(int32_t index) {
+    buses[index].users--;
+    if (buses[index].users == 0 && buses[index].fd >= 0) {
+        (void) close(buses[index].fd);
+        buses[index].fd = -1;
+    }
+}
+
+
+void i2c_use_simulator(int32_t enable) {
+    simulator_enabled = (enable != 0) ? 1 : 0;
+}
+
+
+int32_t i2c_open(int32_t bus, uint8_t addr) {
+    int32_t handle = -1;
+    int32_t i = 0;
+
+    for (i = 0; i < I2C_MAX_DEVICES && handle < 0; i++) {
+        if (devices[i].in_use == 0) {
+            handle = i;
+        }
+    }
+
+    if (handle >= 0) {
+        int32_t bus_index = open_bus(bus);
+
+        if (bus_index >= 0) {
+            (void) memset(&devices[handle], 0, sizeof(devices[handle]));
+            devices[handle].in_use = 1;
+            devices[handle].bus_index = bus_index;
+            devices[handle].addr = addr;
+        }
+        else {
+            handle = -1;
+        }
+    }
+
+    return handle;
+}
+
+
+void i2c_close(int32_t handle) {
+    if (handle_valid(handle) == 1) {
+        release_bus(devices[handle].bus_index);
+        devices[handle].in_use = 0;
+    }
+}
+
+
+int32_t i2c_read_regs(int32_t handle, uint8_t reg, uint8_t *buf, int32_t len) {
+    int32_t result = 0;
+
+    if (handle_valid(handle) == 1 && buf != NULL && len > 0 && len <= I2C_MAX_BURST) {
+        I2cDevice *dev = &devices[handle];
+        uint8_t reg_byte = reg;
+        struct i2c_msg msgs[2];
+        int32_t i = 0;
+
+        // Register address write, repeated start, read. One ioctl.
+        msgs[0].addr = dev->addr;
+        msgs[0].flags = 0U;
+        msgs[0].len = 1U;
+        msgs[0].buf = &reg_byte;
+        msgs[1].addr = dev->addr;
+        msgs[1].flags = I2C_M_RD;
+        msgs[1].len = (uint16_t) len;
+        msgs[1].buf = buf;
+
+        result = transfer(dev, msgs, 2);
+
+        if (result == 1) {
+            for (i = 0; i < len; i++) {
+                cache_store(dev, (uint8_t) (reg + (uint8_t) i), buf[i]);
+            }
+        }
+    }
+
+    return result;
+}
+
+
+int32_t i2c_read_reg(int32_t handle, uint8_t reg, uint8_t *value) {
+    return i2c_read_regs(handle, reg, value, 1);
+}
+
+
+// Writes registers, skipping the transaction if force is 0 and the cache has all the values.
+static int32_t write_regs(int32_t handle, uint8_t reg, const uint8_t *buf, int32_t len, int32_t force) {
+    int32_t result = 0;
+
+    if (handle_valid(handle) == 1 && buf != NULL && len > 0 && len <= I2C_MAX_BURST) {
+        I2cDevice *dev = &devices[handle];
+        int32_t redundant = (force == 0) ? 1 : 0;
+        int32_t i = 0;
+
+        for (i = 0; i < len && redundant == 1; i++) {
+            redundant = cache_has(dev, (uint8_t) (reg + (uint8_t) i), buf[i]);
+        }
+
+        if (redundant == 1) {
+            dev->stats.skipped_writes++;
+            result = 1;
+        }
+        else {
+            uint8_t data[I2C_MAX_BURST + 1];
+            struct i2c_msg msg;
+
+            data[0] = reg;
+            (void) memcpy(&data[1], buf, (size_t) len);
+            msg.addr = dev->addr;
+            msg.flags = 0U;
+            msg.len = (uint16_t) (len + 1);
+            msg.buf = data;
+
+            result = transfer(dev, &msg, 1);
+
+            // Write-through: the cache only learns values the device accepted.
+            if (result == 1) {
+                for (i = 0; i < len; i++) {
+                    cache_store(dev, (uint8_t) (reg + (uint8_t) i), buf[i]);
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+
+int32_t i2c_write_regs(int32_t handle, uint8_t reg, const uint8_t *buf, int32_t len) {
+    return write_regs(handle, reg, buf, len, 0);
+}
+
+
+int32_t i2c_write_regs_force(int32_t handle, uint8_t reg, const uint8_t *buf, int32_t len) {
+    return write_regs(handle, reg, buf, len, 1);
+}
+
+
+int32_t i2c_write_reg(int32_t handle, uint8_t reg, uint8_t value) {
+    return i2c_write_regs(handle, reg, &value, 1);
+}
+
+
+int32_t i2c_set_volatile(int32_t handle, uint8_t reg, int32_t len) {
+    int32_t result = 0;
+
+    if (handle_valid(handle) == 1 && len > 0 && len <= (I2C_REGISTER_COUNT - (int32_t) reg)) {
+        I2cDevice *dev = &devices[handle];
+        int32_t i = 0;
+
+        for (i = (int32_t) reg; i < (int32_t) reg + len; i++) {
+            dev->volatile_regs[i / 32] |= (uint32_t) 1U << ((uint32_t) i % 32U);
+            dev->cache_valid[i / 32] &= ~((uint32_t) 1U << ((uint32_t) i % 32U));
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+
+void i2c_invalidate_cache(int32_t handle) {
+    if (handle_valid(handle) == 1) {
+        (void) memset(devices[handle].cache_valid, 0, sizeof(devices[handle].cache_valid));
+    }
+}
+
+
+void i2c_get_stats(int32_t handle, I2cStats *stats) {
+    if (handle_valid(handle) == 1) {
+        *stats = devices[handle].stats;
+    }
+    else {
+        (void) memset(stats, 0, sizeof(*stats));
+    }
+}
+
+
+void i2c_print_stats(int32_t handle) {
+    I2cStats stats;
+
+    i2c_get_stats(handle, &stats);
+
+    if (handle_valid(handle) == 1) {
+        const I2cBus *bus = &buses[devices[handle].bus_index];
+
+        (void) printf("I2C %s bus %d, device 0x%02x:\n", (bus->simulated == 1) ? "simulated" : "i2c-dev", bus->bus, devices[handle].addr);
+    }
+    (void) printf("  transactions %llu, bytes %llu, skipped writes %llu, failures %llu\n", (unsigned long long) stats.transactions,
+                  (unsigned long long) stats.bytes, (unsigned long long) stats.skipped_writes, (unsigned long long) stats.failures);
+    (void) printf("  %.2f us per transaction, %.0f transactions/s\n",
+                  (stats.transactions > 0U) ? ((double) stats.busy_ns / (1e3 * (double) stats.transactions)) : 0.0,
+                  (stats.busy_ns > 0) ? ((double) stats.transactions * 1e9 / (double) stats.busy_ns) : 0.0);
+}
+
+
+int32_t i2c_sim_attach(int32_t bus, uint8_t addr) {
+    int32_t result = 0;
+    int32_t i = 0;
+
+    if (find_sim_device(bus, addr) != NULL) {
+        result = 1;
+    }
+
+    for (i = 0; i < I2C_SIM_MAX_DEVICES && result == 0; i++) {
+        if (sim_devices[i].attached == 0) {
+            (void) memset(&sim_devices[i], 0, sizeof(sim_devices[i]));
+            sim_devices[i].attached = 1;
+            sim_devices[i].bus = bus;
+            sim_devices[i].addr = addr;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+int32_t i2c_sim_set_reg(int32_t bus, uint8_t addr, uint8_t reg, uint8_t value) {
+    int32_t result = 0;
+    I2cSimDevice *dev = find_sim_device(bus, addr);
+
+    if (dev != NULL) {
+        dev->regs[reg] = value;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+int32_t i2c_sim_get_reg(int32_t bus, uint8_t addr, uint8_t reg, uint8_t *value) {
+    int32_t result = 0;
+    I2cSimDevice *dev = find_sim_device(bus, addr);
+
+    if (dev != NULL) {
+        *value = dev->regs[reg];
+        result = 1;
+    }
+
+    return result;
+}
+
+
+uint64_t i2c_sim_transaction_count(void) {
+    return sim_transactions;
+}
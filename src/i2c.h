@@ -0,0 +1,183 @@
+/*
+This file is for defining I2C access through the Linux i2c-dev driver (/dev/i2c-X), for sensors and I/O expanders.
+- One file descriptor per bus, opened once and shared by every device on that bus. Each transaction carries its own
+  address (I2C_RDWR), so there is no I2C_SLAVE ioctl before every access.
+- A register read is one combined transaction: the register address write and the read, joined by a repeated start,
+  in a single I2C_RDWR ioctl. Blocks of registers are read in one burst (the device auto-increments the address).
+- Every device has a write-through register cache. Writing a value a register already holds (as far as we know) is
+  skipped. Registers that change on their own (status, data, clear-on-write flags) must be marked with
+  i2c_set_volatile: they are never cached, so every write to them goes to the device. i2c_write_regs_force writes
+  whatever the cache says, e.g. to re-send a trigger. Call i2c_invalidate_cache after anything that changes the device
+  behind our back (a reset).
+
+There is also a simulated bus (i2c_use_simulator) with attachable devices that are plain 256 byte register files,
+so drivers can be checked and benchmarked without hardware.
+
+Sources:
+https://www.kernel.org/doc/Documentation/i2c/dev-interface
+*/
+
+#ifndef I2C_H
+#define I2C_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define I2C_DEV_PATH "/dev/i2c-%d"
+
+// Buses that can be open at once (the BeagleBone has i2c-0 to i2c-2).
+#define I2C_MAX_BUSES ((int32_t) 4)
+
+// Devices that can be open at once.
+#define I2C_MAX_DEVICES ((int32_t) 8)
+
+// 8 bit register addresses.
+#define I2C_REGISTER_COUNT ((int32_t) 256)
+
+// Largest burst read or write.
+#define I2C_MAX_BURST ((int32_t) 32)
+
+// Simulated devices that can be attached.
+#define I2C_SIM_MAX_DEVICES ((int32_t) 8)
+
+
+typedef struct {
+    uint64_t transactions;      // ioctls (or simulated transactions)
+    uint64_t bytes;
+    uint64_t skipped_writes;    // Writes the cache proved redundant
+    uint64_t failures;
+    int64_t busy_ns;            // Time spent inside the ioctl
+} I2cStats;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Switches between the real i2c-dev driver and the simulated bus. Only affects devices opened afterwards.
+// Parameters: enable - 1 for the simulator, 0 for /dev/i2c-X
+void i2c_use_simulator(int32_t enable);
+
+
+// Description: Opens a device. The bus is opened the first time one of its devices is opened.
+// Parameters:
+// bus  - Bus number (X in /dev/i2c-X)
+// addr - 7 bit device address
+// Returns - A handle for the other functions, -1 on failure.
+int32_t i2c_open(int32_t bus, uint8_t addr);
+
+
+// Description: Closes a device. The bus is closed with its last device.
+// Parameters: handle - Handle from i2c_open
+void i2c_close(int32_t handle);
+
+
+// Description: Reads consecutive registers in one combined transaction and refreshes the cache with them (except the
+// volatile ones).
+// Parameters:
+// handle - Handle from i2c_open
+// reg    - First register
+// buf    - Where the values are stored
+// len    - Number of registers (1 to I2C_MAX_BURST)
+// Returns - 1 on success, 0 on failure.
+int32_t i2c_read_regs(int32_t handle, uint8_t reg, uint8_t *buf, int32_t len);
+
+
+// Description: Reads one register. Same as i2c_read_regs with len 1.
+// Parameters:
+// handle - Handle from i2c_open
+// reg    - The register
+// value  - Where the value is stored
+// Returns - 1 on success, 0 on failure.
+int32_t i2c_read_reg(int32_t handle, uint8_t reg, uint8_t *value);
+
+
+// Description: Writes consecutive registers in one transaction, unless the cache already has all of those values.
+// Parameters:
+// handle - Handle from i2c_open
+// reg    - First register
+// buf    - The values
+// len    - Number of registers (1 to I2C_MAX_BURST)
+// Returns - 1 on success (including a skipped write), 0 on failure.
+int32_t i2c_write_regs(int32_t handle, uint8_t reg, const uint8_t *buf, int32_t len);
+
+
+// Description: Writes one register, unless the cache already has that value.
+// Parameters:
+// handle - Handle from i2c_open
+// reg    - The register
+// value  - The value
+// Returns - 1 on success (including a skipped write), 0 on failure.
+int32_t i2c_write_reg(int32_t handle, uint8_t reg, uint8_t value);
+
+
+// Description: Writes consecutive registers in one transaction, even if the cache already has all of those values.
+// Parameters:
+// handle - Handle from i2c_open
+// reg    - First register
+// buf    - The values
+// len    - Number of registers (1 to I2C_MAX_BURST)
+// Returns - 1 on success, 0 on failure.
+int32_t i2c_write_regs_force(int32_t handle, uint8_t reg, const uint8_t *buf, int32_t len);
+
+
+// Description: Marks consecutive registers as volatile (they change on their own): they are never cached, so writes
+// to them are never skipped. Cached values they had are forgotten.
+// Parameters:
+// handle - Handle from i2c_open
+// reg    - First register
+// len    - Number of registers (1 to I2C_REGISTER_COUNT - reg)
+// Returns - 1 on success, 0 if the handle or the range is invalid.
+int32_t i2c_set_volatile(int32_t handle, uint8_t reg, int32_t len);
+
+
+// Description: Forgets every cached register of a device, so the next writes always go to the device.
+// Parameters: handle - Handle from i2c_open
+void i2c_invalidate_cache(int32_t handle);
+
+
+// Description: Copies the counters of a device.
+// Parameters:
+// handle - Handle from i2c_open
+// stats  - Where the counters are copied
+void i2c_get_stats(int32_t handle, I2cStats *stats);
+
+
+// Description: Prints the counters of a device to stdout.
+// Parameters: handle - Handle from i2c_open
+void i2c_print_stats(int32_t handle);
+
+
+// Description: Simulator only. Attaches a device (all registers zero) to a simulated bus.
+// Parameters:
+// bus  - Bus number
+// addr - 7 bit device address
+// Returns - 1 on success, 0 if there is no room for another device.
+int32_t i2c_sim_attach(int32_t bus, uint8_t addr);
+
+
+// Description: Simulator only. Sets a register of an attached device directly (like a sensor updating its data).
+// Parameters:
+// bus   - Bus number
+// addr  - Device address
+// reg   - The register
+// value - The value
+// Returns - 1 on success, 0 if no such device is attached.
+int32_t i2c_sim_set_reg(int32_t bus, uint8_t addr, uint8_t reg, uint8_t value);
+
+
+// Description: Simulator only. Gets a register of an attached device directly.
+// Parameters:
+// bus   - Bus number
+// addr  - Device address
+// reg   - The register
+// value - Where the value is stored
+// Returns - 1 on success, 0 if no such device is attached.
+int32_t i2c_sim_get_reg(int32_t bus, uint8_t addr, uint8_t reg, uint8_t *value);
+
+
+// Description: Simulator only. Number of transactions the simulated bus has seen, for checking that writes were skipped.
+uint64_t i2c_sim_transaction_count(void);
+
+
+#endif // End of include guard
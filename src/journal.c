@@ -0,0 +1,427 @@
+/*
+This file implements all the functions defined in journal.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN JOURNAL.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+
+
+#define FNV_OFFSET ((uint32_t) 2166136261U)
+
+#define FNV_PRIME ((uint32_t) 16777619U)
+
+
+static int64_t wall_now_ns(void) {
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+
+    return ((int64_t) ts.tv_sec * (int64_t) 1000000000) + (int64_t) ts.tv_nsec;
+}
+
+
+// Maps a segment file. A new segment is preallocated to its full size first so appends never extend the file, and gets
+// its header, written back right away so a crash never leaves it as a last segment without one. Returns the mapping, or
+// NULL on failure.
+static uint8_t *open_segment(const char *dir, uint32_t segment, int32_t create, uint32_t first_sequence, uint32_t session) {
+    uint8_t *result = NULL;
+    char path[192];
+    int32_t fd = -1;
+
+    if (snprintf(path, sizeof(path), JOURNAL_SEGMENT_NAME, dir, segment) > 0) {
+        fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+
+    if (fd >= 0) {
+        struct stat info;
+
+        // An existing segment must have its full size, touching a mapping past the end of the file is a SIGBUS.
+        if ((create == 0 && fstat(fd, &info) == 0 && (size_t) info.st_size >= JOURNAL_SEGMENT_SIZE) ||
+            (create == 1 && posix_fallocate(fd, 0, (off_t) JOURNAL_SEGMENT_SIZE) == 0)) {
+            void *map = mmap(NULL, JOURNAL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+            if (map != MAP_FAILED) {
+                result = (uint8_t *) map;
+            }
+        }
+
+        // The mapping keeps the file alive, the descriptor isn't needed anymore.
+        (void) close(fd);
+    }
+
+    if (result != NULL && create == 1) {
+        JournalHeader *header = (JournalHeader *) result;
+
+        header->magic = JOURNAL_MAGIC;
+        header->version = JOURNAL_VERSION;
+        header->record_size = (uint32_t) sizeof(JournalRecord);
+        header->capacity = JOURNAL_SEGMENT_RECORDS;
+        header->segment = segment;
+        header->first_sequence = first_sequence;
+        header->session = session;
+        (void) msync(result, JOURNAL_HEADER_SIZE, MS_SYNC);
+    }
+
+    return result;
+}
+
+
+// Makes a mapped segment the one appends go to.
+static void use_segment(Journal *journal, uint8_t *map, uint32_t segment) {
+    journal->map = map;
+    journal->records = (JournalRecord *) (map + JOURNAL_HEADER_SIZE);
+    journal->segment = segment;
+}
+
+
+static int32_t map_segment(Journal *journal, uint32_t segment, int32_t create) {
+    int32_t result = 0;
+    uint8_t *map = open_segment(journal->dir, segment, create, journal->next_sequence, journal->session);
+
+    if (map != NULL) {
+        use_segment(journal, map, segment);
+        if (create == 1) {
+            journal->next_slot = 0U;
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+
+static void unmap_segment(Journal *journal) {
+    if (journal->map != NULL) {
+        (void) munmap(journal->map, JOURNAL_SEGMENT_SIZE);
+        journal->map = NULL;
+        journal->records = NULL;
+    }
+}
+
+
+// Writes back and unmaps a full segment, and deletes the one that falls out of the kept range with it.
+static void release_segment(const char *dir, uint8_t *map, uint32_t segment) {
+    char path[192];
+
+    (void) msync(map, JOURNAL_SEGMENT_SIZE, MS_ASYNC);
+    (void) munmap(map, JOURNAL_SEGMENT_SIZE);
+
+    if (segment + 1U >= JOURNAL_MAX_SEGMENTS && snprintf(path, sizeof(path), JOURNAL_SEGMENT_NAME, dir, (segment + 1U) - JOURNAL_MAX_SEGMENTS) > 0) {
+        (void) unlink(path);
+    }
+}
+
+
+// Switches to the next segment. With the spare journal_sync mapped ahead this is a few assignments, the full segment
+// is left for journal_sync to release. Without one the next segment is mapped here, system calls and all.
+static int32_t rotate(Journal *journal) {
+    int32_t result = 0;
+    uint32_t next = journal->segment + 1U;
+    uint8_t *map = journal->spare;
+
+    if (map == NULL) {
+        map = open_segment(journal->dir, next, 1, journal->next_sequence, journal->session);
+        journal->late_rotations++;
+    }
+
+    // The full segment stays mapped (and appends fail) if the next one can't be created.
+    if (map != NULL) {
+        if (journal->retired != NULL) {
+            release_segment(journal->dir, journal->retired, journal->retired_segment);
+        }
+        journal->retired = journal->map;
+        journal->retired_segment = journal->segment;
+        journal->spare = NULL;
+        use_segment(journal, map, next);
+        journal->next_slot = 0U;
+        journal->rotations++;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+// Finds the highest segment number in the directory. Returns 0 if there is none.
+static int32_t find_last_segment(const char *dir, uint32_t *segment) {
+    int32_t found = 0;
+    DIR *d = opendir(dir);
+    struct dirent *entry = NULL;
+    uint32_t number = 0U;
+
+    if (d != NULL) {
+        entry = readdir(d);
+        while (entry != NULL) {
+            if (sscanf(entry->d_name, "journal-%u.bin", &number) == 1 && (found == 0 || number > *segment)) {
+                *segment = number;
+                found = 1;
+            }
+            entry = readdir(d);
+        }
+        (void) closedir(d);
+    }
+
+    return found;
+}
+
+
+// Checks whether a segment header was never written (all zeros).
+static int32_t header_is_blank(const uint8_t *map) {
+    int32_t blank = 1;
+    size_t i = 0U;
+
+    for (i = 0U; i < sizeof(JournalHeader); i++) {
+        if (map[i] != 0U) {
+            blank = 0;
+        }
+    }
+
+    return blank;
+}
+
+
+// Maps the last segment and finds where appending resumes and which session comes next. A last segment with a blank
+// header is a spare whose header never reached the disk: appending resumes in the segment before it, which recreates
+// the spare when it fills up, or starts over in segment 0 if there is no segment before it.
+static int32_t resume(Journal *journal, uint32_t segment) {
+    int32_t result = 0;
+    int32_t searching = 1;
+    uint32_t current = segment;
+
+    while (searching == 1) {
+        searching = 0;
+
+        if (map_segment(journal, current, 0) == 1) {
+            const JournalHeader *header = (const JournalHeader *) journal->map;
+
+            if (header->magic == JOURNAL_MAGIC && header->record_size == (uint32_t) sizeof(JournalRecord) &&
+                header->capacity == JOURNAL_SEGMENT_RECORDS) {
+                uint32_t slot = 0U;
+                uint32_t session = header->session;
+
+                while (slot < JOURNAL_SEGMENT_RECORDS && journal->records[slot].check == journal_record_check(&journal->records[slot])) {
+                    if (journal->records[slot].session > session) {
+                        session = journal->records[slot].session;
+                    }
+                    slot++;
+                }
+
+                journal->next_slot = slot;
+                journal->next_sequence = header->first_sequence + slot;
+                journal->session = session + 1U;
+                result = 1;
+            }
+            else if (header_is_blank(journal->map) == 1 && current == segment) {
+                unmap_segment(journal);
+                if (current > 0U) {
+                    current--;
+                    searching = 1;
+                }
+                else {
+                    journal->session = 1U;
+                    result = map_segment(journal, 0U, 1);
+                }
+            }
+            else {
+                unmap_segment(journal);
+            }
+        }
+    }
+
+    return result;
+}
+
+
+uint32_t journal_record_check(const JournalRecord *record) {
+    const uint8_t *bytes = (const uint8_t *) record;
+    uint32_t hash = FNV_OFFSET;
+    size_t i = 0U;
+
+    for (i = 0U; i < offsetof(JournalRecord, check); i++) {
+        hash = (hash ^ (uint32_t) bytes[i]) * FNV_PRIME;
+    }
+
+    return (hash == 0U) ? 1U : hash;
+}
+
+
+int32_t journal_open(Journal *journal, const char *dir) {
+    int32_t result = 0;
+    uint32_t segment = 0U;
+
+    (void) memset(journal, 0, sizeof(*journal));
+    (void) snprintf(journal->dir, sizeof(journal->dir), "%s", dir);
+    (void) pthread_mutex_init(&journal->lock, NULL);
+
+    if (mkdir(dir, 0755) == 0 || errno == EEXIST) {
+        if (find_last_segment(dir, &segment) == 1) {
+            result = resume(journal, segment);
+        }
+        else {
+            journal->session = 1U;
+            result = map_segment(journal, 0U, 1);
+        }
+    }
+
+    if (result == 1) {
+        result = journal_append(journal, JOURNAL_EVENT_SESSION, 0, 0);
+        journal_sync(journal);
+    }
+
+    return result;
+}
+
+
+int32_t journal_append(Journal *journal, uint16_t type, int64_t elapsed_ns, int32_t pin) {
+    int32_t result = 0;
+
+    (void) pthread_mutex_lock(&journal->lock);
+
+    if (journal->map != NULL && (journal->next_slot < JOURNAL_SEGMENT_RECORDS || rotate(journal) == 1)) {
+        JournalRecord *record = &journal->records[journal->next_slot];
+        JournalRecord staged;
+
+        // Build the record on the stack, copy it in, and only then publish the check word.
+        (void) memset(&staged, 0, sizeof(staged));
+        staged.wall_ns = wall_now_ns();
+        staged.elapsed_ns = elapsed_ns;
+        staged.session = journal->session;
+        staged.sequence = journal->next_sequence;
+        staged.type = type;
+        staged.pin = (uint16_t) pin;
+        staged.check = 0U;
+
+        (void) memcpy(record, &staged, offsetof(JournalRecord, check));
+        __atomic_store_n(&record->check, journal_record_check(&staged), __ATOMIC_RELEASE);
+
+        journal->next_slot++;
+        journal->next_sequence++;
+        journal->appended++;
+        result = 1;
+    }
+
+    (void) pthread_mutex_unlock(&journal->lock);
+
+    return result;
+}
+
+
+void journal_sync(Journal *journal) {
+    uint8_t *retired = NULL;
+    uint32_t retired_segment = 0U;
+    uint8_t *spare = NULL;
+    uint32_t next = 0U;
+    uint32_t first_sequence = 0U;
+    uint32_t session = 0U;
+    int32_t need_spare = 0;
+
+    (void) pthread_mutex_lock(&journal->lock);
+    if (journal->map != NULL) {
+        (void) msync(journal->map, JOURNAL_SEGMENT_SIZE, MS_ASYNC);
+
+        retired = journal->retired;
+        retired_segment = journal->retired_segment;
+        journal->retired = NULL;
+
+        if (journal->spare == NULL) {
+            // The current segment is full when the spare is used, so its first sequence follows on from there.
+            need_spare = 1;
+            next = journal->segment + 1U;
+            first_sequence = ((const JournalHeader *) journal->map)->first_sequence + JOURNAL_SEGMENT_RECORDS;
+            session = journal->session;
+        }
+    }
+    (void) pthread_mutex_unlock(&journal->lock);
+
+    // The slow part runs without the lock so appends from other threads aren't held up by it.
+    if (retired != NULL) {
+        release_segment(journal->dir, retired, retired_segment);
+    }
+
+    if (need_spare == 1) {
+        spare = open_segment(journal->dir, next, 1, first_sequence, session);
+    }
+
+    if (spare != NULL) {
+        (void) pthread_mutex_lock(&journal->lock);
+        if (journal->map != NULL && journal->spare == NULL && journal->segment + 1U == next) {
+            journal->spare = spare;
+            spare = NULL;
+        }
+        (void) pthread_mutex_unlock(&journal->lock);
+
+        // A rotation got to this segment first (or another journal_sync did).
+        if (spare != NULL) {
+            (void) munmap(spare, JOURNAL_SEGMENT_SIZE);
+        }
+    }
+}
+
+
+void journal_close(Journal *journal) {
+    char path[192];
+
+    (void) pthread_mutex_lock(&journal->lock);
+    if (journal->map != NULL) {
+        if (journal->retired != NULL) {
+            release_segment(journal->dir, journal->retired, journal->retired_segment);
+            journal->retired = NULL;
+        }
+
+        // Nothing was written to the spare yet, don't leave it behind as an empty last segment.
+        if (journal->spare != NULL) {
+            (void) munmap(journal->spare, JOURNAL_SEGMENT_SIZE);
+            journal->spare = NULL;
+            if (snprintf(path, sizeof(path), JOURNAL_SEGMENT_NAME, journal->dir, journal->segment + 1U) > 0) {
+                (void) unlink(path);
+            }
+        }
+
+        (void) msync(journal->map, JOURNAL_SEGMENT_SIZE, MS_SYNC);
+        unmap_segment(journal);
+    }
+    (void) pthread_mutex_unlock(&journal->lock);
+}
+
+
+const char *journal_event_name(uint16_t type) {
+    const char *name = "unknown";
+
+    switch (type) {
+        case JOURNAL_EVENT_SESSION:
+            name = "session";
+            break;
+        case JOURNAL_EVENT_START:
+            name = "start";
+            break;
+        case JOURNAL_EVENT_STOP:
+            name = "stop";
+            break;
+        case JOURNAL_EVENT_RESET:
+            name = "reset";
+            break;
+        case JOURNAL_EVENT_LAP:
+            name = "lap";
+            break;
+        case JOURNAL_EVENT_END:
+            name = "end";
+            break;
+        default:
+            name = "unknown";
+            break;
+    }
+
+    return name;
+}
@@ -0,0 +1,143 @@
+/*
+This file is for defining the session journal: an append-only history of stopwatch events (session start, start, stop,
+reset, laps) kept for audits.
+
+Layout:
+- The journal is a directory of segment files journal-NNNNNN.bin. Each segment is preallocated to its full size and
+  mapped with mmap, so appending a record is a copy into memory: no write() or other system call on the hot path.
+  Timestamps come from clock_gettime, which goes through the vDSO and doesn't enter the kernel either.
+- A segment holds a header followed by JOURNAL_SEGMENT_RECORDS fixed size records. The next segment is created,
+  preallocated and mapped ahead of time by journal_sync (and journal_open), so the append that fills a segment only
+  switches two pointers. The full segment is written back and unmapped, and segments older than JOURNAL_MAX_SEGMENTS
+  are deleted, by the next journal_sync. Call it regularly from a thread that isn't time critical: if it hasn't run
+  since the last switch, the switch maps the next segment itself, with the system calls (counted in late_rotations).
+  A crash can leave the spare as the last segment. Its header is written back when it is created, so appending then
+  resumes in it and the sequence numbers skip the unused slots of the previous segment. A last segment whose header
+  never made it to the disk is taken for an unused spare, and appending resumes in the segment before it.
+- Every record ends with a check word that is written last. A record with a wrong check word (the power went out in the
+  middle of writing it) and everything after it is treated as never written, and the first such slot is where
+  appending resumes after a restart.
+The kernel writes the dirty pages back on its own. journal_sync asks for it explicitly, and journal_close waits for it.
+
+The journalq tool (journal_query.c) reads the segments back and summarizes sessions by time range.
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define JOURNAL_DEFAULT_DIR "stopwatch-journal"
+
+#define JOURNAL_SEGMENT_NAME "%s/journal-%06u.bin"
+
+#define JOURNAL_MAGIC ((uint64_t) 0x314C4E524A424242U)    // "BBBJRNL1"
+
+#define JOURNAL_VERSION ((uint32_t) 1)
+
+// 32 KB of records per segment (plus the header page).
+#define JOURNAL_SEGMENT_RECORDS ((uint32_t) 1024)
+
+// Segments kept on disk, older ones are deleted when a new one is started.
+#define JOURNAL_MAX_SEGMENTS ((uint32_t) 64)
+
+// The header takes a whole page so the records start page aligned.
+#define JOURNAL_HEADER_SIZE ((uint32_t) 4096)
+
+#define JOURNAL_SEGMENT_SIZE ((size_t) JOURNAL_HEADER_SIZE + ((size_t) JOURNAL_SEGMENT_RECORDS * sizeof(JournalRecord)))
+
+// Event types.
+#define JOURNAL_EVENT_SESSION ((uint16_t) 1)    // Program started, a new session begins
+#define JOURNAL_EVENT_START ((uint16_t) 2)
+#define JOURNAL_EVENT_STOP ((uint16_t) 3)
+#define JOURNAL_EVENT_RESET ((uint16_t) 4)
+#define JOURNAL_EVENT_LAP ((uint16_t) 5)        // Split / lap time
+#define JOURNAL_EVENT_END ((uint16_t) 6)        // Program terminated
+
+
+typedef struct {
+    int64_t wall_ns;        // CLOCK_REALTIME, for finding sessions by date
+    int64_t elapsed_ns;     // Stopwatch reading at the event
+    uint32_t session;
+    uint32_t sequence;      // Position in the whole journal, increases by one per record
+    uint16_t type;          // JOURNAL_EVENT_
+    uint16_t pin;           // GPIO that caused the event, 0 if none
+    uint32_t check;         // Written last, see journal_record_check
+} JournalRecord;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;      // Records in this segment
+    uint32_t segment;       // Segment number (NNNNNN in the file name)
+    uint32_t first_sequence;
+    uint32_t session;       // Session in progress when the segment was started
+} JournalHeader;
+
+typedef struct {
+    char dir[128];
+    uint8_t *map;               // Mapping of the current segment, NULL when the journal is not open
+    JournalRecord *records;
+    uint32_t segment;
+    uint32_t next_slot;         // Next free record in the current segment
+    uint32_t next_sequence;
+    uint32_t session;
+    uint8_t *spare;             // Next segment, mapped ahead by journal_sync. NULL if not ready.
+    uint8_t *retired;           // Full segment waiting for journal_sync to release it, NULL if none
+    uint32_t retired_segment;
+    uint64_t appended;
+    uint64_t rotations;
+    uint64_t late_rotations;    // Rotations that found no spare and mapped the next segment themselves
+    pthread_mutex_t lock;       // Appends can come from several threads. Uncontended, it stays in user space.
+} Journal;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Opens (creating it if needed) the journal in a directory, resumes after the last complete record and
+// appends a JOURNAL_EVENT_SESSION record for a new session.
+// Parameters:
+// journal - The journal
+// dir     - Directory of the segment files
+// Returns - 1 on success, 0 on failure (the journal then ignores appends).
+int32_t journal_open(Journal *journal, const char *dir);
+
+
+// Description: Appends one record.
+// Parameters:
+// journal    - The journal
+// type       - One of the JOURNAL_EVENT_ types
+// elapsed_ns - Stopwatch reading at the event
+// pin        - GPIO that caused the event, 0 if none
+// Returns - 1 on success, 0 if the journal is not open or the segment is full and the next one could not be created.
+int32_t journal_append(Journal *journal, uint16_t type, int64_t elapsed_ns, int32_t pin);
+
+
+// Description: Asks the kernel to start writing the journal to disk, without waiting for it. Also releases the last
+// full segment and maps the next one ahead of time (without holding up appends). Not for the hot path.
+// Parameters: journal - The journal
+void journal_sync(Journal *journal);
+
+
+// Description: Writes the journal to disk, waits for it and closes it.
+// Parameters: journal - The journal
+void journal_close(Journal *journal);
+
+
+// Description: Computes the check word of a record (everything before the check field). Never 0, so a slot that was
+// never written (all zeros) never looks complete.
+// Parameters: record - The record
+uint32_t journal_record_check(const JournalRecord *record);
+
+
+// Description: Returns a printable name of an event type, e.g. "start".
+// Parameters: type - One of the JOURNAL_EVENT_ types
+const char *journal_event_name(uint16_t type);
+
+
+#endif // End of include guard
@@ -0,0 +1,243 @@
+/*
+This file is the journalq tool: it reads the session journal written by the stopwatch (see journal.h) and prints one
+summary line per session, optionally only the sessions that overlap a time range.
+Segments are mapped read-only and scanned in order, so it can run while the stopwatch is still appending.
+
+Usage: ./journalq [journal dir] [from] [to]
+from / to are local times "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM:SS", or seconds since the epoch. Use - to leave one open.
+A date alone as "to" includes that whole day.
+*/
+
+// strptime is an XSI extension.
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rtutil.h"
+#include "journal.h"
+
+#define MAX_SEGMENTS ((int32_t) (JOURNAL_MAX_SEGMENTS * 2U))
+
+typedef struct {
+    uint32_t session;
+    int64_t first_wall_ns;
+    int64_t last_wall_ns;
+    int64_t last_elapsed_ns;
+    uint32_t records;
+    uint32_t starts;
+    uint32_t stops;
+    uint32_t resets;
+    uint32_t laps;
+    int32_t ended;
+} SessionSummary;
+
+typedef struct {
+    int64_t from_ns;
+    int64_t to_ns;
+    uint32_t shown;
+    uint64_t records;
+    uint64_t torn;
+} Query;
+
+
+// Parses a date, a date and time, or epoch seconds. "-" gives fallback. A date alone is the start of that day, or its
+// last nanosecond with end_of_day set (for the end of a range, which includes that day).
+static int64_t parse_time(const char *text, int64_t fallback, int32_t end_of_day) {
+    int64_t result = fallback;
+    struct tm tm;
+    char *end = NULL;
+
+    if (strcmp(text, "-") != 0) {
+        (void) memset(&tm, 0, sizeof(tm));
+        tm.tm_isdst = -1;
+
+        if (strptime(text, "%Y-%m-%dT%H:%M:%S", &tm) != NULL) {
+            result = (int64_t) mktime(&tm) * NS_PER_SEC;
+        }
+        else if (strptime(text, "%Y-%m-%d", &tm) != NULL) {
+            // mktime carries the day over into the next month or year.
+            if (end_of_day == 1) {
+                tm.tm_mday++;
+            }
+            result = ((int64_t) mktime(&tm) * NS_PER_SEC) - ((end_of_day == 1) ? 1 : 0);
+        }
+        else {
+            long long seconds = strtoll(text, &end, 10);
+
+            if (end != text && *end == '\0') {
+                result = (int64_t) seconds * NS_PER_SEC;
+            }
+        }
+    }
+
+    return result;
+}
+
+
+static void format_wall(int64_t wall_ns, char *out, size_t size) {
+    time_t seconds = (time_t) (wall_ns / NS_PER_SEC);
+    struct tm tm;
+
+    (void) localtime_r(&seconds, &tm);
+    (void) strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+
+static void print_session(Query *query, const SessionSummary *s) {
+    char begin[32];
+
+    if (s->records > 0U && s->last_wall_ns >= query->from_ns && s->first_wall_ns <= query->to_ns) {
+        format_wall(s->first_wall_ns, begin, sizeof(begin));
+        (void) printf("%8u  %s  %7.1f s  %6u  %6u  %6u  %6u  %10.2f s%s\n", s->session, begin,
+                      (double) (s->last_wall_ns - s->first_wall_ns) / (double) NS_PER_SEC, s->starts, s->stops, s->resets, s->laps,
+                      (double) s->last_elapsed_ns / (double) NS_PER_SEC, (s->ended == 1) ? "" : "  (no end record)");
+        query->shown++;
+    }
+}
+
+
+static void add_record(Query *query, SessionSummary *s, const JournalRecord *r) {
+    if (r->session != s->session) {
+        print_session(query, s);
+        (void) memset(s, 0, sizeof(*s));
+        s->session = r->session;
+        s->first_wall_ns = r->wall_ns;
+    }
+
+    s->records++;
+    s->last_wall_ns = r->wall_ns;
+
+    switch (r->type) {
+        case JOURNAL_EVENT_START:
+            s->starts++;
+            break;
+        case JOURNAL_EVENT_STOP:
+            s->stops++;
+            s->last_elapsed_ns = r->elapsed_ns;
+            break;
+        case JOURNAL_EVENT_RESET:
+            s->resets++;
+            break;
+        case JOURNAL_EVENT_LAP:
+            s->laps++;
+            s->last_elapsed_ns = r->elapsed_ns;
+            break;
+        case JOURNAL_EVENT_END:
+            s->ended = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+
+// Scans one segment until its first incomplete record.
+static void scan_segment(Query *query, SessionSummary *s, const char *dir, uint32_t segment) {
+    char path[192];
+    int32_t fd = -1;
+    struct stat info;
+
+    if (snprintf(path, sizeof(path), JOURNAL_SEGMENT_NAME, dir, segment) > 0) {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    if (fd >= 0 && fstat(fd, &info) == 0 && (size_t) info.st_size >= JOURNAL_SEGMENT_SIZE) {
+        void *map = mmap(NULL, JOURNAL_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (map != MAP_FAILED) {
+            const JournalHeader *header = (const JournalHeader *) map;
+            const JournalRecord *records = (const JournalRecord *) ((const uint8_t *) map + JOURNAL_HEADER_SIZE);
+            uint32_t i = 0U;
+
+            if (header->magic == JOURNAL_MAGIC && header->record_size == (uint32_t) sizeof(JournalRecord)) {
+                // Sequential read of the whole segment, let the kernel read ahead.
+                (void) posix_madvise(map, JOURNAL_SEGMENT_SIZE, POSIX_MADV_SEQUENTIAL);
+
+                while (i < header->capacity && records[i].check == journal_record_check(&records[i])) {
+                    add_record(query, s, &records[i]);
+                    i++;
+                }
+                query->records += i;
+
+                // A written record after the first bad one means a torn write, not just the end of the journal.
+                if (i < header->capacity && records[i].check != 0U) {
+                    query->torn++;
+                }
+            }
+            (void) munmap(map, JOURNAL_SEGMENT_SIZE);
+        }
+    }
+
+    if (fd >= 0) {
+        (void) close(fd);
+    }
+}
+
+
+static int32_t compare_segments(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+int32_t main(int32_t argc, char **argv) {
+    const char *dir = (argc > 1) ? argv[1] : JOURNAL_DEFAULT_DIR;
+    uint32_t segments[MAX_SEGMENTS];
+    int32_t segment_count = 0;
+    SessionSummary summary;
+    Query query;
+    DIR *d = NULL;
+    struct dirent *entry = NULL;
+    uint32_t number = 0U;
+    int32_t i = 0;
+    int64_t start_ns = 0;
+
+    (void) memset(&query, 0, sizeof(query));
+    (void) memset(&summary, 0, sizeof(summary));
+    query.from_ns = (argc > 2) ? parse_time(argv[2], INT64_MIN, 0) : INT64_MIN;
+    query.to_ns = (argc > 3) ? parse_time(argv[3], INT64_MAX, 1) : INT64_MAX;
+
+    d = opendir(dir);
+    if (d == NULL) {
+        (void) printf("Could not open journal directory %s\n", dir);
+        return 1;
+    }
+    entry = readdir(d);
+    while (entry != NULL && segment_count < MAX_SEGMENTS) {
+        if (sscanf(entry->d_name, "journal-%u.bin", &number) == 1) {
+            segments[segment_count] = number;
+            segment_count++;
+        }
+        entry = readdir(d);
+    }
+    (void) closedir(d);
+    qsort(segments, (size_t) segment_count, sizeof(segments[0]), &compare_segments);
+
+    (void) printf(" Session  Began                Length  Starts   Stops  Resets    Laps  Last time\n");
+
+    start_ns = rt_now_ns();
+    for (i = 0; i < segment_count; i++) {
+        scan_segment(&query, &summary, dir, segments[i]);
+    }
+    print_session(&query, &summary);
+    start_ns = rt_now_ns() - start_ns;
+
+    (void) printf("%u sessions shown, %llu records in %d segments scanned in %.2f ms (%.1f M records/s)",
+                  query.shown, (unsigned long long) query.records, segment_count, (double) start_ns / 1e6,
+                  (start_ns > 0) ? ((double) query.records * 1e3 / (double) start_ns) : 0.0);
+    if (query.torn > 0U) {
+        (void) printf(", %llu torn records", (unsigned long long) query.torn);
+    }
+    (void) printf("\n");
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+This file implements all the functions defined in keypad.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN KEYPAD.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include "rtutil.h"
+#include "gpiobank.h"
+#include "keypad.h"
+
+
+void keypad_default_config(KeypadConfig *config) {
+    (void) memset(config, 0, sizeof(*config));
+    config->scan_period_ns = KEYPAD_DEFAULT_SCAN_NS;
+    config->debounce_ns = KEYPAD_DEFAULT_DEBOUNCE_NS;
+    config->settle_ns = KEYPAD_DEFAULT_SETTLE_NS;
+}
+
+
+int32_t keypad_init(Keypad *keypad, const KeypadConfig *config) {
+    int32_t result = 0;
+    int32_t i = 0;
+
+    (void) memset(keypad, 0, sizeof(*keypad));
+    keypad->config = *config;
+
+    if (config->row_count > 0 && config->row_count <= KEYPAD_MAX_ROWS && config->column_count > 0 &&
+        config->column_count <= KEYPAD_MAX_COLUMNS && config->scan_period_ns > 0) {
+        result = 1;
+        keypad->row_bank = GPIO_BANK_OF(config->row_pins[0]);
+        keypad->column_bank = GPIO_BANK_OF(config->column_pins[0]);
+
+        for (i = 0; i < config->row_count; i++) {
+            if (config->row_pins[i] < 0 || GPIO_BANK_OF(config->row_pins[i]) != keypad->row_bank) {
+                result = 0;
+            }
+            keypad->row_bits[i] = GPIO_BIT_OF(config->row_pins[i]);
+            keypad->row_mask |= keypad->row_bits[i];
+        }
+        for (i = 0; i < config->column_count; i++) {
+            if (config->column_pins[i] < 0 || GPIO_BANK_OF(config->column_pins[i]) != keypad->column_bank) {
+                result = 0;
+            }
+            keypad->column_bits[i] = GPIO_BIT_OF(config->column_pins[i]);
+            keypad->column_mask |= keypad->column_bits[i];
+        }
+        if (keypad->row_bank >= GPIO_BANK_COUNT || keypad->column_bank >= GPIO_BANK_COUNT) {
+            result = 0;
+        }
+    }
+
+    if (result == 1) {
+        (void) gpio_bank_write(keypad->row_bank, keypad->row_mask, 0U);
+    }
+
+    return result;
+}
+
+
+// Reads the whole matrix, bit (row * column count + column) per key. Returns 1 on success.
+static int32_t read_matrix(Keypad *keypad, uint64_t *matrix) {
+    int32_t ok = 1;
+    int32_t row = 0;
+    int32_t column = 0;
+
+    *matrix = 0U;
+    for (row = 0; row < keypad->config.row_count && ok == 1; row++) {
+        uint32_t value = 0U;
+
+        ok = gpio_bank_write(keypad->row_bank, keypad->row_mask, keypad->row_bits[row]);
+        if (keypad->config.settle_ns > 0) {
+            int64_t settled_ns = rt_now_ns() + keypad->config.settle_ns;
+
+            while (rt_now_ns() < settled_ns) {
+            }
+        }
+        if (ok == 1) {
+            ok = gpio_bank_read(keypad->column_bank, keypad->column_mask, &value);
+        }
+        for (column = 0; column < keypad->config.column_count; column++) {
+            if ((value & keypad->column_bits[column]) != 0U) {
+                *matrix |= (uint64_t) 1U << ((row * keypad->config.column_count) + column);
+            }
+        }
+    }
+    (void) gpio_bank_write(keypad->row_bank, keypad->row_mask, 0U);
+
+    return ok;
+}
+
+
+// Keys that can't be told apart from a ghost: the corners of every rectangle of pressed keys.
+static uint64_t ghost_keys(const Keypad *keypad, uint64_t matrix) {
+    int32_t columns = keypad->config.column_count;
+    uint64_t row_keys = ((uint64_t) 1U << columns) - 1U;
+    uint64_t ghosts = 0U;
+    int32_t a = 0;
+    int32_t b = 0;
+
+    for (a = 0; a < keypad->config.row_count; a++) {
+        uint64_t row_a = (matrix >> (a * columns)) & row_keys;
+
+        for (b = a + 1; b < keypad->config.row_count && row_a != 0U; b++) {
+            uint64_t shared = row_a & (matrix >> (b * columns));
+
+            if (__builtin_popcountll(shared) >= 2) {
+                ghosts |= (shared << (a * columns)) | (shared << (b * columns));
+            }
+        }
+    }
+
+    return ghosts;
+}
+
+
+int32_t keypad_scan(Keypad *keypad, int64_t now_ns, GpioEvent *events, int32_t max) {
+    int32_t count = 0;
+    int64_t start_ns = rt_now_ns();
+    uint64_t matrix = 0U;
+
+    if (read_matrix(keypad, &matrix) == 1) {
+        int64_t scan_ns = rt_now_ns() - start_ns;
+        uint64_t ghosts = ghost_keys(keypad, matrix);
+        uint64_t changed = (matrix ^ keypad->stable) & ~ghosts;
+        uint64_t settled = keypad->pending & ~changed;    // Back to their stable state before debounce_ns
+        uint64_t todo = 0U;
+
+        keypad->stats.scans++;
+        keypad->stats.sum_scan_ns += scan_ns;
+        if (scan_ns > keypad->stats.max_scan_ns) {
+            keypad->stats.max_scan_ns = scan_ns;
+        }
+
+        if (ghosts != keypad->ghosts && count < max) {
+            events[count].type = GPIO_EVENT_GHOSTING;
+            events[count].pin = -1;
+            events[count].value = __builtin_popcountll(ghosts);
+            events[count].time_ns = now_ns;
+            events[count].merged = 0U;
+            count++;
+            keypad->ghosts = ghosts;
+        }
+        if (ghosts != 0U) {
+            keypad->stats.ghost_scans++;
+        }
+
+        // Bounces on keys that aren't ghosts, the ghost keys just stay as they are.
+        todo = settled & ~ghosts;
+        while (todo != 0U) {
+            int32_t key = __builtin_ctzll(todo);
+
+            keypad->bounces[key]++;
+            keypad->stats.bounces++;
+            todo &= todo - 1U;
+        }
+        keypad->pending &= ~settled;
+
+        todo = changed;
+        while (todo != 0U) {
+            int32_t key = __builtin_ctzll(todo);
+            uint64_t bit = (uint64_t) 1U << key;
+
+            if ((keypad->pending & bit) == 0U) {
+                keypad->pending |= bit;
+                keypad->since_ns[key] = now_ns;
+            }
+            else if (now_ns - keypad->since_ns[key] >= keypad->config.debounce_ns && count < max) {
+                int32_t pressed = (int32_t) ((matrix & bit) != 0U);
+
+                events[count].type = GPIO_EVENT_KEY;
+                events[count].pin = key;
+                events[count].value = pressed;
+                events[count].time_ns = keypad->since_ns[key];
+                events[count].merged = keypad->bounces[key];
+                count++;
+
+                keypad->stable ^= bit;
+                keypad->pending &= ~bit;
+                keypad->bounces[key] = 0U;
+                if (pressed == 1) {
+                    keypad->stats.presses++;
+                }
+                else {
+                    keypad->stats.releases++;
+                }
+            }
+            else {
+            }
+            todo &= todo - 1U;
+        }
+    }
+    else {
+        keypad->stats.failed_scans++;
+    }
+
+    return count;
+}
+
+
+static int32_t scanner(void *context, int64_t now_ns, GpioEvent *events, int32_t max) {
+    return keypad_scan((Keypad *) context, now_ns, events, max);
+}
+
+
+int32_t keypad_attach(Keypad *keypad, GpioInputSet *set) {
+    return gpio_input_add_scanner(set, &scanner, keypad, keypad->config.scan_period_ns);
+}
+
+
+void keypad_print_stats(const Keypad *keypad) {
+    const KeypadStats *s = &keypad->stats;
+
+    (void) printf("Keypad %dx%d on %s: %llu scans every %.1f ms, scan avg %.2f us, max %.2f us, %llu failed\n",
+                  keypad->config.row_count, keypad->config.column_count, gpio_bank_backend_name(gpio_bank_backend()),
+                  (unsigned long long) s->scans, (double) keypad->config.scan_period_ns / 1e6,
+                  (s->scans > 0U) ? ((double) s->sum_scan_ns / (1e3 * (double) s->scans)) : 0.0, (double) s->max_scan_ns / 1e3,
+                  (unsigned long long) s->failed_scans);
+    (void) printf("  %llu presses, %llu releases, %llu bounces filtered, %llu scans with ghosting\n",
+                  (unsigned long long) s->presses, (unsigned long long) s->releases, (unsigned long long) s->bounces,
+                  (unsigned long long) s->ghost_scans);
+}
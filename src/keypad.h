@@ -0,0 +1,128 @@
+/*
+This file is for defining a matrix keypad scanner, so many lanes can have their own keys without a header pin per key:
+an R x C matrix needs R + C pins for R * C keys (16 keys on 8 pins).
+
+Wiring: every key connects a row to a column. Rows are outputs, columns inputs with pull-downs. A scan drives one row
+high at a time and reads which columns follow it.
+- Each row step is one mask write on the row bank (the active row high and the other rows low in the same operation)
+  and one read of the column bank, so all the rows must be in one bank and all the columns in one bank.
+- The idle rows are driven low, not released (gpiobank has no direction control), so put a series resistor on every
+  row: two keys pressed in one column would otherwise short an active row to an idle one.
+- Without a diode per key, three pressed keys on the corners of a rectangle make the fourth corner read pressed too
+  (ghosting). The scanner can't tell which of the four is real, so while two rows share two or more pressed columns
+  the keys on those rows and columns keep their last state, and a GPIO_EVENT_GHOSTING event says how many there are.
+  A key pressed on the rectangle is reported once the rectangle is gone. With diodes it never happens.
+
+Every key is debounced on its own: a change is accepted once the key has read the new state for debounce_ns, and the
+event carries the time of the first scan that saw the state it settled in (so the debounce doesn't add latency to the
+timestamp, the bounces do). Bounces that didn't last are counted in the event's merged field.
+
+The scanner runs on a fixed period inside gpio_input_wait (keypad_attach), and its events come out of the same queue as
+the button edges (GPIO_EVENT_KEY, pin = key number = row * column count + column).
+
+Sources:
+https://github.com/torvalds/linux/blob/master/drivers/input/keyboard/matrix_keypad.c (the kernel's GPIO matrix scanner)
+https://www.kernel.org/doc/Documentation/devicetree/bindings/input/matrix-keymap.txt
+*/
+
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <stdint.h>
+#include "gpioinput.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define KEYPAD_MAX_ROWS ((int32_t) 8)
+
+#define KEYPAD_MAX_COLUMNS ((int32_t) 8)
+
+#define KEYPAD_MAX_KEYS (KEYPAD_MAX_ROWS * KEYPAD_MAX_COLUMNS)
+
+#define KEYPAD_DEFAULT_SCAN_NS ((int64_t) 2000000)
+
+#define KEYPAD_DEFAULT_DEBOUNCE_NS ((int64_t) 10000000)
+
+// Time the columns get to follow a new row before they are read (line capacitance against the pull-downs).
+#define KEYPAD_DEFAULT_SETTLE_NS ((int64_t) 2000)
+
+
+typedef struct {
+    int32_t row_pins[KEYPAD_MAX_ROWS];
+    int32_t row_count;
+    int32_t column_pins[KEYPAD_MAX_COLUMNS];
+    int32_t column_count;
+    int64_t scan_period_ns;
+    int64_t debounce_ns;
+    int64_t settle_ns;
+} KeypadConfig;
+
+typedef struct {
+    uint64_t scans;
+    int64_t sum_scan_ns;            // Time of the scan itself (row writes and column reads)
+    int64_t max_scan_ns;
+    uint64_t failed_scans;          // A bank write or read failed, the scan was dropped
+    uint64_t presses;
+    uint64_t releases;
+    uint64_t bounces;               // Changes that didn't last debounce_ns
+    uint64_t ghost_scans;           // Scans with keys ignored for ghosting
+} KeypadStats;
+
+typedef struct {
+    KeypadConfig config;
+    int32_t row_bank;
+    uint32_t row_mask;
+    uint32_t row_bits[KEYPAD_MAX_ROWS];
+    int32_t column_bank;
+    uint32_t column_mask;
+    uint32_t column_bits[KEYPAD_MAX_COLUMNS];
+    uint64_t stable;                // Debounced state, bit per key
+    uint64_t pending;               // Keys reading the other state, not for debounce_ns yet
+    uint64_t ghosts;                // Keys ignored in the last scan
+    int64_t since_ns[KEYPAD_MAX_KEYS];     // First scan a pending key read its new state
+    uint32_t bounces[KEYPAD_MAX_KEYS];     // Bounces of a key since its last event
+    KeypadStats stats;
+} Keypad;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Fills a config with no pins and the KEYPAD_DEFAULT_ timings.
+// Parameters: config - The config
+void keypad_default_config(KeypadConfig *config);
+
+
+// Description: Prepares a keypad and drives its rows low. The rows must already be set up as outputs and the columns as
+// inputs (setup_gpio_pin), and gpiobank must be open.
+// Parameters:
+// keypad - The keypad
+// config - Pins and timings (copied)
+// Returns - 1 on success, 0 if the config is invalid (rows or columns over more than one bank, too many of them).
+int32_t keypad_init(Keypad *keypad, const KeypadConfig *config);
+
+
+// Description: Scans the matrix once and debounces the keys.
+// Parameters:
+// keypad - The keypad
+// now_ns - Time of the scan
+// events - Where to store the key and ghosting events
+// max    - Size of events
+// Returns - Number of events stored.
+int32_t keypad_scan(Keypad *keypad, int64_t now_ns, GpioEvent *events, int32_t max);
+
+
+// Description: Makes the keypad the scanner of an input set, scanned every scan_period_ns by gpio_input_wait.
+// Parameters:
+// keypad - The keypad
+// set    - The input set
+// Returns - 1 on success, 0 if the set already has a scanner.
+int32_t keypad_attach(Keypad *keypad, GpioInputSet *set);
+
+
+// Description: Prints the scan time and the key counters.
+// Parameters: keypad - The keypad
+void keypad_print_stats(const Keypad *keypad);
+
+
+#endif // End of include guard
@@ -0,0 +1,715 @@
+/*
+This file implements all the functions defined in onewire.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN ONEWIRE.H AND WILL NOT BE REPEATED HERE.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include "rtutil.h"
+#include "gpiobank.h"
+#include "onewire.h"
+
+
+// Bus operations timed by onewire_calibrate.
+#define CALIBRATION_OPERATIONS ((int32_t) 1000)
+
+// Shortest time the bus is released between two slots.
+#define RECOVERY_MIN_NS ((int64_t) 5000)
+
+// Simulated slaves: what they do with the next slots.
+#define SIM_PHASE_IDLE ((int32_t) 0)                // Not selected, waiting for a reset
+#define SIM_PHASE_ROM_CMD ((int32_t) 1)
+#define SIM_PHASE_SEND_ROM ((int32_t) 2)
+#define SIM_PHASE_MATCH_ROM ((int32_t) 3)
+#define SIM_PHASE_SEARCH ((int32_t) 4)
+#define SIM_PHASE_FUNCTION_CMD ((int32_t) 5)
+#define SIM_PHASE_SEND_SCRATCHPAD ((int32_t) 6)
+#define SIM_PHASE_CONVERTING ((int32_t) 7)
+
+// A low pulse this long is a reset to a slave.
+#define SIM_RESET_DETECT_NS ((int64_t) 450000)
+
+// Where a slave samples a bit the master writes (DS18B20: 15 to 60 us, typically 30 us).
+#define SIM_SAMPLE_NS ((int64_t) 30000)
+
+#define SIM_PRESENCE_WAIT_NS ((int64_t) 30000)
+
+#define SIM_PRESENCE_NS ((int64_t) 120000)
+
+#define SIM_DEFAULT_HOLD_NS ((int64_t) 30000)
+
+#define SIM_DEFAULT_CONVERSION_NS ((int64_t) 10000000)
+
+
+// Busy-waits until deadline_ns, on the clock (vDSO, no system call).
+static void wait_until(int64_t deadline_ns) {
+    while (rt_now_ns() < deadline_ns) {
+    }
+}
+
+
+int64_t onewire_calibrate(OneWire *ow) {
+    int64_t best_ns = 0;
+    int32_t run = 0;
+    int32_t i = 0;
+
+    // Fastest of a few runs: the slower ones were interrupted. The bus is released, so releasing it again and
+    // sampling it changes nothing on it.
+    for (run = 0; run < 5; run++) {
+        int64_t start_ns = rt_now_ns();
+        int64_t ns = 0;
+
+        for (i = 0; i < CALIBRATION_OPERATIONS; i++) {
+            ow->ops.drive_low(ow->ops.context, 0);
+            (void) ow->ops.sample(ow->ops.context);
+        }
+        ns = rt_now_ns() - start_ns;
+        if (run == 0 || ns < best_ns) {
+            best_ns = ns;
+        }
+    }
+
+    ow->operation_ns = best_ns / (2 * CALIBRATION_OPERATIONS);
+
+    return ow->operation_ns;
+}
+
+
+int32_t onewire_isolate_thread(int32_t cpu) {
+    cpu_set_t set;
+
+    if (cpu < 0) {
+        cpu = (int32_t) sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET((size_t) cpu, &set);
+
+    return (int32_t) (sched_setaffinity(0, sizeof(set), &set) == 0);
+}
+
+
+void onewire_init(OneWire *ow, const OneWireBusOps *ops) {
+    (void) memset(ow, 0, sizeof(*ow));
+    ow->ops = *ops;
+    (void) onewire_calibrate(ow);
+}
+
+
+// Counts a slot that was outside its window by error_ns.
+static void slot_error(OneWire *ow, int64_t error_ns) {
+    ow->stats.slot_errors++;
+    if (error_ns > ow->stats.max_slot_error_ns) {
+        ow->stats.max_slot_error_ns = error_ns;
+    }
+}
+
+
+int32_t onewire_reset(OneWire *ow) {
+    int64_t start_ns = rt_now_ns();
+    int64_t release_ns = 0;
+    int64_t low_ns = 0;
+    int64_t sample_ns = 0;
+    int32_t presence = 0;
+
+    ow->ops.drive_low(ow->ops.context, 1);
+    wait_until(start_ns + ONEWIRE_RESET_LOW_NS - ow->operation_ns);
+    ow->ops.drive_low(ow->ops.context, 0);
+    release_ns = rt_now_ns();
+    low_ns = release_ns - start_ns;
+    wait_until(release_ns + ONEWIRE_PRESENCE_SAMPLE_NS - ow->operation_ns);
+    presence = (int32_t) (ow->ops.sample(ow->ops.context) == 0);
+    sample_ns = rt_now_ns() - release_ns;
+    wait_until(release_ns + ONEWIRE_PRESENCE_SAMPLE_NS + ONEWIRE_RESET_RECOVERY_NS);
+
+    ow->stats.resets++;
+    if (low_ns < ONEWIRE_RESET_MIN_LOW_NS) {
+        slot_error(ow, ONEWIRE_RESET_MIN_LOW_NS - low_ns);
+    }
+    if (sample_ns > ONEWIRE_PRESENCE_MAX_SAMPLE_NS) {
+        slot_error(ow, sample_ns - ONEWIRE_PRESENCE_MAX_SAMPLE_NS);
+    }
+    if (presence == 0) {
+        ow->stats.no_presence++;
+    }
+
+    return presence;
+}
+
+
+void onewire_write_bit(OneWire *ow, int32_t bit) {
+    int64_t start_ns = rt_now_ns();
+    int64_t low_ns = 0;
+
+    ow->ops.drive_low(ow->ops.context, 1);
+    wait_until(start_ns + ((bit != 0) ? ONEWIRE_WRITE1_LOW_NS : ONEWIRE_WRITE0_LOW_NS) - ow->operation_ns);
+    ow->ops.drive_low(ow->ops.context, 0);
+    low_ns = rt_now_ns() - start_ns;
+    wait_until(start_ns + ((ONEWIRE_SLOT_NS - low_ns > RECOVERY_MIN_NS) ? ONEWIRE_SLOT_NS : (low_ns + RECOVERY_MIN_NS)));
+
+    ow->stats.slots++;
+    if (bit != 0) {
+        ow->stats.write1_slots++;
+        ow->stats.sum_write1_low_ns += low_ns;
+        if (low_ns > ONEWIRE_WRITE1_MAX_LOW_NS) {
+            slot_error(ow, low_ns - ONEWIRE_WRITE1_MAX_LOW_NS);
+        }
+    }
+    else if (low_ns < ONEWIRE_WRITE0_MIN_LOW_NS) {
+        slot_error(ow, ONEWIRE_WRITE0_MIN_LOW_NS - low_ns);
+    }
+    else if (low_ns > ONEWIRE_WRITE0_MAX_LOW_NS) {
+        slot_error(ow, low_ns - ONEWIRE_WRITE0_MAX_LOW_NS);
+    }
+    else {
+    }
+}
+
+
+int32_t onewire_read_bit(OneWire *ow) {
+    int64_t start_ns = rt_now_ns();
+    int64_t sample_ns = 0;
+    int32_t bit = 0;
+
+    ow->ops.drive_low(ow->ops.context, 1);
+    wait_until(start_ns + ONEWIRE_READ_LOW_NS - ow->operation_ns);
+    ow->ops.drive_low(ow->ops.context, 0);
+    wait_until(start_ns + ONEWIRE_READ_SAMPLE_NS - ow->operation_ns);
+    bit = ow->ops.sample(ow->ops.context);
+    sample_ns = rt_now_ns() - start_ns;
+    wait_until(start_ns + ONEWIRE_SLOT_NS);
+
+    ow->stats.slots++;
+    ow->stats.read_slots++;
+    ow->stats.sum_read_sample_ns += sample_ns;
+    if (sample_ns > ONEWIRE_READ_MAX_SAMPLE_NS) {
+        slot_error(ow, sample_ns - ONEWIRE_READ_MAX_SAMPLE_NS);
+    }
+
+    return bit;
+}
+
+
+void onewire_write_byte(OneWire *ow, uint8_t value) {
+    int32_t i = 0;
+
+    for (i = 0; i < 8; i++) {
+        onewire_write_bit(ow, (int32_t) ((value >> i) & 1U));
+    }
+}
+
+
+uint8_t onewire_read_byte(OneWire *ow) {
+    uint8_t value = 0U;
+    int32_t i = 0;
+
+    for (i = 0; i < 8; i++) {
+        value |= (uint8_t) ((uint32_t) onewire_read_bit(ow) << i);
+    }
+
+    return value;
+}
+
+
+uint8_t onewire_crc8(const uint8_t *data, int32_t count) {
+    uint8_t crc = 0U;
+    int32_t i = 0;
+    int32_t bit = 0;
+
+    for (i = 0; i < count; i++) {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++) {
+            crc = ((crc & 1U) != 0U) ? (uint8_t) ((crc >> 1) ^ 0x8CU) : (uint8_t) (crc >> 1);
+        }
+    }
+
+    return crc;
+}
+
+
+// CRC of the first count bytes of a ROM code (8 to check one, 7 to make one).
+static uint8_t rom_crc(uint64_t rom, int32_t count) {
+    uint8_t bytes[8];
+    int32_t i = 0;
+
+    for (i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (rom >> (8 * i));
+    }
+
+    return onewire_crc8(bytes, count);
+}
+
+
+// One pass of the search: follows the branch chosen by last_discrepancy. Returns 1 with the ROM found, 0 if the pass
+// went wrong (no presence, no device answered a bit, a slot outside its window, bad CRC).
+static int32_t search_pass(OneWire *ow, uint64_t previous, int32_t last_discrepancy, uint64_t *rom, int32_t *last_zero) {
+    uint64_t slot_errors = ow->stats.slot_errors;
+    int32_t result = 0;
+    int32_t bit = 0;
+
+    *rom = 0U;
+    *last_zero = -1;
+
+    if (onewire_reset(ow) == 1) {
+        onewire_write_byte(ow, ONEWIRE_CMD_SEARCH_ROM);
+        result = 1;
+
+        for (bit = 0; bit < 64 && result == 1; bit++) {
+            int32_t value = onewire_read_bit(ow);
+            int32_t complement = onewire_read_bit(ow);
+            int32_t direction = 0;
+
+            if (value == 1 && complement == 1) {
+                result = 0;
+            }
+            else {
+                if (value != complement) {
+                    direction = value;
+                }
+                // Devices disagree on this bit: redo the earlier choices, take 1 at the last branch point, 0 after it.
+                else if (bit < last_discrepancy) {
+                    direction = (int32_t) ((previous >> bit) & 1U);
+                }
+                else {
+                    direction = (int32_t) (bit == last_discrepancy);
+                }
+                if (value == complement && direction == 0) {
+                    *last_zero = bit;
+                }
+
+                onewire_write_bit(ow, direction);
+                *rom |= (uint64_t) direction << bit;
+            }
+        }
+
+        // A late slot can make devices drop out of the search and still end on a valid ROM, with the wrong branches.
+        if (ow->stats.slot_errors != slot_errors) {
+            result = 0;
+        }
+        else if (result == 1 && rom_crc(*rom, 8) != 0U) {
+            ow->stats.crc_errors++;
+            result = 0;
+        }
+        else {
+        }
+    }
+
+    return result;
+}
+
+
+int32_t onewire_search(OneWire *ow, uint64_t *roms, int32_t max) {
+    int32_t count = 0;
+    int32_t last_discrepancy = -1;
+    int32_t failed = 0;
+    int32_t searching = 1;
+    uint64_t previous = 0U;
+
+    while (count < max && failed == 0 && searching == 1) {
+        int32_t last_zero = -1;
+        int32_t attempt = 0;
+        int32_t ok = 0;
+        uint64_t rom = 0U;
+
+        for (attempt = 0; attempt < ONEWIRE_RETRIES && ok == 0; attempt++) {
+            if (attempt > 0) {
+                ow->stats.retries++;
+            }
+            ok = search_pass(ow, previous, last_discrepancy, &rom, &last_zero);
+        }
+
+        if (ok == 1) {
+            roms[count] = rom;
+            count++;
+            previous = rom;
+            last_discrepancy = last_zero;
+            // No branch left: every device has been found.
+            if (last_discrepancy < 0) {
+                searching = 0;
+            }
+        }
+        else {
+            ow->stats.failures++;
+            failed = 1;
+        }
+    }
+
+    return (failed == 1) ? -1 : count;
+}
+
+
+static void match_rom(OneWire *ow, uint64_t rom) {
+    int32_t i = 0;
+
+    onewire_write_byte(ow, ONEWIRE_CMD_MATCH_ROM);
+    for (i = 0; i < 8; i++) {
+        onewire_write_byte(ow, (uint8_t) (rom >> (8 * i)));
+    }
+}
+
+
+int32_t onewire_convert_all(OneWire *ow) {
+    int32_t result = 0;
+    int32_t attempt = 0;
+
+    for (attempt = 0; attempt < ONEWIRE_RETRIES && result == 0; attempt++) {
+        uint64_t slot_errors = ow->stats.slot_errors;
+
+        if (attempt > 0) {
+            ow->stats.retries++;
+        }
+        if (onewire_reset(ow) == 1) {
+            int64_t start_ns = rt_now_ns();
+
+            onewire_write_byte(ow, ONEWIRE_CMD_SKIP_ROM);
+            onewire_write_byte(ow, ONEWIRE_CMD_CONVERT_T);
+
+            // The devices answer read slots with 0 while converting, 1 when done. Between polls the bus is idle,
+            // so sleep instead of spinning. After a late slot the command may have been another one (redo it), and a
+            // late poll reads 1 (poll again).
+            if (ow->stats.slot_errors == slot_errors) {
+                while (result == 0 && rt_now_ns() - start_ns < ONEWIRE_CONVERT_TIMEOUT_NS) {
+                    slot_errors = ow->stats.slot_errors;
+                    if (onewire_read_bit(ow) == 1 && ow->stats.slot_errors == slot_errors) {
+                        result = 1;
+                    }
+                    else {
+                        rt_sleep_until_ns(rt_now_ns() + NS_PER_MS);
+                    }
+                }
+            }
+        }
+    }
+
+    if (result == 0) {
+        ow->stats.failures++;
+    }
+
+    return result;
+}
+
+
+int32_t onewire_read_temperature(OneWire *ow, uint64_t rom, int32_t *milli_c) {
+    int32_t result = 0;
+    int32_t attempt = 0;
+
+    for (attempt = 0; attempt < ONEWIRE_RETRIES && result == 0; attempt++) {
+        uint8_t scratchpad[9];
+        uint8_t all_zero = 0U;
+        uint64_t slot_errors = ow->stats.slot_errors;
+        int32_t i = 0;
+
+        if (attempt > 0) {
+            ow->stats.retries++;
+        }
+        if (onewire_reset(ow) == 1) {
+            match_rom(ow, rom);
+            onewire_write_byte(ow, ONEWIRE_CMD_READ_SCRATCHPAD);
+            for (i = 0; i < 9; i++) {
+                scratchpad[i] = onewire_read_byte(ow);
+                all_zero |= scratchpad[i];
+            }
+
+            // A bus stuck low reads all zeros, whose CRC is also 0. A late slot may have selected another device.
+            if (ow->stats.slot_errors != slot_errors) {
+            }
+            else if (all_zero != 0U && onewire_crc8(scratchpad, 9) == 0U) {
+                *milli_c = ((int32_t) (int16_t) ((uint16_t) scratchpad[0] | ((uint16_t) scratchpad[1] << 8)) * 1000) / 16;
+                result = 1;
+            }
+            else {
+                ow->stats.crc_errors++;
+            }
+        }
+    }
+
+    if (result == 0) {
+        ow->stats.failures++;
+    }
+
+    return result;
+}
+
+
+void onewire_print_stats(const OneWire *ow) {
+    const OneWireStats *s = &ow->stats;
+
+    (void) printf("1-Wire: %llu slots, %llu outside the timing windows (worst by %.1f us), write-1 low avg %.2f us, read sample avg %.2f us\n",
+                  (unsigned long long) s->slots, (unsigned long long) s->slot_errors, (double) s->max_slot_error_ns / 1e3,
+                  (s->write1_slots > 0U) ? ((double) s->sum_write1_low_ns / (1e3 * (double) s->write1_slots)) : 0.0,
+                  (s->read_slots > 0U) ? ((double) s->sum_read_sample_ns / (1e3 * (double) s->read_slots)) : 0.0);
+    (void) printf("  %llu resets (%llu without presence), %llu CRC errors, %llu retries, %llu failed operations, bus operation %lld ns\n",
+                  (unsigned long long) s->resets, (unsigned long long) s->no_presence, (unsigned long long) s->crc_errors,
+                  (unsigned long long) s->retries, (unsigned long long) s->failures, (long long) ow->operation_ns);
+}
+
+
+/// ----------- GPIO BANK BUS ----------- ///
+
+static void gpio_drive_low(void *context, int32_t low) {
+    OneWireGpio *gpio = (OneWireGpio *) context;
+
+    (void) gpio_bank_write(gpio->tx_bank, gpio->tx_mask, (low == 1) ? gpio->tx_low_value : (gpio->tx_low_value ^ gpio->tx_mask));
+}
+
+
+static int32_t gpio_sample(void *context) {
+    OneWireGpio *gpio = (OneWireGpio *) context;
+    uint32_t value = 0U;
+
+    (void) gpio_bank_read(gpio->rx_bank, gpio->rx_mask, &value);
+
+    return (int32_t) (value != 0U);
+}
+
+
+int32_t onewire_gpio_bus(OneWireGpio *gpio, int32_t tx_pin, int32_t rx_pin, int32_t tx_inverted, OneWireBusOps *ops) {
+    int32_t result = 0;
+    int32_t backend = gpio_bank_backend();
+
+    if ((backend == GPIO_BACKEND_MMAP || backend == GPIO_BACKEND_SIM) && tx_pin >= 0 && rx_pin >= 0 &&
+        GPIO_BANK_OF(tx_pin) < GPIO_BANK_COUNT && GPIO_BANK_OF(rx_pin) < GPIO_BANK_COUNT) {
+        gpio->tx_bank = GPIO_BANK_OF(tx_pin);
+        gpio->tx_mask = GPIO_BIT_OF(tx_pin);
+        gpio->tx_low_value = (tx_inverted == 1) ? 0U : gpio->tx_mask;
+        gpio->rx_bank = GPIO_BANK_OF(rx_pin);
+        gpio->rx_mask = GPIO_BIT_OF(rx_pin);
+        ops->drive_low = &gpio_drive_low;
+        ops->sample = &gpio_sample;
+        ops->context = gpio;
+        gpio_drive_low(gpio, 0);
+        result = 1;
+    }
+
+    return result;
+}
+
+
+/// ----------- SIMULATED BUS ----------- ///
+
+static int32_t sim_rom_bit(const OneWireSimDevice *device, int32_t bit) {
+    return (int32_t) ((device->rom >> bit) & 1U);
+}
+
+
+static void sim_load(OneWireSimDevice *device, int32_t phase, const uint8_t *bytes, int32_t count) {
+    device->phase = phase;
+    device->bit_count = 0;
+    (void) memcpy(device->tx, bytes, (size_t) count);
+    device->tx_bits = count * 8;
+}
+
+
+// The device got a whole command byte.
+static void sim_command(OneWireSim *sim, OneWireSimDevice *device, uint8_t command, int64_t now_ns) {
+    uint8_t bytes[9];
+    int32_t i = 0;
+
+    device->bit_count = 0;
+    device->rx = 0U;
+
+    if (device->phase == SIM_PHASE_ROM_CMD) {
+        if (command == ONEWIRE_CMD_READ_ROM) {
+            for (i = 0; i < 8; i++) {
+                bytes[i] = (uint8_t) (device->rom >> (8 * i));
+            }
+            sim_load(device, SIM_PHASE_SEND_ROM, bytes, 8);
+        }
+        else if (command == ONEWIRE_CMD_MATCH_ROM) {
+            device->phase = SIM_PHASE_MATCH_ROM;
+        }
+        else if (command == ONEWIRE_CMD_SKIP_ROM) {
+            device->phase = SIM_PHASE_FUNCTION_CMD;
+        }
+        else if (command == ONEWIRE_CMD_SEARCH_ROM) {
+            device->phase = SIM_PHASE_SEARCH;
+            device->search_step = 0;
+        }
+        else {
+            device->phase = SIM_PHASE_IDLE;
+        }
+    }
+    else if (command == ONEWIRE_CMD_CONVERT_T) {
+        device->phase = SIM_PHASE_CONVERTING;
+        device->converting_until_ns = now_ns + sim->conversion_ns;
+    }
+    else if (command == ONEWIRE_CMD_READ_SCRATCHPAD) {
+        bytes[0] = (uint8_t) device->temperature_16;
+        bytes[1] = (uint8_t) ((uint32_t) device->temperature_16 >> 8);
+        bytes[2] = 0x4BU;       // TH, TL and configuration (12 bits) as after power up
+        bytes[3] = 0x46U;
+        bytes[4] = 0x7FU;
+        bytes[5] = 0xFFU;
+        bytes[6] = 0x0CU;
+        bytes[7] = 0x10U;
+        bytes[8] = onewire_crc8(bytes, 8);
+        sim_load(device, SIM_PHASE_SEND_SCRATCHPAD, bytes, 9);
+    }
+    else {
+        device->phase = SIM_PHASE_IDLE;
+    }
+}
+
+
+// The master pulled the bus low: a slot starts. Devices that send a 0 in this slot hold the bus.
+static void sim_slot_start(OneWireSim *sim, int64_t now_ns) {
+    int32_t i = 0;
+
+    for (i = 0; i < sim->device_count; i++) {
+        OneWireSimDevice *device = &sim->devices[i];
+        int32_t bit = 1;
+
+        device->receiving = (int32_t) (device->phase == SIM_PHASE_ROM_CMD || device->phase == SIM_PHASE_FUNCTION_CMD ||
+                                       device->phase == SIM_PHASE_MATCH_ROM || (device->phase == SIM_PHASE_SEARCH && device->search_step == 2));
+        if (device->phase == SIM_PHASE_SEND_ROM || device->phase == SIM_PHASE_SEND_SCRATCHPAD) {
+            bit = (int32_t) ((device->tx[device->bit_count / 8] >> (device->bit_count % 8)) & 1U);
+            device->bit_count++;
+            if (device->bit_count == device->tx_bits) {
+                device->phase = (device->phase == SIM_PHASE_SEND_ROM) ? SIM_PHASE_FUNCTION_CMD : SIM_PHASE_IDLE;
+                device->bit_count = 0;
+            }
+        }
+        else if (device->phase == SIM_PHASE_SEARCH && device->search_step < 2) {
+            bit = (device->search_step == 0) ? sim_rom_bit(device, device->bit_count) : (1 - sim_rom_bit(device, device->bit_count));
+            device->search_step++;
+        }
+        else if (device->phase == SIM_PHASE_CONVERTING) {
+            bit = (int32_t) (now_ns >= device->converting_until_ns);
+        }
+        else {
+        }
+
+        if (bit == 0) {
+            device->hold_until_ns = now_ns + sim->hold_ns;
+        }
+    }
+}
+
+
+// The master released the bus after a low pulse of width_ns: a reset, or a bit for the devices that receive.
+static void sim_slot_end(OneWireSim *sim, int64_t width_ns, int64_t now_ns) {
+    int32_t bit = (int32_t) (width_ns < SIM_SAMPLE_NS);
+    int32_t i = 0;
+
+    if (width_ns >= SIM_RESET_DETECT_NS) {
+        for (i = 0; i < sim->device_count; i++) {
+            sim->devices[i].phase = SIM_PHASE_ROM_CMD;
+            sim->devices[i].bit_count = 0;
+            sim->devices[i].rx = 0U;
+            sim->devices[i].hold_until_ns = 0;
+        }
+        sim->presence_from_ns = now_ns + SIM_PRESENCE_WAIT_NS;
+        sim->presence_until_ns = sim->presence_from_ns + SIM_PRESENCE_NS;
+    }
+    else {
+        for (i = 0; i < sim->device_count; i++) {
+            OneWireSimDevice *device = &sim->devices[i];
+
+            // Only slots that started while the device was receiving carry a bit for it.
+            if (device->receiving == 0) {
+            }
+            else if (device->phase == SIM_PHASE_ROM_CMD || device->phase == SIM_PHASE_FUNCTION_CMD) {
+                device->rx |= (uint64_t) bit << device->bit_count;
+                device->bit_count++;
+                if (device->bit_count == 8) {
+                    sim_command(sim, device, (uint8_t) device->rx, now_ns);
+                }
+            }
+            else if (device->phase == SIM_PHASE_MATCH_ROM) {
+                if (bit != sim_rom_bit(device, device->bit_count)) {
+                    device->phase = SIM_PHASE_IDLE;
+                }
+                else {
+                    device->bit_count++;
+                    if (device->bit_count == 64) {
+                        device->phase = SIM_PHASE_FUNCTION_CMD;
+                        device->bit_count = 0;
+                        device->rx = 0U;
+                    }
+                }
+            }
+            else if (device->phase == SIM_PHASE_SEARCH && device->search_step == 2) {
+                device->search_step = 0;
+                if (bit != sim_rom_bit(device, device->bit_count)) {
+                    device->phase = SIM_PHASE_IDLE;
+                }
+                else {
+                    device->bit_count++;
+                    if (device->bit_count == 64) {
+                        device->phase = SIM_PHASE_IDLE;
+                    }
+                }
+            }
+            else {
+            }
+        }
+    }
+}
+
+
+static void sim_drive_low(void *context, int32_t low) {
+    OneWireSim *sim = (OneWireSim *) context;
+    int64_t now_ns = rt_now_ns();
+
+    if (low == 1 && sim->master_low == 0) {
+        sim->fall_ns = now_ns;
+        sim_slot_start(sim, now_ns);
+    }
+    else if (low == 0 && sim->master_low == 1) {
+        sim_slot_end(sim, now_ns - sim->fall_ns, now_ns);
+    }
+    else {
+    }
+    sim->master_low = (low == 1) ? 1 : 0;
+}
+
+
+static int32_t sim_sample(void *context) {
+    OneWireSim *sim = (OneWireSim *) context;
+    int64_t now_ns = rt_now_ns();
+    int32_t level = 1;
+    int32_t i = 0;
+
+    if (sim->master_low == 1 || (now_ns >= sim->presence_from_ns && now_ns < sim->presence_until_ns)) {
+        level = 0;
+    }
+    for (i = 0; i < sim->device_count && level == 1; i++) {
+        if (now_ns < sim->devices[i].hold_until_ns) {
+            level = 0;
+        }
+    }
+
+    return level;
+}
+
+
+void onewire_sim_init(OneWireSim *sim, OneWireBusOps *ops) {
+    (void) memset(sim, 0, sizeof(*sim));
+    sim->hold_ns = SIM_DEFAULT_HOLD_NS;
+    sim->conversion_ns = SIM_DEFAULT_CONVERSION_NS;
+    ops->drive_low = &sim_drive_low;
+    ops->sample = &sim_sample;
+    ops->context = sim;
+}
+
+
+int32_t onewire_sim_add_device(OneWireSim *sim, uint64_t serial, int32_t milli_c) {
+    int32_t result = -1;
+
+    if (sim->device_count < ONEWIRE_SIM_MAX_DEVICES) {
+        OneWireSimDevice *device = &sim->devices[sim->device_count];
+        uint64_t rom = (uint64_t) ONEWIRE_FAMILY_DS18B20 | ((serial & 0xFFFFFFFFFFFFULL) << 8);
+
+        (void) memset(device, 0, sizeof(*device));
+        device->rom = rom | ((uint64_t) rom_crc(rom, 7) << 56);
+        device->temperature_16 = (milli_c * 16) / 1000;
+        result = sim->device_count;
+        sim->device_count++;
+    }
+
+    return result;
+}
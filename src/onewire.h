@@ -0,0 +1,284 @@
+/*
+This file is for defining a bit-banged 1-Wire bus master, for DS18B20 style temperature sensors without a 1-Wire
+kernel overlay.
+
+1-Wire timing is in microseconds: every bit is a slot of about 70 us that starts with the master pulling the bus low,
+and a 1 is a low pulse of under 15 us while a 0 holds it for 60 us. Reading a bit means a short low pulse and sampling
+the bus before 15 us, while the slave may be holding it low. A sysfs write takes longer than a whole slot, so the
+master only runs on the MMAP backend of gpiobank (one register write or read per bus operation), or on the SIM backend
+or the simulated bus (below) for tests.
+
+Wiring: the bus is open drain with a pull-up, and gpiobank pins are push-pull outputs or inputs, so the master uses
+two pins: TX drives a transistor that pulls the bus low (TX high = bus low, unless tx_inverted), RX reads the bus.
+
+Timing: the waits inside a slot are busy waits on the clock (a vDSO read, no system call), to deadlines counted from
+the start of the slot so the errors don't add up over a byte. Every wait ends early by the duration of one bus
+operation (a register write or read), calibrated at startup (onewire_calibrate), so the edge itself lands on time. A
+spin loop calibrated in iterations per microsecond was tried first: the core's clock speed changes while it spins, and
+write 0 pulses came out 20 % too short or too long. A slot must not be interrupted, so run the master from an RT
+thread (rt_thread_start) pinned to a core that nothing else uses (onewire_isolate_thread, with the core removed from
+the scheduler by isolcpus= on the kernel command line).
+Every slot is still timestamped at its edges, and the achieved timings are checked against the 1-Wire windows. A slot
+outside them counts as a slot error, and the operation it was part of is redone: a late slot can be read as another
+bit by the devices without any CRC error (a search that selected the wrong devices, a match ROM for another one).
+
+Supported: reset / presence, search ROM for any number of devices, match ROM / skip ROM, and temperature conversion
+and scratchpad reads of DS18B20 sensors, all CRC checked and retried up to ONEWIRE_RETRIES times.
+
+There is also a simulated bus with simulated slaves (onewire_sim_init), which decodes the master's actual pulse widths
+and holds the bus for its own bits with the real timing, so a master that is too slow gets the wrong bits just like
+with a real sensor.
+
+Sources:
+https://www.analog.com/en/resources/technical-articles/1wire-communication-through-software.html (slot timings)
+https://www.analog.com/en/resources/app-notes/1wire-search-algorithm.html (search ROM)
+https://www.analog.com/media/en/technical-documentation/data-sheets/DS18B20.pdf (commands, scratchpad, CRC)
+*/
+
+#ifndef ONEWIRE_H
+#define ONEWIRE_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// Standard speed slot timings, in nanoseconds.
+#define ONEWIRE_RESET_LOW_NS ((int64_t) 500000)
+
+#define ONEWIRE_PRESENCE_SAMPLE_NS ((int64_t) 70000)
+
+#define ONEWIRE_RESET_RECOVERY_NS ((int64_t) 430000)
+
+#define ONEWIRE_WRITE1_LOW_NS ((int64_t) 6000)
+
+#define ONEWIRE_WRITE0_LOW_NS ((int64_t) 60000)
+
+#define ONEWIRE_READ_LOW_NS ((int64_t) 3000)
+
+// Read sample point, from the start of the slot.
+#define ONEWIRE_READ_SAMPLE_NS ((int64_t) 12000)
+
+#define ONEWIRE_SLOT_NS ((int64_t) 70000)
+
+// The windows a slot must stay in (checked on every slot).
+#define ONEWIRE_WRITE1_MAX_LOW_NS ((int64_t) 15000)
+
+#define ONEWIRE_WRITE0_MIN_LOW_NS ((int64_t) 60000)
+
+#define ONEWIRE_WRITE0_MAX_LOW_NS ((int64_t) 120000)
+
+#define ONEWIRE_READ_MAX_SAMPLE_NS ((int64_t) 15000)
+
+#define ONEWIRE_RESET_MIN_LOW_NS ((int64_t) 480000)
+
+// Latest presence sample after the reset pulse (a slave pulls the bus low from 15-60 us for 60-240 us).
+#define ONEWIRE_PRESENCE_MAX_SAMPLE_NS ((int64_t) 120000)
+
+#define ONEWIRE_RETRIES ((int32_t) 3)
+
+// DS18B20 conversion time at 12 bits, the limit when polling for the end of a conversion.
+#define ONEWIRE_CONVERT_TIMEOUT_NS ((int64_t) 750000000)
+
+#define ONEWIRE_SIM_MAX_DEVICES ((int32_t) 8)
+
+// Commands.
+#define ONEWIRE_CMD_SEARCH_ROM ((uint8_t) 0xF0U)
+
+#define ONEWIRE_CMD_READ_ROM ((uint8_t) 0x33U)
+
+#define ONEWIRE_CMD_MATCH_ROM ((uint8_t) 0x55U)
+
+#define ONEWIRE_CMD_SKIP_ROM ((uint8_t) 0xCCU)
+
+#define ONEWIRE_CMD_CONVERT_T ((uint8_t) 0x44U)
+
+#define ONEWIRE_CMD_READ_SCRATCHPAD ((uint8_t) 0xBEU)
+
+#define ONEWIRE_FAMILY_DS18B20 ((uint8_t) 0x28U)
+
+
+// The bus as the master sees it.
+typedef struct {
+    void (*drive_low)(void *context, int32_t low);  // 1 pulls the bus low, 0 releases it
+    int32_t (*sample)(void *context);               // Level of the bus, 0 or 1
+    void *context;
+} OneWireBusOps;
+
+typedef struct {
+    uint64_t slots;
+    uint64_t slot_errors;           // Slots outside the 1-Wire timing windows
+    int64_t max_slot_error_ns;      // Furthest a slot was outside its window
+    int64_t sum_write1_low_ns;      // Achieved pulse widths, for the averages in the report
+    uint64_t write1_slots;
+    int64_t sum_read_sample_ns;
+    uint64_t read_slots;
+    uint64_t resets;
+    uint64_t no_presence;
+    uint64_t crc_errors;
+    uint64_t retries;
+    uint64_t failures;              // Operations that still failed after ONEWIRE_RETRIES
+} OneWireStats;
+
+typedef struct {
+    OneWireBusOps ops;
+    int64_t operation_ns;           // Duration of one bus operation, from onewire_calibrate
+    OneWireStats stats;
+} OneWire;
+
+// GPIO bank bus (see the wiring above).
+typedef struct {
+    int32_t tx_bank;
+    uint32_t tx_mask;
+    uint32_t tx_low_value;          // Value of the TX bit that pulls the bus low
+    int32_t rx_bank;
+    uint32_t rx_mask;
+} OneWireGpio;
+
+typedef struct {
+    uint64_t rom;                   // Family, serial and CRC, family code in the low byte
+    int32_t temperature_16;         // 1/16 degree C
+    int32_t phase;                  // What the device does with the next slots (not selected: waits for a reset)
+    int32_t receiving;              // The current slot carries a bit for the device
+    int32_t bit_count;              // Bits received or sent in this phase
+    uint64_t rx;
+    uint8_t tx[9];
+    int32_t tx_bits;
+    int32_t search_step;            // 0 send the bit, 1 its complement, 2 receive the direction
+    int64_t hold_until_ns;          // Holding the bus low until
+    int64_t converting_until_ns;
+} OneWireSimDevice;
+
+// Simulated bus with slaves.
+typedef struct {
+    OneWireSimDevice devices[ONEWIRE_SIM_MAX_DEVICES];
+    int32_t device_count;
+    int32_t master_low;
+    int64_t fall_ns;                // When the master last pulled the bus low
+    int64_t presence_from_ns;
+    int64_t presence_until_ns;
+    int64_t hold_ns;                // How long a slave holds the bus for a 0 bit
+    int64_t conversion_ns;
+} OneWireSim;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Measures how long one bus operation takes, which every wait in a slot ends early by. Done by
+// onewire_init, the bus must be released.
+// Parameters: ow - The master
+// Returns - Nanoseconds per bus operation.
+int64_t onewire_calibrate(OneWire *ow);
+
+
+// Description: Pins the calling thread to one CPU, for an RT thread on an isolated core.
+// Parameters: cpu - CPU number, -1 for the last CPU
+// Returns - 1 on success, 0 on failure.
+int32_t onewire_isolate_thread(int32_t cpu);
+
+
+// Description: Prepares a master on a bus and calibrates it.
+// Parameters:
+// ow  - The master
+// ops - The bus (copied)
+void onewire_init(OneWire *ow, const OneWireBusOps *ops);
+
+
+// Description: Sets up a bus on two GPIO pins (see the wiring above) and releases it. gpiobank must be open on the
+// MMAP or SIM backend.
+// Parameters:
+// gpio        - The bus
+// tx_pin      - GPIO that pulls the bus low
+// rx_pin      - GPIO that reads the bus
+// tx_inverted - 0 if TX high pulls the bus low, 1 if TX low does
+// ops         - Where to store the bus operations for onewire_init
+// Returns - 1 on success, 0 if the backend is too slow for 1-Wire (SYSFS) or not open.
+int32_t onewire_gpio_bus(OneWireGpio *gpio, int32_t tx_pin, int32_t rx_pin, int32_t tx_inverted, OneWireBusOps *ops);
+
+
+// Description: Sends a reset pulse and waits for a presence pulse.
+// Parameters: ow - The master
+// Returns - 1 if at least one device answered, 0 otherwise.
+int32_t onewire_reset(OneWire *ow);
+
+
+// Description: Writes one bit slot.
+// Parameters:
+// ow  - The master
+// bit - 0 or 1
+void onewire_write_bit(OneWire *ow, int32_t bit);
+
+
+// Description: Reads one bit slot.
+// Parameters: ow - The master
+// Returns - The bit.
+int32_t onewire_read_bit(OneWire *ow);
+
+
+// Description: Writes a byte, least significant bit first.
+// Parameters:
+// ow    - The master
+// value - The byte
+void onewire_write_byte(OneWire *ow, uint8_t value);
+
+
+// Description: Reads a byte, least significant bit first.
+// Parameters: ow - The master
+// Returns - The byte.
+uint8_t onewire_read_byte(OneWire *ow);
+
+
+// Description: Dallas / Maxim CRC-8 (polynomial x^8 + x^5 + x^4 + 1) of some bytes.
+// Parameters:
+// data  - The bytes
+// count - How many
+// Returns - The CRC. Over data that ends with its own CRC it is 0.
+uint8_t onewire_crc8(const uint8_t *data, int32_t count);
+
+
+// Description: Finds the ROM code of every device on the bus (search ROM).
+// Parameters:
+// ow    - The master
+// roms  - Where to store the ROM codes
+// max   - Size of roms
+// Returns - Number of devices found, -1 if the search failed after ONEWIRE_RETRIES.
+int32_t onewire_search(OneWire *ow, uint64_t *roms, int32_t max);
+
+
+// Description: Starts a temperature conversion on every device at once (skip ROM) and waits for it to end.
+// Parameters: ow - The master
+// Returns - 1 on success, 0 on failure.
+int32_t onewire_convert_all(OneWire *ow);
+
+
+// Description: Reads the last converted temperature of one device (match ROM, read scratchpad).
+// Parameters:
+// ow      - The master
+// rom     - ROM code of the device
+// milli_c - Where to store the temperature in thousandths of a degree C
+// Returns - 1 on success, 0 after ONEWIRE_RETRIES failed reads.
+int32_t onewire_read_temperature(OneWire *ow, uint64_t rom, int32_t *milli_c);
+
+
+// Description: Prints the slot timing and the retries.
+// Parameters: ow - The master
+void onewire_print_stats(const OneWire *ow);
+
+
+// Description: Prepares a simulated bus with no devices.
+// Parameters:
+// sim - The bus
+// ops - Where to store the bus operations for onewire_init
+void onewire_sim_init(OneWireSim *sim, OneWireBusOps *ops);
+
+
+// Description: Adds a simulated DS18B20.
+// Parameters:
+// sim     - The bus
+// serial  - 48 bit serial number (the ROM code gets the family code and CRC)
+// milli_c - Temperature it reports, in thousandths of a degree C
+// Returns - Index of the device, -1 if there are ONEWIRE_SIM_MAX_DEVICES already.
+int32_t onewire_sim_add_device(OneWireSim *sim, uint64_t serial, int32_t milli_c);
+
+
+#endif // End of include guard
@@ -0,0 +1,185 @@
+/*
+This file implements all the functions defined in perfstat.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN PERFSTAT.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfstat.h"
+
+
+static const char *const counter_names[PERF_COUNTER_COUNT] = { "cycles", "instructions", "cache misses", "ctx switches", "page faults" };
+
+
+// Opens one counter on the calling thread, in the group of leader_fd (-1 to open a leader). Returns the fd or -1.
+static int32_t open_counter(uint32_t type, uint64_t config, int32_t leader_fd, int32_t exclude_kernel) {
+    struct perf_event_attr attr;
+
+    (void) memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = (leader_fd < 0) ? 1U : 0U;
+    attr.exclude_kernel = (exclude_kernel == 1) ? 1U : 0U;
+    attr.exclude_hv = 1U;
+
+    return (int32_t) syscall(SYS_perf_event_open, &attr, 0, -1, leader_fd, 0UL);
+}
+
+
+// Adds a member to the group. Returns 1 if it could be opened.
+static int32_t add_member(PerfThread *pt, int32_t slot, uint32_t type, uint64_t config) {
+    int32_t result = 0;
+    int32_t fd = open_counter(type, config, pt->leader_fd, pt->user_only);
+
+    if (fd >= 0) {
+        pt->fds[slot] = fd;
+        pt->index[slot] = pt->member_count;
+        pt->member_count++;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+// Reads every counter of the group into values (by slot). Returns 1 on success.
+static int32_t read_group(PerfThread *pt, uint64_t *values) {
+    int32_t result = 0;
+    uint64_t buffer[1 + PERF_COUNTER_COUNT];
+    ssize_t expected = (ssize_t) (sizeof(uint64_t) * (1U + (uint32_t) pt->member_count));
+    int32_t i = 0;
+
+    if (read(pt->leader_fd, buffer, sizeof(buffer)) == expected) {
+        for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+            values[i] = (pt->index[i] != PERF_NOT_AVAILABLE) ? buffer[1 + pt->index[i]] : 0U;
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+
+int32_t perf_thread_open(PerfThread *pt, const char *name) {
+    int32_t i = 0;
+
+    (void) memset(pt, 0, sizeof(*pt));
+    (void) snprintf(pt->name, sizeof(pt->name), "%s", name);
+    for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+        pt->fds[i] = -1;
+        pt->index[i] = PERF_NOT_AVAILABLE;
+    }
+
+    // Hardware cycles lead the group if the PMU can be used, with the kernel counted if allowed.
+    pt->leader_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 0);
+    if (pt->leader_fd < 0) {
+        pt->user_only = 1;
+        pt->leader_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 1);
+    }
+
+    if (pt->leader_fd >= 0) {
+        pt->fds[PERF_COUNTER_CYCLES] = pt->leader_fd;
+        pt->index[PERF_COUNTER_CYCLES] = 0;
+        pt->member_count = 1;
+        (void) add_member(pt, PERF_COUNTER_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        (void) add_member(pt, PERF_COUNTER_CACHE_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    }
+    else {
+        // No PMU: the task clock stands in for cycles.
+        pt->user_only = 0;
+        pt->software_cycles = 1;
+        pt->leader_fd = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, 0);
+        if (pt->leader_fd >= 0) {
+            pt->fds[PERF_COUNTER_CYCLES] = pt->leader_fd;
+            pt->index[PERF_COUNTER_CYCLES] = 0;
+            pt->member_count = 1;
+        }
+    }
+
+    if (pt->leader_fd >= 0) {
+        (void) add_member(pt, PERF_COUNTER_CONTEXT_SWITCHES, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+        (void) add_member(pt, PERF_COUNTER_PAGE_FAULTS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+        (void) ioctl(pt->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        (void) ioctl(pt->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    return (int32_t) (pt->leader_fd >= 0);
+}
+
+
+void perf_iteration_begin(PerfThread *pt) {
+    if (pt->leader_fd >= 0 && read_group(pt, pt->begin) != 1) {
+        pt->read_failures++;
+    }
+}
+
+
+void perf_iteration_end(PerfThread *pt) {
+    uint64_t end[PERF_COUNTER_COUNT];
+    int32_t i = 0;
+
+    if (pt->leader_fd >= 0) {
+        if (read_group(pt, end) == 1) {
+            pt->iterations++;
+            for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+                uint64_t delta = end[i] - pt->begin[i];
+
+                pt->sum[i] += delta;
+                if (delta > pt->max[i]) {
+                    pt->max[i] = delta;
+                }
+            }
+        }
+        else {
+            pt->read_failures++;
+        }
+    }
+}
+
+
+void perf_print_report(const PerfThread *pt) {
+    int32_t i = 0;
+
+    if (pt->leader_fd < 0) {
+        (void) printf("  %-15s no performance counters (perf_event_open not permitted)\n", pt->name);
+    }
+    else {
+        (void) printf("  %-15s %llu iterations%s%s\n", pt->name, (unsigned long long) pt->iterations,
+                      (pt->software_cycles == 1) ? ", no PMU: cycles is the task clock in ns" : "",
+                      (pt->user_only == 1) ? ", hardware counts are user space only" : "");
+        for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+            if (pt->index[i] == PERF_NOT_AVAILABLE) {
+                (void) printf("    %-14s not available\n", counter_names[i]);
+            }
+            else {
+                (void) printf("    %-14s avg %12.1f  max %10llu per iteration\n", counter_names[i],
+                              (pt->iterations > 0U) ? ((double) pt->sum[i] / (double) pt->iterations) : 0.0, (unsigned long long) pt->max[i]);
+            }
+        }
+        if (pt->read_failures > 0U) {
+            (void) printf("    %llu counter reads failed\n", (unsigned long long) pt->read_failures);
+        }
+    }
+}
+
+
+void perf_thread_close(PerfThread *pt) {
+    int32_t i = 0;
+
+    // Members first, the leader is also fds[PERF_COUNTER_CYCLES].
+    for (i = PERF_COUNTER_COUNT - 1; i >= 0; i--) {
+        if (pt->fds[i] >= 0) {
+            (void) close(pt->fds[i]);
+            pt->fds[i] = -1;
+        }
+    }
+    pt->leader_fd = -1;
+}
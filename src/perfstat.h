@@ -0,0 +1,96 @@
+/*
+This file is for defining per thread performance counters, to find out why a loop iteration of a real-time thread is
+slow. Wakeup latency says that it was late, the counters say whether the time went on cache misses, context switches
+or page faults.
+
+Every thread opens its own counters (perf_thread_open, from the thread itself) and brackets the work of each loop
+iteration with perf_iteration_begin / perf_iteration_end. The counters are opened as one perf_event_open group, so
+begin and end are one read system call each, and the deltas are accumulated (sum and worst iteration) per counter.
+
+Counters, in the order of the PERF_COUNTER_ slots:
+- cycles, instructions, cache misses: hardware (PMU) events. Often not permitted (perf_event_paranoid, containers,
+  virtual machines without a virtual PMU). Without them cycles falls back to the software task clock (nanoseconds of
+  CPU time) and the other two are reported as not available.
+- context switches, page faults: software events, normally always available.
+When the kernel is excluded from counting (perf_event_paranoid 2 without CAP_PERFMON) the hardware counts are user
+space only, which the report says.
+
+Sources:
+https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+PERF_FORMAT_GROUP is what lets one read return every counter of the group.
+*/
+
+#ifndef PERFSTAT_H
+#define PERFSTAT_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define PERF_COUNTER_CYCLES ((int32_t) 0)
+
+#define PERF_COUNTER_INSTRUCTIONS ((int32_t) 1)
+
+#define PERF_COUNTER_CACHE_MISSES ((int32_t) 2)
+
+#define PERF_COUNTER_CONTEXT_SWITCHES ((int32_t) 3)
+
+#define PERF_COUNTER_PAGE_FAULTS ((int32_t) 4)
+
+#define PERF_COUNTER_COUNT ((int32_t) 5)
+
+#define PERF_NAME_LENGTH ((int32_t) 16)
+
+// Slot of a counter that could not be opened.
+#define PERF_NOT_AVAILABLE ((int32_t) -1)
+
+
+typedef struct {
+    char name[PERF_NAME_LENGTH];
+    int32_t leader_fd;                      // -1 when no counter could be opened
+    int32_t fds[PERF_COUNTER_COUNT];
+    int32_t index[PERF_COUNTER_COUNT];      // Position in the group read, PERF_NOT_AVAILABLE if not opened
+    int32_t member_count;
+    int32_t software_cycles;                // Cycles is the task clock in nanoseconds
+    int32_t user_only;                      // Kernel excluded from the hardware counts
+    uint64_t begin[PERF_COUNTER_COUNT];
+    uint64_t iterations;
+    uint64_t sum[PERF_COUNTER_COUNT];
+    uint64_t max[PERF_COUNTER_COUNT];       // Worst single iteration
+    uint64_t read_failures;
+} PerfThread;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Opens the counters of the calling thread. Call it from the thread to be measured.
+// Parameters:
+// pt   - The counters
+// name - Name in the report
+// Returns - 1 if at least one counter was opened, 0 otherwise (perf_iteration_begin / end then do nothing).
+int32_t perf_thread_open(PerfThread *pt, const char *name);
+
+
+// Description: Marks the start of the work of a loop iteration.
+// Parameters: pt - The counters
+void perf_iteration_begin(PerfThread *pt);
+
+
+// Description: Marks the end of the work of a loop iteration and adds it to the statistics.
+// Parameters: pt - The counters
+void perf_iteration_end(PerfThread *pt);
+
+
+// Description: Prints the average and worst iteration of every counter. The statistics are written by the measured
+// thread only, so print them once it is stopped or idle.
+// Parameters: pt - The counters
+void perf_print_report(const PerfThread *pt);
+
+
+// Description: Closes the counters.
+// Parameters: pt - The counters
+void perf_thread_close(PerfThread *pt);
+
+
+#endif // End of include guard
@@ -0,0 +1,386 @@
+/*
+This file implements all the functions defined in photogate.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN PHOTOGATE.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "rtutil.h"
+#include "gpiobank.h"
+#include "photogate.h"
+
+
+static void reset_run(Photogate *gate) {
+    int32_t i = 0;
+
+    (void) memset(&gate->current, 0, sizeof(gate->current));
+    for (i = 0; i < PHOTOGATE_MAX_GATES; i++) {
+        gate->pending_since_ns[i] = -1;
+    }
+}
+
+
+// Feeds one sample of a gate into its state machine. gap_ns is the time since the previous sample.
+static void update_gate(Photogate *gate, int32_t index, int32_t active, int64_t sample_ns, int64_t gap_ns) {
+    PhotogateRun *run = &gate->current;
+
+    if (index < run->count) {
+        // Already triggered this run: anything it does now is bounce.
+        if (active == 1 && gate->pending_since_ns[index] < 0) {
+            run->rejected_bounces++;
+            gate->pending_since_ns[index] = sample_ns;
+        }
+        else if (active == 0) {
+            gate->pending_since_ns[index] = -1;
+        }
+        else {
+        }
+    }
+    else if (active == 0) {
+        // Went back before min_break_ns: a glitch, not a beam break.
+        if (gate->pending_since_ns[index] >= 0) {
+            run->rejected_glitches++;
+            gate->pending_since_ns[index] = -1;
+        }
+    }
+    else if (index > run->count) {
+        // Out of order, the earlier gates haven't triggered yet.
+    }
+    else if (gate->pending_since_ns[index] < 0) {
+        gate->pending_since_ns[index] = sample_ns;
+        run->uncertainty_ns[index] = gap_ns;
+    }
+    else {
+    }
+
+    // Confirm a break that has lasted long enough, stamped with its first sample.
+    if (index == run->count && gate->pending_since_ns[index] >= 0 &&
+        sample_ns - gate->pending_since_ns[index] >= gate->config.min_break_ns) {
+        run->time_ns[index] = gate->pending_since_ns[index];
+        run->count++;
+    }
+}
+
+
+// Hands a complete run to photogate_wait_run and re-arms the gates.
+static void hand_over_run(Photogate *gate) {
+    if (gate->current.count == gate->config.count) {
+        (void) pthread_mutex_lock(&gate->lock);
+        gate->completed = gate->current;
+        gate->completed_ready = 1;
+        gate->runs++;
+        (void) pthread_cond_signal(&gate->done);
+        (void) pthread_mutex_unlock(&gate->lock);
+
+        reset_run(gate);
+    }
+}
+
+
+static void *sampler_thread_func(void *arg) {
+    Photogate *gate = (Photogate *) arg;
+    uint32_t masks[GPIO_BANK_COUNT] = { 0U, 0U, 0U, 0U };
+    uint32_t levels[GPIO_BANK_COUNT] = { 0U, 0U, 0U, 0U };
+    int64_t next_ns = rt_now_ns();
+    int64_t prev_sample_ns = next_ns;
+    int32_t i = 0;
+    int32_t bank = 0;
+
+    for (i = 0; i < gate->config.count; i++) {
+        masks[GPIO_BANK_OF(gate->config.pins[i])] |= GPIO_BIT_OF(gate->config.pins[i]);
+    }
+
+    while (atomic_load(&gate->stop_requested) == 0) {
+        int64_t read_start_ns = rt_now_ns();
+        int64_t sample_ns = 0;
+        int64_t gap_ns = 0;
+        int32_t failed = 0;
+
+        for (bank = 0; bank < GPIO_BANK_COUNT; bank++) {
+            if (masks[bank] != 0U && gpio_bank_read(bank, masks[bank], &levels[bank]) != 1) {
+                failed = 1;
+            }
+        }
+
+        // One timestamp per sample: the edges seen now happened between the previous sample and this one.
+        sample_ns = rt_now_ns();
+        gap_ns = sample_ns - prev_sample_ns;
+        prev_sample_ns = sample_ns;
+
+        if (failed == 0) {
+            for (i = 0; i < gate->config.count; i++) {
+                int32_t pin = gate->config.pins[i];
+                int32_t level = ((levels[GPIO_BANK_OF(pin)] & GPIO_BIT_OF(pin)) != 0U) ? 1 : 0;
+
+                update_gate(gate, i, (level == gate->config.active_level) ? 1 : 0, sample_ns, gap_ns);
+            }
+        }
+
+        (void) pthread_mutex_lock(&gate->lock);
+        gate->sampler.samples++;
+        gate->sampler.sum_gap_ns += gap_ns;
+        if (gap_ns > gate->sampler.max_gap_ns && gate->sampler.samples > 1U) {
+            gate->sampler.max_gap_ns = gap_ns;
+        }
+        if (sample_ns - read_start_ns > gate->sampler.max_read_ns) {
+            gate->sampler.max_read_ns = sample_ns - read_start_ns;
+        }
+        if (failed == 1) {
+            gate->sampler.read_failures++;
+        }
+        (void) pthread_mutex_unlock(&gate->lock);
+
+        hand_over_run(gate);
+
+        next_ns += gate->config.sample_ns;
+        // Don't try to catch up on samples missed by a slow backend, just keep the period from here.
+        if (next_ns < sample_ns) {
+            next_ns = sample_ns;
+        }
+        rt_sleep_until_ns(next_ns);
+    }
+
+    return NULL;
+}
+
+
+// Time left before the pending break of a gate can be confirmed, INT64_MAX if there is none.
+static int64_t confirm_in_ns(const Photogate *gate, int32_t index, int64_t now_ns) {
+    int64_t result = INT64_MAX;
+
+    if (index == gate->current.count && gate->pending_since_ns[index] >= 0) {
+        result = (gate->pending_since_ns[index] + gate->config.min_break_ns) - now_ns;
+    }
+
+    return result;
+}
+
+
+static void *edge_thread_func(void *arg) {
+    Photogate *gate = (Photogate *) arg;
+    int32_t active[PHOTOGATE_MAX_GATES];
+    int32_t i = 0;
+
+    for (i = 0; i < gate->config.count; i++) {
+        active[i] = (gate->inputs.pins[i].last_level == gate->config.active_level) ? 1 : 0;
+    }
+
+    while (atomic_load(&gate->stop_requested) == 0) {
+        GpioEvent event;
+        int64_t wait_ns = (int64_t) PHOTOGATE_STOP_CHECK_MS * NS_PER_MS;
+        int64_t now_ns = rt_now_ns();
+        int32_t ready = 0;
+
+        // Sleep until the next edge, or until a pending break has lasted min_break_ns.
+        for (i = 0; i < gate->config.count; i++) {
+            int64_t t_ns = confirm_in_ns(gate, i, now_ns);
+
+            if (t_ns < wait_ns) {
+                wait_ns = (t_ns > 0) ? t_ns : 0;
+            }
+        }
+        ready = gpio_input_wait(&gate->inputs, &event, (int32_t) ((wait_ns + NS_PER_MS - 1) / NS_PER_MS));
+        now_ns = rt_now_ns();
+
+        (void) pthread_mutex_lock(&gate->lock);
+        gate->sampler.samples++;
+        if (ready < 0) {
+            gate->sampler.read_failures++;
+        }
+        (void) pthread_mutex_unlock(&gate->lock);
+
+        for (i = 0; i < gate->config.count && ready == 1; i++) {
+            if (event.pin == gate->config.pins[i]) {
+                active[i] = (event.value == gate->config.active_level) ? 1 : 0;
+
+                // Only edges are stamped. A pin back from quarantine just takes its level, it may be the middle of a bounce.
+                if (event.type == GPIO_EVENT_EDGE) {
+                    update_gate(gate, i, active[i], event.time_ns, (gate->inputs.pins[i].fd >= 0) ? PHOTOGATE_UNCERTAINTY_UNKNOWN : GPIO_INPUT_POLL_NS);
+                }
+            }
+        }
+
+        // A break that is still on confirms itself with time alone, there is no later edge for it. A gate that broke out
+        // of order is stamped here once its turn comes, long after the break itself.
+        for (i = 0; i < gate->config.count; i++) {
+            if (active[i] == 1 && confirm_in_ns(gate, i, now_ns) <= 0) {
+                update_gate(gate, i, 1, now_ns, PHOTOGATE_UNCERTAINTY_UNKNOWN);
+            }
+        }
+
+        hand_over_run(gate);
+    }
+
+    return NULL;
+}
+
+
+// Adds the gates to an input set in gate order. Returns 1 if every gate can be read.
+static int32_t open_edge_inputs(Photogate *gate) {
+    GpioInputLimits limits;
+    int32_t result = 1;
+    int32_t i = 0;
+
+    limits.holdoff_ns = 0;
+    limits.storm_rate = PHOTOGATE_STORM_RATE;
+    limits.storm_burst = PHOTOGATE_STORM_BURST;
+    limits.quarantine_ns = PHOTOGATE_QUARANTINE_NS;
+    gpio_input_init(&gate->inputs, &limits);
+
+    for (i = 0; i < gate->config.count && result == 1; i++) {
+        result = gpio_input_add(&gate->inputs, gate->config.pins[i]);
+    }
+    if (result != 1) {
+        gpio_input_close(&gate->inputs);
+    }
+
+    return result;
+}
+
+
+void photogate_default_config(PhotogateConfig *config) {
+    (void) memset(config, 0, sizeof(*config));
+    config->active_level = 1;
+    config->mode = PHOTOGATE_MODE_EDGES;
+    config->sample_ns = PHOTOGATE_DEFAULT_SAMPLE_NS;
+    config->min_break_ns = PHOTOGATE_DEFAULT_MIN_BREAK_NS;
+}
+
+
+int32_t photogate_start(Photogate *gate, const PhotogateConfig *config, int32_t priority) {
+    int32_t result = 0;
+
+    int32_t sampled = (config->mode == PHOTOGATE_MODE_SAMPLED) ? 1 : 0;
+
+    if (config->count >= 2 && config->count <= PHOTOGATE_MAX_GATES && config->sample_ns > 0 && config->min_break_ns >= 0 &&
+        (config->mode == PHOTOGATE_MODE_EDGES || (sampled == 1 && gpio_bank_backend() != GPIO_BACKEND_SYSFS))) {
+        (void) memset(gate, 0, sizeof(*gate));
+        gate->config = *config;
+        reset_run(gate);
+        atomic_init(&gate->stop_requested, 0);
+
+        if ((sampled == 1 || open_edge_inputs(gate) == 1) &&
+            pthread_mutex_init(&gate->lock, NULL) == 0 && pthread_cond_init(&gate->done, NULL) == 0 &&
+            rt_thread_start(&gate->thread, priority, (sampled == 1) ? &sampler_thread_func : &edge_thread_func, gate) == 0) {
+            result = 1;
+        }
+        else if (sampled == 0) {
+            gpio_input_close(&gate->inputs);
+        }
+        else {
+        }
+    }
+
+    return result;
+}
+
+
+int32_t photogate_wait_run(Photogate *gate, PhotogateRun *run, int32_t timeout_ms) {
+    int32_t result = 0;
+    int32_t error = 0;
+    struct timespec deadline;
+
+    // pthread_cond_timedwait wants CLOCK_REALTIME.
+    (void) clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms >= 0) {
+        int64_t ns = ((int64_t) deadline.tv_nsec) + ((int64_t) timeout_ms * NS_PER_MS);
+
+        deadline.tv_sec += (time_t) (ns / NS_PER_SEC);
+        deadline.tv_nsec = (long) (ns % NS_PER_SEC);
+    }
+
+    (void) pthread_mutex_lock(&gate->lock);
+    while (gate->completed_ready == 0 && error != ETIMEDOUT) {
+        if (timeout_ms < 0) {
+            (void) pthread_cond_wait(&gate->done, &gate->lock);
+        }
+        else {
+            error = pthread_cond_timedwait(&gate->done, &gate->lock, &deadline);
+        }
+    }
+    if (gate->completed_ready == 1) {
+        *run = gate->completed;
+        gate->completed_ready = 0;
+        result = 1;
+    }
+    (void) pthread_mutex_unlock(&gate->lock);
+
+    return result;
+}
+
+
+void photogate_stop(Photogate *gate) {
+    atomic_store(&gate->stop_requested, 1);
+    (void) pthread_join(gate->thread, NULL);
+
+    if (gate->config.mode == PHOTOGATE_MODE_EDGES) {
+        gpio_input_close(&gate->inputs);
+    }
+}
+
+
+int64_t photogate_elapsed_ns(const PhotogateRun *run, int32_t index) {
+    int64_t result = -1;
+
+    if (index > 0 && index < run->count) {
+        result = run->time_ns[index] - run->time_ns[0];
+    }
+
+    return result;
+}
+
+
+void photogate_print_run(const PhotogateRun *run) {
+    int32_t i = 0;
+
+    for (i = 1; i < run->count; i++) {
+        (void) printf("  %s %d: %.6f s", (i == run->count - 1) ? "Stop " : "Split", i, (double) photogate_elapsed_ns(run, i) / (double) NS_PER_SEC);
+
+        // Both ends of the interval are uncertain, each by the sample gap before its trigger.
+        if (run->uncertainty_ns[0] == PHOTOGATE_UNCERTAINTY_UNKNOWN || run->uncertainty_ns[i] == PHOTOGATE_UNCERTAINTY_UNKNOWN) {
+            (void) printf(" (+/- unknown, edge interrupt latency)\n");
+        }
+        else {
+            (void) printf(" (+/- %.1f us)\n",
+                          (double) (run->uncertainty_ns[0] > run->uncertainty_ns[i] ? run->uncertainty_ns[0] : run->uncertainty_ns[i]) / 1e3);
+        }
+    }
+    (void) printf("  Rejected: %u glitches, %u bounces\n", run->rejected_glitches, run->rejected_bounces);
+}
+
+
+void photogate_print_resolution(Photogate *gate) {
+    PhotogateSamplerStats stats;
+    int32_t i = 0;
+
+    (void) pthread_mutex_lock(&gate->lock);
+    stats = gate->sampler;
+    (void) pthread_mutex_unlock(&gate->lock);
+
+    if (gate->config.mode == PHOTOGATE_MODE_EDGES) {
+        (void) printf("Photogate on edge interrupts: %llu wakeups, %llu wait failures\n", (unsigned long long) stats.samples,
+                      (unsigned long long) stats.read_failures);
+        // The fds don't change while the gate thread runs, only at start and stop.
+        for (i = 0; i < gate->inputs.count; i++) {
+            if (gate->inputs.pins[i].fd >= 0) {
+                (void) printf("  gate %d (GPIO %d): edge interrupt, resolution is the interrupt and wakeup latency (unknown, not measurable from user space)\n", i,
+                              gate->inputs.pins[i].pin);
+            }
+            else {
+                (void) printf("  gate %d (GPIO %d): no edge interrupt, sampled every %.1f ms\n", i, gate->inputs.pins[i].pin,
+                              (double) GPIO_INPUT_POLL_NS / 1e6);
+            }
+        }
+    }
+    else {
+        (void) printf("Photogate sampler (%s backend, %.1f us period):\n", gpio_bank_backend_name(gpio_bank_backend()),
+                      (double) gate->config.sample_ns / 1e3);
+        (void) printf("  %llu samples, read failures %llu, longest read of all gates %.1f us\n", (unsigned long long) stats.samples,
+                      (unsigned long long) stats.read_failures, (double) stats.max_read_ns / 1e3);
+        (void) printf("  resolution: avg %.1f us, worst %.1f us between samples\n",
+                      (stats.samples > 0U) ? ((double) stats.sum_gap_ns / (1e3 * (double) stats.samples)) : 0.0, (double) stats.max_gap_ns / 1e3);
+    }
+}
@@ -0,0 +1,159 @@
+/*
+This file is for defining the photogate (light gate) timer used by the stopwatch gate mode.
+Instead of a human pressing the start/stop button, the first gate of a run starts it, optional middle gates record
+splits and the last gate stops it. Every time is the difference of two edge timestamps, nothing is accumulated in a loop.
+
+The gates are watched in one of two modes (PhotogateConfig.mode):
+- PHOTOGATE_MODE_EDGES (default): the gates are a gpioinput.h set with edge interrupts. The thread sleeps in poll() and
+  only wakes up for an edge, for a break to be confirmed (min_break_ns) and every PHOTOGATE_STOP_CHECK_MS to see if it
+  must stop, so idle gates cost ~10 wakeups per second. An edge is stamped with the time poll() returned for it: the
+  interrupt and wakeup latency before that can't be measured from user space, so its uncertainty is
+  PHOTOGATE_UNCERTAINTY_UNKNOWN and is printed as unknown. A pin without edge support is sampled by gpioinput every
+  GPIO_INPUT_POLL_NS and gets that as its uncertainty.
+- PHOTOGATE_MODE_SAMPLED (opt in, MMAP or SIM backend only): a sampler thread reads the gate banks through gpiobank.h
+  every sample_ns on absolute deadlines. An edge is stamped with the time of the first sample that saw it, so its
+  uncertainty is the gap since the previous sample, and the sampler measures those gaps. It gives a known bound on
+  every stamp (a few us with mmap reads), but it never sleeps for long: at the default 100 us period it wakes up
+  10000 times a second, and at a SCHED_FIFO priority on the single core of the BeagleBone it takes a large share of
+  the CPU from everything else for as long as the gates are watched. Sysfs is refused, it would need one file read
+  per pin per sample.
+
+Bounce rejection, per gate:
+- A gate only triggers once its level has stayed active for min_break_ns. Shorter pulses are rejected as glitches,
+  but a confirmed trigger keeps the timestamp of its first active sample.
+- Once a gate has triggered, further edges on it are bounces and are ignored for the rest of the run.
+- Gates must trigger in order; a later gate breaking before an earlier one is ignored.
+When the last gate triggers the run is complete, it is handed to photogate_wait_run and the gates are re-armed.
+*/
+
+#ifndef PHOTOGATE_H
+#define PHOTOGATE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "gpioinput.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// Start gate, up to 6 split gates and the stop gate.
+#define PHOTOGATE_MAX_GATES ((int32_t) 8)
+
+#define PHOTOGATE_DEFAULT_SAMPLE_NS ((int64_t) 100000)
+
+#define PHOTOGATE_DEFAULT_MIN_BREAK_NS ((int64_t) 500000)
+
+#define PHOTOGATE_MODE_EDGES ((int32_t) 0)
+
+#define PHOTOGATE_MODE_SAMPLED ((int32_t) 1)
+
+// Longest an edge mode thread sleeps without an edge, so a stop is noticed.
+#define PHOTOGATE_STOP_CHECK_MS ((int32_t) 100)
+
+// Edge mode input limits: every edge is delivered (no hold-off, the gates debounce themselves), and a storm budget
+// wide enough for a bouncing gate but not for a floating line.
+#define PHOTOGATE_STORM_RATE ((int32_t) 2000)
+
+#define PHOTOGATE_STORM_BURST ((int32_t) 200)
+
+#define PHOTOGATE_QUARANTINE_NS ((int64_t) 1000000000)
+
+// Uncertainty of a stamp taken on an edge interrupt wakeup, whose latency is not known.
+#define PHOTOGATE_UNCERTAINTY_UNKNOWN ((int64_t) -1)
+
+
+typedef struct {
+    int32_t pins[PHOTOGATE_MAX_GATES];  // GPIO numbers in order: start, splits..., stop
+    int32_t count;                      // At least 2
+    int32_t active_level;               // Level the gate output has while the beam is broken
+    int32_t mode;                       // PHOTOGATE_MODE_EDGES or PHOTOGATE_MODE_SAMPLED
+    int64_t sample_ns;                  // Sampling period (SAMPLED mode)
+    int64_t min_break_ns;               // Shortest beam break that counts
+} PhotogateConfig;
+
+typedef struct {
+    int64_t time_ns[PHOTOGATE_MAX_GATES];           // When each gate triggered
+    int64_t uncertainty_ns[PHOTOGATE_MAX_GATES];    // How much earlier the edge may have happened, or PHOTOGATE_UNCERTAINTY_UNKNOWN
+    int32_t count;
+    uint32_t rejected_glitches;
+    uint32_t rejected_bounces;
+} PhotogateRun;
+
+// In EDGES mode samples counts the wakeups, read_failures the failed waits and the rest stays 0.
+typedef struct {
+    uint64_t samples;
+    uint64_t read_failures;
+    int64_t max_gap_ns;
+    int64_t sum_gap_ns;
+    int64_t max_read_ns;        // Longest time to read all the gate banks once
+} PhotogateSamplerStats;
+
+typedef struct {
+    PhotogateConfig config;
+    PhotogateRun current;                   // Run being recorded (gate thread only)
+    int64_t pending_since_ns[PHOTOGATE_MAX_GATES];  // First active sample of a gate that is not confirmed yet, -1 if none
+    PhotogateRun completed;
+    int32_t completed_ready;
+    uint32_t runs;
+    PhotogateSamplerStats sampler;
+    GpioInputSet inputs;                    // The gates in EDGES mode (gate thread only once started)
+    pthread_mutex_t lock;                   // Protects completed, completed_ready, runs and sampler
+    pthread_cond_t done;
+    atomic_int stop_requested;
+    pthread_t thread;
+} Photogate;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Fills a configuration with EDGES mode, the default sampling period and minimum break and no gates.
+// Parameters: config - The configuration
+void photogate_default_config(PhotogateConfig *config);
+
+
+// Description: Starts watching the gates. The gate pins must already be set up as inputs. EDGES mode turns their edge
+// interrupts on, SAMPLED mode reads them with the currently open gpio_bank backend (see gpio_bank_open).
+// Parameters:
+// gate     - The photogate
+// config   - Gates and timing. Copied.
+// priority - SCHED_FIFO priority of the gate thread (see rt_thread_start)
+// Returns - 1 on success, 0 if the configuration is invalid (SAMPLED on the SYSFS backend included), a gate can't be
+// read or the thread can't be started.
+int32_t photogate_start(Photogate *gate, const PhotogateConfig *config, int32_t priority);
+
+
+// Description: Waits for the next completed run.
+// Parameters:
+// gate       - A started photogate
+// run        - Where the run is copied
+// timeout_ms - Maximum time to wait, -1 to wait forever
+// Returns - 1 if a run was copied, 0 on timeout.
+int32_t photogate_wait_run(Photogate *gate, PhotogateRun *run, int32_t timeout_ms);
+
+
+// Description: Stops the gate thread (and turns the edge interrupts off in EDGES mode).
+// Parameters: gate - A started photogate
+void photogate_stop(Photogate *gate);
+
+
+// Description: Time from the start gate to a gate of a run, purely from the two timestamps.
+// Parameters:
+// run   - A completed run
+// index - Gate index (1 for the first split, run->count - 1 for the stop gate)
+// Returns - Nanoseconds, or -1 for an invalid index.
+int64_t photogate_elapsed_ns(const PhotogateRun *run, int32_t index);
+
+
+// Description: Prints the times of a run with their uncertainty and the rejected edges to stdout.
+// Parameters: run - A completed run
+void photogate_print_run(const PhotogateRun *run);
+
+
+// Description: Prints the achieved resolution to stdout: sample gaps and read time in SAMPLED mode, interrupt or
+// sampled gates and their edge counts in EDGES mode.
+// Parameters: gate - The photogate
+void photogate_print_resolution(Photogate *gate);
+
+
+#endif // End of include guard
@@ -0,0 +1,88 @@
+/*
+This file is for defining USDT (user space statically defined tracing) probes: named points in the code that perf,
+bpftrace or systemtap can attach to in a running program, without rebuilding it and without a debug build.
+For example, every sysfs write of the stopwatch with its duration:
+    bpftrace -e 'usdt:./stopwatch:bbbio:write_gpio_value_return { @us = hist(arg3 / 1000); }'
+
+A probe is a single nop instruction plus a note in the ELF file that tells the tracer where the nop is and where its
+arguments live. Nothing is evaluated or called while no tracer is attached. The only real cost is measuring the
+duration passed to the _return probes, so every probe has a semaphore: a counter in the .probes section that the
+tracer increments while it is attached. BBB_PROBE_START reads the clock only when it is non zero.
+
+Probes come from <sys/sdt.h> (systemtap-sdt-dev). Without it, or when built with -DBBB_NO_PROBES, every macro here
+compiles to nothing (the probe arguments aren't evaluated).
+
+A probe's semaphore must be defined once in the file that uses it, with BBB_PROBE_SEMAPHORE at file scope.
+
+Sources:
+https://sourceware.org/systemtap/wiki/UserSpaceProbeImplementation
+https://github.com/bpftrace/bpftrace/blob/master/man/adoc/bpftrace.adoc (usdt probes)
+*/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__has_include) && !defined(BBB_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#define BBB_PROBES ((int32_t) 1)
+#endif
+#endif
+
+#ifdef BBB_PROBES
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define BBB_PROBE_SEMAPHORE(PROVIDER, NAME) unsigned short PROVIDER##_##NAME##_semaphore __attribute__((unused, section(".probes")))
+
+// 1 while a tracer is attached to the probe.
+#define BBB_PROBE_ACTIVE(PROVIDER, NAME) (__builtin_expect(PROVIDER##_##NAME##_semaphore != 0U, 0))
+
+#define BBB_PROBE1(PROVIDER, NAME, A) STAP_PROBE1(PROVIDER, NAME, A)
+
+#define BBB_PROBE2(PROVIDER, NAME, A, B) STAP_PROBE2(PROVIDER, NAME, A, B)
+
+#define BBB_PROBE3(PROVIDER, NAME, A, B, C) STAP_PROBE3(PROVIDER, NAME, A, B, C)
+
+#define BBB_PROBE4(PROVIDER, NAME, A, B, C, D) STAP_PROBE4(PROVIDER, NAME, A, B, C, D)
+
+#else
+
+// Keeps the trailing ';' of a semaphore definition valid at file scope.
+#define BBB_PROBE_SEMAPHORE(PROVIDER, NAME) extern int32_t bbb_no_probe_##PROVIDER##_##NAME
+
+#define BBB_PROBE_ACTIVE(PROVIDER, NAME) (0)
+
+// The arguments only go through sizeof (+ 0 so an array parameter decays): never evaluated, but a variable kept for a
+// probe (probe_start) still counts as used.
+#define BBB_PROBE1(PROVIDER, NAME, A) do { (void) sizeof((A) + 0); } while (0)
+
+#define BBB_PROBE2(PROVIDER, NAME, A, B) do { (void) sizeof((A) + 0); (void) sizeof((B) + 0); } while (0)
+
+#define BBB_PROBE3(PROVIDER, NAME, A, B, C) do { (void) sizeof((A) + 0); (void) sizeof((B) + 0); (void) sizeof((C) + 0); } while (0)
+
+#define BBB_PROBE4(PROVIDER, NAME, A, B, C, D) do { (void) sizeof((A) + 0); (void) sizeof((B) + 0); (void) sizeof((C) + 0); (void) sizeof((D) + 0); } while (0)
+
+#endif
+
+
+// CLOCK_MONOTONIC in nanoseconds (bbbio doesn't depend on rtutil).
+static inline int64_t bbb_probe_now_ns(void) {
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((int64_t) now.tv_sec * (int64_t) 1000000000) + (int64_t) now.tv_nsec;
+}
+
+// Start time of a probed call, 0 (no clock read) unless a tracer is attached to the probe.
+#define BBB_PROBE_START(PROVIDER, NAME) (BBB_PROBE_ACTIVE(PROVIDER, NAME) ? bbb_probe_now_ns() : (int64_t) 0)
+
+// Nanoseconds since BBB_PROBE_START, 0 if it didn't read the clock.
+#define BBB_PROBE_ELAPSED(START) (((START) != 0) ? (bbb_probe_now_ns() - (START)) : (int64_t) 0)
+
+
+#endif // End of include guard
@@ -0,0 +1,289 @@
+/*
+This file implements all the functions defined in pwmbox.h.
+Each mailbox is one 64 bit word: MAILBOX_PENDING, the duty cycle in bits 32 to 62 and the period in bits 0 to 31, or 0
+once the applier took it. One word means a post and a take are a single atomic exchange, with no torn period / duty
+pairs.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN PWMBOX.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "rtutil.h"
+#include "bbbio_fast.h"
+#include "pwmbox.h"
+
+
+#define MAILBOX_PENDING ((uint64_t) 1U << 63)
+
+typedef struct {
+    Buffer name;
+    PwmHandle pwm;              // All fds -1 for a simulated channel
+    uint32_t period_ns;         // Values the channel has now
+    uint32_t duty_ns;
+    int64_t next_apply_ns;
+} Channel;
+
+static Channel channels[PWMBOX_MAX_CHANNELS];
+
+static int32_t channel_count = 0;
+
+static _Atomic uint64_t mailboxes[PWMBOX_MAX_CHANNELS];
+
+static atomic_int stop_requested;
+
+static int32_t started = 0;
+
+// Set by pwmbox_stop: the channels are closed and only their counters are left. The next pwmbox_open starts over.
+static int32_t closed = 0;
+
+static int64_t apply_period_ns = PWMBOX_EVERY_PWM_PERIOD;
+
+static pthread_t applier_thread;
+
+// Posts and coalesced are written by the posters, the rest by the applier, and all are read by pwmbox_get_stats.
+static atomic_ullong stat_posts[PWMBOX_MAX_CHANNELS];
+static atomic_ullong stat_coalesced[PWMBOX_MAX_CHANNELS];
+static atomic_ullong stat_applies[PWMBOX_MAX_CHANNELS];
+static atomic_ullong stat_period_writes[PWMBOX_MAX_CHANNELS];
+static atomic_ullong stat_duty_writes[PWMBOX_MAX_CHANNELS];
+static atomic_ullong stat_failed_writes[PWMBOX_MAX_CHANNELS];
+static atomic_uint stat_period_ns[PWMBOX_MAX_CHANNELS];
+static atomic_uint stat_duty_ns[PWMBOX_MAX_CHANNELS];
+
+
+static void write_period(int32_t c, uint32_t period_ns) {
+    Channel *ch = &channels[c];
+
+    if (period_ns != ch->period_ns) {
+        (void) atomic_fetch_add(&stat_period_writes[c], 1ULL);
+        if (ch->pwm.period_fd < 0 || write_pwm_period_fast(&ch->pwm, period_ns) == 1) {
+            ch->period_ns = period_ns;
+        }
+        else {
+            (void) atomic_fetch_add(&stat_failed_writes[c], 1ULL);
+        }
+    }
+}
+
+
+static void write_duty(int32_t c, uint32_t duty_ns) {
+    Channel *ch = &channels[c];
+
+    if (duty_ns != ch->duty_ns) {
+        (void) atomic_fetch_add(&stat_duty_writes[c], 1ULL);
+        if (ch->pwm.duty_fd < 0 || write_pwm_duty_fast(&ch->pwm, duty_ns) == 1) {
+            ch->duty_ns = duty_ns;
+        }
+        else {
+            (void) atomic_fetch_add(&stat_failed_writes[c], 1ULL);
+        }
+    }
+}
+
+
+// Takes a channel's mailbox and writes what changed, keeping duty <= period after every write.
+static void apply_channel(int32_t c) {
+    uint64_t slot = atomic_exchange(&mailboxes[c], 0U);
+
+    if ((slot & MAILBOX_PENDING) != 0U) {
+        uint32_t period_ns = (uint32_t) slot;
+        uint32_t duty_ns = (uint32_t) ((slot & ~MAILBOX_PENDING) >> 32);
+
+        (void) atomic_fetch_add(&stat_applies[c], 1ULL);
+        if (period_ns >= channels[c].period_ns) {
+            write_period(c, period_ns);
+            write_duty(c, duty_ns);
+        }
+        else {
+            write_duty(c, duty_ns);
+            write_period(c, period_ns);
+        }
+        atomic_store(&stat_period_ns[c], channels[c].period_ns);
+        atomic_store(&stat_duty_ns[c], channels[c].duty_ns);
+    }
+}
+
+
+static int64_t apply_interval_ns(int32_t c) {
+    int64_t interval_ns = (apply_period_ns > 0) ? apply_period_ns : (int64_t) channels[c].period_ns;
+
+    return (interval_ns > PWMBOX_MIN_APPLY_NS) ? interval_ns : PWMBOX_MIN_APPLY_NS;
+}
+
+
+static void *applier_thread_func(void *arg) {
+    int32_t c = 0;
+
+    (void) arg;
+
+    for (c = 0; c < channel_count; c++) {
+        channels[c].next_apply_ns = rt_now_ns() + apply_interval_ns(c);
+    }
+
+    while (atomic_load(&stop_requested) == 0) {
+        int64_t next_ns = INT64_MAX;
+        int64_t now_ns = 0;
+
+        for (c = 0; c < channel_count; c++) {
+            if (channels[c].next_apply_ns < next_ns) {
+                next_ns = channels[c].next_apply_ns;
+            }
+        }
+        rt_sleep_until_ns(next_ns);
+        now_ns = rt_now_ns();
+
+        for (c = 0; c < channel_count; c++) {
+            if (now_ns >= channels[c].next_apply_ns) {
+                apply_channel(c);
+
+                // Stay on the channel's own grid, skipping any periods we missed.
+                while (channels[c].next_apply_ns <= now_ns) {
+                    channels[c].next_apply_ns += apply_interval_ns(c);
+                }
+            }
+        }
+    }
+
+    // Whatever was posted before the stop still goes out.
+    for (c = 0; c < channel_count; c++) {
+        apply_channel(c);
+    }
+
+    return NULL;
+}
+
+
+int32_t pwmbox_open(Buffer pin_identifier, int32_t frequency) {
+    int32_t result = -1;
+
+    if (started == 0 && closed == 1) {
+        channel_count = 0;
+        closed = 0;
+    }
+
+    if (started == 0 && channel_count < PWMBOX_MAX_CHANNELS && frequency > 0) {
+        Channel *ch = &channels[channel_count];
+        int32_t ok = 0;
+
+        (void) memset(ch, 0, sizeof(*ch));
+        clear_pwm_handle(&ch->pwm);
+        // The channel starts at 1 %.
+        ch->period_ns = pwm_period_ns(frequency);
+        ch->duty_ns = (uint32_t) ((float32_t) ch->period_ns / 100.0f);
+
+        if (pin_identifier == NULL) {
+            (void) snprintf((char *) ch->name, sizeof(ch->name), "sim%d", channel_count);
+            ok = 1;
+        }
+        else {
+            (void) snprintf((char *) ch->name, sizeof(ch->name), "%s", (char *) pin_identifier);
+            ok = open_pwm_channel(pin_identifier, frequency, 1.0f, PWM_ON, &ch->pwm);
+        }
+
+        if (ok == 1) {
+            atomic_store(&mailboxes[channel_count], 0U);
+            atomic_store(&stat_posts[channel_count], 0ULL);
+            atomic_store(&stat_coalesced[channel_count], 0ULL);
+            atomic_store(&stat_applies[channel_count], 0ULL);
+            atomic_store(&stat_period_writes[channel_count], 0ULL);
+            atomic_store(&stat_duty_writes[channel_count], 0ULL);
+            atomic_store(&stat_failed_writes[channel_count], 0ULL);
+            atomic_store(&stat_period_ns[channel_count], ch->period_ns);
+            atomic_store(&stat_duty_ns[channel_count], ch->duty_ns);
+            result = channel_count;
+            channel_count++;
+        }
+    }
+
+    return result;
+}
+
+
+int32_t pwmbox_start(int64_t period_ns, int32_t priority) {
+    int32_t result = 0;
+
+    if (started == 0 && closed == 0 && channel_count > 0 && period_ns >= 0) {
+        apply_period_ns = period_ns;
+        atomic_store(&stop_requested, 0);
+
+        if (rt_thread_start(&applier_thread, priority, &applier_thread_func, NULL) == 0) {
+            started = 1;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+void pwmbox_stop(void) {
+    int32_t c = 0;
+
+    if (started == 1) {
+        atomic_store(&stop_requested, 1);
+        (void) pthread_join(applier_thread, NULL);
+        started = 0;
+    }
+
+    for (c = 0; c < channel_count; c++) {
+        close_pwm_handle(&channels[c].pwm);
+    }
+    closed = 1;
+}
+
+
+int32_t pwmbox_post(int32_t channel, uint32_t period_ns, uint32_t duty_ns) {
+    int32_t result = 0;
+
+    if (closed == 0 && channel >= 0 && channel < channel_count && period_ns > 0U && duty_ns <= period_ns && duty_ns <= PWMBOX_MAX_DUTY_NS) {
+        uint64_t previous = atomic_exchange(&mailboxes[channel], MAILBOX_PENDING | ((uint64_t) duty_ns << 32) | (uint64_t) period_ns);
+
+        (void) atomic_fetch_add_explicit(&stat_posts[channel], 1ULL, memory_order_relaxed);
+        if ((previous & MAILBOX_PENDING) != 0U) {
+            (void) atomic_fetch_add_explicit(&stat_coalesced[channel], 1ULL, memory_order_relaxed);
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+
+void pwmbox_get_stats(int32_t channel, PwmboxStats *stats) {
+    (void) memset(stats, 0, sizeof(*stats));
+
+    if (channel >= 0 && channel < channel_count) {
+        stats->posts = atomic_load(&stat_posts[channel]);
+        stats->coalesced = atomic_load(&stat_coalesced[channel]);
+        stats->applies = atomic_load(&stat_applies[channel]);
+        stats->period_writes = atomic_load(&stat_period_writes[channel]);
+        stats->duty_writes = atomic_load(&stat_duty_writes[channel]);
+        stats->failed_writes = atomic_load(&stat_failed_writes[channel]);
+        stats->period_ns = atomic_load(&stat_period_ns[channel]);
+        stats->duty_ns = atomic_load(&stat_duty_ns[channel]);
+    }
+}
+
+
+void pwmbox_print_stats(void) {
+    int32_t c = 0;
+
+    (void) printf("PWM mailbox (%s):\n", (apply_period_ns > 0) ? "fixed apply rate" : "applied once per PWM period");
+    (void) printf("  channel  posts       applies     post/apply  writes (period + duty)  failed   now (period / duty ns)\n");
+
+    for (c = 0; c < channel_count; c++) {
+        PwmboxStats s;
+
+        pwmbox_get_stats(c, &s);
+        (void) printf("  %-8s %-11llu %-11llu %-11.1f %-23llu %-8llu %u / %u\n", (char *) channels[c].name,
+                      (unsigned long long) s.posts, (unsigned long long) s.applies,
+                      (s.applies > 0U) ? ((double) s.posts / (double) s.applies) : 0.0,
+                      (unsigned long long) (s.period_writes + s.duty_writes), (unsigned long long) s.failed_writes,
+                      s.period_ns, s.duty_ns);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+This file is for defining a PWM update mailbox: producers that change a duty cycle far more often than the PWM can show
+it (a control loop, a UI slider) post to the mailbox instead of calling set_pwm_duty_cycle, which opens, writes and
+closes a sysfs file every time.
+
+- A post stores the period and duty cycle in the channel's mailbox with one atomic exchange. It never blocks and never
+  makes a system call, from any number of threads. The last post wins.
+- An applier thread takes each channel's mailbox once per PWM period of that channel (the hardware only picks up a new
+  duty cycle at the end of a period anyway), or at a fixed rate given to pwmbox_start, and writes what changed through
+  period and duty_cycle files it keeps open.
+- The kernel refuses a duty cycle longer than the period at any moment, so when both change the applier writes the
+  period first if it grows and the duty cycle first if it shrinks.
+
+Posts that were overwritten before the applier took them are counted, the post / apply ratio is the sysfs traffic
+avoided.
+
+Sources:
+https://www.kernel.org/doc/Documentation/pwm.txt
+*/
+
+#ifndef PWMBOX_H
+#define PWMBOX_H
+
+#include <stdint.h>
+#include "bbbio.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+// The four channels of the two EHRPWM modules (1A, 1B, 2A, 2B).
+#define PWMBOX_MAX_CHANNELS ((int32_t) 4)
+
+// pwmbox_start rate: each channel once per its PWM period.
+#define PWMBOX_EVERY_PWM_PERIOD ((int64_t) 0)
+
+// Shortest time between two applies of a channel, for PWM periods shorter than a thread can usefully wake up.
+#define PWMBOX_MIN_APPLY_NS ((int64_t) 1000000)
+
+// Longest period and duty cycle a post can carry.
+#define PWMBOX_MAX_PERIOD_NS ((uint32_t) 0xFFFFFFFFU)
+
+#define PWMBOX_MAX_DUTY_NS ((uint32_t) 0x7FFFFFFFU)
+
+
+typedef struct {
+    uint64_t posts;             // pwmbox_post calls accepted
+    uint64_t coalesced;         // Posts overwritten by a later post before they were applied
+    uint64_t applies;           // Mailbox values taken by the applier
+    uint64_t period_writes;     // sysfs writes actually done
+    uint64_t duty_writes;
+    uint64_t failed_writes;
+    uint32_t period_ns;         // Last applied values
+    uint32_t duty_ns;
+} PwmboxStats;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Sets up and opens a PWM channel (open_pwm_channel) for the applier. Open the channels before
+// pwmbox_start. The first pwmbox_open after a pwmbox_stop starts a new set of channels from 0.
+// Parameters:
+// pin_identifier - PWM channel, e.g. "1A", or NULL for a simulated channel (only the counters and the applied values)
+// frequency      - Starting PWM frequency in Hz
+// Returns - The channel number for pwmbox_post, -1 on failure (no such channel, all PWMBOX_MAX_CHANNELS open).
+int32_t pwmbox_open(Buffer pin_identifier, int32_t frequency);
+
+
+// Description: Starts the applier thread.
+// Parameters:
+// apply_period_ns - How often each channel is applied, PWMBOX_EVERY_PWM_PERIOD for once per PWM period of the channel
+//                   (at least PWMBOX_MIN_APPLY_NS either way)
+// priority        - Priority of the applier thread (RT_PRIORITY_NONE is fine for anything but a fast control loop)
+// Returns - 1 on success, 0 on failure (already started, stopped without opening the channels again, or the thread
+// could not be created).
+int32_t pwmbox_start(int64_t apply_period_ns, int32_t priority);
+
+
+// Description: Stops the applier after applying what is still posted, and closes the channels. Their counters can
+// still be read until the next pwmbox_open, posts are refused.
+void pwmbox_stop(void);
+
+
+// Description: Posts a new period and duty cycle for a channel. Never blocks and never makes a syscall.
+// Parameters:
+// channel   - From pwmbox_open
+// period_ns - PWM period
+// duty_ns   - Duty cycle, at most period_ns and PWMBOX_MAX_DUTY_NS
+// Returns - 1 if posted, 0 if the channel or the values are invalid.
+int32_t pwmbox_post(int32_t channel, uint32_t period_ns, uint32_t duty_ns);
+
+
+// Description: Copies the counters of a channel.
+// Parameters:
+// channel - From pwmbox_open
+// stats   - Where the counters are copied
+void pwmbox_get_stats(int32_t channel, PwmboxStats *stats);
+
+
+// Description: Prints the post / apply ratio and the writes of every channel to stdout.
+void pwmbox_print_stats(void);
+
+
+#endif // End of include guard
@@ -0,0 +1,59 @@
+/*
+This file implements all the functions defined in rtutil.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN RTUTIL.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <errno.h>
+#include <sched.h>
+#include "rtutil.h"
+
+
+int64_t rt_now_ns(void) {
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((int64_t) now.tv_sec * NS_PER_SEC) + (int64_t) now.tv_nsec;
+}
+
+
+void rt_sleep_until_ns(int64_t deadline_ns) {
+    struct timespec deadline;
+    int32_t ret = 0;
+
+    deadline.tv_sec = (time_t) (deadline_ns / NS_PER_SEC);
+    deadline.tv_nsec = (long) (deadline_ns % NS_PER_SEC);
+
+    // clock_nanosleep returns EINTR if a signal arrives, just go back to sleep until the same deadline.
+    do {
+        ret = (int32_t) clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    } while (ret == EINTR);
+}
+
+
+int32_t rt_thread_start(pthread_t *thread, int32_t priority, void *(*func)(void *), void *arg) {
+    int32_t result = -1;
+    pthread_attr_t attr;
+    struct sched_param param;
+
+    if (priority > RT_PRIORITY_NONE && pthread_attr_init(&attr) == 0) {
+        param.sched_priority = priority;
+
+        if (pthread_attr_setschedpolicy(&attr, SCHED_FIFO) == 0 &&
+            pthread_attr_setschedparam(&attr, &param) == 0 &&
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) == 0) {
+            result = (int32_t) pthread_create(thread, &attr, func, arg);
+        }
+
+        (void) pthread_attr_destroy(&attr);
+    }
+
+    // Either no real-time priority was asked for or we are not allowed to use it.
+    if (result != 0) {
+        result = (int32_t) pthread_create(thread, NULL, func, arg);
+    }
+
+    return result;
+}
@@ -0,0 +1,51 @@
+/*
+This file is for defining small real-time helpers shared by the bbbio modules: monotonic nanosecond timestamps,
+absolute-time sleeping and starting SCHED_FIFO threads.
+Why? Every periodic task needs to sleep until an absolute deadline instead of using usleep, otherwise the time spent
+doing the work (and any preemption) slowly shifts the whole schedule.
+
+Sources:
+https://man7.org/linux/man-pages/man2/clock_nanosleep.2.html
+The TIMER_ABSTIME flag is what lets us sleep until a deadline rather than for a duration.
+*/
+
+#ifndef RTUTIL_H
+#define RTUTIL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define NS_PER_SEC ((int64_t) 1000000000)
+
+#define NS_PER_MS ((int64_t) 1000000)
+
+#define NS_PER_US ((int64_t) 1000)
+
+// Pass this as the priority to rt_thread_start to create a normal (non real-time) thread.
+#define RT_PRIORITY_NONE ((int32_t) 0)
+
+
+// Description: Returns the current CLOCK_MONOTONIC time in nanoseconds.
+int64_t rt_now_ns(void);
+
+
+// Description: Sleeps until the given CLOCK_MONOTONIC time. Returns immediately if the deadline already passed.
+// Parameters:
+// deadline_ns - Absolute CLOCK_MONOTONIC time in nanoseconds
+void rt_sleep_until_ns(int64_t deadline_ns);
+
+
+// Description: Starts a thread with SCHED_FIFO at the given priority.
+// If the process is not allowed to use real-time scheduling (not root, no CAP_SYS_NICE) the thread is started with default
+// attributes instead so the code still runs off-target, just without the real-time guarantees.
+// Parameters:
+// thread   - Where to store the thread handle
+// priority - SCHED_FIFO priority, or RT_PRIORITY_NONE for a normal thread
+// func     - Thread function
+// arg      - Argument passed to the thread function
+// Returns - 0 on success, otherwise the error number from pthread_create.
+int32_t rt_thread_start(pthread_t *thread, int32_t priority, void *(*func)(void *), void *arg);
+
+
+#endif // End of include guard
@@ -0,0 +1,220 @@
+/*
+This file implements all the functions defined in sequencer.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN SEQUENCER.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "gpiobank.h"
+#include "rtutil.h"
+#include "sequencer.h"
+
+
+static void reset_stats(Sequencer *seq) {
+    int32_t i = 0;
+
+    for (i = 0; i < seq->step_count; i++) {
+        seq->stats[i].last_error_ns = 0;
+        seq->stats[i].min_error_ns = INT64_MAX;
+        seq->stats[i].max_error_ns = INT64_MIN;
+        seq->stats[i].sum_error_ns = 0;
+        seq->stats[i].count = 0U;
+        seq->stats[i].write_failures = 0U;
+    }
+}
+
+
+static void record_step(SeqStepStats *stats, int64_t error_ns, int32_t write_ok) {
+    stats->last_error_ns = error_ns;
+    stats->sum_error_ns += error_ns;
+    stats->count++;
+
+    if (error_ns < stats->min_error_ns) {
+        stats->min_error_ns = error_ns;
+    }
+    if (error_ns > stats->max_error_ns) {
+        stats->max_error_ns = error_ns;
+    }
+    if (write_ok != 1) {
+        stats->write_failures++;
+    }
+}
+
+
+// Blocks until the trigger pin goes from 0 to 1. Returns the time the edge was seen, or -1 if a stop was requested.
+static int64_t wait_for_trigger(Sequencer *seq) {
+    int32_t trigger_bank = GPIO_BANK_OF(seq->trigger_pin);
+    uint32_t trigger_bit = GPIO_BIT_OF(seq->trigger_pin);
+    uint32_t level = 0U;
+    uint32_t prev_level = trigger_bit;  // Treat the pin as high at first so a line that is already high is not an edge.
+    int64_t edge_ns = -1;
+    int64_t next_poll_ns = rt_now_ns();
+
+    while (edge_ns < 0 && atomic_load(&seq->stop_requested) == 0) {
+        if (gpio_bank_read(trigger_bank, trigger_bit, &level) == 1) {
+            if (level != 0U && prev_level == 0U) {
+                edge_ns = rt_now_ns();
+            }
+            prev_level = level;
+        }
+
+        if (edge_ns < 0) {
+            next_poll_ns += SEQ_TRIGGER_POLL_NS;
+            rt_sleep_until_ns(next_poll_ns);
+        }
+    }
+
+    return edge_ns;
+}
+
+
+// Plays the table once starting at start_ns. Returns 1 if the whole pass was played, 0 if it was stopped early.
+static int32_t play_pass(Sequencer *seq, int64_t start_ns) {
+    int32_t completed = 1;
+    int32_t i = 0;
+    int64_t deadline_ns = start_ns;
+
+    for (i = 0; i < seq->step_count && completed == 1; i++) {
+        if (atomic_load(&seq->stop_requested) != 0) {
+            completed = 0;
+        }
+        else {
+            const SeqStep *step = &seq->steps[i];
+
+            rt_sleep_until_ns(deadline_ns);
+            int32_t write_ok = gpio_bank_write(seq->bank, step->pin_mask, step->value_mask);
+            record_step(&seq->stats[i], rt_now_ns() - deadline_ns, write_ok);
+
+            // Next deadline comes from the schedule, not from when this step actually happened.
+            deadline_ns += (int64_t) step->hold_ns;
+        }
+    }
+
+    // Let the last step hold for its full time before the pass counts as done (and before the next loop pass starts).
+    if (completed == 1) {
+        rt_sleep_until_ns(deadline_ns);
+        seq->passes++;
+    }
+
+    return completed;
+}
+
+
+static void *sequencer_thread_func(void *arg) {
+    Sequencer *seq = (Sequencer *) arg;
+    int64_t start_ns = rt_now_ns() + SEQ_START_LEAD_NS;
+    int32_t keep_going = 1;
+
+    while (keep_going == 1) {
+        if (seq->mode == SEQ_MODE_TRIGGERED) {
+            start_ns = wait_for_trigger(seq);
+            if (start_ns < 0) {
+                keep_going = 0;
+            }
+        }
+
+        if (keep_going == 1) {
+            keep_going = play_pass(seq, start_ns);
+
+            if (seq->mode == SEQ_MODE_ONESHOT) {
+                keep_going = 0;
+            }
+            else if (seq->mode == SEQ_MODE_LOOP) {
+                // Back to back passes: the next pass starts exactly where this one ended.
+                int32_t i = 0;
+                for (i = 0; i < seq->step_count; i++) {
+                    start_ns += (int64_t) seq->steps[i].hold_ns;
+                }
+            }
+            else {
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+int32_t sequencer_init(Sequencer *seq, int32_t bank, const SeqStep *steps, SeqStepStats *stats, int32_t step_count, int32_t mode, int32_t trigger_pin) {
+    int32_t result = 0;
+
+    if (seq != NULL && steps != NULL && stats != NULL && step_count > 0 &&
+        bank >= 0 && bank < GPIO_BANK_COUNT &&
+        mode >= SEQ_MODE_ONESHOT && mode <= SEQ_MODE_TRIGGERED &&
+        (mode != SEQ_MODE_TRIGGERED || trigger_pin >= 0)) {
+
+        seq->bank = bank;
+        seq->steps = steps;
+        seq->stats = stats;
+        seq->step_count = step_count;
+        seq->mode = mode;
+        seq->trigger_pin = trigger_pin;
+        seq->passes = 0U;
+        atomic_init(&seq->stop_requested, 0);
+        atomic_init(&seq->running, 0);
+        reset_stats(seq);
+        result = 1;
+    }
+
+    return result;
+}
+
+
+int32_t sequencer_start(Sequencer *seq, int32_t priority) {
+    int32_t result = 0;
+
+    if (atomic_load(&seq->running) == 0) {
+        atomic_store(&seq->stop_requested, 0);
+        atomic_store(&seq->running, 1);
+
+        if (rt_thread_start(&seq->thread, priority, &sequencer_thread_func, seq) == 0) {
+            result = 1;
+        }
+        else {
+            atomic_store(&seq->running, 0);
+        }
+    }
+
+    return result;
+}
+
+
+void sequencer_stop(Sequencer *seq) {
+    atomic_store(&seq->stop_requested, 1);
+    sequencer_wait(seq);
+}
+
+
+void sequencer_wait(Sequencer *seq) {
+    // Only a started thread that wasn't joined yet can be joined.
+    if (atomic_load(&seq->running) == 1) {
+        (void) pthread_join(seq->thread, NULL);
+        atomic_store(&seq->running, 0);
+    }
+}
+
+
+void sequencer_print_report(const Sequencer *seq) {
+    int32_t i = 0;
+
+    (void) printf("Sequencer report: bank %d, %d steps, %u passes, backend %s\n",
+                  seq->bank, seq->step_count, seq->passes, gpio_bank_backend_name(gpio_bank_backend()));
+    (void) printf("  step   pins       values     hold(ns)    last(ns)    min(ns)     max(ns)     avg(ns)     fails\n");
+
+    for (i = 0; i < seq->step_count; i++) {
+        const SeqStepStats *stats = &seq->stats[i];
+
+        if (stats->count == 0U) {
+            (void) printf("  %-6d 0x%08" PRIx32 " 0x%08" PRIx32 " %-11" PRIu32 " (not played)\n",
+                          i, seq->steps[i].pin_mask, seq->steps[i].value_mask, seq->steps[i].hold_ns);
+        }
+        else {
+            (void) printf("  %-6d 0x%08" PRIx32 " 0x%08" PRIx32 " %-11" PRIu32 " %-11" PRId64 " %-11" PRId64 " %-11" PRId64 " %-11" PRId64 " %" PRIu32 "\n",
+                          i, seq->steps[i].pin_mask, seq->steps[i].value_mask, seq->steps[i].hold_ns,
+                          stats->last_error_ns, stats->min_error_ns, stats->max_error_ns,
+                          stats->sum_error_ns / (int64_t) stats->count, stats->write_failures);
+        }
+    }
+}
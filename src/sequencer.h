@@ -0,0 +1,113 @@
+/*
+This file is for defining the GPIO pattern sequencer.
+The sequencer plays a precomputed table of steps on one GPIO bank. Each step is (pin mask, value mask, hold time):
+the pins in the pin mask are driven to the matching bits of the value mask with one gpio_bank_write, and the next step
+starts hold_ns nanoseconds after this one was scheduled.
+Steps are scheduled against absolute CLOCK_MONOTONIC deadlines computed from the start of the pass, so the time the
+writes take (or a late wakeup) does not accumulate over the table like it would with a loop of usleep calls.
+
+Modes:
+- ONESHOT:   Play the table once and stop.
+- LOOP:      Play the table over and over until sequencer_stop is called.
+- TRIGGERED: Wait for a rising edge on the trigger pin, play the table once, wait for the next edge, and so on.
+
+For every step we keep the timing error (time the write finished minus the deadline) so the report shows how
+accurately each step of the pattern was placed.
+*/
+
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define SEQ_MODE_ONESHOT ((int32_t) 0)
+
+#define SEQ_MODE_LOOP ((int32_t) 1)
+
+#define SEQ_MODE_TRIGGERED ((int32_t) 2)
+
+// How often the trigger pin is sampled while waiting for an edge in TRIGGERED mode.
+#define SEQ_TRIGGER_POLL_NS ((int64_t) 50000)
+
+// Time between the call to sequencer_start and the first step, so the first deadline is not already late. Not used in
+// TRIGGERED mode: a pass starts at the time the edge was seen, so its schedule lines up with the trigger and the first
+// step's lateness is the time it took to see the edge.
+#define SEQ_START_LEAD_NS ((int64_t) 1000000)
+
+
+typedef struct {
+    uint32_t pin_mask;      // Pins written by this step (bit i = GPIO bank * 32 + i)
+    uint32_t value_mask;    // Levels for those pins
+    uint32_t hold_ns;       // Time until the next step starts
+} SeqStep;
+
+// Timing error statistics for one step, in nanoseconds. Positive means late.
+typedef struct {
+    int64_t last_error_ns;
+    int64_t min_error_ns;
+    int64_t max_error_ns;
+    int64_t sum_error_ns;
+    uint32_t count;
+    uint32_t write_failures;
+} SeqStepStats;
+
+typedef struct {
+    int32_t bank;
+    const SeqStep *steps;
+    SeqStepStats *stats;    // Must have as many entries as steps
+    int32_t step_count;
+    int32_t mode;
+    int32_t trigger_pin;    // GPIO number, only used in TRIGGERED mode
+    uint32_t passes;        // Number of completed passes over the table
+    atomic_int stop_requested;
+    atomic_int running;     // Started and not joined yet (cleared by sequencer_stop / sequencer_wait)
+    pthread_t thread;
+} Sequencer;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Prepares a sequencer. Nothing is written to the pins until sequencer_start.
+// Parameters:
+// seq         - The sequencer to initialize
+// bank        - GPIO bank the table is played on (0 to 3)
+// steps       - The pattern table. It is not copied so it must stay valid while the sequencer runs.
+// stats       - Array of step_count entries to hold the timing report
+// step_count  - Number of steps in the table
+// mode        - SEQ_MODE_ONESHOT, SEQ_MODE_LOOP or SEQ_MODE_TRIGGERED
+// trigger_pin - GPIO number of the trigger input (TRIGGERED mode only, otherwise ignored)
+// Returns - 1 on success, 0 if any parameter is invalid.
+int32_t sequencer_init(Sequencer *seq, int32_t bank, const SeqStep *steps, SeqStepStats *stats, int32_t step_count, int32_t mode, int32_t trigger_pin);
+
+
+// Description: Starts playing the table from its own thread.
+// Parameters:
+// seq      - An initialized sequencer
+// priority - SCHED_FIFO priority for the sequencer thread (see rt_thread_start)
+// Returns - 1 on success, 0 on failure.
+int32_t sequencer_start(Sequencer *seq, int32_t priority);
+
+
+// Description: Asks the sequencer to stop after the current step and waits for its thread to finish. Does nothing if
+// it isn't started (or was already stopped).
+// Parameters: seq - The sequencer
+void sequencer_stop(Sequencer *seq);
+
+
+// Description: Waits for a ONESHOT sequencer to finish its pass. Do not use on LOOP / TRIGGERED, they never finish by
+// themselves. Does nothing if it isn't started (or was already waited for).
+// Parameters: seq - The sequencer
+void sequencer_wait(Sequencer *seq);
+
+
+// Description: Prints the per-step timing error report to stdout.
+// Parameters: seq - The sequencer to report on
+void sequencer_print_report(const Sequencer *seq);
+
+
+#endif // End of include guard
@@ -0,0 +1,355 @@
+/*
+This file implements all the functions defined in spi.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN SPI.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "rtutil.h"
+#include "spi.h"
+
+
+#define SPI_BITS_PER_WORD ((uint8_t) 8)
+
+typedef struct {
+    int32_t in_use;
+    int32_t simulated;
+    int32_t fd;
+    int32_t bus;
+    int32_t cs;
+    uint8_t mode;
+    uint32_t speed_hz;
+    SpiStats stats;
+} SpiDevice;
+
+static SpiDevice devices[SPI_MAX_DEVICES];
+
+static int32_t simulator_enabled = 0;
+
+static SpiSimRecord sim_history[SPI_SIM_HISTORY];
+
+static uint64_t sim_count = 0U;
+
+
+static int32_t handle_valid(int32_t handle) {
+    return (int32_t) (handle >= 0 && handle < SPI_MAX_DEVICES && devices[handle].in_use == 1);
+}
+
+
+static int32_t configure_device(int32_t fd, uint8_t mode, uint32_t speed_hz) {
+    int32_t result = 0;
+    uint8_t bits = SPI_BITS_PER_WORD;
+
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) >= 0 &&
+        ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) >= 0 &&
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) >= 0) {
+        result = 1;
+    }
+
+    return result;
+}
+
+
+// The simulated device: record every segment and loop MOSI back to MISO.
+static int32_t sim_transfer(const SpiDevice *dev, const SpiSegment *segments, int32_t count) {
+    int32_t i = 0;
+    int64_t now_ns = rt_now_ns();
+
+    for (i = 0; i < count; i++) {
+        SpiSimRecord *record = &sim_history[sim_count % (uint64_t) SPI_SIM_HISTORY];
+        uint32_t kept = (segments[i].len < (uint32_t) SPI_SIM_MAX_BYTES) ? segments[i].len : (uint32_t) SPI_SIM_MAX_BYTES;
+
+        record->bus = dev->bus;
+        record->cs = dev->cs;
+        record->len = segments[i].len;
+        record->cs_change = segments[i].cs_change;
+        record->time_ns = now_ns;
+
+        if (segments[i].tx != NULL) {
+            (void) memcpy(record->data, segments[i].tx, kept);
+        }
+        else {
+            (void) memset(record->data, 0, kept);
+        }
+
+        if (segments[i].rx != NULL) {
+            if (segments[i].tx != NULL) {
+                (void) memcpy(segments[i].rx, segments[i].tx, segments[i].len);
+            }
+            else {
+                (void) memset(segments[i].rx, 0, segments[i].len);
+            }
+        }
+
+        sim_count++;
+    }
+
+    return 1;
+}
+
+
+static int32_t real_transfer(const SpiDevice *dev, const SpiSegment *segments, int32_t count) {
+    int32_t result = 0;
+    int32_t i = 0;
+    struct spi_ioc_transfer xfers[SPI_MAX_SEGMENTS];
+
+    (void) memset(xfers, 0, sizeof(xfers));
+
+    for (i = 0; i < count; i++) {
+        xfers[i].tx_buf = (uint64_t) (uintptr_t) segments[i].tx;
+        xfers[i].rx_buf = (uint64_t) (uintptr_t) segments[i].rx;
+        xfers[i].len = segments[i].len;
+        xfers[i].speed_hz = dev->speed_hz;
+        xfers[i].bits_per_word = SPI_BITS_PER_WORD;
+        xfers[i].cs_change = segments[i].cs_change;
+    }
+
+    // One ioctl for the whole batch. It returns the number of bytes transferred.
+    if (ioctl(dev->fd, SPI_IOC_MESSAGE(count), xfers) >= 0) {
+        result = 1;
+    }
+
+    return result;
+}
+
+
+void spi_use_simulator(int32_t enable) {
+    simulator_enabled = (enable != 0) ? 1 : 0;
+}
+
+
+int32_t spi_open(int32_t bus, int32_t cs, uint8_t mode, uint32_t speed_hz) {
+    int32_t handle = -1;
+    int32_t free_slot = -1;
+    int32_t i = 0;
+
+    // Already open? Then just reuse the cached descriptor (reconfiguring it if needed).
+    for (i = 0; i < SPI_MAX_DEVICES && handle < 0; i++) {
+        if (devices[i].in_use == 1 && devices[i].bus == bus && devices[i].cs == cs && devices[i].simulated == simulator_enabled) {
+            handle = i;
+        }
+        else if (devices[i].in_use == 0 && free_slot < 0) {
+            free_slot = i;
+        }
+        else {
+        }
+    }
+
+    if (handle >= 0) {
+        // The word size is always SPI_BITS_PER_WORD, so only the mode and the speed can differ.
+        if (devices[handle].simulated == 0 && (devices[handle].mode != mode || devices[handle].speed_hz != speed_hz)) {
+            if (configure_device(devices[handle].fd, mode, speed_hz) == 1) {
+                devices[handle].mode = mode;
+                devices[handle].speed_hz = speed_hz;
+            }
+            else {
+                handle = -1;
+            }
+        }
+    }
+    else if (free_slot >= 0) {
+        SpiDevice *dev = &devices[free_slot];
+        char path[32];
+
+        (void) memset(dev, 0, sizeof(*dev));
+        dev->fd = -1;
+        dev->bus = bus;
+        dev->cs = cs;
+        dev->mode = mode;
+        dev->speed_hz = speed_hz;
+        dev->simulated = simulator_enabled;
+
+        if (simulator_enabled == 1) {
+            dev->in_use = 1;
+            handle = free_slot;
+        }
+        else if (snprintf(path, sizeof(path), SPI_DEV_PATH, bus, cs) > 0) {
+            dev->fd = open(path, O_RDWR | O_CLOEXEC);
+
+            if (dev->fd >= 0 && configure_device(dev->fd, mode, speed_hz) == 1) {
+                dev->in_use = 1;
+                handle = free_slot;
+            }
+            else if (dev->fd >= 0) {
+                (void) close(dev->fd);
+                dev->fd = -1;
+            }
+            else {
+            }
+        }
+        else {
+        }
+    }
+    else {
+    }
+
+    return handle;
+}
+
+
+void spi_close(int32_t handle) {
+    if (handle_valid(handle) == 1) {
+        if (devices[handle].fd >= 0) {
+            (void) close(devices[handle].fd);
+        }
+        devices[handle].in_use = 0;
+        devices[handle].fd = -1;
+    }
+}
+
+
+int32_t spi_transfer(int32_t handle, const SpiSegment *segments, int32_t count) {
+    int32_t result = 0;
+
+    if (handle_valid(handle) == 1 && segments != NULL && count > 0 && count <= SPI_MAX_SEGMENTS) {
+        SpiDevice *dev = &devices[handle];
+        int64_t start_ns = rt_now_ns();
+        int32_t i = 0;
+
+        if (dev->simulated == 1) {
+            result = sim_transfer(dev, segments, count);
+        }
+        else {
+            result = real_transfer(dev, segments, count);
+        }
+
+        dev->stats.busy_ns += rt_now_ns() - start_ns;
+        dev->stats.ioctls++;
+        dev->stats.segments += (uint64_t) count;
+        for (i = 0; i < count; i++) {
+            dev->stats.bytes += segments[i].len;
+        }
+        if (result != 1) {
+            dev->stats.failures++;
+        }
+    }
+
+    return result;
+}
+
+
+int32_t spi_frame_init(SpiFrame *frame, uint32_t len, uint32_t segment_len) {
+    int32_t result = 0;
+
+    if (frame != NULL && len > 0U && len <= (uint32_t) SPI_FRAME_MAX && segment_len > 0U &&
+        (len % segment_len) == 0U && (len / segment_len) <= (uint32_t) SPI_MAX_SEGMENTS) {
+        (void) memset(frame->buffers, 0, sizeof(frame->buffers));
+        frame->back = 0;
+        frame->len = len;
+        frame->segment_len = segment_len;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+uint8_t *spi_frame_back(SpiFrame *frame) {
+    return frame->buffers[frame->back];
+}
+
+
+int32_t spi_frame_commit(int32_t handle, SpiFrame *frame) {
+    int32_t result = 0;
+    SpiSegment segments[SPI_MAX_SEGMENTS];
+    int32_t count = 0;
+    const uint8_t *front = frame->buffers[frame->back];
+    int32_t i = 0;
+
+    // Same checks as spi_frame_init, a zeroed or never initialised frame has no segments to send.
+    if (frame->segment_len > 0U && frame->len > 0U && frame->len <= (uint32_t) SPI_FRAME_MAX && (frame->len % frame->segment_len) == 0U &&
+        (frame->len / frame->segment_len) <= (uint32_t) SPI_MAX_SEGMENTS) {
+        count = (int32_t) (frame->len / frame->segment_len);
+    }
+
+    if (count > 0) {
+        frame->back ^= 1;
+
+        // The next frame starts from this one.
+        (void) memcpy(frame->buffers[frame->back], front, frame->len);
+
+        for (i = 0; i < count; i++) {
+            segments[i].tx = &front[(uint32_t) i * frame->segment_len];
+            segments[i].rx = NULL;
+            segments[i].len = frame->segment_len;
+            segments[i].cs_change = 1U;
+        }
+
+        // Toggling chip select after the very last segment is not needed (the driver releases it at the end of the message anyway).
+        segments[count - 1].cs_change = 0U;
+
+        result = spi_transfer(handle, segments, count);
+    }
+
+    if (result == 1) {
+        SpiStats *stats = &devices[handle].stats;
+        int64_t now_ns = rt_now_ns();
+
+        if (stats->frames == 0U) {
+            stats->first_frame_ns = now_ns;
+        }
+        stats->last_frame_ns = now_ns;
+        stats->frames++;
+    }
+
+    return result;
+}
+
+
+void spi_get_stats(int32_t handle, SpiStats *stats) {
+    if (handle_valid(handle) == 1) {
+        *stats = devices[handle].stats;
+    }
+    else {
+        (void) memset(stats, 0, sizeof(*stats));
+    }
+}
+
+
+void spi_print_stats(int32_t handle) {
+    SpiStats stats;
+    double fps = 0.0;
+    double wire_fps = 0.0;
+
+    spi_get_stats(handle, &stats);
+
+    if (stats.frames > 1U && stats.last_frame_ns > stats.first_frame_ns) {
+        fps = (double) (stats.frames - 1U) * 1e9 / (double) (stats.last_frame_ns - stats.first_frame_ns);
+    }
+
+    // What the bus itself allows: 8 clocks per byte at the configured speed.
+    if (handle_valid(handle) == 1 && stats.frames > 0U && stats.bytes > 0U) {
+        double bytes_per_frame = (double) stats.bytes / (double) stats.ioctls;
+        wire_fps = (double) devices[handle].speed_hz / (8.0 * bytes_per_frame);
+    }
+
+    (void) printf("SPI %s device stats:\n", (handle_valid(handle) == 1 && devices[handle].simulated == 1) ? "simulated" : "spidev");
+    (void) printf("  ioctls %llu, segments %llu, bytes %llu, failures %llu\n", (unsigned long long) stats.ioctls,
+                  (unsigned long long) stats.segments, (unsigned long long) stats.bytes, (unsigned long long) stats.failures);
+    (void) printf("  frames %llu, achieved %.1f frames/s, bus limit %.1f frames/s, %.2f us per ioctl\n",
+                  (unsigned long long) stats.frames, fps, wire_fps,
+                  (stats.ioctls > 0U) ? ((double) stats.busy_ns / (1e3 * (double) stats.ioctls)) : 0.0);
+}
+
+
+uint64_t spi_sim_transfer_count(void) {
+    return sim_count;
+}
+
+
+int32_t spi_sim_get_record(int32_t age, SpiSimRecord *record) {
+    int32_t result = 0;
+
+    if (age >= 0 && age < SPI_SIM_HISTORY && (uint64_t) age < sim_count) {
+        *record = sim_history[(sim_count - 1U - (uint64_t) age) % (uint64_t) SPI_SIM_HISTORY];
+        result = 1;
+    }
+
+    return result;
+}
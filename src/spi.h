@@ -0,0 +1,161 @@
+/*
+This file is for defining SPI access through the Linux spidev driver (/dev/spidevX.Y).
+Shift register chains (74HC595) and SPI LED drivers (MAX7219 and similar) want a whole frame at a time, so:
+- Device files are opened once and cached, not opened per transfer.
+- Several transfers (segments) go to the driver in one SPI_IOC_MESSAGE(n) ioctl. Chip select is toggled between
+  segments when asked (cs_change), which is what latches a 74HC595 chain or a MAX7219 register.
+- Frames have a back buffer the application draws into, and spi_frame_commit sends the whole frame with a single ioctl.
+  The ioctl is synchronous, so nothing is drawn while a frame is on the wire. The front buffer keeps the frame last
+  sent, and the new back buffer starts as a copy of it, so a display that changes a few bytes only writes those.
+
+There is also a simulated device (spi_use_simulator) that records every transfer instead of talking to the driver,
+so display code can be checked and benchmarked on a machine without SPI. It loops MOSI back to MISO like a jumper would.
+
+On the BeagleBone the SPI pins have to be muxed first, e.g. set_pinmux("P9_18", PINMUX_SPI) (see bbbio.h).
+
+Sources:
+https://www.kernel.org/doc/Documentation/spi/spidev
+*/
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define SPI_DEV_PATH "/dev/spidev%d.%d"
+
+// Number of spidev devices that can be open at once.
+#define SPI_MAX_DEVICES ((int32_t) 4)
+
+// Maximum segments in one ioctl (and in one frame).
+#define SPI_MAX_SEGMENTS ((int32_t) 16)
+
+// Largest frame a SpiFrame can hold.
+#define SPI_FRAME_MAX ((int32_t) 512)
+
+// Transfers the simulator remembers (the oldest ones are overwritten).
+#define SPI_SIM_HISTORY ((int32_t) 64)
+
+// Largest single transfer the simulator keeps a copy of.
+#define SPI_SIM_MAX_BYTES ((int32_t) SPI_FRAME_MAX)
+
+
+typedef struct {
+    const uint8_t *tx;      // Bytes to send, NULL to send zeros
+    uint8_t *rx;            // Where received bytes go, NULL to ignore them
+    uint32_t len;
+    uint8_t cs_change;      // 1 to release chip select after this segment (latches shift registers)
+} SpiSegment;
+
+typedef struct {
+    uint8_t buffers[2][SPI_FRAME_MAX];
+    int32_t back;           // Index of the buffer the application draws into
+    uint32_t len;           // Frame length in bytes
+    uint32_t segment_len;   // Bytes per latched segment (len for one latch per frame)
+} SpiFrame;
+
+typedef struct {
+    uint64_t ioctls;
+    uint64_t segments;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t failures;
+    int64_t busy_ns;        // Time spent inside the ioctl
+    int64_t first_frame_ns;
+    int64_t last_frame_ns;
+} SpiStats;
+
+// One recorded transfer of the simulated device.
+typedef struct {
+    int32_t bus;
+    int32_t cs;
+    uint32_t len;
+    uint8_t cs_change;
+    int64_t time_ns;
+    uint8_t data[SPI_SIM_MAX_BYTES];
+} SpiSimRecord;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Switches between the real spidev driver and the simulated device. Only affects devices opened afterwards.
+// Parameters: enable - 1 for the simulator, 0 for /dev/spidevX.Y
+void spi_use_simulator(int32_t enable);
+
+
+// Description: Opens (or returns the already open) device for a bus / chip select and configures it. An open device is
+// reconfigured if the mode or the speed differ.
+// Parameters:
+// bus      - SPI bus number (X in /dev/spidevX.Y)
+// cs       - Chip select (Y in /dev/spidevX.Y)
+// mode     - SPI mode 0 to 3
+// speed_hz - Clock speed
+// Returns - A handle for the other functions, -1 on failure.
+int32_t spi_open(int32_t bus, int32_t cs, uint8_t mode, uint32_t speed_hz);
+
+
+// Description: Closes a device.
+// Parameters: handle - Handle from spi_open
+void spi_close(int32_t handle);
+
+
+// Description: Sends several segments in a single ioctl.
+// Parameters:
+// handle   - Handle from spi_open
+// segments - The segments, in order
+// count    - Number of segments (1 to SPI_MAX_SEGMENTS)
+// Returns - 1 on success, 0 on failure.
+int32_t spi_transfer(int32_t handle, const SpiSegment *segments, int32_t count);
+
+
+// Description: Prepares a double buffered frame. Both buffers start zeroed.
+// Parameters:
+// frame       - The frame
+// len         - Frame length in bytes (up to SPI_FRAME_MAX)
+// segment_len - Bytes sent per chip select cycle. len must be a multiple of it and len / segment_len <= SPI_MAX_SEGMENTS.
+// Returns - 1 on success, 0 if the sizes are invalid.
+int32_t spi_frame_init(SpiFrame *frame, uint32_t len, uint32_t segment_len);
+
+
+// Description: Returns the buffer to draw the next frame into.
+// Parameters: frame - The frame
+uint8_t *spi_frame_back(SpiFrame *frame);
+
+
+// Description: Makes the back buffer the front one and sends it with one ioctl (returns once it is sent). The new back
+// buffer starts as a copy of the frame just sent, so a display that only changes a few bytes can just change those.
+// Parameters:
+// handle - Handle from spi_open
+// frame  - The frame
+// Returns - 1 on success, 0 on failure (also for a frame spi_frame_init didn't accept).
+int32_t spi_frame_commit(int32_t handle, SpiFrame *frame);
+
+
+// Description: Copies the counters of a device.
+// Parameters:
+// handle - Handle from spi_open
+// stats  - Where the counters are copied
+void spi_get_stats(int32_t handle, SpiStats *stats);
+
+
+// Description: Prints the counters and the frame rate achieved by a device to stdout.
+// Parameters: handle - Handle from spi_open
+void spi_print_stats(int32_t handle);
+
+
+// Description: Simulator only. Number of transfers (segments) recorded since the start.
+uint64_t spi_sim_transfer_count(void);
+
+
+// Description: Simulator only. Gets a recorded transfer.
+// Parameters:
+// age    - 0 for the most recent transfer, 1 for the one before, ...
+// record - Where the record is copied
+// Returns - 1 on success, 0 if that transfer is not in the history anymore.
+int32_t spi_sim_get_record(int32_t age, SpiSimRecord *record);
+
+
+#endif // End of include guard
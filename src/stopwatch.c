@@ -3,15 +3,35 @@
 #include <signal.h>
 #include <sched.h>
 #include <unistd.h>
+#include <semaphore.h>
+#include <errno.h>
 #include "bbbio.h"
-
-// Mutex for thread synchronization
+#include "timeline.h"
+#include "gpioinput.h"
+#include "gpiobank.h"
+#include "photogate.h"
+#include "journal.h"
+#include "rtutil.h"
+#include "fault.h"
+#include "perfstat.h"
+#include "tracemark.h"
+#include "probes.h"
+#include "keypad.h"
+#include "swcore.h"
+
+// Mutex for thread synchronization. The stopwatch state doesn't need it any more (see below), it keeps the display thread
+// from writing over the startup timeline and the exit report.
 static pthread_mutex_t mutex;
 
-// Some protected resources we will use between threads.
-static float32_t current_time = 0;      
-static int32_t stopwatch_running = 0;  
-static int32_t reset_requested = 0;
+// Stopwatch state (see swcore.h): the button thread pushes start / stop / reset / lap events to the queue and posts the
+// semaphore, the core thread applies them at their timestamps and publishes the core for the display.
+static SwQueue core_events;
+static sem_t core_events_pending;
+
+// Written by the core thread only.
+static SwCore core;
+
+static SwShared shared_core;
 
 // Set by asking user for GPIO pins.
 static int32_t START_STOP_BUTTON_PIN = -1;
@@ -19,6 +39,59 @@ static int32_t RESET_BUTTON_PIN = -1;
 static int32_t RED_LED_PIN = -1;
 static int32_t GREEN_LED_PIN = -1;
 
+// History of every start, stop, reset and lap for audits (see journal.h). Appends don't make system calls, the display
+// thread syncs it every JOURNAL_SYNC_FRAMES frames, which maps the next segment ahead of time.
+static Journal journal;
+
+#define JOURNAL_SYNC_FRAMES ((int64_t) 10)
+
+// Deadlines checked in every run, reported when running under fault injection (./stopwatch fault "<rules>", see fault.h).
+// A press must have its LEDs updated within one button period.
+#define PRESS_DEADLINE_NS ((int64_t) 10000000)
+
+typedef struct {
+    uint64_t count;
+    uint64_t misses;
+    int64_t sum_ns;
+    int64_t max_ns;
+} DeadlineStats;
+
+// Edge to LEDs updated, written by the core thread only.
+static DeadlineStats press_latency;
+
+static int32_t fault_mode = 0;
+
+// Performance counters of each thread's loop iterations (./stopwatch perf, see perfstat.h), written by their own thread.
+static PerfThread button_perf;
+static PerfThread core_perf;
+static PerfThread display_perf;
+
+static int32_t perf_mode = 0;
+
+// Lane keypad (./stopwatch keypad <row pins> <column pins>, see keypad.h): key 0 is start/stop, key 1 reset, and every
+// other key records a lap for its lane. Scanned by the button thread along with the buttons.
+#define KEY_START_STOP ((int32_t) 0)
+#define KEY_RESET ((int32_t) 1)
+
+static Keypad keypad;
+
+static int32_t keypad_mode = 0;
+
+// Light gates (./stopwatch gate [sampled], see photogate.h), stopped by cleanup.
+static Photogate gate;
+
+static int32_t gate_mode = 0;
+
+// USDT probes (see probes.h):
+// stopwatch:state            new state (0 stopped, 1 running, 2 reset), elapsed ns
+// stopwatch:button_iteration pin, value of the event handled
+// stopwatch:core_iteration   events applied in the iteration
+// stopwatch:display_iteration frame number, displayed time in ms
+BBB_PROBE_SEMAPHORE(stopwatch, state);
+BBB_PROBE_SEMAPHORE(stopwatch, button_iteration);
+BBB_PROBE_SEMAPHORE(stopwatch, core_iteration);
+BBB_PROBE_SEMAPHORE(stopwatch, display_iteration);
+
 // Thread priorities - check the main function at the bottom of this code. We are dynamically getting min and max.
 
 // Helper function to safely lock
@@ -41,50 +114,111 @@ static void unlockMutex(void) {
     }
 }
 
-//Button thread function - Reads button states every 10ms and updates stopwatch state accordingly
+// Adds one sample to deadline statistics. Returns 1 if it missed the deadline.
+static int32_t record_deadline(DeadlineStats *stats, int64_t ns, int64_t deadline_ns) {
+    int32_t missed = 0;
+
+    stats->count++;
+    stats->sum_ns += ns;
+    if (ns > stats->max_ns) {
+        stats->max_ns = ns;
+    }
+    if (ns > deadline_ns) {
+        stats->misses++;
+        missed = 1;
+    }
+
+    return missed;
+}
+
+// 1 if the event is a press of the button on pin, or of the keypad key.
+static int32_t is_press(const GpioEvent *event, int32_t pin, int32_t key) {
+    return (int32_t) (event->value == 1 && ((event->type == GPIO_EVENT_EDGE && event->pin == pin) ||
+                                            (event->type == GPIO_EVENT_KEY && event->pin == key)));
+}
+
+// Opens the counters of the calling thread in perf mode. Otherwise they stay closed and the iteration calls do nothing.
+static void open_thread_perf(PerfThread *pt, const char *name) {
+    if (perf_mode == 1) {
+        if (perf_thread_open(pt, name) != 1) {
+            (void) printf("\n[WARNING] No performance counters for the %s thread.\n", name);
+        }
+    }
+    else {
+        pt->leader_fd = -1;
+    }
+}
+
+static void print_deadline(const char *name, const DeadlineStats *stats, int64_t deadline_ns) {
+    (void) printf("  %-15s %6llu samples, avg %8.1f us, max %8.1f us, %llu over the %.0f ms deadline\n", name,
+                  (unsigned long long) stats->count, (stats->count > 0U) ? ((double) stats->sum_ns / (1e3 * (double) stats->count)) : 0.0,
+                  (double) stats->max_ns / 1e3, (unsigned long long) stats->misses, (double) deadline_ns / 1e6);
+}
+
+// Queues an event for the core thread. A full queue drops it (counted, reported on exit).
+static void push_core_event(int32_t type, int32_t source, int64_t time_ns) {
+    SwEvent event;
+
+    event.type = type;
+    event.source = source;
+    event.time_ns = time_ns;
+    if (sw_queue_push(&core_events, &event) == 1) {
+        (void) sem_post(&core_events_pending);
+    }
+}
+
+//Button thread function - Waits for button events and turns presses into stopwatch events.
+// Events come from the gpioinput module: edge interrupts where the pin supports them (10 ms sampling otherwise),
+// with bounce merged and a storming button quarantined so a bad wire can't keep this thread busy.
 static void *button_thread_func(void) {
-    int32_t start_stop_prev = 0;
-    int32_t start_stop_current = 0;
-    int32_t reset_prev = 0;
-    int32_t reset_current = 0;
-    int32_t state = 0;
+    GpioInputSet inputs;
+    GpioEvent event;
+
+    open_thread_perf(&button_perf, "button");
+    gpio_input_init(&inputs, NULL);
+    if (gpio_input_add(&inputs, START_STOP_BUTTON_PIN) != 1 || gpio_input_add(&inputs, RESET_BUTTON_PIN) != 1) {
+        (void) printf("ERROR: Could not watch the button pins! Sending SIGINT...\n");
+        (void) raise(SIGINT);
+    }
+    if (keypad_mode == 1 && keypad_attach(&keypad, &inputs) != 1) {
+        (void) printf("ERROR: Could not scan the keypad! Sending SIGINT...\n");
+        (void) raise(SIGINT);
+    }
     
     while (1 == 1) {
-        start_stop_current = read_gpio_value(START_STOP_BUTTON_PIN);
-        reset_current = read_gpio_value(RESET_BUTTON_PIN);
-        
-        if ((int32_t) start_stop_current == 1 && (int32_t) start_stop_prev == 0) {
-            lockMutex();
-            // Toggle stopwatch state
-            stopwatch_running = (!(int32_t)stopwatch_running);
-            state = stopwatch_running;
-            unlockMutex();
-            
-            // Update LEDs based on state
-            if (state == 1) {
-                set_gpio_off(RED_LED_PIN);
-                set_gpio_on(GREEN_LED_PIN);
-            } else {
-                set_gpio_on(RED_LED_PIN);
-                set_gpio_off(GREEN_LED_PIN);
-            }
-        
+        if (gpio_input_wait(&inputs, &event, -1) != 1) {
+            continue;
+        }
+        perf_iteration_begin(&button_perf);
+        BBB_PROBE2(stopwatch, button_iteration, event.pin, event.value);
+
+        if (event.type == GPIO_EVENT_QUARANTINE) {
+            (void) printf("\n[WARNING] GPIO %d is storming, ignoring it for %d ms.\n", event.pin, (int32_t) (GPIO_INPUT_DEFAULT_QUARANTINE_NS / 1000000));
+        }
+        else if (event.type == GPIO_EVENT_RELEASED) {
+            (void) printf("\n[WARNING] GPIO %d is back from quarantine.\n", event.pin);
+        }
+        else if (event.type == GPIO_EVENT_GHOSTING && event.value > 0) {
+            (void) printf("\n[WARNING] Keypad ghosting, %d keys ignored until some are released.\n", event.value);
+        }
+        // Lane key press: a lap for that lane
+        else if (event.type == GPIO_EVENT_KEY && event.pin > KEY_RESET && event.value == 1) {
+            trace_mark(TRACE_EVENT_PRESS, event.pin, (rt_now_ns() - event.time_ns) / NS_PER_US);
+            push_core_event(SW_EVENT_LAP, event.pin, event.time_ns);
+        }
+        // Start/stop button press (rising edge)
+        else if (is_press(&event, START_STOP_BUTTON_PIN, KEY_START_STOP) == 1) {
+            trace_mark(TRACE_EVENT_PRESS, event.pin, (rt_now_ns() - event.time_ns) / NS_PER_US);
+            push_core_event(SW_EVENT_TOGGLE, event.pin, event.time_ns);
         }
         // Check for reset button press
-        else if ((int32_t) reset_current == 1 && (int32_t) reset_prev == 0) {
-            lockMutex();
-            reset_requested = 1;
-            unlockMutex();
+        else if (is_press(&event, RESET_BUTTON_PIN, KEY_RESET) == 1) {
+            trace_mark(TRACE_EVENT_PRESS, event.pin, (rt_now_ns() - event.time_ns) / NS_PER_US);
+            push_core_event(SW_EVENT_RESET, event.pin, event.time_ns);
         }
         else {
         }
-        
-        // Update previous button states
-        start_stop_prev = start_stop_current;
-        reset_prev = reset_current;
-
-        (void) usleep(10000); // Sleep for 10ms - button polling period of 10 ms. 
-        // Every 10 ms, buttons are read with high priority.
+        perf_iteration_end(&button_perf);
     }
     
     return NULL;
@@ -94,12 +228,17 @@ static void *button_thread_func(void) {
 static void *display_thread_func(void) {
     float32_t time_to_display = 0.0f;
     int32_t is_running = 0;
-    
+    int64_t frame = 0;
+    SwCore snapshot;
+
+    open_thread_perf(&display_perf, "display");
     while (1 == 1) {
+        perf_iteration_begin(&display_perf);
         lockMutex();
-        time_to_display = current_time;
-        is_running = stopwatch_running;
+        swcore_read(&shared_core, &snapshot);
         unlockMutex();
+        is_running = (int32_t) (snapshot.state == SW_STATE_RUNNING);
+        time_to_display = (float32_t) ((double) swcore_elapsed_ns(&snapshot, rt_now_ns()) / 1e9);
 
         // Clear the current line
         (void) printf("\r                                                                 \r");
@@ -114,6 +253,13 @@ static void *display_thread_func(void) {
         
         // Ensure output is displayed immediately
         (void) fflush(stdout);
+        trace_mark(TRACE_EVENT_FRAME, frame, (int64_t) (time_to_display * 1000.0f));
+        BBB_PROBE2(stopwatch, display_iteration, frame, (int64_t) (time_to_display * 1000.0f));
+        if ((frame % JOURNAL_SYNC_FRAMES) == 0) {
+            journal_sync(&journal);
+        }
+        frame++;
+        perf_iteration_end(&display_perf);
         
         // Sleep for 100ms (display update period)
         (void) usleep(100000);
@@ -122,49 +268,70 @@ static void *display_thread_func(void) {
     return NULL;
 }
 
-// Timer thread - measures elasped time and sets the counter. 
-static void *timer_thread_func(void) {
-    struct timespec last_time, current_time_val;
-    float32_t elapsed_time;
+// Side effects of an applied event: LEDs, journal, trace markers and probes. Times are the elapsed time at the press.
+static void handle_core_output(const SwEvent *event, const SwOutput *output) {
+    int32_t state = 0;
 
-    // Get initial time using CLOCK_MONOTONIC (Clock that cannot be set and represents monotonic time since some unspecified starting point.)
-    // This initial time is what we will use to measure elapsed time by getting the times afterward.
-    (void) clock_gettime(CLOCK_MONOTONIC, &last_time);
+    if (output->effect == SW_EFFECT_START || output->effect == SW_EFFECT_STOP) {
+        state = (output->effect == SW_EFFECT_START) ? 1 : 0;
+        trace_mark(TRACE_EVENT_STATE, state, output->elapsed_ns / NS_PER_MS);
+        BBB_PROBE2(stopwatch, state, state, output->elapsed_ns);
 
-    while (1 == 1) {
-        // Get current time
-        (void) clock_gettime(CLOCK_MONOTONIC, &current_time_val);
+        // Update LEDs based on state
+        if (state == 1) {
+            set_gpio_off(RED_LED_PIN);
+            set_gpio_on(GREEN_LED_PIN);
+        } else {
+            set_gpio_on(RED_LED_PIN);
+            set_gpio_off(GREEN_LED_PIN);
+        }
+        trace_mark(TRACE_EVENT_LED, RED_LED_PIN, (state == 1) ? 0 : 1);
+        trace_mark(TRACE_EVENT_LED, GREEN_LED_PIN, state);
+        if (record_deadline(&press_latency, rt_now_ns() - event->time_ns, PRESS_DEADLINE_NS) == 1) {
+            trace_mark(TRACE_EVENT_DEADLINE_MISS, 0, (rt_now_ns() - event->time_ns) / NS_PER_US);
+        }
 
-        // Calculate elapsed time in seconds
-        elapsed_time = (current_time_val.tv_sec - last_time.tv_sec) +  // Calculate the difference in seconds
-                        (current_time_val.tv_nsec - last_time.tv_nsec) / 1000000000.0f;  // Calculate the difference in nanoseconds and then finally convert to seconds 
+        // The journal comes after the LEDs, the press deadline is about what the user sees.
+        (void) journal_append(&journal, (state == 1) ? JOURNAL_EVENT_START : JOURNAL_EVENT_STOP, output->elapsed_ns, event->source);
+    }
+    else if (output->effect == SW_EFFECT_RESET) {
+        trace_mark(TRACE_EVENT_STATE, 2, output->elapsed_ns / NS_PER_MS);
+        BBB_PROBE2(stopwatch, state, 2, output->elapsed_ns);
+        (void) journal_append(&journal, JOURNAL_EVENT_RESET, output->elapsed_ns, event->source);
+    }
+    else if (output->effect == SW_EFFECT_LAP) {
+        (void) journal_append(&journal, JOURNAL_EVENT_LAP, output->elapsed_ns, event->source);
+        (void) printf("\nLane %d: %.2f seconds\n", event->source, (double) output->elapsed_ns / 1e9);
+    }
+    else {
+    }
+}
 
-        // Update last time for next iteration
-        last_time = current_time_val;
+// Core thread - applies the stopwatch events as they come. The elapsed time is computed from the event timestamps
+// (see swcore.h), so nothing has to be accumulated on a tick and a reset counts from the press.
+static void *core_thread_func(void) {
+    SwEvent event;
+    SwOutput output;
+    int32_t applied = 0;
 
-        lockMutex();
+    open_thread_perf(&core_perf, "core");
 
-        // Handle reset if requested
-        if (reset_requested == 1) {
-            current_time = 0.0f;
-            reset_requested = 0;
-        } 
-        else if (stopwatch_running == 1) { // Update current time if stopwatch is running
-            if (current_time + elapsed_time < (float) FLT_MAX) {
-                current_time += elapsed_time;
-            }
-            else {
-                current_time = 0.0f; // Reset to 0 if overflow occurs
-            }
-        }
-        else {
-            unlockMutex();
-            (void) usleep(10000); // Sleep for 10ms if not running
+    while (1 == 1) {
+        if (sem_wait(&core_events_pending) != 0) {
             continue;
         }
+        perf_iteration_begin(&core_perf);
+
+        applied = 0;
+        while (sw_queue_pop(&core_events, &event) == 1) {
+            (void) swcore_apply(&core, &event, &output);
+            swcore_publish(&shared_core, &core);
+            handle_core_output(&event, &output);
+            applied++;
+        }
 
-        unlockMutex();
-        (void) usleep(10000);
+        BBB_PROBE1(stopwatch, core_iteration, applied);
+        perf_iteration_end(&core_perf);
     }
 
     return NULL;
@@ -197,14 +364,37 @@ static int32_t get_input_and_initialize_gpio(void) {
         ret = -1;
     }
 
-    if 
-    ( 
-        ret == 0 && // Make sure previous part was successful.
-        setup_gpio_pin(START_STOP_BUTTON_PIN, (BufferPointer) GPIO_INPUT_MODE) && 
-        setup_gpio_pin(RESET_BUTTON_PIN, (BufferPointer) GPIO_INPUT_MODE) && 
-        setup_gpio_pin(RED_LED_PIN, (BufferPointer)GPIO_OUTPUT_MODE) && 
-        setup_gpio_pin(GREEN_LED_PIN, (BufferPointer) GPIO_OUTPUT_MODE)
-    ) 
+    timeline_mark_wait("config (stdin)", TIMELINE_NO_ID);
+
+    // Set up the pins one at a time (stopping at the first failure) so the startup timeline shows each one.
+    if (ret == 0 && setup_gpio_pin(START_STOP_BUTTON_PIN, (BufferPointer) GPIO_INPUT_MODE) != 1) {
+        ret = -1;
+    }
+    timeline_mark("setup start/stop button gpio", START_STOP_BUTTON_PIN);
+
+    if (ret == 0 && setup_gpio_pin(RESET_BUTTON_PIN, (BufferPointer) GPIO_INPUT_MODE) != 1) {
+        ret = -1;
+    }
+    timeline_mark("setup reset button gpio", RESET_BUTTON_PIN);
+
+    // The buttons read 1 when pressed, so turn on the internal pull-downs instead of needing external resistors.
+    // Not fatal: without the pinmux helpers (no cape-universal overlay) external resistors still work.
+    if (ret == 0 && (set_gpio_pull(START_STOP_BUTTON_PIN, (BufferPointer) PINMUX_GPIO_PD) != 1 || set_gpio_pull(RESET_BUTTON_PIN, (BufferPointer) PINMUX_GPIO_PD) != 1)) {
+        (void) printf("[WARNING] Could not enable the button pull-down resistors, use external ones.\n");
+    }
+    timeline_mark("button pull-downs (pinmux)", TIMELINE_NO_ID);
+
+    if (ret == 0 && setup_gpio_pin(RED_LED_PIN, (BufferPointer) GPIO_OUTPUT_MODE) != 1) {
+        ret = -1;
+    }
+    timeline_mark("setup red led gpio", RED_LED_PIN);
+
+    if (ret == 0 && setup_gpio_pin(GREEN_LED_PIN, (BufferPointer) GPIO_OUTPUT_MODE) != 1) {
+        ret = -1;
+    }
+    timeline_mark("setup green led gpio", GREEN_LED_PIN);
+
+    if (ret == 0) 
     {
         set_gpio_on(RED_LED_PIN);
         set_gpio_off(GREEN_LED_PIN);
@@ -235,33 +425,220 @@ static void cleanup(int32_t signum) {
     // Destroy mutex
     (void) pthread_mutex_destroy(&mutex);
 
+    SwCore snapshot;
+
+    swcore_read(&shared_core, &snapshot);
+    (void) journal_append(&journal, JOURNAL_EVENT_END, swcore_elapsed_ns(&snapshot, rt_now_ns()), 0);
+    journal_close(&journal);
+    trace_close();
+
+    if (fault_mode == 1) {
+        (void) printf("\n");
+        fault_print_report();
+        (void) printf("Deadlines under fault injection:\n");
+        print_deadline("press to LEDs", &press_latency, PRESS_DEADLINE_NS);
+        (void) printf("  %u GPIO writes failed, %llu stopwatch events dropped (queue full)\n", get_gpio_write_failures(),
+                      (unsigned long long) atomic_load(&core_events.dropped));
+    }
+
+    if (perf_mode == 1) {
+        (void) printf("\nPerformance counters per loop iteration:\n");
+        perf_print_report(&button_perf);
+        perf_print_report(&core_perf);
+        perf_print_report(&display_perf);
+    }
+
+    if (keypad_mode == 1) {
+        (void) printf("\n");
+        keypad_print_stats(&keypad);
+    }
+
+    // Turns the edge interrupts of the gates off again.
+    if (gate_mode == 1) {
+        photogate_stop(&gate);
+    }
+
     (void) printf("\nStopwatch application terminated.\n");
     exit(0);
 }
 
+// SIGUSR1 - turns the trace markers off and on.
+static void toggle_trace(int32_t signum) {
+    (void) signum;
+    trace_enable((trace_enabled() == 1) ? 0 : 1);
+}
+
+// Gate mode - light gates instead of the start/stop button. ./stopwatch gate [sampled]
+// The first gate starts a run, the last one stops it and any gates in between record splits. Times come straight from
+// the edge timestamps of the gates, like the button presses of the core thread. "sampled" polls the gates through
+// /dev/mem instead of waiting for their interrupts: a bounded resolution, but it keeps the CPU busy (see photogate.h).
+static int32_t run_gate_mode(int32_t sampled) {
+    Buffer input;
+    PhotogateConfig config;
+    PhotogateRun run;
+    char *token = NULL;
+    uint32_t runs = 0U;
+
+    photogate_default_config(&config);
+
+    (void) printf("Please provide the GPIO pins of the light gates in order. Format:\n");
+    (void) printf("Start gate GPIO Pin,[Split gate GPIO Pins,...]Stop gate GPIO Pin\n");
+
+    if (fgets((char *) input, sizeof(input), stdin) == NULL) {
+        return -1;
+    }
+
+    token = strtok((char *) input, ",\n");
+    while (token != NULL && config.count < PHOTOGATE_MAX_GATES) {
+        config.pins[config.count] = atoi(token);
+        if (setup_gpio_pin(config.pins[config.count], (BufferPointer) GPIO_INPUT_MODE) != 1) {
+            (void) printf("[ERROR] Could not set up gate GPIO %d\n", config.pins[config.count]);
+            return -1;
+        }
+        config.count++;
+        token = strtok(NULL, ",\n");
+    }
+
+    if (sampled == 1) {
+        if (gpio_bank_open(GPIO_BACKEND_MMAP) != 1) {
+            (void) printf("[ERROR] The gate sampler needs /dev/mem, run without \"sampled\" to use the edge interrupts.\n");
+            return -1;
+        }
+        config.mode = PHOTOGATE_MODE_SAMPLED;
+    }
+
+    if (photogate_start(&gate, &config, sched_get_priority_max(SCHED_FIFO)) != 1) {
+        (void) printf("[ERROR] Need at least a start and a stop gate (at most %d gates) that can all be read.\n", PHOTOGATE_MAX_GATES);
+        return -1;
+    }
+    gate_mode = 1;
+
+    (void) printf("Waiting for runs...\n");
+    while (1 == 1) {
+        if (photogate_wait_run(&gate, &run, -1) == 1) {
+            runs++;
+            (void) journal_append(&journal, JOURNAL_EVENT_START, 0, config.pins[0]);
+            for (int32_t i = 1; i < run.count; i++) {
+                (void) journal_append(&journal, (i == run.count - 1) ? JOURNAL_EVENT_STOP : JOURNAL_EVENT_LAP, photogate_elapsed_ns(&run, i), config.pins[i]);
+            }
+            journal_sync(&journal);
+            (void) printf("Run %u:\n", runs);
+            photogate_print_run(&run);
+            photogate_print_resolution(&gate);
+        }
+    }
+
+    return 0;
+}
+
+// Sets up the lane keypad from comma separated row and column pins. 0 on success, -1 otherwise.
+static int32_t setup_keypad(const char *rows, const char *columns) {
+    KeypadConfig config;
+    char list[2][128];
+    int32_t ret = 0;
+
+    keypad_default_config(&config);
+    (void) snprintf(list[0], sizeof(list[0]), "%s", rows);
+    (void) snprintf(list[1], sizeof(list[1]), "%s", columns);
+
+    for (int32_t l = 0; l < 2 && ret == 0; l++) {
+        char *token = strtok(list[l], ",");
+
+        while (token != NULL && ret == 0) {
+            int32_t pin = atoi(token);
+
+            if (l == 0 && config.row_count < KEYPAD_MAX_ROWS && setup_gpio_pin(pin, (BufferPointer) GPIO_OUTPUT_MODE) == 1) {
+                config.row_pins[config.row_count] = pin;
+                config.row_count++;
+            }
+            else if (l == 1 && config.column_count < KEYPAD_MAX_COLUMNS && setup_gpio_pin(pin, (BufferPointer) GPIO_INPUT_MODE) == 1) {
+                (void) set_gpio_pull(pin, (BufferPointer) PINMUX_GPIO_PD);
+                config.column_pins[config.column_count] = pin;
+                config.column_count++;
+            }
+            else {
+                (void) printf("[ERROR] Could not set up keypad GPIO %d\n", pin);
+                ret = -1;
+            }
+            token = strtok(NULL, ",");
+        }
+    }
+
+    // One register write / read per row on MMAP, sysfs still works (a slower scan).
+    if (ret == 0 && gpio_bank_open(GPIO_BACKEND_MMAP) != 1) {
+        (void) printf("[WARNING] /dev/mem not available, scanning the keypad through sysfs.\n");
+        (void) gpio_bank_open(GPIO_BACKEND_SYSFS);
+    }
+    if (ret == 0 && keypad_init(&keypad, &config) != 1) {
+        (void) printf("[ERROR] The keypad rows must all be in one GPIO bank, and the columns too (at most %d of each).\n", KEYPAD_MAX_ROWS);
+        ret = -1;
+    }
+
+    return ret;
+}
+
 // Main function that has all our code that runs our threads and handles setting up priorities for them.
-int32_t main(void) {
+int32_t main(int32_t argc, char **argv) {
 
     (void) signal(SIGINT, &cleanup); // CTRL+C
     (void) signal(SIGTSTP, &cleanup); // CTRL+Z
     (void) signal(SIGTERM, &cleanup); // Kill command
     (void) signal(SIGQUIT, &cleanup); // CTRL+ \ /
 
+    // Not fatal: the stopwatch works without a history, it just can't be audited.
+    if (journal_open(&journal, JOURNAL_DEFAULT_DIR) != 1) {
+        (void) printf("[WARNING] Could not open the session journal in %s, sessions will not be recorded.\n", JOURNAL_DEFAULT_DIR);
+    }
+    timeline_mark("open session journal", TIMELINE_NO_ID);
+
+    // Fault injection: every GPIO operation from here on goes through the rules (see fault.h).
+    if (argc > 2 && strcmp(argv[1], "fault") == 0) {
+        fault_init((uint64_t) rt_now_ns());
+        if (fault_parse(argv[2]) <= 0) {
+            (void) printf("[ERROR] Could not parse the fault rules \"%s\"\n", argv[2]);
+            return 1;
+        }
+        fault_enable(1);
+        fault_mode = 1;
+        fault_print_report();
+    }
+
+    // Counters per thread loop iteration, printed on exit (see perfstat.h).
+    if (argc > 1 && strcmp(argv[1], "perf") == 0) {
+        perf_mode = 1;
+    }
+
+    // ftrace markers (see tracemark.h): ./stopwatch trace [file], into the kernel trace buffer unless a file is given.
+    // SIGUSR1 turns them off and on while running.
+    if (argc > 1 && strcmp(argv[1], "trace") == 0) {
+        if (trace_open((argc > 2) ? argv[2] : NULL) != 1) {
+            (void) printf("[ERROR] Could not open %s for the trace markers\n", (argc > 2) ? argv[2] : TRACE_MARKER_PATH);
+            return 1;
+        }
+        trace_enable(1);
+        (void) signal(SIGUSR1, &toggle_trace);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "gate") == 0) {
+        check((int32_t) run_gate_mode((argc > 2 && strcmp(argv[2], "sampled") == 0) ? 1 : 0), (BufferPointer) "gate mode");
+        return 0;
+    }
+
     // Set up threads with real-time priority using FIFO.
-    pthread_t button_thread, display_thread, timer_thread;
-    pthread_attr_t button_attr, display_attr, timer_attr;
-    struct sched_param button_param, display_param, timer_param;
+    pthread_t button_thread, display_thread, core_thread;
+    pthread_attr_t button_attr, display_attr, core_attr;
+    struct sched_param button_param, display_param, core_param;
 
     // Init attributes
     // Small note - these check functions will exit if we find anything bad going on. 
     check((int32_t) pthread_attr_init(&button_attr), (BufferPointer) "pthread_attr_init (button)");
     check((int32_t) pthread_attr_init(&display_attr), (BufferPointer) "pthread_attr_init (display)");
-    check((int32_t) pthread_attr_init(&timer_attr), (BufferPointer) "pthread_attr_init (timer)");
+    check((int32_t) pthread_attr_init(&core_attr), (BufferPointer) "pthread_attr_init (core)");
 
     // Set scheduling policy (FIFO for real-time)
     check((int32_t) pthread_attr_setschedpolicy(&button_attr, SCHED_FIFO), (BufferPointer) "setschedpolicy (button)");
     check((int32_t) pthread_attr_setschedpolicy(&display_attr, SCHED_FIFO), (BufferPointer) "setschedpolicy (display)");
-    check((int32_t) pthread_attr_setschedpolicy(&timer_attr, SCHED_FIFO), (BufferPointer) "setschedpolicy (timer)");
+    check((int32_t) pthread_attr_setschedpolicy(&core_attr, SCHED_FIFO), (BufferPointer) "setschedpolicy (core)");
 
     // Set priorities from our macros
     // Get min and max priorities for SCHED_FIFO
@@ -274,29 +651,29 @@ int32_t main(void) {
 
     // Assign priorities based on Rate Monotonic Scheduling
     int32_t button_priority  = max_priority;         // Fastest period (10ms)
-    int32_t timer_priority   = max_priority - 10;    // Mid (10ms but maybe not blocking)
+    int32_t core_priority    = max_priority - 10;    // Mid (runs once per press, right after the button thread)
     int32_t display_priority = min_priority + 50;         // Slowest (100ms)
     // We are using three threads so we can use max and min priorities. Won't make much difference.
 
     // Print for verification
     (void) printf("Assigned Priorities:\n");
     (void) printf("  Button  Thread: %d\n", button_priority);
-    (void) printf("  Timer   Thread: %d\n", timer_priority);
+    (void) printf("  Core    Thread: %d\n", core_priority);
     (void) printf("  Display Thread: %d\n", display_priority);
 
     // Set thread priorities
     button_param.sched_priority = button_priority;
     display_param.sched_priority = display_priority;
-    timer_param.sched_priority = timer_priority;
+    core_param.sched_priority = core_priority;
 
     check((int32_t) pthread_attr_setschedparam(&button_attr, &button_param), (BufferPointer) "setschedparam (button)");
     check((int32_t) pthread_attr_setschedparam(&display_attr, &display_param), (BufferPointer) "setschedparam (display)");
-    check((int32_t) pthread_attr_setschedparam(&timer_attr, &timer_param), (BufferPointer) "setschedparam (timer)");
+    check((int32_t) pthread_attr_setschedparam(&core_attr, &core_param), (BufferPointer) "setschedparam (core)");
 
     // Use explicit scheduling to make sure the thread runs with the specified priority and not with that of parent.
     check((int32_t) pthread_attr_setinheritsched(&button_attr, PTHREAD_EXPLICIT_SCHED), (BufferPointer) "setinheritsched (button)");
     check((int32_t) pthread_attr_setinheritsched(&display_attr, PTHREAD_EXPLICIT_SCHED), (BufferPointer) "setinheritsched (display)");
-    check((int32_t) pthread_attr_setinheritsched(&timer_attr, PTHREAD_EXPLICIT_SCHED), (BufferPointer) "setinheritsched (timer)");
+    check((int32_t) pthread_attr_setinheritsched(&core_attr, PTHREAD_EXPLICIT_SCHED), (BufferPointer) "setinheritsched (core)");
 
     // Init mutex. Use mutex attributes to configure how the mutex works.
     // Set the protocol for the mutex. We're using "PTHREAD_PRIO_INHERIT" to ensure priority inheritance,
@@ -308,18 +685,41 @@ int32_t main(void) {
     check(pthread_mutexattr_init(&mutex_attr), (BufferPointer) "pthread_mutexattr_init");
     check(pthread_mutexattr_setprotocol(&mutex_attr, PTHREAD_PRIO_INHERIT), (BufferPointer) "pthread_mutexattr_setprotocol");
     check(pthread_mutex_init(&mutex, &mutex_attr), (BufferPointer) "pthread_mutex_init");
+
+    // Stopwatch core at zero, and the queue the button thread feeds it through.
+    sw_queue_init(&core_events);
+    check((sem_init(&core_events_pending, 0, 0U) == 0) ? 0 : errno, (BufferPointer) "sem_init");
+    swcore_init(&core, rt_now_ns());
+    swcore_publish(&shared_core, &core);
     
+    timeline_mark("thread attributes and mutex", TIMELINE_NO_ID);
+
     check((int32_t) get_input_and_initialize_gpio(), (BufferPointer) "gpio_setup");
+
+    // Lane keypad: ./stopwatch keypad <row pins> <column pins>, e.g. ./stopwatch keypad 66,67,69,68 45,44,23,26
+    if (argc > 3 && strcmp(argv[1], "keypad") == 0) {
+        if (setup_keypad(argv[2], argv[3]) != 0) {
+            return 1;
+        }
+        keypad_mode = 1;
+        timeline_mark("setup keypad", TIMELINE_NO_ID);
+    }
     
-    // Start our threads.
+    // Start our threads. Hold the mutex until the timeline is printed so the display thread doesn't write over it.
+    lockMutex();
     check((int32_t) pthread_create(&button_thread, &button_attr, &button_thread_func, NULL), (BufferPointer) "pthread_create (button)");
+    timeline_mark("start button thread", TIMELINE_NO_ID);
     check((int32_t) pthread_create(&display_thread, &display_attr, &display_thread_func, NULL), (BufferPointer) "pthread_create (display)");
-    check((int32_t) pthread_create(&timer_thread, &timer_attr, &timer_thread_func, NULL), (BufferPointer) "pthread_create (timer)");
+    timeline_mark("start display thread", TIMELINE_NO_ID);
+    check((int32_t) pthread_create(&core_thread, &core_attr, &core_thread_func, NULL), (BufferPointer) "pthread_create (core)");
+    timeline_mark("start core thread", TIMELINE_NO_ID);
+    timeline_print();
+    unlockMutex();
     
     // We will never reach here since we have threads with inifinte loops.
     (void) pthread_join(button_thread, NULL);
     (void) pthread_join(display_thread, NULL);
-    (void) pthread_join(timer_thread, NULL);
+    (void) pthread_join(core_thread, NULL);
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+This file implements all the functions defined in swcore.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN SWCORE.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <string.h>
+#include "swcore.h"
+
+
+typedef struct {
+    int32_t next_state;
+    int32_t effect;
+    int64_t keep_mask;      // All ones to keep the elapsed time, 0 to zero it
+} SwTransition;
+
+#define KEEP ((int64_t) -1)
+
+#define ZERO ((int64_t) 0)
+
+static const SwTransition transitions[SW_STATE_COUNT][SW_EVENT_COUNT] = {
+    // SW_STATE_ZERO
+    {
+        { SW_STATE_RUNNING, SW_EFFECT_START, KEEP },     // start
+        { SW_STATE_ZERO, SW_EFFECT_NONE, KEEP },         // stop
+        { SW_STATE_RUNNING, SW_EFFECT_START, KEEP },     // toggle
+        { SW_STATE_ZERO, SW_EFFECT_RESET, ZERO },        // reset
+        { SW_STATE_ZERO, SW_EFFECT_LAP, KEEP }           // lap
+    },
+    // SW_STATE_RUNNING: a reset zeroes the time and keeps running
+    {
+        { SW_STATE_RUNNING, SW_EFFECT_NONE, KEEP },
+        { SW_STATE_STOPPED, SW_EFFECT_STOP, KEEP },
+        { SW_STATE_STOPPED, SW_EFFECT_STOP, KEEP },
+        { SW_STATE_RUNNING, SW_EFFECT_RESET, ZERO },
+        { SW_STATE_RUNNING, SW_EFFECT_LAP, KEEP }
+    },
+    // SW_STATE_STOPPED
+    {
+        { SW_STATE_RUNNING, SW_EFFECT_START, KEEP },
+        { SW_STATE_STOPPED, SW_EFFECT_NONE, KEEP },
+        { SW_STATE_RUNNING, SW_EFFECT_START, KEEP },
+        { SW_STATE_ZERO, SW_EFFECT_RESET, ZERO },
+        { SW_STATE_STOPPED, SW_EFFECT_LAP, KEEP }
+    }
+};
+
+// 1 for the states the time runs in.
+static const int64_t running[SW_STATE_COUNT] = { 0, 1, 0 };
+
+
+void swcore_init(SwCore *core, int64_t now_ns) {
+    (void) memset(core, 0, sizeof(*core));
+    core->state = SW_STATE_ZERO;
+    core->origin_ns = now_ns;
+    core->last_ns = now_ns;
+}
+
+
+int64_t swcore_elapsed_ns(const SwCore *core, int64_t now_ns) {
+    return core->base_ns + (running[core->state] * (now_ns - core->origin_ns));
+}
+
+
+int32_t swcore_apply(SwCore *core, const SwEvent *event, SwOutput *output) {
+    int64_t time_ns = event->time_ns;
+
+    if (time_ns < core->last_ns) {
+        time_ns = core->last_ns;
+        core->reordered++;
+    }
+    output->time_ns = time_ns;
+    output->elapsed_ns = swcore_elapsed_ns(core, time_ns);
+
+    if (event->type >= 0 && event->type < SW_EVENT_COUNT) {
+        const SwTransition *t = &transitions[core->state][event->type];
+
+        // Every transition re-bases the time at the event, including the ones that don't change anything.
+        core->base_ns = output->elapsed_ns & t->keep_mask;
+        core->origin_ns = time_ns;
+        core->last_ns = time_ns;
+        core->state = t->next_state;
+        output->effect = t->effect;
+    }
+    else {
+        output->effect = SW_EFFECT_NONE;
+    }
+    output->state = core->state;
+
+    core->applied++;
+    if (output->effect == SW_EFFECT_NONE) {
+        core->no_effect++;
+    }
+
+    return output->effect;
+}
+
+
+int32_t swcore_replay(SwCore *core, const SwEvent *events, int32_t count) {
+    int32_t effects = 0;
+    int32_t i = 0;
+    SwOutput output;
+
+    for (i = 0; i < count; i++) {
+        if (swcore_apply(core, &events[i], &output) != SW_EFFECT_NONE) {
+            effects++;
+        }
+    }
+
+    return effects;
+}
+
+
+void sw_queue_init(SwQueue *queue) {
+    uint32_t i = 0U;
+
+    for (i = 0U; i < SW_QUEUE_SIZE; i++) {
+        atomic_store_explicit(&queue->cells[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&queue->tail, 0U, memory_order_relaxed);
+    queue->head = 0U;
+    atomic_store(&queue->dropped, 0ULL);
+}
+
+
+int32_t sw_queue_push(SwQueue *queue, const SwEvent *event) {
+    int32_t result = 0;
+    int32_t done = 0;
+    uint32_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    while (done == 0) {
+        SwQueueCell *cell = &queue->cells[position & (SW_QUEUE_SIZE - 1U)];
+        int32_t difference = (int32_t) (atomic_load_explicit(&cell->sequence, memory_order_acquire) - position);
+
+        if (difference == 0) {
+            // The cell is free for this lap of the ring: claim it, or retry from wherever another producer got to.
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1U, memory_order_relaxed, memory_order_relaxed)) {
+                cell->event = *event;
+                atomic_store_explicit(&cell->sequence, position + 1U, memory_order_release);
+                result = 1;
+                done = 1;
+            }
+            else {
+            }
+        }
+        else if (difference < 0) {
+            // The consumer hasn't read this cell from the previous lap yet: full.
+            (void) atomic_fetch_add_explicit(&queue->dropped, 1ULL, memory_order_relaxed);
+            done = 1;
+        }
+        else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    return result;
+}
+
+
+int32_t sw_queue_pop(SwQueue *queue, SwEvent *event) {
+    int32_t result = 0;
+    SwQueueCell *cell = &queue->cells[queue->head & (SW_QUEUE_SIZE - 1U)];
+
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) == queue->head + 1U) {
+        *event = cell->event;
+        atomic_store_explicit(&cell->sequence, queue->head + SW_QUEUE_SIZE, memory_order_release);
+        queue->head++;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+void swcore_publish(SwShared *shared, const SwCore *core) {
+    uint32_t sequence = atomic_load_explicit(&shared->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&shared->sequence, sequence + 1U, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&shared->state, core->state, memory_order_relaxed);
+    atomic_store_explicit(&shared->base_ns, core->base_ns, memory_order_relaxed);
+    atomic_store_explicit(&shared->origin_ns, core->origin_ns, memory_order_relaxed);
+    atomic_store_explicit(&shared->sequence, sequence + 2U, memory_order_release);
+}
+
+
+void swcore_read(SwShared *shared, SwCore *core) {
+    uint32_t before = 0U;
+    uint32_t after = 0U;
+
+    (void) memset(core, 0, sizeof(*core));
+    do {
+        before = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+        core->state = atomic_load_explicit(&shared->state, memory_order_relaxed);
+        core->base_ns = atomic_load_explicit(&shared->base_ns, memory_order_relaxed);
+        core->origin_ns = atomic_load_explicit(&shared->origin_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&shared->sequence, memory_order_relaxed);
+    } while ((before & 1U) != 0U || before != after);
+}
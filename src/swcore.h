@@ -0,0 +1,188 @@
+/*
+This file is for defining the core of the stopwatch as an event-sourced state machine, so the state isn't a set of
+variables (running, reset requested, current time) changed from three threads under a mutex.
+
+- The state is what the stopwatch shows: SW_STATE_ZERO (stopped at 0), SW_STATE_RUNNING or SW_STATE_STOPPED (paused).
+- Every input is an event with a timestamp: start, stop, toggle (the start/stop button), reset and lap. The buttons and
+  the keypad push events to a lock-free multi-producer single-consumer queue (SwQueue), and one thread applies them.
+- A transition is one lookup in a table (state x event gives the next state, the effect and whether the elapsed time
+  is kept or zeroed) and the same few assignments for every entry. It takes effect at the event's timestamp, not when
+  the event is applied: the elapsed time is base_ns + (now - origin_ns) while running, and a transition just re-bases
+  it at the event time. A reset pressed 7 ms before the consumer gets to it still zeroes the time at the press.
+- swcore_apply only reads the core and the event and writes the core: no clock, no I/O, no globals. Replaying the same
+  events gives the same states (swcore_replay), so a session can be rebuilt from its events and the core benchmarked
+  on its own.
+
+Producers push with a compare-and-swap on the tail and a per-cell sequence number (Vyukov's bounded MPMC queue, with a
+single consumer). A full queue drops the event and counts it rather than blocking a producer.
+
+The consumer publishes the core after each event with a sequence lock (SwShared) so the display can read a consistent
+state without a mutex.
+
+Sources:
+https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+https://www.kernel.org/doc/html/latest/locking/seqlock.html
+*/
+
+#ifndef SWCORE_H
+#define SWCORE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define SW_STATE_ZERO ((int32_t) 0)
+
+#define SW_STATE_RUNNING ((int32_t) 1)
+
+#define SW_STATE_STOPPED ((int32_t) 2)
+
+#define SW_STATE_COUNT ((int32_t) 3)
+
+#define SW_EVENT_START ((int32_t) 0)
+
+#define SW_EVENT_STOP ((int32_t) 1)
+
+// Start when not running, stop when running (the start/stop button).
+#define SW_EVENT_TOGGLE ((int32_t) 2)
+
+#define SW_EVENT_RESET ((int32_t) 3)
+
+#define SW_EVENT_LAP ((int32_t) 4)
+
+#define SW_EVENT_COUNT ((int32_t) 5)
+
+// What a transition did, for the consumer's side effects (LEDs, journal, display).
+#define SW_EFFECT_NONE ((int32_t) 0)
+
+#define SW_EFFECT_START ((int32_t) 1)
+
+#define SW_EFFECT_STOP ((int32_t) 2)
+
+#define SW_EFFECT_RESET ((int32_t) 3)
+
+#define SW_EFFECT_LAP ((int32_t) 4)
+
+// Events the queue holds. Must be a power of 2.
+#define SW_QUEUE_SIZE ((uint32_t) 64)
+
+
+typedef struct {
+    int32_t type;           // SW_EVENT_
+    int32_t source;         // Pin or key that produced it (for the journal)
+    int64_t time_ns;        // CLOCK_MONOTONIC time of the press
+} SwEvent;
+
+typedef struct {
+    int32_t state;          // SW_STATE_
+    int64_t base_ns;        // Elapsed time at origin_ns
+    int64_t origin_ns;      // Time of the last transition
+    int64_t last_ns;        // Time of the last event applied, an earlier event is applied at this time instead
+    uint64_t applied;       // Events applied
+    uint64_t no_effect;     // Events that changed nothing (stop while stopped...)
+    uint64_t reordered;     // Events older than the last one applied
+} SwCore;
+
+// Result of one event.
+typedef struct {
+    int32_t effect;         // SW_EFFECT_
+    int32_t state;          // State after the event
+    int64_t elapsed_ns;     // Elapsed time at the event, before the transition (the time a stop, reset or lap records)
+    int64_t time_ns;        // Time the event was applied at
+} SwOutput;
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    SwEvent event;
+} SwQueueCell;
+
+typedef struct {
+    SwQueueCell cells[SW_QUEUE_SIZE];
+    _Atomic uint32_t tail;          // Next cell a producer claims
+    uint32_t head;                  // Next cell the consumer reads, consumer only
+    atomic_ullong dropped;          // Pushes to a full queue
+} SwQueue;
+
+// The consumer's core, for other threads. sequence is odd while it is written.
+typedef struct {
+    _Atomic uint32_t sequence;
+    atomic_int state;
+    _Atomic int64_t base_ns;
+    _Atomic int64_t origin_ns;
+} SwShared;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Starts a core at zero.
+// Parameters:
+// core   - The core
+// now_ns - Time it starts at (events before it are applied at this time)
+void swcore_init(SwCore *core, int64_t now_ns);
+
+
+// Description: Applies one event to the core at the event's timestamp (or at the last event's, if it is older).
+// Parameters:
+// core   - The core
+// event  - The event
+// output - What the event did
+// Returns - The effect (output->effect). An unknown event type has no effect.
+int32_t swcore_apply(SwCore *core, const SwEvent *event, SwOutput *output);
+
+
+// Description: Applies a list of events in order, e.g. to rebuild a session from its history.
+// Parameters:
+// core   - The core (usually fresh from swcore_init)
+// events - The events
+// count  - Number of events
+// Returns - Number of events with an effect.
+int32_t swcore_replay(SwCore *core, const SwEvent *events, int32_t count);
+
+
+// Description: Elapsed time of the core at a given time.
+// Parameters:
+// core   - The core
+// now_ns - The time, not before the last event applied
+// Returns - Elapsed time in nanoseconds.
+int64_t swcore_elapsed_ns(const SwCore *core, int64_t now_ns);
+
+
+// Description: Empties a queue.
+// Parameters: queue - The queue
+void sw_queue_init(SwQueue *queue);
+
+
+// Description: Adds an event to the queue. Any number of threads may push at once. Never blocks.
+// Parameters:
+// queue - The queue
+// event - The event (copied)
+// Returns - 1 if queued, 0 if the queue was full (the event is dropped and counted).
+int32_t sw_queue_push(SwQueue *queue, const SwEvent *event);
+
+
+// Description: Takes the oldest event of the queue. Only one thread may pop.
+// Parameters:
+// queue - The queue
+// event - Where the event is stored
+// Returns - 1 if an event was taken, 0 if the queue is empty.
+int32_t sw_queue_pop(SwQueue *queue, SwEvent *event);
+
+
+// Description: Publishes the core for swcore_read. Only the consumer may publish.
+// Parameters:
+// shared - Where it is published
+// core   - The core
+void swcore_publish(SwShared *shared, const SwCore *core);
+
+
+// Description: Reads the last published core, from any thread. Only state, base_ns and origin_ns are set, which is
+// what swcore_elapsed_ns needs.
+// Parameters:
+// shared - Where it is published
+// core   - Where it is copied
+void swcore_read(SwShared *shared, SwCore *core);
+
+
+#endif // End of include guard
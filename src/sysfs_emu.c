@@ -0,0 +1,792 @@
+/*
+This file is a FUSE filesystem that emulates the parts of the BeagleBone sysfs tree bbbio uses, with the kernel's behavior
+instead of plain files, so the library, the stopwatch and their startup / hot path timings can be exercised off-target.
+A tmpfs mock tree accepts anything; this one behaves like the GPIO and PWM drivers:
+
+- /sys/class/gpio/export creates gpioN/, but its files only appear after the export delay (like udev fixing their
+  permissions on the board). Exporting twice fails with EBUSY, unexporting a pin that isn't exported with EINVAL.
+- direction takes in / out / low / high, edge takes none / rising / falling / both, anything else is EINVAL.
+  Writing value on an input is EPERM, a pin with an edge set can't become an output (EIO).
+- poll() on a value file reports POLLPRI | POLLERR after an edge matching the edge file, until the file is read again.
+- PWM chips: export creates pwm-C:N/ (after the export delay), duty_cycle > period is EINVAL in either order of writes,
+  enabling with period 0 is EINVAL.
+- Pinmux state files (ocp:PX_YY_pinmux/state) for every header GPIO, accepting only the states of the cape-universal overlay.
+- Every read and write can be given a fixed latency, to model a loaded board.
+
+Inputs are driven through an extra control tree that isn't part of sysfs:
+- /emu/inject: write "PIN VALUE" to change the level of an exported input (and raise edges on it).
+- /emu/stats:  read the operation counters.
+
+Usage:
+    make sysfs_emu                       (needs libfuse3 and its headers: apt install libfuse3-dev)
+    mkdir -p /tmp/bbbfs && ./sysfs_emu /tmp/bbbfs -f [--export-delay-ms=N] [--read-us=N] [--write-us=N]
+    make SYSFS_ROOT=/tmp/bbbfs all bench (in another terminal: bbbio now uses /tmp/bbbfs/sys/...)
+    echo "60 1" > /tmp/bbbfs/emu/inject  (press the button on GPIO 60)
+
+Sources:
+https://www.kernel.org/doc/Documentation/gpio/sysfs.txt
+https://www.kernel.org/doc/Documentation/pwm.txt
+https://libfuse.github.io/doxygen/structfuse__operations.html
+*/
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse.h>
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "bbbio.h"
+#include "rtutil.h"
+
+// GPIO numbers the emulator knows (4 banks of 32).
+#define EMU_GPIO_COUNT ((int32_t) 128)
+
+#define EMU_PWM_CHIPS ((int32_t) 2)
+
+#define EMU_PWM_CHANNELS ((int32_t) 2)
+
+#define EMU_INJECT_PATH "/emu/inject"
+
+#define EMU_STATS_PATH "/emu/stats"
+
+#define EMU_DEFAULT_EXPORT_DELAY_MS ((uint32_t) 50)
+
+// Every path the emulator can show at once (export files, 4 files per GPIO, pinmux files, PWM files, control files).
+#define EMU_MAX_FILES ((int32_t) 800)
+
+#define EMU_PATH_LENGTH ((int32_t) 160)
+
+#define EMU_CONTENT_LENGTH ((int32_t) 512)
+
+#define EDGE_NONE ((int32_t) 0)
+#define EDGE_RISING ((int32_t) 1)
+#define EDGE_FALLING ((int32_t) 2)
+#define EDGE_BOTH ((int32_t) 3)
+
+// What a path refers to.
+#define NODE_NONE ((int32_t) 0)
+#define NODE_DIR ((int32_t) 1)
+#define NODE_GPIO_EXPORT ((int32_t) 2)
+#define NODE_GPIO_UNEXPORT ((int32_t) 3)
+#define NODE_GPIO_DIRECTION ((int32_t) 4)
+#define NODE_GPIO_VALUE ((int32_t) 5)
+#define NODE_GPIO_EDGE ((int32_t) 6)
+#define NODE_GPIO_ACTIVE_LOW ((int32_t) 7)
+#define NODE_PINMUX_STATE ((int32_t) 8)
+#define NODE_PWM_EXPORT ((int32_t) 9)
+#define NODE_PWM_PERIOD ((int32_t) 10)
+#define NODE_PWM_DUTY ((int32_t) 11)
+#define NODE_PWM_ENABLE ((int32_t) 12)
+#define NODE_EMU_INJECT ((int32_t) 13)
+#define NODE_EMU_STATS ((int32_t) 14)
+
+typedef struct {
+    int32_t kind;
+    int32_t gpio;       // GPIO number, or the GPIO of the header pin for pinmux files
+    int32_t chip;
+    int32_t channel;
+} Node;
+
+typedef struct {
+    int32_t exported;
+    int64_t export_ns;
+    int32_t output;
+    int32_t value;
+    int32_t edge;
+    int32_t active_low;
+    uint32_t events;                    // Edges raised so far, poll reports POLLPRI until a reader has seen them all
+    struct fuse_pollhandle *poll_handle;
+    char pinmux[PINMUX_STATE_LENGTH];
+} EmuGpio;
+
+typedef struct {
+    int32_t exported;
+    int64_t export_ns;
+    int64_t period;
+    int64_t duty;
+    int32_t enabled;
+} EmuPwm;
+
+// Per open file: the event count the reader has seen, like kernfs keeps per open file.
+typedef struct {
+    Node node;
+    uint32_t seen_events;
+} OpenFile;
+
+typedef struct {
+    uint32_t export_delay_ms;
+    uint32_t read_us;
+    uint32_t write_us;
+} EmuOptions;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t rejected;      // Writes that failed validation
+    uint64_t polls;
+    uint64_t edges;
+    uint64_t notifications;
+} EmuStats;
+
+static EmuGpio gpios[EMU_GPIO_COUNT];
+
+static EmuPwm pwms[EMU_PWM_CHIPS][EMU_PWM_CHANNELS];
+
+static EmuOptions options = { EMU_DEFAULT_EXPORT_DELAY_MS, 0U, 0U };
+
+static EmuStats stats;
+
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const pwm_export_paths[EMU_PWM_CHIPS] = { PWM1_EXPORT_PATH, PWM2_EXPORT_PATH };
+
+static const char *const pwm_channel_paths[EMU_PWM_CHIPS][EMU_PWM_CHANNELS] = {
+    { PWM1PINA_PATH, PWM1PINB_PATH },
+    { PWM2PINA_PATH, PWM2PINB_PATH }
+};
+
+static const char *const pinmux_states[] = {
+    PINMUX_DEFAULT, PINMUX_GPIO, PINMUX_GPIO_PU, PINMUX_GPIO_PD, PINMUX_GPIO_INPUT, PINMUX_PWM, PINMUX_SPI,
+    PINMUX_SPI_CS, PINMUX_SPI_SCLK, PINMUX_I2C, PINMUX_UART, PINMUX_TIMER, PINMUX_PRU_OUT, PINMUX_PRU_IN
+};
+
+static const char *const edge_names[] = { GPIO_EDGE_NONE, GPIO_EDGE_RISING, GPIO_EDGE_FALLING, GPIO_EDGE_BOTH };
+
+// The current file list, rebuilt under state_lock whenever a path has to be resolved.
+static char file_paths[EMU_MAX_FILES][EMU_PATH_LENGTH];
+
+static Node file_nodes[EMU_MAX_FILES];
+
+static int32_t file_count = 0;
+
+
+/// ----------- FILE TREE ----------- ///
+
+static int32_t export_done(int64_t export_ns) {
+    return (int32_t) (rt_now_ns() >= export_ns + ((int64_t) options.export_delay_ms * NS_PER_MS));
+}
+
+
+static void add_file(int32_t kind, int32_t gpio, int32_t chip, int32_t channel, const char *format, const char *arg) {
+    if (file_count < EMU_MAX_FILES) {
+        (void) snprintf(file_paths[file_count], EMU_PATH_LENGTH, format, arg);
+        file_nodes[file_count].kind = kind;
+        file_nodes[file_count].gpio = gpio;
+        file_nodes[file_count].chip = chip;
+        file_nodes[file_count].channel = channel;
+        file_count++;
+    }
+}
+
+
+// Lists every file that exists right now. The emulated paths are the bbbio ones without SYSFS_ROOT.
+static void build_file_list(void) {
+    int32_t gpio = 0;
+    int32_t chip = 0;
+    int32_t channel = 0;
+    char path[EMU_PATH_LENGTH];
+
+    file_count = 0;
+    add_file(NODE_GPIO_EXPORT, -1, -1, -1, "%s", GPIO_EXPORT_PATH);
+    add_file(NODE_GPIO_UNEXPORT, -1, -1, -1, "%s", GLOBAL_GPIO_PATH "unexport");
+    add_file(NODE_EMU_INJECT, -1, -1, -1, "%s", EMU_INJECT_PATH);
+    add_file(NODE_EMU_STATS, -1, -1, -1, "%s", EMU_STATS_PATH);
+
+    for (gpio = 0; gpio < EMU_GPIO_COUNT; gpio++) {
+        BufferPointer header_pin = get_gpio_header_pin(gpio);
+
+        if (gpios[gpio].exported == 1 && export_done(gpios[gpio].export_ns) == 1) {
+            (void) snprintf(path, sizeof(path), GLOBAL_GPIO_PATH "gpio%d/", gpio);
+            add_file(NODE_GPIO_DIRECTION, gpio, -1, -1, "%sdirection", path);
+            add_file(NODE_GPIO_VALUE, gpio, -1, -1, "%svalue", path);
+            add_file(NODE_GPIO_EDGE, gpio, -1, -1, "%sedge", path);
+            add_file(NODE_GPIO_ACTIVE_LOW, gpio, -1, -1, "%sactive_low", path);
+        }
+        if (strncmp((char *) header_pin, NULL_STR, sizeof(NULL_STR)) != 0) {
+            add_file(NODE_PINMUX_STATE, gpio, -1, -1, PINMUX_STATE_PATH, (const char *) header_pin);
+        }
+    }
+
+    for (chip = 0; chip < EMU_PWM_CHIPS; chip++) {
+        add_file(NODE_PWM_EXPORT, -1, chip, -1, "%s", pwm_export_paths[chip]);
+        for (channel = 0; channel < EMU_PWM_CHANNELS; channel++) {
+            if (pwms[chip][channel].exported == 1 && export_done(pwms[chip][channel].export_ns) == 1) {
+                add_file(NODE_PWM_PERIOD, -1, chip, channel, "%s" PWM_PERIOD_PATH, pwm_channel_paths[chip][channel]);
+                add_file(NODE_PWM_DUTY, -1, chip, channel, "%s" PWM_DUTY_CYCLE_PATH, pwm_channel_paths[chip][channel]);
+                add_file(NODE_PWM_ENABLE, -1, chip, channel, "%s" PWM_ENABLE_PATH, pwm_channel_paths[chip][channel]);
+            }
+        }
+    }
+}
+
+
+// A path is a file from the list, a directory if it is a prefix of one of them (at a '/'), or nothing.
+static Node resolve(const char *path) {
+    Node node = { NODE_NONE, -1, -1, -1 };
+    size_t length = strlen(path);
+    int32_t i = 0;
+
+    build_file_list();
+
+    for (i = 0; i < file_count && node.kind == NODE_NONE; i++) {
+        if (strcmp(file_paths[i], path) == 0) {
+            node = file_nodes[i];
+        }
+        else if (length == 1U || (strncmp(file_paths[i], path, length) == 0 && file_paths[i][length] == '/')) {
+            node.kind = NODE_DIR;
+        }
+        else {
+        }
+    }
+
+    return node;
+}
+
+
+/// ----------- CONTENT ----------- ///
+
+static void render(const Node *node, char *out, size_t size) {
+    out[0] = '\0';
+
+    switch (node->kind) {
+        case NODE_GPIO_DIRECTION:
+            (void) snprintf(out, size, "%s\n", (gpios[node->gpio].output == 1) ? "out" : "in");
+            break;
+        case NODE_GPIO_VALUE:
+            (void) snprintf(out, size, "%d\n", gpios[node->gpio].value ^ gpios[node->gpio].active_low);
+            break;
+        case NODE_GPIO_EDGE:
+            (void) snprintf(out, size, "%s\n", edge_names[gpios[node->gpio].edge]);
+            break;
+        case NODE_GPIO_ACTIVE_LOW:
+            (void) snprintf(out, size, "%d\n", gpios[node->gpio].active_low);
+            break;
+        case NODE_PINMUX_STATE:
+            (void) snprintf(out, size, "%s\n", (gpios[node->gpio].pinmux[0] != '\0') ? gpios[node->gpio].pinmux : PINMUX_DEFAULT);
+            break;
+        case NODE_PWM_PERIOD:
+            (void) snprintf(out, size, "%lld\n", (long long) pwms[node->chip][node->channel].period);
+            break;
+        case NODE_PWM_DUTY:
+            (void) snprintf(out, size, "%lld\n", (long long) pwms[node->chip][node->channel].duty);
+            break;
+        case NODE_PWM_ENABLE:
+            (void) snprintf(out, size, "%d\n", pwms[node->chip][node->channel].enabled);
+            break;
+        case NODE_EMU_STATS:
+            (void) snprintf(out, size, "reads %llu\nwrites %llu\nrejected %llu\npolls %llu\nedges %llu\nnotifications %llu\n"
+                            "export_delay_ms %u\nread_us %u\nwrite_us %u\n",
+                            (unsigned long long) stats.reads, (unsigned long long) stats.writes, (unsigned long long) stats.rejected,
+                            (unsigned long long) stats.polls, (unsigned long long) stats.edges, (unsigned long long) stats.notifications,
+                            options.export_delay_ms, options.read_us, options.write_us);
+            break;
+        default:
+            break;
+    }
+}
+
+
+// Parses a whole decimal number written to an attribute (a trailing newline is allowed, like the kernel's kstrtoll).
+static int32_t parse_number(const char *text, long long *value) {
+    char *end = NULL;
+    int32_t result = 0;
+
+    errno = 0;
+    *value = strtoll(text, &end, 10);
+    if (end != text && errno == 0 && (*end == '\0' || (*end == '\n' && end[1] == '\0'))) {
+        result = 1;
+    }
+
+    return result;
+}
+
+
+// Compares a written word, ignoring one trailing newline (sysfs_streq).
+static int32_t word_is(const char *text, const char *word) {
+    size_t length = strlen(word);
+
+    return (int32_t) (strncmp(text, word, length) == 0 && (text[length] == '\0' || (text[length] == '\n' && text[length + 1U] == '\0')));
+}
+
+
+// Sets the level of an input and raises an edge if the edge file asks for it.
+static int32_t drive_input(int32_t gpio, int32_t level) {
+    EmuGpio *g = &gpios[gpio];
+    int32_t rising = (int32_t) (g->value == 0 && level == 1);
+    int32_t falling = (int32_t) (g->value == 1 && level == 0);
+
+    g->value = level;
+
+    // The edge file is in terms of the value the reader sees, so active_low swaps rising and falling.
+    if (g->active_low == 1) {
+        int32_t swap = rising;
+        rising = falling;
+        falling = swap;
+    }
+
+    if ((rising == 1 && (g->edge == EDGE_RISING || g->edge == EDGE_BOTH)) ||
+        (falling == 1 && (g->edge == EDGE_FALLING || g->edge == EDGE_BOTH))) {
+        g->events++;
+        stats.edges++;
+        if (g->poll_handle != NULL) {
+            (void) fuse_notify_poll(g->poll_handle);
+            fuse_pollhandle_destroy(g->poll_handle);
+            g->poll_handle = NULL;
+            stats.notifications++;
+        }
+    }
+
+    return 0;
+}
+
+
+// Applies a write with the driver's validation rules. Returns 0 or a negative errno.
+static int32_t apply_write(const Node *node, const char *text) {
+    int32_t result = 0;
+    long long number = 0;
+    int32_t i = 0;
+
+    switch (node->kind) {
+        case NODE_GPIO_EXPORT:
+            if (parse_number(text, &number) != 1 || number < 0 || number >= EMU_GPIO_COUNT) {
+                result = -EINVAL;
+            }
+            else if (gpios[number].exported == 1) {
+                result = -EBUSY;
+            }
+            else {
+                gpios[number].exported = 1;
+                gpios[number].export_ns = rt_now_ns();
+                gpios[number].output = 0;
+                gpios[number].edge = EDGE_NONE;
+                gpios[number].active_low = 0;
+            }
+            break;
+
+        case NODE_GPIO_UNEXPORT:
+            if (parse_number(text, &number) != 1 || number < 0 || number >= EMU_GPIO_COUNT || gpios[number].exported == 0) {
+                result = -EINVAL;
+            }
+            else {
+                gpios[number].exported = 0;
+            }
+            break;
+
+        case NODE_GPIO_DIRECTION:
+            if (word_is(text, "in") == 1) {
+                gpios[node->gpio].output = 0;
+            }
+            else if (word_is(text, "out") == 0 && word_is(text, "low") == 0 && word_is(text, "high") == 0) {
+                result = -EINVAL;
+            }
+            else if (gpios[node->gpio].edge != EDGE_NONE) {
+                result = -EIO;
+            }
+            else {
+                gpios[node->gpio].output = 1;
+                gpios[node->gpio].value = (word_is(text, "high") == 1) ? 1 : 0;
+            }
+            break;
+
+        case NODE_GPIO_VALUE:
+            if (gpios[node->gpio].output == 0) {
+                result = -EPERM;
+            }
+            else if (parse_number(text, &number) != 1) {
+                result = -EINVAL;
+            }
+            else {
+                gpios[node->gpio].value = ((number != 0) ? 1 : 0) ^ gpios[node->gpio].active_low;
+            }
+            break;
+
+        case NODE_GPIO_EDGE:
+            result = -EINVAL;
+            for (i = 0; i < (int32_t) (sizeof(edge_names) / sizeof(edge_names[0])); i++) {
+                if (word_is(text, edge_names[i]) == 1) {
+                    result = 0;
+                    if (gpios[node->gpio].output == 1 && i != EDGE_NONE) {
+                        result = -EIO;
+                    }
+                    else {
+                        gpios[node->gpio].edge = i;
+                    }
+                }
+            }
+            break;
+
+        case NODE_GPIO_ACTIVE_LOW:
+            if (parse_number(text, &number) != 1) {
+                result = -EINVAL;
+            }
+            else {
+                gpios[node->gpio].active_low = (number != 0) ? 1 : 0;
+            }
+            break;
+
+        case NODE_PINMUX_STATE:
+            result = -EINVAL;
+            for (i = 0; i < (int32_t) (sizeof(pinmux_states) / sizeof(pinmux_states[0])); i++) {
+                if (word_is(text, pinmux_states[i]) == 1) {
+                    (void) snprintf(gpios[node->gpio].pinmux, sizeof(gpios[node->gpio].pinmux), "%s", pinmux_states[i]);
+                    result = 0;
+                }
+            }
+            break;
+
+        case NODE_PWM_EXPORT:
+            if (parse_number(text, &number) != 1 || number < 0 || number >= EMU_PWM_CHANNELS) {
+                result = -EINVAL;
+            }
+            else if (pwms[node->chip][number].exported == 1) {
+                result = -EBUSY;
+            }
+            else {
+                (void) memset(&pwms[node->chip][number], 0, sizeof(pwms[node->chip][number]));
+                pwms[node->chip][number].exported = 1;
+                pwms[node->chip][number].export_ns = rt_now_ns();
+            }
+            break;
+
+        case NODE_PWM_PERIOD:
+            if (parse_number(text, &number) != 1 || number < 0 || number < pwms[node->chip][node->channel].duty) {
+                result = -EINVAL;
+            }
+            else {
+                pwms[node->chip][node->channel].period = (int64_t) number;
+            }
+            break;
+
+        case NODE_PWM_DUTY:
+            if (parse_number(text, &number) != 1 || number < 0 || number > pwms[node->chip][node->channel].period) {
+                result = -EINVAL;
+            }
+            else {
+                pwms[node->chip][node->channel].duty = (int64_t) number;
+            }
+            break;
+
+        case NODE_PWM_ENABLE:
+            if (parse_number(text, &number) != 1 || (number != 0 && number != 1) ||
+                (number == 1 && pwms[node->chip][node->channel].period == 0)) {
+                result = -EINVAL;
+            }
+            else {
+                pwms[node->chip][node->channel].enabled = (int32_t) number;
+            }
+            break;
+
+        case NODE_EMU_INJECT: {
+            int pin = 0;
+            int level = 0;
+
+            if (sscanf(text, "%d %d", &pin, &level) != 2 || pin < 0 || pin >= EMU_GPIO_COUNT ||
+                gpios[pin].exported == 0 || gpios[pin].output == 1) {
+                result = -EINVAL;
+            }
+            else {
+                result = drive_input(pin, (level != 0) ? 1 : 0);
+            }
+            break;
+        }
+
+        default:
+            result = -EACCES;
+            break;
+    }
+
+    return result;
+}
+
+
+/// ----------- FUSE OPERATIONS ----------- ///
+
+static void *emu_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
+    (void) conn;
+
+    // sysfs contents change behind the reader's back: no attribute or lookup caching, no page cache.
+    cfg->entry_timeout = 0.0;
+    cfg->attr_timeout = 0.0;
+    cfg->negative_timeout = 0.0;
+    cfg->direct_io = 1;
+
+    return NULL;
+}
+
+
+static int emu_getattr(const char *path, struct stat *st, struct fuse_file_info *fi) {
+    int result = 0;
+    Node node;
+
+    (void) fi;
+    (void) memset(st, 0, sizeof(*st));
+
+    (void) pthread_mutex_lock(&state_lock);
+    node = resolve(path);
+    (void) pthread_mutex_unlock(&state_lock);
+
+    if (node.kind == NODE_NONE) {
+        result = -ENOENT;
+    }
+    else if (node.kind == NODE_DIR) {
+        st->st_mode = S_IFDIR | 0755;
+        st->st_nlink = 2;
+    }
+    else {
+        // Like sysfs: every attribute reports a page as its size, export files are write only.
+        st->st_mode = S_IFREG | ((node.kind == NODE_GPIO_EXPORT || node.kind == NODE_GPIO_UNEXPORT ||
+                                  node.kind == NODE_PWM_EXPORT || node.kind == NODE_EMU_INJECT) ? 0200 : 0644);
+        st->st_nlink = 1;
+        st->st_size = 4096;
+    }
+
+    return result;
+}
+
+
+static int emu_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi,
+                       enum fuse_readdir_flags flags) {
+    char names[EMU_MAX_FILES][EMU_PATH_LENGTH];
+    int32_t name_count = 0;
+    size_t length = strlen(path);
+    int32_t i = 0;
+    int32_t j = 0;
+
+    (void) offset;
+    (void) fi;
+    (void) flags;
+
+    (void) filler(buf, ".", NULL, 0, (enum fuse_fill_dir_flags) 0);
+    (void) filler(buf, "..", NULL, 0, (enum fuse_fill_dir_flags) 0);
+
+    // The entries are the next path component of every file under this directory, each listed once.
+    (void) pthread_mutex_lock(&state_lock);
+    build_file_list();
+    for (i = 0; i < file_count; i++) {
+        const char *rest = NULL;
+
+        if (length == 1U) {
+            rest = &file_paths[i][1];
+        }
+        else if (strncmp(file_paths[i], path, length) == 0 && file_paths[i][length] == '/') {
+            rest = &file_paths[i][length + 1U];
+        }
+        else {
+        }
+
+        if (rest != NULL) {
+            size_t name_length = strcspn(rest, "/");
+            int32_t seen = 0;
+
+            for (j = 0; j < name_count && seen == 0; j++) {
+                seen = (int32_t) (strncmp(names[j], rest, name_length) == 0 && names[j][name_length] == '\0');
+            }
+            if (seen == 0 && name_length < (size_t) EMU_PATH_LENGTH) {
+                (void) memcpy(names[name_count], rest, name_length);
+                names[name_count][name_length] = '\0';
+                name_count++;
+            }
+        }
+    }
+    (void) pthread_mutex_unlock(&state_lock);
+
+    for (i = 0; i < name_count; i++) {
+        (void) filler(buf, names[i], NULL, 0, (enum fuse_fill_dir_flags) 0);
+    }
+
+    return 0;
+}
+
+
+static int emu_open(const char *path, struct fuse_file_info *fi) {
+    int result = 0;
+    OpenFile *file = NULL;
+    Node node;
+
+    (void) pthread_mutex_lock(&state_lock);
+    node = resolve(path);
+    if (node.kind == NODE_NONE || node.kind == NODE_DIR) {
+        result = (node.kind == NODE_DIR) ? -EISDIR : -ENOENT;
+    }
+    else {
+        file = (OpenFile *) calloc(1U, sizeof(OpenFile));
+        if (file == NULL) {
+            result = -ENOMEM;
+        }
+        else {
+            file->node = node;
+            file->seen_events = (node.kind == NODE_GPIO_VALUE) ? gpios[node.gpio].events : 0U;
+            fi->fh = (uint64_t) (uintptr_t) file;
+            fi->direct_io = 1;
+            fi->nonseekable = 0;
+        }
+    }
+    (void) pthread_mutex_unlock(&state_lock);
+
+    return result;
+}
+
+
+static int emu_release(const char *path, struct fuse_file_info *fi) {
+    (void) path;
+    free((void *) (uintptr_t) fi->fh);
+
+    return 0;
+}
+
+
+// Opening with O_TRUNC (fopen "w", shell redirection) truncates first. Attributes have no length to truncate.
+static int emu_truncate(const char *path, off_t size, struct fuse_file_info *fi) {
+    (void) path;
+    (void) size;
+    (void) fi;
+
+    return 0;
+}
+
+
+static int emu_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+    int result = 0;
+    OpenFile *file = (OpenFile *) (uintptr_t) fi->fh;
+    char content[EMU_CONTENT_LENGTH];
+    size_t length = 0U;
+
+    (void) path;
+
+    if (options.read_us > 0U) {
+        (void) usleep(options.read_us);
+    }
+
+    (void) pthread_mutex_lock(&state_lock);
+    stats.reads++;
+    render(&file->node, content, sizeof(content));
+    // Reading the value is what acknowledges the edges for poll.
+    if (file->node.kind == NODE_GPIO_VALUE) {
+        file->seen_events = gpios[file->node.gpio].events;
+    }
+    (void) pthread_mutex_unlock(&state_lock);
+
+    length = strlen(content);
+    if ((size_t) offset < length) {
+        result = (int) (((length - (size_t) offset) < size) ? (length - (size_t) offset) : size);
+        (void) memcpy(buf, &content[offset], (size_t) result);
+    }
+
+    return result;
+}
+
+
+static int emu_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+    int result = (int) size;
+    OpenFile *file = (OpenFile *) (uintptr_t) fi->fh;
+    char text[EMU_CONTENT_LENGTH];
+    int32_t error = 0;
+
+    (void) path;
+    (void) offset;
+
+    if (options.write_us > 0U) {
+        (void) usleep(options.write_us);
+    }
+
+    if (size >= sizeof(text)) {
+        result = -EINVAL;
+    }
+    else {
+        (void) memcpy(text, buf, size);
+        text[size] = '\0';
+
+        (void) pthread_mutex_lock(&state_lock);
+        stats.writes++;
+        // Unexporting while a file is open makes the open file dead, like the kernel does.
+        if (resolve(path).kind != file->node.kind) {
+            error = -ENODEV;
+        }
+        else {
+            error = apply_write(&file->node, text);
+        }
+        if (error != 0) {
+            stats.rejected++;
+            result = error;
+        }
+        (void) pthread_mutex_unlock(&state_lock);
+    }
+
+    return result;
+}
+
+
+static int emu_poll(const char *path, struct fuse_file_info *fi, struct fuse_pollhandle *ph, unsigned *reventsp) {
+    OpenFile *file = (OpenFile *) (uintptr_t) fi->fh;
+    unsigned revents = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+
+    (void) path;
+
+    (void) pthread_mutex_lock(&state_lock);
+    stats.polls++;
+    if (file->node.kind == NODE_GPIO_VALUE) {
+        EmuGpio *g = &gpios[file->node.gpio];
+
+        if (file->seen_events != g->events) {
+            revents |= POLLPRI | POLLERR;
+        }
+        // Keep the newest handle to notify on the next edge (one waiter per pin, which is what gpioinput uses).
+        if (ph != NULL) {
+            if (g->poll_handle != NULL) {
+                fuse_pollhandle_destroy(g->poll_handle);
+            }
+            g->poll_handle = ph;
+            ph = NULL;
+        }
+    }
+    (void) pthread_mutex_unlock(&state_lock);
+
+    if (ph != NULL) {
+        fuse_pollhandle_destroy(ph);
+    }
+
+    *reventsp = revents;
+
+    return 0;
+}
+
+
+static const struct fuse_operations emu_operations = {
+    .init = emu_init,
+    .getattr = emu_getattr,
+    .readdir = emu_readdir,
+    .open = emu_open,
+    .release = emu_release,
+    .truncate = emu_truncate,
+    .read = emu_read,
+    .write = emu_write,
+    .poll = emu_poll,
+};
+
+
+static const struct fuse_opt emu_option_spec[] = {
+    { "--export-delay-ms=%u", offsetof(EmuOptions, export_delay_ms), 0 },
+    { "--read-us=%u", offsetof(EmuOptions, read_us), 0 },
+    { "--write-us=%u", offsetof(EmuOptions, write_us), 0 },
+    FUSE_OPT_END
+};
+
+
+int32_t main(int32_t argc, char **argv) {
+    int32_t result = 0;
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+
+    if (fuse_opt_parse(&args, &options, emu_option_spec, NULL) != 0) {
+        (void) printf("Usage: %s <mountpoint> [-f] [--export-delay-ms=N] [--read-us=N] [--write-us=N]\n", argv[0]);
+        result = 1;
+    }
+    else {
+        // The filesystem is single rooted at the mountpoint, bbbio reaches it through SYSFS_ROOT.
+        result = fuse_main(args.argc, args.argv, &emu_operations, NULL);
+    }
+
+    fuse_opt_free_args(&args);
+
+    return result;
+}
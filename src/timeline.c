@@ -0,0 +1,164 @@
+/*
+This file implements all the functions defined in timeline.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN TIMELINE.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtutil.h"
+#include "timeline.h"
+
+
+#define PROC_SELF_STAT_PATH "/proc/self/stat"
+
+// starttime is field 22 of /proc/self/stat (man 5 proc).
+#define STAT_STARTTIME_FIELD ((int32_t) 22)
+
+typedef struct {
+    const char *label;
+    int32_t id;
+    int32_t waiting;        // Marked with timeline_mark_wait
+    int64_t time_ns;
+} TimelineMark;
+
+static TimelineMark marks[TIMELINE_MAX_MARKS];
+
+static int32_t mark_count = 0;
+
+static int32_t dropped_marks = 0;
+
+// Sum of the waiting steps, left out of the total.
+static int64_t waited_ns = 0;
+
+// exec() time converted to CLOCK_MONOTONIC, -1 if unknown.
+static int64_t exec_ns = -1;
+
+
+// Reads when the process started (in clock ticks since boot) and converts it to CLOCK_MONOTONIC nanoseconds.
+static int64_t read_exec_time(void) {
+    int64_t result = -1;
+    char line[512];
+    FILE *file = fopen(PROC_SELF_STAT_PATH, "r");
+
+    if (file != NULL) {
+        if (fgets(line, (int) sizeof(line), file) != NULL) {
+            // The command name (field 2) can contain spaces, so start counting fields after its closing ')'.
+            char *cursor = strrchr(line, ')');
+            int32_t field = 2;
+            long long ticks = -1;
+
+            while (cursor != NULL && field < STAT_STARTTIME_FIELD) {
+                cursor = strchr(cursor + 1, ' ');
+                field++;
+            }
+
+            if (cursor != NULL && sscanf(cursor + 1, "%lld", &ticks) == 1) {
+                long ticks_per_sec = sysconf(_SC_CLK_TCK);
+                struct timespec boot;
+
+                if (ticks_per_sec > 0 && clock_gettime(CLOCK_BOOTTIME, &boot) == 0) {
+                    int64_t boot_ns = ((int64_t) boot.tv_sec * NS_PER_SEC) + (int64_t) boot.tv_nsec;
+                    int64_t start_since_boot_ns = ((int64_t) ticks * NS_PER_SEC) / (int64_t) ticks_per_sec;
+
+                    // BOOTTIME and MONOTONIC only differ by the time spent suspended, which is constant over our startup.
+                    result = rt_now_ns() - (boot_ns - start_since_boot_ns);
+                }
+            }
+        }
+
+        (void) fclose(file);
+    }
+
+    return result;
+}
+
+
+// Runs before main, so the first mark is as close as possible to the end of the loader's work.
+__attribute__((constructor))
+static void timeline_at_entry(void) {
+    timeline_mark("loader (exec to first code)", TIMELINE_NO_ID);
+    exec_ns = read_exec_time();
+}
+
+
+static void add_mark(const char *label, int32_t id, int32_t waiting) {
+    if (mark_count < TIMELINE_MAX_MARKS) {
+        marks[mark_count].label = label;
+        marks[mark_count].id = id;
+        marks[mark_count].waiting = waiting;
+        marks[mark_count].time_ns = rt_now_ns();
+        if (waiting == 1 && mark_count > 0) {
+            waited_ns += marks[mark_count].time_ns - marks[mark_count - 1].time_ns;
+        }
+        mark_count++;
+    }
+    else {
+        dropped_marks++;
+    }
+}
+
+
+void timeline_mark(const char *label, int32_t id) {
+    add_mark(label, id, 0);
+}
+
+
+void timeline_mark_wait(const char *label, int32_t id) {
+    add_mark(label, id, 1);
+}
+
+
+int64_t timeline_total_ns(void) {
+    int64_t result = -1;
+
+    if (exec_ns >= 0 && mark_count > 0) {
+        result = marks[mark_count - 1].time_ns - exec_ns - waited_ns;
+    }
+
+    return result;
+}
+
+
+void timeline_print(void) {
+    int32_t i = 0;
+    int64_t prev_ns = exec_ns;
+
+    (void) printf("Startup timeline (ms since exec / ms for the step):\n");
+
+    for (i = 0; i < mark_count; i++) {
+        int64_t since_exec_ns = marks[i].time_ns - exec_ns;
+        int64_t step_ns = marks[i].time_ns - prev_ns;
+
+        // The very first step is measured against exec, if exec is unknown there is nothing to compare to.
+        if (exec_ns < 0) {
+            since_exec_ns = marks[i].time_ns - marks[0].time_ns;
+            step_ns = (i == 0) ? 0 : (marks[i].time_ns - marks[i - 1].time_ns);
+        }
+
+        if (marks[i].id == TIMELINE_NO_ID) {
+            (void) printf("  %10.3f  %10.3f  %s", (double) since_exec_ns / 1e6, (double) step_ns / 1e6, marks[i].label);
+        }
+        else {
+            (void) printf("  %10.3f  %10.3f  %s %d", (double) since_exec_ns / 1e6, (double) step_ns / 1e6, marks[i].label, marks[i].id);
+        }
+        (void) printf("%s\n", (marks[i].waiting == 1) ? " (waiting, not in the total)" : "");
+
+        prev_ns = marks[i].time_ns;
+    }
+
+    if (exec_ns < 0) {
+        (void) printf("  (exec time unavailable, times are relative to the first mark)\n");
+    }
+    else {
+        (void) printf("  Total startup: %.3f ms (without %.3f ms waiting)\n", (double) timeline_total_ns() / 1e6, (double) waited_ns / 1e6);
+    }
+
+    if (dropped_marks > 0) {
+        (void) printf("  (%d marks dropped)\n", dropped_marks);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+This file is for defining the startup timeline.
+Programs call timeline_mark at each step of their startup (config read, every pin set up, every thread started) and
+timeline_print once they are up. The report also includes the time spent before main: from the exec() of the process
+to the first of our code running, which is mostly the dynamic loader. That first point comes from /proc/self/stat and
+only has clock tick resolution (usually 10 ms), the rest of the timeline uses CLOCK_MONOTONIC.
+A step that waits for something outside the program (the user typing the config) is marked with timeline_mark_wait:
+it shows in the timeline, but is left out of the startup total.
+*/
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+
+// Maximum number of marks kept. Marks past this are dropped (and counted in the report).
+#define TIMELINE_MAX_MARKS ((int32_t) 32)
+
+// Use as the id when a mark is not about a specific pin / thread.
+#define TIMELINE_NO_ID ((int32_t) -1)
+
+
+// Description: Records that a startup step just finished.
+// Parameters:
+// label - What finished. Must be a string literal (or live as long as the program), it is not copied.
+// id    - Pin number or other id printed next to the label, or TIMELINE_NO_ID
+void timeline_mark(const char *label, int32_t id);
+
+
+// Description: Records that a step waiting for something outside the program just finished. It is printed like the
+// others but not counted in the startup total.
+// Parameters:
+// label - What was waited for. Must be a string literal (or live as long as the program), it is not copied.
+// id    - Pin number or other id printed next to the label, or TIMELINE_NO_ID
+void timeline_mark_wait(const char *label, int32_t id);
+
+
+// Description: Prints the timeline to stdout: time since exec and time of each step.
+void timeline_print(void);
+
+
+// Description: Returns the nanoseconds from exec() to the last mark, without the waiting steps. -1 if the exec time
+// could not be read.
+int64_t timeline_total_ns(void);
+
+
+#endif // End of include guard
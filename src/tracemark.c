@@ -0,0 +1,138 @@
+/*
+This file implements all the functions defined in tracemark.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN TRACEMARK.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "tracemark.h"
+
+
+typedef struct {
+    const char *prefix;         // Up to the first number
+    int32_t prefix_length;
+    const char *middle;         // Between the numbers
+    int32_t middle_length;
+} TraceFormat;
+
+#define TRACE_FORMAT(PREFIX, MIDDLE) { PREFIX, (int32_t) (sizeof(PREFIX) - 1U), MIDDLE, (int32_t) (sizeof(MIDDLE) - 1U) }
+
+static const TraceFormat formats[TRACE_EVENT_COUNT] = {
+    TRACE_FORMAT("stopwatch: press pin=", " edge_us="),
+    TRACE_FORMAT("stopwatch: state state=", " elapsed_ms="),
+    TRACE_FORMAT("stopwatch: led pin=", " level="),
+    TRACE_FORMAT("stopwatch: frame n=", " shown_ms="),
+    TRACE_FORMAT("stopwatch: deadline_miss which=", " took_us=")
+};
+
+static int32_t trace_fd = -1;
+
+static _Atomic int32_t enabled = 0;
+
+static _Atomic uint64_t written_count = 0;
+
+static _Atomic uint64_t failed_count = 0;
+
+
+// Writes value as decimal text at out. Returns the number of characters.
+static int32_t append_int(char *out, int64_t value) {
+    char digits[20];
+    int32_t count = 0;
+    int32_t length = 0;
+    uint64_t magnitude = (value < 0) ? (0U - (uint64_t) value) : (uint64_t) value;
+
+    if (value < 0) {
+        out[length] = '-';
+        length++;
+    }
+    do {
+        digits[count] = (char) ('0' + (magnitude % 10U));
+        magnitude /= 10U;
+        count++;
+    } while (magnitude > 0U);
+
+    while (count > 0) {
+        count--;
+        out[length] = digits[count];
+        length++;
+    }
+
+    return length;
+}
+
+
+int32_t trace_open(const char *path) {
+    trace_close();
+
+    if (path == NULL) {
+        trace_fd = open(TRACE_MARKER_PATH, O_WRONLY | O_CLOEXEC);
+        if (trace_fd < 0) {
+            trace_fd = open(TRACE_MARKER_DEBUGFS_PATH, O_WRONLY | O_CLOEXEC);
+        }
+    }
+    else {
+        trace_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    atomic_store(&written_count, 0U);
+    atomic_store(&failed_count, 0U);
+
+    return (int32_t) (trace_fd >= 0);
+}
+
+
+void trace_enable(int32_t enable) {
+    atomic_store_explicit(&enabled, (enable != 0 && trace_fd >= 0) ? 1 : 0, memory_order_relaxed);
+}
+
+
+int32_t trace_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+
+void trace_mark(int32_t event, int64_t a, int64_t b) {
+    if (atomic_load_explicit(&enabled, memory_order_relaxed) == 1 && event >= 0 && event < TRACE_EVENT_COUNT) {
+        const TraceFormat *format = &formats[event];
+        char record[TRACE_RECORD_LENGTH];
+        int32_t length = format->prefix_length;
+
+        (void) memcpy(record, format->prefix, (size_t) format->prefix_length);
+        length += append_int(&record[length], a);
+        (void) memcpy(&record[length], format->middle, (size_t) format->middle_length);
+        length += format->middle_length;
+        length += append_int(&record[length], b);
+        record[length] = '\n';
+        length++;
+
+        // One write per record: the kernel adds it to the trace buffer with the timestamp, CPU and task.
+        if (write(trace_fd, record, (size_t) length) == (ssize_t) length) {
+            (void) atomic_fetch_add_explicit(&written_count, 1U, memory_order_relaxed);
+        }
+        else {
+            (void) atomic_fetch_add_explicit(&failed_count, 1U, memory_order_relaxed);
+        }
+    }
+}
+
+
+void trace_get_counts(uint64_t *written, uint64_t *failed) {
+    if (written != NULL) {
+        *written = atomic_load(&written_count);
+    }
+    if (failed != NULL) {
+        *failed = atomic_load(&failed_count);
+    }
+}
+
+
+void trace_close(void) {
+    atomic_store(&enabled, 0);
+    if (trace_fd >= 0) {
+        (void) close(trace_fd);
+        trace_fd = -1;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+This file is for defining ftrace trace_marker records: the stopwatch writes a line into the kernel trace buffer at its
+key points (press detected, state changed, LED written, display frame, deadline missed). With the markers a late press
+can be seen in the same timeline as the kernel's scheduling events (trace-cmd / kernelshark / perf), e.g. which task
+was running when the button thread should have woken up.
+
+The cost has to stay around a microsecond so the markers can stay on while measuring:
+- The trace_marker file is opened once (trace_open) and every record is a single write() on that fd.
+- Every event has its text preformatted in a table; a record copies it into a fixed buffer on the stack and appends
+  its two numbers with a hand written integer conversion, no printf.
+- trace_enable turns records on and off at runtime. While off a record is one atomic load.
+
+The output can go to any file instead of the kernel (trace_open with a path), for off-target tests.
+
+Sources:
+https://www.kernel.org/doc/html/latest/trace/ftrace.html
+"trace_marker: This is a very useful file for synchronizing user space with events happening in the kernel. Writing
+strings into this file will be written into the ftrace buffer."
+*/
+
+#ifndef TRACEMARK_H
+#define TRACEMARK_H
+
+#include <stdint.h>
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define TRACE_MARKER_PATH "/sys/kernel/tracing/trace_marker"
+
+// Where tracefs is mounted on older kernels.
+#define TRACE_MARKER_DEBUGFS_PATH "/sys/kernel/debug/tracing/trace_marker"
+
+// Longest record, prefix and both numbers included.
+#define TRACE_RECORD_LENGTH ((int32_t) 96)
+
+// Events. Each record has two numbers, meaning depends on the event (see the table in tracemark.c).
+#define TRACE_EVENT_PRESS ((int32_t) 0)             // pin, microseconds since the edge
+
+#define TRACE_EVENT_STATE ((int32_t) 1)             // new state (0 stopped, 1 running, 2 reset), elapsed ms
+
+#define TRACE_EVENT_LED ((int32_t) 2)               // pin, level
+
+#define TRACE_EVENT_FRAME ((int32_t) 3)             // frame number, displayed time in ms
+
+#define TRACE_EVENT_DEADLINE_MISS ((int32_t) 4)     // which deadline (0 press, 1 timer), microseconds taken
+
+#define TRACE_EVENT_COUNT ((int32_t) 5)
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Opens the file the records are written to. Tracing stays disabled until trace_enable.
+// Parameters: path - File to write to, or NULL for the kernel trace_marker (TRACE_MARKER_PATH, then
+// TRACE_MARKER_DEBUGFS_PATH). Any other file is created if needed and appended to.
+// Returns - 1 on success, 0 on failure (no tracefs, or not allowed to write to it).
+int32_t trace_open(const char *path);
+
+
+// Description: Turns the records on or off. Safe from any thread and from a signal handler.
+// Parameters: enable - 1 to write records, 0 to skip them
+void trace_enable(int32_t enable);
+
+
+// Description: Returns 1 if records are being written (open and enabled).
+int32_t trace_enabled(void);
+
+
+// Description: Writes one record, if tracing is enabled.
+// Parameters:
+// event - One of the TRACE_EVENT_ values
+// a     - First number of the record
+// b     - Second number of the record
+void trace_mark(int32_t event, int64_t a, int64_t b);
+
+
+// Description: Returns how many records were written and how many writes failed since trace_open.
+// Parameters:
+// written - Where to store the records written (NULL to skip)
+// failed  - Where to store the failed writes (NULL to skip)
+void trace_get_counts(uint64_t *written, uint64_t *failed);
+
+
+// Description: Disables tracing and closes the file.
+void trace_close(void);
+
+
+#endif // End of include guard
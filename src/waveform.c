@@ -0,0 +1,277 @@
+/*
+This file implements all the functions defined in waveform.h.
+
+ALL COMMENTS FOR THE FUNCTIONS ARE IN WAVEFORM.H AND WILL NOT BE REPEATED HERE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "rtutil.h"
+#include "waveform.h"
+
+
+#define PI (3.14159265358979324)
+
+static int32_t simulator_enabled = 0;
+
+
+// sin(x) for x in [0, 2 pi), without libm: folded into [0, pi / 2] and a Taylor series to x^13 (error under 1e-9 there).
+static double table_sin(double x) {
+    double sign = 1.0;
+    double x2 = 0.0;
+
+    if (x >= PI) {
+        x -= PI;
+        sign = -1.0;
+    }
+    if (x > PI / 2.0) {
+        x = PI - x;
+    }
+    x2 = x * x;
+
+    return sign * x * (1.0 - (x2 / 6.0) * (1.0 - (x2 / 20.0) * (1.0 - (x2 / 42.0) * (1.0 - (x2 / 72.0) * (1.0 - (x2 / 110.0) * (1.0 - (x2 / 156.0)))))));
+}
+
+
+// Level (0 to WAVE_LEVEL_MAX) of entry i of a shape.
+static uint32_t shape_level(const WaveConfig *config, int32_t i) {
+    uint32_t level = 0U;
+    const uint32_t half = (uint32_t) WAVE_TABLE_SIZE / 2U;
+
+    switch (config->shape) {
+        case WAVE_SINE:
+            level = (uint32_t) (((1.0 + table_sin((2.0 * PI * (double) i) / (double) WAVE_TABLE_SIZE)) * 0.5 * (double) WAVE_LEVEL_MAX) + 0.5);
+            break;
+        case WAVE_TRIANGLE:
+            level = ((uint32_t) i < half) ? (((uint32_t) i * WAVE_LEVEL_MAX) / half) : ((((uint32_t) WAVE_TABLE_SIZE - (uint32_t) i) * WAVE_LEVEL_MAX) / half);
+            break;
+        case WAVE_SAWTOOTH:
+            level = ((uint32_t) i * WAVE_LEVEL_MAX) / ((uint32_t) WAVE_TABLE_SIZE - 1U);
+            break;
+        case WAVE_SQUARE:
+            level = ((uint32_t) i < half) ? WAVE_LEVEL_MAX : 0U;
+            break;
+        default:
+            // Nearest entry of the custom table.
+            level = (uint32_t) config->custom[((int64_t) i * config->custom_count) / WAVE_TABLE_SIZE];
+            break;
+    }
+
+    return (level > WAVE_LEVEL_MAX) ? WAVE_LEVEL_MAX : level;
+}
+
+
+static uint32_t frequency_increment(int32_t rate_hz, uint32_t frequency_mhz) {
+    // 2^32 per waveform period: increment = f / rate * 2^32, with f in millihertz.
+    return (uint32_t) ((((uint64_t) frequency_mhz) << 32) / ((uint64_t) rate_hz * 1000U));
+}
+
+
+// Advances every channel by ticks ticks.
+static void step_ticks(WaveModulator *mod, uint32_t ticks) {
+    int32_t i = 0;
+
+    for (i = 0; i < mod->channel_count; i++) {
+        WaveChannel *ch = &mod->channels[i];
+        uint32_t duty_ns = 0U;
+
+        ch->phase += atomic_load_explicit(&ch->increment, memory_order_relaxed) * ticks;
+        duty_ns = ch->duty_ns[ch->phase >> (32U - WAVE_TABLE_BITS)];
+
+        if (duty_ns == ch->last_duty_ns) {
+            ch->skipped++;
+        }
+        else if (ch->simulated == 1 || write_pwm_duty_fast(&ch->pwm, duty_ns) == 1) {
+            ch->last_duty_ns = duty_ns;
+            ch->writes++;
+        }
+        else {
+            // Try again next tick.
+            ch->write_failures++;
+        }
+    }
+}
+
+
+static void *task_thread_func(void *arg) {
+    WaveModulator *mod = (WaveModulator *) arg;
+    int64_t next_ns = rt_now_ns() + mod->period_ns;
+
+    while (atomic_load(&mod->stop_requested) == 0) {
+        int64_t wake_ns = 0;
+        int64_t late_ns = 0;
+        uint32_t ticks = 1U;
+
+        rt_sleep_until_ns(next_ns);
+        wake_ns = rt_now_ns();
+        late_ns = wake_ns - next_ns;
+
+        // Woke up a whole period or more late: do the missed ticks in one go so the phase stays on time.
+        if (late_ns >= mod->period_ns) {
+            ticks += (uint32_t) (late_ns / mod->period_ns);
+            mod->stats.missed_ticks += (uint64_t) ticks - 1U;
+        }
+
+        step_ticks(mod, ticks);
+
+        mod->stats.ticks++;
+        if (late_ns > mod->stats.max_late_ns) {
+            mod->stats.max_late_ns = late_ns;
+        }
+        late_ns = rt_now_ns() - wake_ns;
+        mod->stats.sum_tick_ns += late_ns;
+        if (late_ns > mod->stats.max_tick_ns) {
+            mod->stats.max_tick_ns = late_ns;
+        }
+
+        next_ns += (int64_t) ticks * mod->period_ns;
+    }
+
+    return NULL;
+}
+
+
+void wave_use_simulator(int32_t enable) {
+    simulator_enabled = (enable != 0) ? 1 : 0;
+}
+
+
+int32_t wave_init(WaveModulator *mod, int32_t rate_hz) {
+    int32_t result = 0;
+
+    (void) memset(mod, 0, sizeof(*mod));
+    atomic_init(&mod->stop_requested, 0);
+
+    if (rate_hz >= 1 && rate_hz <= WAVE_MAX_RATE_HZ) {
+        mod->rate_hz = rate_hz;
+        mod->period_ns = NS_PER_SEC / (int64_t) rate_hz;
+        result = 1;
+    }
+
+    return result;
+}
+
+
+int32_t wave_add_channel(WaveModulator *mod, Buffer pin_identifier, int32_t pwm_frequency, const WaveConfig *config) {
+    int32_t result = -1;
+    WaveChannel *ch = &mod->channels[mod->channel_count];
+    BufferPointer channel_path = get_pwm_channel_path(pin_identifier);
+    int32_t valid = (int32_t) (mod->channel_count < WAVE_MAX_CHANNELS && mod->running == 0 && pwm_frequency > 0 &&
+                               config->min_duty_percent >= 0.0f && config->max_duty_percent <= 100.0f &&
+                               config->min_duty_percent <= config->max_duty_percent &&
+                               config->shape >= WAVE_SINE && config->shape <= WAVE_CUSTOM &&
+                               (config->shape != WAVE_CUSTOM || (config->custom != NULL && config->custom_count > 0)) &&
+                               strncmp((char *) channel_path, (char *) NULL_STR, sizeof(NULL_STR)) != 0);
+
+    if (valid == 1) {
+        (void) memset(ch, 0, sizeof(*ch));
+        clear_pwm_handle(&ch->pwm);
+        ch->simulated = simulator_enabled;
+        ch->last_duty_ns = WAVE_NOTHING_WRITTEN;
+        (void) snprintf((char *) ch->pin_identifier, sizeof(ch->pin_identifier), "%s", (char *) pin_identifier);
+        ch->period_ns = pwm_period_ns(pwm_frequency);
+
+        if (ch->simulated == 1) {
+            valid = 1;
+        }
+        else {
+            // bbbio doesn't accept 0 %, the first tick writes the real starting value anyway.
+            valid = open_pwm_channel(pin_identifier, pwm_frequency, (config->max_duty_percent > 0.0f) ? config->max_duty_percent : 1.0f,
+                                     PWM_ON, &ch->pwm);
+        }
+    }
+
+    if (valid == 1) {
+        uint64_t min_ns = (uint64_t) ((double) ch->period_ns * (double) config->min_duty_percent / 100.0);
+        uint64_t max_ns = (uint64_t) ((double) ch->period_ns * (double) config->max_duty_percent / 100.0);
+        int32_t i = 0;
+
+        for (i = 0; i < WAVE_TABLE_SIZE; i++) {
+            ch->duty_ns[i] = (uint32_t) (min_ns + ((((max_ns - min_ns) * (uint64_t) shape_level(config, i)) + (WAVE_LEVEL_MAX / 2U)) / WAVE_LEVEL_MAX));
+        }
+
+        atomic_init(&ch->increment, frequency_increment(mod->rate_hz, config->frequency_mhz));
+        ch->active = 1;
+        result = mod->channel_count;
+        mod->channel_count++;
+    }
+
+    return result;
+}
+
+
+void wave_set_frequency(WaveModulator *mod, int32_t channel, uint32_t frequency_mhz) {
+    if (channel >= 0 && channel < mod->channel_count) {
+        atomic_store_explicit(&mod->channels[channel].increment, frequency_increment(mod->rate_hz, frequency_mhz), memory_order_relaxed);
+    }
+}
+
+
+void wave_step(WaveModulator *mod) {
+    step_ticks(mod, 1U);
+}
+
+
+int32_t wave_start(WaveModulator *mod, int32_t priority) {
+    int32_t result = 0;
+
+    if (mod->running == 0 && mod->rate_hz > 0) {
+        atomic_store(&mod->stop_requested, 0);
+        if (rt_thread_start(&mod->thread, priority, &task_thread_func, mod) == 0) {
+            mod->running = 1;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+
+void wave_stop(WaveModulator *mod) {
+    if (mod->running == 1) {
+        atomic_store(&mod->stop_requested, 1);
+        (void) pthread_join(mod->thread, NULL);
+        mod->running = 0;
+    }
+}
+
+
+uint32_t wave_last_duty_ns(const WaveModulator *mod, int32_t channel) {
+    uint32_t result = WAVE_NOTHING_WRITTEN;
+
+    if (channel >= 0 && channel < mod->channel_count) {
+        result = mod->channels[channel].last_duty_ns;
+    }
+
+    return result;
+}
+
+
+void wave_print_stats(const WaveModulator *mod) {
+    const WaveTaskStats *s = &mod->stats;
+    int32_t i = 0;
+
+    (void) printf("Waveform task at %d Hz: %llu ticks, %llu missed, wakeup late max %.1f us, update avg %.2f us max %.2f us\n",
+                  mod->rate_hz, (unsigned long long) s->ticks, (unsigned long long) s->missed_ticks, (double) s->max_late_ns / 1e3,
+                  (s->ticks > 0U) ? ((double) s->sum_tick_ns / (1e3 * (double) s->ticks)) : 0.0, (double) s->max_tick_ns / 1e3);
+
+    for (i = 0; i < mod->channel_count; i++) {
+        const WaveChannel *ch = &mod->channels[i];
+        uint64_t updates = ch->writes + ch->skipped + ch->write_failures;
+
+        (void) printf("  %s%s: %llu writes, %llu unchanged (%.1f %% avoided), %llu failed\n", (char *) ch->pin_identifier,
+                      (ch->simulated == 1) ? " (sim)" : "", (unsigned long long) ch->writes, (unsigned long long) ch->skipped,
+                      (updates > 0U) ? (100.0 * (double) ch->skipped / (double) updates) : 0.0, (unsigned long long) ch->write_failures);
+    }
+}
+
+
+void wave_close(WaveModulator *mod) {
+    int32_t i = 0;
+
+    for (i = 0; i < mod->channel_count; i++) {
+        close_pwm_handle(&mod->channels[i].pwm);
+    }
+}
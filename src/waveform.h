@@ -0,0 +1,174 @@
+/*
+This file is for defining the PWM waveform modulator: the duty cycle of PWM channels follows a periodic waveform (sine,
+triangle, sawtooth, square or a custom table), for LED breathing indicators and slow test stimuli.
+Why not call set_pwm_duty_cycle from a loop? Every call does float math, builds the file path, opens, writes and
+closes the duty_cycle file. Here everything that can be is done once, when the channel is added:
+
+- The waveform is turned into a table of WAVE_TABLE_SIZE duty cycles in nanoseconds, already scaled to the channel's
+  period and duty range, so an update is a table lookup with no floating point.
+- The position in the waveform is a 32 bit fixed point phase accumulator (direct digital synthesis): every tick adds
+  the channel's increment and the top WAVE_TABLE_BITS bits index the table. The increment sets the frequency, with a
+  resolution of rate / 2^32, and wraps for free.
+- The duty_cycle file stays open and a new value is written with one pwrite, and only when it differs from the last
+  one written (slow waveforms repeat the same entry for many ticks).
+
+All channels are updated by one task running at up to WAVE_MAX_RATE_HZ on absolute deadlines. If it falls behind,
+the phase still advances by every tick that was missed, so the waveform keeps time.
+
+There is also a simulated mode (wave_use_simulator) that keeps the last written value instead of writing to sysfs, so
+the modulator runs on any machine.
+*/
+
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "bbbio.h"
+#include "bbbio_fast.h"
+
+/* --------------------------------------------- CONSTANTS ---------------------------------------------*/
+
+#define WAVE_MAX_CHANNELS ((int32_t) 4)
+
+#define WAVE_TABLE_BITS ((uint32_t) 8)
+
+#define WAVE_TABLE_SIZE ((int32_t) 256)
+
+#define WAVE_MAX_RATE_HZ ((int32_t) 1000)
+
+// Custom tables hold levels from 0 (min duty) to WAVE_LEVEL_MAX (max duty).
+#define WAVE_LEVEL_MAX ((uint32_t) 65535)
+
+#define WAVE_SINE ((int32_t) 0)
+
+#define WAVE_TRIANGLE ((int32_t) 1)
+
+#define WAVE_SAWTOOTH ((int32_t) 2)
+
+#define WAVE_SQUARE ((int32_t) 3)
+
+#define WAVE_CUSTOM ((int32_t) 4)
+
+// last_duty_ns before anything was written.
+#define WAVE_NOTHING_WRITTEN ((uint32_t) 0xFFFFFFFFU)
+
+
+typedef struct {
+    int32_t shape;                  // One of the WAVE_ shapes
+    const uint16_t *custom;         // WAVE_CUSTOM: levels over one period, resampled to WAVE_TABLE_SIZE
+    int32_t custom_count;
+    float32_t min_duty_percent;     // Duty at the bottom of the waveform
+    float32_t max_duty_percent;     // Duty at the top
+    uint32_t frequency_mhz;         // Waveform frequency in millihertz (500 = one breath every 2 s)
+} WaveConfig;
+
+typedef struct {
+    int32_t active;
+    int32_t simulated;
+    PwmHandle pwm;                  // Open channel files, fds -1 when simulated
+    uint8_t pin_identifier[4];
+    uint32_t period_ns;
+    _Atomic uint32_t increment;     // Added to phase every tick
+    uint32_t phase;
+    uint32_t duty_ns[WAVE_TABLE_SIZE];
+    uint32_t last_duty_ns;          // Last value written, WAVE_NOTHING_WRITTEN at first
+    uint64_t writes;
+    uint64_t skipped;               // Ticks where the value didn't change, nothing was written
+    uint64_t write_failures;
+} WaveChannel;
+
+typedef struct {
+    uint64_t ticks;
+    uint64_t missed_ticks;          // Ticks that were late by a whole period or more (caught up in the phase)
+    int64_t max_late_ns;            // Wakeup lateness
+    int64_t sum_tick_ns;            // Time spent updating the channels
+    int64_t max_tick_ns;
+} WaveTaskStats;
+
+typedef struct {
+    WaveChannel channels[WAVE_MAX_CHANNELS];
+    int32_t channel_count;
+    int32_t rate_hz;
+    int64_t period_ns;
+    pthread_t thread;
+    _Atomic int32_t stop_requested;
+    int32_t running;
+    WaveTaskStats stats;            // Written by the task only, read it after wave_stop
+} WaveModulator;
+
+
+/* --------------------------------------------- FUNCTIONS ---------------------------------------------*/
+
+
+// Description: Selects whether channels added from now on write to sysfs or are simulated.
+// Parameters: enable - 1 for simulated channels, 0 for the real PWM channels
+void wave_use_simulator(int32_t enable);
+
+
+// Description: Prepares a modulator with no channels.
+// Parameters:
+// mod     - The modulator
+// rate_hz - Updates per second of every channel, 1 to WAVE_MAX_RATE_HZ
+// Returns - 1 on success, 0 if the rate is out of range.
+int32_t wave_init(WaveModulator *mod, int32_t rate_hz);
+
+
+// Description: Sets up a PWM channel (open_pwm_channel) and builds its duty table. Add all the channels before
+// wave_start.
+// Parameters:
+// mod            - The modulator
+// pin_identifier - PWM channel, e.g. "1A"
+// pwm_frequency  - PWM frequency in Hz (the carrier, not the waveform)
+// config         - The waveform
+// Returns - Index of the channel, -1 on failure (bad config, channel not usable or WAVE_MAX_CHANNELS channels).
+int32_t wave_add_channel(WaveModulator *mod, Buffer pin_identifier, int32_t pwm_frequency, const WaveConfig *config);
+
+
+// Description: Changes the waveform frequency of a channel. Safe while the task is running, the waveform continues
+// from the same phase.
+// Parameters:
+// mod           - The modulator
+// channel       - Index returned by wave_add_channel
+// frequency_mhz - New frequency in millihertz
+void wave_set_frequency(WaveModulator *mod, int32_t channel, uint32_t frequency_mhz);
+
+
+// Description: Advances every channel by one tick and writes the duty cycles that changed. The task calls this, it
+// is public to drive the modulator by hand (tests, benchmarks) without the task.
+// Parameters: mod - The modulator
+void wave_step(WaveModulator *mod);
+
+
+// Description: Starts the update task.
+// Parameters:
+// mod      - The modulator
+// priority - SCHED_FIFO priority, or RT_PRIORITY_NONE
+// Returns - 1 on success, 0 on failure.
+int32_t wave_start(WaveModulator *mod, int32_t priority);
+
+
+// Description: Stops the update task. The channels keep their last duty cycle.
+// Parameters: mod - The modulator
+void wave_stop(WaveModulator *mod);
+
+
+// Description: Returns the duty cycle last written to a channel in nanoseconds, WAVE_NOTHING_WRITTEN if none yet.
+// Parameters:
+// mod     - The modulator
+// channel - Index returned by wave_add_channel
+uint32_t wave_last_duty_ns(const WaveModulator *mod, int32_t channel);
+
+
+// Description: Prints the task timing and, per channel, how many writes the change check avoided.
+// Parameters: mod - The modulator
+void wave_print_stats(const WaveModulator *mod);
+
+
+// Description: Closes the duty_cycle files. Stop the task first.
+// Parameters: mod - The modulator
+void wave_close(WaveModulator *mod);
+
+
+#endif // End of include guard